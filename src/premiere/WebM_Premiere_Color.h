@@ -0,0 +1,184 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+
+#ifndef WEBM_PREMIERE_COLOR_H
+#define WEBM_PREMIERE_COLOR_H
+
+#include "vpx/vpx_image.h"
+
+
+// The YUV matrices and ranges, each one a type with its numbers in an enum, so
+// the conversions can take them as template parameters and every combination
+// compiles into its own kernel with nothing to look up per pixel.
+//
+// To YUV, the coefficients are times 10000, for Y, V and U from R, G and B.
+// The V and U coefficients add up to zero.  The offsets are for 8-bit and
+// Adobe 16-bit (0-32768) and include 5000 for rounding.
+//
+// From YUV, also times 10000: the Y scale, then R from V, G from U and V
+// (subtracted), and B from U.
+
+typedef enum {
+	WEBM_MATRIX_601 = 0,
+	WEBM_MATRIX_709,
+	WEBM_MATRIX_2020
+} WebM_Color_Matrix;
+
+
+// What we have a matrix for.  SMPTE 240 is close enough to 709, and
+// without a color space it's 601 like it always was.
+static inline WebM_Color_Matrix
+WebMColorMatrix(vpx_color_space_t cs)
+{
+	return (cs == VPX_CS_BT_709 ? WEBM_MATRIX_709 :
+			cs == VPX_CS_SMPTE_240 ? WEBM_MATRIX_709 :
+			cs == VPX_CS_BT_2020 ? WEBM_MATRIX_2020 :
+			WEBM_MATRIX_601);
+}
+
+
+// For the Matroska Colour element, -1 when we shouldn't say.  Without a
+// color space from the user we don't want to presume.
+static inline int
+WebMMatroskaMatrix(vpx_color_space_t cs)
+{
+	return (cs == VPX_CS_BT_601 ? 5 :		// BT.470BG
+			cs == VPX_CS_BT_709 ? 1 :
+			cs == VPX_CS_SMPTE_170 ? 6 :
+			cs == VPX_CS_SMPTE_240 ? 7 :
+			cs == VPX_CS_BT_2020 ? 9 :		// non-constant luminance
+			cs == VPX_CS_SRGB ? 0 :			// GBR
+			-1);
+}
+
+static inline int
+WebMMatroskaRange(vpx_color_space_t cs, vpx_color_range_t range)
+{
+	return (range == VPX_CR_FULL_RANGE ? 2 :
+			WebMMatroskaMatrix(cs) >= 0 ? 1 :	// broadcast
+			-1);
+}
+
+
+#define WEBM_STUDIO_RANGE \
+	FULL_RANGE = 0, \
+	YADD8 = 165000, UVADD8 = 1285000, \
+	YADD16 = 20565000, UVADD16 = 164495000, \
+	YSCALE = 11644
+
+#define WEBM_FULL_RANGE \
+	FULL_RANGE = 1, \
+	YADD8 = 5000, UVADD8 = 1285000, \
+	YADD16 = 5000, UVADD16 = 163845000, \
+	YSCALE = 10000
+
+
+typedef struct Color601Studio
+{
+	enum {
+		YR = 2568, YG = 5041, YB = 979,
+		VR = 4392, VG = -3678, VB = -714,
+		UR = -1482, UG = -2910, UB = 4392,
+		RV = 15960, GU = 3918, GV = 8130, BU = 20172,
+		WEBM_STUDIO_RANGE
+	};
+} Color601Studio;
+
+typedef struct Color601Full
+{
+	enum {
+		YR = 2990, YG = 5870, YB = 1140,
+		VR = 5000, VG = -4187, VB = -813,
+		UR = -1687, UG = -3313, UB = 5000,
+		RV = 14020, GU = 3441, GV = 7141, BU = 17720,
+		WEBM_FULL_RANGE
+	};
+} Color601Full;
+
+typedef struct Color709Studio
+{
+	enum {
+		YR = 1826, YG = 6142, YB = 620,
+		VR = 4392, VG = -3989, VB = -403,
+		UR = -1006, UG = -3386, UB = 4392,
+		RV = 17927, GU = 2132, GV = 5329, BU = 21124,
+		WEBM_STUDIO_RANGE
+	};
+} Color709Studio;
+
+typedef struct Color709Full
+{
+	enum {
+		YR = 2126, YG = 7152, YB = 722,
+		VR = 5000, VG = -4542, VB = -458,
+		UR = -1146, UG = -3854, UB = 5000,
+		RV = 15748, GU = 1873, GV = 4681, BU = 18556,
+		WEBM_FULL_RANGE
+	};
+} Color709Full;
+
+typedef struct Color2020Studio
+{
+	enum {
+		YR = 2256, YG = 5823, YB = 509,
+		VR = 4392, VG = -4039, VB = -353,
+		UR = -1227, UG = -3165, UB = 4392,
+		RV = 16787, GU = 1873, GV = 6504, BU = 21418,
+		WEBM_STUDIO_RANGE
+	};
+} Color2020Studio;
+
+typedef struct Color2020Full
+{
+	enum {
+		YR = 2627, YG = 6780, YB = 593,
+		VR = 5000, VG = -4598, VB = -402,
+		UR = -1396, UG = -3604, UB = 5000,
+		RV = 14746, GU = 1646, GV = 5714, BU = 18814,
+		WEBM_FULL_RANGE
+	};
+} Color2020Full;
+
+#undef WEBM_STUDIO_RANGE
+#undef WEBM_FULL_RANGE
+
+
+#endif // WEBM_PREMIERE_COLOR_H
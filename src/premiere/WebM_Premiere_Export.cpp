@@ -41,6 +41,21 @@
 #include "WebM_Premiere_Export.h"
 
 #include "WebM_Premiere_Export_Params.h"
+#include "WebM_Premiere_Export_Convert.h"
+#include "WebM_Premiere_Export_Pipeline.h"
+#include "WebM_Premiere_Export_Manifest.h"
+#include "WebM_Premiere_Export_StatsCache.h"
+#include "WebM_Premiere_Export_StatsStore.h"
+#include "WebM_Premiere_Export_Spill.h"
+#include "WebM_Premiere_Export_Threads.h"
+#include "WebM_Premiere_Export_Governor.h"
+#include "WebM_Premiere_Export_Timing.h"
+#include "WebM_Premiere_Export_Ladder.h"
+#include "WebM_Premiere_Export_SmartRender.h"
+#include "WebM_Premiere_Export_Audio.h"
+#include "WebM_Premiere_Export_Writer.h"
+
+#include "WebM_Premiere_Color.h"
 
 
 #ifdef PRMAC_ENV
@@ -66,81 +81,27 @@
 
 #include "mkvmuxer/mkvmuxer.h"
 
+#include <limits>
+#include <sstream>
 
-class PrMkvWriter : public mkvmuxer::IMkvWriter
+
+// PrMkvWriter's way into the file Premiere gave us
+class PremiereFile : public WriterFile
 {
   public:
-	PrMkvWriter(PrSDKExportFileSuite *fileSuite, csSDK_uint32 fileObject);
-	virtual ~PrMkvWriter();
+	PremiereFile(PrSDKExportFileSuite *fileSuite, csSDK_uint32 fileObject) : _fileSuite(fileSuite), _fileObject(fileObject) {}
+	virtual ~PremiereFile() {}
 	
-	virtual int32_t Write(const void* buf, uint32_t len);
-	virtual int64_t Position() const;
-	virtual int32_t Position(int64_t position); // seek
-	virtual bool Seekable() const { return true; }
-	virtual void ElementStartNotify(uint64_t element_id, int64_t position);
+	virtual int32_t Open() { return _fileSuite->Open(_fileObject); }
+	virtual int32_t Seek(int64_t position) { prInt64 pos = 0; return _fileSuite->Seek(_fileObject, position, pos, fileSeekMode_Begin); }
+	virtual int32_t Write(const void *buf, uint32_t len) { return _fileSuite->Write(_fileObject, (void *)buf, len); }
+	virtual int32_t Close() { return _fileSuite->Close(_fileObject); }
 	
   private:
 	const PrSDKExportFileSuite *_fileSuite;
 	const csSDK_uint32 _fileObject;
 };
 
-PrMkvWriter::PrMkvWriter(PrSDKExportFileSuite *fileSuite, csSDK_uint32 fileObject) :
-	_fileSuite(fileSuite),
-	_fileObject(fileObject)
-{
-	prSuiteError err = _fileSuite->Open(_fileObject);
-	
-	if(err != malNoError)
-		throw err;
-}
-
-PrMkvWriter::~PrMkvWriter()
-{
-	prSuiteError err = _fileSuite->Close(_fileObject);
-	
-	assert(err == malNoError);
-}
-
-int32_t
-PrMkvWriter::Write(const void* buf, uint32_t len)
-{
-	prSuiteError err = _fileSuite->Write(_fileObject, (void *)buf, len);
-	
-	return err;
-}
-
-int64_t
-PrMkvWriter::Position() const
-{
-	prInt64 pos = 0;
-
-// son of a gun, fileSeekMode_End and fileSeekMode_Current are flipped inside Premiere!
-#define PR_SEEK_CURRENT fileSeekMode_End
-
-	prSuiteError err = _fileSuite->Seek(_fileObject, 0, pos, PR_SEEK_CURRENT);
-	
-	if(err != malNoError)
-		throw err;
-	
-	return pos;
-}
-
-int32_t
-PrMkvWriter::Position(int64_t position)
-{
-	prInt64 pos = 0;
-
-	prSuiteError err = _fileSuite->Seek(_fileObject, position, pos, fileSeekMode_Begin);
-	
-	return err;
-}
-
-void
-PrMkvWriter::ElementStartNotify(uint64_t element_id, int64_t position)
-{
-	// ummm, should I do something?
-}
-
 
 #pragma mark-
 
@@ -156,6 +117,38 @@ extern int g_num_cpus;
 // When we call finctions like GetTime, we're given Time in Nanoseconds.
 static const uint64_t S2NS = 1000000000LL;
 
+// first pass stats past this go to a temp file, at a few hundred bytes a frame
+static const size_t StatsMemoryBudget = 64 * 1024 * 1024;
+
+// how many packets the audio thread can get ahead of the muxer, a second or more
+static const size_t AudioQueueDepth = 64;
+
+
+// the audio encoder's way into Premiere, on the export thread
+class PremiereAudioSource : public AudioSource
+{
+  public:
+	PremiereAudioSource(PrSDKSequenceAudioSuite *audioSuite, csSDK_uint32 audioRenderID) :
+		_audioSuite(audioSuite),
+		_audioRenderID(audioRenderID),
+		_result(malNoError)
+	{}
+	
+	virtual bool GetAudio(int samples, float **buffers)
+	{
+		_result = _audioSuite->GetAudio(_audioRenderID, samples, buffers, false);
+		
+		return (_result == malNoError);
+	}
+	
+	prMALError Result() const { return _result; } // why GetAudio failed
+	
+  private:
+	PrSDKSequenceAudioSuite *_audioSuite;
+	const csSDK_uint32 _audioRenderID;
+	prMALError _result;
+};
+
 
 static void
 utf16ncpy(prUTF16Char *dest, const char *src, int max_len)
@@ -179,17 +172,25 @@ ncpyUTF16(char *dest, const prUTF16Char *src, int max_len)
 	}while(*c++ != '\0' && --max_len);
 }
 
-static int
-mylog2(int val)
+// the movie's path, for the files that go next to it
+static std::string
+OutputPath(PrSDKExportFileSuite *fileSuite, csSDK_uint32 fileObject)
 {
-	int ret = 0;
+	csSDK_int32 length = 0;
 	
-	while( pow(2.0, ret) < val )
-	{
-		ret++;
-	}
+	if(fileSuite->GetPlatformPath(fileObject, &length, NULL) != malNoError || length <= 0)
+		return std::string();
+	
+	std::vector<prUTF16Char> utf_path(length + 1, 0);
+	
+	if(fileSuite->GetPlatformPath(fileObject, &length, &utf_path[0]) != malNoError)
+		return std::string();
 	
-	return ret;
+	std::vector<char> path(utf_path.size(), '\0');
+	
+	ncpyUTF16(&path[0], &utf_path[0], path.size() - 1);
+	
+	return std::string(&path[0]);
 }
 
 static prMALError
@@ -451,362 +452,572 @@ static void get_framerate(PrTime ticksPerSecond, PrTime ticks_per_frame, exRatio
 }
 
 
-// converting from Adobe 16-bit to regular 16-bit
-#define PF_HALF_CHAN16			16384
-
-static inline unsigned short
-Promote(const unsigned short &val)
+// Converts horizontal bands of the frame, so CopyPixToImg can spread the work over threads
+class CopyPixJob : public WebMJob
 {
-	return (val > PF_HALF_CHAN16 ? ( (val - 1) << 1 ) + 1 : val << 1);
-}
-
+  public:
+	CopyPixJob(vpx_image_t *img, vpx_image_t *alpha_img, PrPixelFormat pixFormat, int band_height) :
+		frameBufferP(NULL),
+		rowbytes(0),
+		Y_PixelAddress(NULL),
+		U_PixelAddress(NULL),
+		V_PixelAddress(NULL),
+		Y_RowBytes(0),
+		U_RowBytes(0),
+		V_RowBytes(0),
+		band_hashes(NULL),
+		_img(img),
+		_alpha_img(alpha_img),
+		_pixFormat(pixFormat),
+		_band_height(band_height)
+	{}
+	
+	virtual void Process(int band);
+	
+	// packed formats
+	char *frameBufferP;
+	csSDK_int32 rowbytes;
+	
+	// planar 4:2:0
+	char *Y_PixelAddress, *U_PixelAddress, *V_PixelAddress;
+	csSDK_uint32 Y_RowBytes, U_RowBytes, V_RowBytes;
+	
+	// if not NULL, each band puts the hash of what it converted here
+	WebMHash *band_hashes;
+	
+  private:
+	vpx_image_t *_img;
+	vpx_image_t *_alpha_img;
+	const PrPixelFormat _pixFormat;
+	const int _band_height;
+};
 
-template <typename BGRA_PIX, typename IMG_PIX>
-static inline IMG_PIX
-DepthConvert(const BGRA_PIX &val, const int &depth);
 
-template<>
-static inline unsigned short
-DepthConvert<unsigned short, unsigned short>(const unsigned short &val, const int &depth)
+void
+CopyPixJob::Process(int band)
 {
-	return (Promote(val) >> (16 - depth));
-}
+	const int y_start = band * _band_height;
+	const int y_end = std::min<int>(y_start + _band_height, _img->d_h);
 
-template<>
-static inline unsigned short
-DepthConvert<unsigned char, unsigned short>(const unsigned char &val, const int &depth)
-{
-	return ((unsigned short)val << (depth - 8)) | (val >> (16 - depth));
+	if(_pixFormat == PrPixelFormat_YUV_420_MPEG2_FRAME_PICTURE_PLANAR_8u_601)
+	{
+		CopyYUV420ToImg(_img, Y_PixelAddress, Y_RowBytes,
+							U_PixelAddress, U_RowBytes,
+							V_PixelAddress, V_RowBytes,
+							y_start, y_end);
+	}
+	else if(_pixFormat == PrPixelFormat_UYVY_422_8u_601)
+	{
+		CopyUYVYToImg(_img, frameBufferP, rowbytes, y_start, y_end);
+	}
+	else if(_pixFormat == PrPixelFormat_VUYX_4444_8u)
+	{
+		CopyVUYAToImg(_img, _alpha_img, frameBufferP, rowbytes, false, y_start, y_end);
+	}
+	else if(_pixFormat == PrPixelFormat_VUYA_4444_16u)
+	{
+		CopyVUYAToImg(_img, _alpha_img, frameBufferP, rowbytes, true, y_start, y_end);
+	}
+	else if(_pixFormat == PrPixelFormat_BGRA_4444_16u)
+	{
+		CopyBGRAToImg(_img, _alpha_img, frameBufferP, rowbytes, true, false, y_start, y_end);
+	}
+	else if(_pixFormat == PrPixelFormat_BGRA_4444_8u)
+	{
+		CopyBGRAToImg(_img, _alpha_img, frameBufferP, rowbytes, false, false, y_start, y_end);
+	}
+	else if(_pixFormat == PrPixelFormat_ARGB_4444_8u)
+	{
+		CopyBGRAToImg(_img, _alpha_img, frameBufferP, rowbytes, false, true, y_start, y_end);
+	}
+	else
+		assert(false);
+	
+	if(band_hashes != NULL)
+	{
+		band_hashes[band] = HashImageRows(_img, y_start, y_end, 0);
+		
+		if(_alpha_img != NULL)
+			band_hashes[band] += HashImageRows(_alpha_img, y_start, y_end, 1);
+	}
 }
 
-template<>
-static inline unsigned char
-DepthConvert<unsigned short, unsigned char>(const unsigned short &val, const int &depth)
-{
-	assert(depth == 8);
-	return ( (((long)(val) * 255) + 16384) / 32768);
-}
 
-template<>
-static inline unsigned char
-DepthConvert<unsigned char, unsigned char>(const unsigned char &val, const int &depth)
+static void
+CopyPixToImg(vpx_image_t *img, vpx_image_t *alpha_img, const PPixHand &outFrame, PrSDKPPixSuite *pixSuite, PrSDKPPix2Suite *pix2Suite,
+				WebMWorkerPool &pool, WebMHash *hash)
 {
-	assert(depth == 8);
-	return val;
-}
+	prRect boundsRect;
+	pixSuite->GetBounds(outFrame, &boundsRect);
+	
+	assert(boundsRect.right == img->d_w && boundsRect.bottom == img->d_h);
 
+	PrPixelFormat pixFormat;
+	pixSuite->GetPixelFormat(outFrame, &pixFormat);
 
-template <typename VUYA_PIX, typename IMG_PIX>
-static void
-CopyVUYAToImg(vpx_image_t *img, vpx_image_t *alpha_img, const char *frameBufferP, const csSDK_int32 rowbytes)
-{
 	const unsigned int sub_x = img->x_chroma_shift + 1;
 	const unsigned int sub_y = img->y_chroma_shift + 1;
 	
-	for(int y = 0; y < img->d_h; y++)
+	
+	// A couple of bands per thread, so they even out.  Bands start on chroma rows,
+	// so with 4:2:0 each band writes its own chroma rows.  The "pixel below" for
+	// MPEG-2 siting might come from the next band, but that's only reading.
+	const int bands_wanted = pool.Threads() * 2;
+	
+	int band_height = std::max<int>(16, (img->d_h + bands_wanted - 1) / bands_wanted);
+	
+	band_height = ((band_height + sub_y - 1) / sub_y) * sub_y;
+	
+	const int bands = (img->d_h + band_height - 1) / band_height;
+	
+	CopyPixJob job(img, alpha_img, pixFormat, band_height);
+	
+	std::vector<WebMHash> band_hashes;
+	
+	if(hash != NULL)
 	{
-		IMG_PIX *imgY = (IMG_PIX *)(img->planes[VPX_PLANE_Y] + (img->stride[VPX_PLANE_Y] * y));
-		IMG_PIX *imgU = (IMG_PIX *)(img->planes[VPX_PLANE_U] + (img->stride[VPX_PLANE_U] * (y / sub_y)));
-		IMG_PIX *imgV = (IMG_PIX *)(img->planes[VPX_PLANE_V] + (img->stride[VPX_PLANE_V] * (y / sub_y)));
+		band_hashes.resize(bands, 0);
+		
+		job.band_hashes = &band_hashes[0];
+	}
 	
-		const VUYA_PIX *prVUYA = (VUYA_PIX *)(frameBufferP + (rowbytes * (img->d_h - 1 - y)));
+
+	if(pixFormat == PrPixelFormat_YUV_420_MPEG2_FRAME_PICTURE_PLANAR_8u_601)
+	{
+		assert(sub_x == 2 && sub_y == 2);
+		assert(img->bit_depth == 8);
+		assert(alpha_img == NULL);
+		
+		pix2Suite->GetYUV420PlanarBuffers(outFrame, PrPPixBufferAccess_ReadOnly,
+											&job.Y_PixelAddress, &job.Y_RowBytes,
+											&job.U_PixelAddress, &job.U_RowBytes,
+											&job.V_PixelAddress, &job.V_RowBytes);
+	}
+	else
+	{
+		pixSuite->GetPixels(outFrame, PrPPixBufferAccess_ReadOnly, &job.frameBufferP);
+		pixSuite->GetRowBytes(outFrame, &job.rowbytes);
 		
-		const VUYA_PIX *prV = prVUYA + 0;
-		const VUYA_PIX *prU = prVUYA + 1;
-		const VUYA_PIX *prY = prVUYA + 2;
 		
-		for(int x=0; x < img->d_w; x++)
+		if(pixFormat == PrPixelFormat_UYVY_422_8u_601)
 		{
-			*imgY++ = DepthConvert<VUYA_PIX, IMG_PIX>(*prY, img->bit_depth);
-			
-			if( (y % sub_y == 0) && (x % sub_x == 0) )
-			{
-				*imgU++ = DepthConvert<VUYA_PIX, IMG_PIX>(*prU, img->bit_depth);
-				*imgV++ = DepthConvert<VUYA_PIX, IMG_PIX>(*prV, img->bit_depth);
-			}
-			
-			prY += 4;
-			prU += 4;
-			prV += 4;
+			assert(sub_x == 2 && sub_y == 1);
+			assert(img->bit_depth == 8);
+			assert(alpha_img == NULL);
+		}
+		else if(pixFormat == PrPixelFormat_VUYX_4444_8u)
+		{
+			assert(sub_x == 1 && sub_y == 1);
+			assert(img->bit_depth == 8);
+			assert(alpha_img == NULL);
+		}
+		else if(pixFormat == PrPixelFormat_VUYA_4444_16u)
+		{
+			assert(img->bit_depth > 8);
 		}
 	}
 	
-	if(alpha_img != NULL)
+	pool.Run(job, bands);
+	
+	if(hash != NULL)
 	{
-		assert(sub_x == alpha_img->x_chroma_shift + 1);
-		assert(sub_y == alpha_img->y_chroma_shift + 1);
-		
-		for(int y = 0; y < img->d_h; y++)
-		{
-			IMG_PIX *imgY = (IMG_PIX *)(alpha_img->planes[VPX_PLANE_Y] + (alpha_img->stride[VPX_PLANE_Y] * y));
-			IMG_PIX *imgU = (IMG_PIX *)(alpha_img->planes[VPX_PLANE_U] + (alpha_img->stride[VPX_PLANE_U] * (y / sub_y)));
-			IMG_PIX *imgV = (IMG_PIX *)(alpha_img->planes[VPX_PLANE_V] + (alpha_img->stride[VPX_PLANE_V] * (y / sub_y)));
+		*hash = 0;
 		
-			const VUYA_PIX *prVUYA = (VUYA_PIX *)(frameBufferP + (rowbytes * (alpha_img->d_h - 1 - y)));
-			
-			const VUYA_PIX *prA = prVUYA + 3;
-			
-			for(int x=0; x < img->d_w; x++)
-			{
-				*imgY++ = DepthConvert<VUYA_PIX, IMG_PIX>(*prA, img->bit_depth);
-				
-				if( (y % sub_y == 0) && (x % sub_x == 0) )
-				{
-					*imgU++ = DepthConvert<unsigned char, IMG_PIX>(128, alpha_img->bit_depth);
-					*imgV++ = DepthConvert<unsigned char, IMG_PIX>(128, alpha_img->bit_depth);
-				}
-				
-				prA += 4;
-			}
-		}
+		for(int i=0; i < bands; i++)
+			*hash += band_hashes[i];
 	}
 }
 
 
-template <typename BGRA_PIX, typename IMG_PIX, bool isARGB>
+// Premiere's planar 4:2:0 is already what the encoder takes, so instead of
+// copying it, the image points at Premiere's planes.  The frame stays ours
+// until the encoder is done with it, then DisposeUnwrapped() gives it back.
+// libvpx uses the U stride for V too, so they have to match.
+static vpx_image_t *
+WrapPixToImg(const PPixHand &outFrame, PrSDKPPixSuite *pixSuite, PrSDKPPix2Suite *pix2Suite,
+				FramePool &pool, vpx_img_fmt_t fmt)
+{
+	PrPixelFormat pixFormat;
+	pixSuite->GetPixelFormat(outFrame, &pixFormat);
+	
+	if(pixFormat != PrPixelFormat_YUV_420_MPEG2_FRAME_PICTURE_PLANAR_8u_601 || fmt != VPX_IMG_FMT_I420)
+		return NULL;
+	
+	prRect boundsRect;
+	pixSuite->GetBounds(outFrame, &boundsRect);
+	
+	char *Y_PixelAddress = NULL, *U_PixelAddress = NULL, *V_PixelAddress = NULL;
+	csSDK_uint32 Y_RowBytes = 0, U_RowBytes = 0, V_RowBytes = 0;
+	
+	prSuiteError err = pix2Suite->GetYUV420PlanarBuffers(outFrame, PrPPixBufferAccess_ReadOnly,
+															&Y_PixelAddress, &Y_RowBytes,
+															&U_PixelAddress, &U_RowBytes,
+															&V_PixelAddress, &V_RowBytes);
+	
+	if(err != suiteError_NoError || U_RowBytes != V_RowBytes)
+		return NULL;
+	
+	unsigned char *planes[3] = { (unsigned char *)Y_PixelAddress, (unsigned char *)U_PixelAddress, (unsigned char *)V_PixelAddress };
+	const int strides[3] = { (int)Y_RowBytes, (int)U_RowBytes, (int)V_RowBytes };
+	
+	return pool.Wrap(fmt, boundsRect.right - boundsRect.left, boundsRect.bottom - boundsRect.top,
+						planes, strides, (void *)outFrame);
+}
+
+
+// the frames WrapPixToImg() images were made from, once the encoders are done with them
 static void
-CopyBGRAToImg(vpx_image_t *img, vpx_image_t *alpha_img, const char *frameBufferP, const csSDK_int32 rowbytes)
+DisposeUnwrapped(FramePool &pool, PrSDKPPixSuite *pixSuite)
 {
-	const unsigned int sub_x = img->x_chroma_shift + 1;
-	const unsigned int sub_y = img->y_chroma_shift + 1;
+	std::vector<void *> frames;
+	
+	pool.Unwrapped(frames);
+	
+	for(size_t i=0; i < frames.size(); i++)
+		pixSuite->Dispose( (PPixHand)frames[i] );
+}
+
+
+// the hash CopyPixToImg() would have made, for a frame read back from the spill
+static WebMHash
+ImageHash(const vpx_image_t *img, const vpx_image_t *alpha_img)
+{
+	return HashImageRows(img, 0, img->d_h, 0) + (alpha_img != NULL ? HashImageRows(alpha_img, 0, alpha_img->d_h, 1) : 0);
+}
+
 
-	for(int y = 0; y < img->d_h; y++)
+// Renders frames spread over the export and hashes them, for telling
+// whether cached first pass stats could go with this export.  A few frames
+// make the cache key, which only guesses.  All of them make the same hash
+// the analysis pass stores, which has to match before the stats get used.
+// Frames already in the spill are read from it, the others go into it.
+// Progress goes up to progress_end.
+static prMALError
+ProbeFrames(WebMHash &hash, int frames, int probes, PrTime startTime, PrTime frameDuration,
+			PrSDKSequenceRenderSuite *renderSuite, csSDK_uint32 videoRenderID, SequenceRender_ParamsRec &renderParms,
+			PrSDKPPixSuite *pixSuite, PrSDKPPix2Suite *pix2Suite,
+			FramePool &frame_pool, WebMWorkerPool &convert_pool,
+			vpx_img_fmt_t imgfmt, int bit_depth, bool use_alpha,
+			FrameSpill *spill, PrSDKExportProgressSuite *progressSuite, csSDK_uint32 exID, float progress_end)
+{
+	prMALError result = malNoError;
+	
+	probes = std::min<int>(frames, probes);
+	
+	hash = 0;
+	
+	for(int i=0; i < probes && result == malNoError; i++)
 	{
-		IMG_PIX *imgY = (IMG_PIX *)(img->planes[VPX_PLANE_Y] + (img->stride[VPX_PLANE_Y] * y));
-		IMG_PIX *imgU = (IMG_PIX *)(img->planes[VPX_PLANE_U] + (img->stride[VPX_PLANE_U] * (y / sub_y)));
-		IMG_PIX *imgV = (IMG_PIX *)(img->planes[VPX_PLANE_V] + (img->stride[VPX_PLANE_V] * (y / sub_y)));
-		
-		const BGRA_PIX *prBGRA = (BGRA_PIX *)(frameBufferP + (rowbytes * (img->d_h - 1 - y)));
+		const int frame = (probes > 1 ? ((long long)i * (frames - 1)) / (probes - 1) : 0);
 		
-		const BGRA_PIX *prB = prBGRA + 0;
-		const BGRA_PIX *prG = prBGRA + 1;
-		const BGRA_PIX *prR = prBGRA + 2;
+		bool from_spill = false;
 		
-		if(isARGB)
+		if(spill != NULL && spill->Has(frame))
 		{
-			// Media Encoder CS5 insists on handing us this format in some cases,
-			// even though we didn't list it as an option
-			prR = prBGRA + 1;
-			prG = prBGRA + 2;
-			prB = prBGRA + 3;
+			vpx_image_t *img = frame_pool.Get(imgfmt, renderParms.inWidth, renderParms.inHeight, bit_depth, false);
+			
+			vpx_image_t *alpha_img = (use_alpha ? frame_pool.Get(imgfmt, renderParms.inWidth, renderParms.inHeight, bit_depth, true) : NULL);
+			
+			if(img && (!use_alpha || alpha_img) && spill->Get(frame, img, alpha_img))
+			{
+				hash += HashCombine(ImageHash(img, alpha_img), frame);
+				
+				from_spill = true;
+			}
+			
+			if(img)
+				frame_pool.Release(img);
+			
+			if(alpha_img)
+				frame_pool.Release(alpha_img);
 		}
 		
-		// These are the pixels below the current one for MPEG-2 chroma siting
-		const BGRA_PIX *prBb = prB - (rowbytes / sizeof(BGRA_PIX));
-		const BGRA_PIX *prGb = prG - (rowbytes / sizeof(BGRA_PIX));
-		const BGRA_PIX *prRb = prR - (rowbytes / sizeof(BGRA_PIX));
+		SequenceRender_GetFrameReturnRec renderResult;
 		
-		// unless this is the last line and there is no pixel below
-		if(y == (img->d_h - 1) || sub_y != 2)
+		if(!from_spill)
 		{
-			prBb = prB;
-			prGb = prG;
-			prRb = prR;
+			result = renderSuite->RenderVideoFrame(videoRenderID,
+													startTime + (frame * frameDuration),
+													&renderParms,
+													kRenderCacheType_None,
+													&renderResult);
 		}
 		
-		
-		// using the conversion found here: http://www.fourcc.org/fccyvrgb.php
-		// and 601 spec here: http://www.itu.int/dms_pubrec/itu-r/rec/bt/R-REC-BT.601-7-201103-I!!PDF-E.pdf
-		
-		// these are part of the RGBtoYUV math (uses Adobe 16-bit)
-		const int Yadd = (sizeof(BGRA_PIX) > 1 ? 20565000 : 165000);    // to be divided by 10000
-		const int UVadd = (sizeof(BGRA_PIX) > 1 ? 164495000 : 1285000); // includes extra 5000 for rounding
-		
-		for(int x=0; x < img->d_w; x++)
+		if(!from_spill && result == suiteError_NoError)
 		{
-			*imgY++ = DepthConvert<BGRA_PIX, IMG_PIX>( ((2568 * (int)*prR) + (5041 * (int)*prG) + ( 979 * (int)*prB) + Yadd) / 10000, img->bit_depth);
+			prRect bounds;
+			pixSuite->GetBounds(renderResult.outFrame, &bounds);
+			
+			const int width = bounds.right - bounds.left;
+			const int height = bounds.bottom - bounds.top;
+			
+			vpx_image_t *img = frame_pool.Get(imgfmt, width, height, bit_depth, false);
 			
-			if(sub_y > 1)
+			vpx_image_t *alpha_img = (use_alpha ? frame_pool.Get(imgfmt, width, height, bit_depth, true) : NULL);
+			
+			if(img && (!use_alpha || alpha_img))
 			{
-				if( (y % sub_y == 0) && (x % sub_x == 0) )
-				{
-					*imgV++ = DepthConvert<BGRA_PIX, IMG_PIX>( (((4392 * (int)*prR) - (3678 * (int)*prG) - ( 714 * (int)*prB) + UVadd) +
-										((4392 * (int)*prRb) - (3678 * (int)*prGb) - ( 714 * (int)*prBb) + UVadd)) / 20000, img->bit_depth);
-					*imgU++ = DepthConvert<BGRA_PIX, IMG_PIX>( ((-(1482 * (int)*prR) - (2910 * (int)*prG) + (4392 * (int)*prB) + UVadd) +
-										(-(1482 * (int)*prRb) - (2910 * (int)*prGb) + (4392 * (int)*prBb) + UVadd)) / 20000, img->bit_depth);
-				}
+				WebMHash frame_hash = 0;
+				
+				CopyPixToImg(img, alpha_img, renderResult.outFrame, pixSuite, pix2Suite, convert_pool, &frame_hash);
 				
-				prRb += 4;
-				prGb += 4;
-				prBb += 4;
+				hash += HashCombine(frame_hash, frame);
+				
+				if(spill != NULL)
+					spill->Put(frame, img, alpha_img);
 			}
 			else
-			{
-				if(x % sub_x == 0)
-				{
-					*imgV++ = DepthConvert<BGRA_PIX, IMG_PIX>( (((4392 * (int)*prR) - (3678 * (int)*prG) - ( 714 * (int)*prB) + UVadd)) / 10000, img->bit_depth);
-					*imgU++ = DepthConvert<BGRA_PIX, IMG_PIX>( ((-(1482 * (int)*prR) - (2910 * (int)*prG) + (4392 * (int)*prB) + UVadd) ) / 10000, img->bit_depth);
-				}
-			}
+				result = exportReturn_ErrMemory;
+			
+			if(img)
+				frame_pool.Release(img);
+			
+			if(alpha_img)
+				frame_pool.Release(alpha_img);
+			
+			pixSuite->Dispose(renderResult.outFrame);
+		}
+		
+		if(result == malNoError && progressSuite != NULL)
+		{
+			result = progressSuite->UpdateProgressPercent(exID, progress_end * (float)(i + 1) / (float)probes);
 			
-			prR += 4;
-			prG += 4;
-			prB += 4;
+			if(result == suiteError_ExporterSuspended)
+				result = progressSuite->WaitForResume(exID);
 		}
 	}
 	
+	return result;
+}
+
+
+// Renders every frame once to see which stretches can be copied from the
+// smart render sources, the rest get encoded.  The frames that look like
+// they'll be encoded go in the spill, so the encode doesn't render them again.
+static prMALError
+PlanSmartRender(std::vector<SmartSpan> &spans, std::vector<SmartSource *> &sources, const std::string &key_dir,
+				int min_frames, int max_encoded,
+				int frames, PrTime startTime, PrTime frameDuration,
+				PrSDKSequenceRenderSuite *renderSuite, csSDK_uint32 videoRenderID, SequenceRender_ParamsRec &renderParms,
+				PrSDKPPixSuite *pixSuite, PrSDKPPix2Suite *pix2Suite,
+				FramePool &frame_pool, WebMWorkerPool &convert_pool,
+				vpx_img_fmt_t imgfmt, int bit_depth, FrameSpill &spill,
+				PrSDKExportProgressSuite *progressSuite, csSDK_uint32 exID)
+{
+	prMALError result = malNoError;
+	
+	SmartPlanner planner(sources, key_dir, min_frames, max_encoded);
 	
-	if(alpha_img != NULL)
+	for(int frame=0; frame < frames && result == malNoError; frame++)
 	{
-		assert(sub_x == alpha_img->x_chroma_shift + 1);
-		assert(sub_y == alpha_img->y_chroma_shift + 1);
+		SequenceRender_GetFrameReturnRec renderResult;
 		
-		for(int y = 0; y < img->d_h; y++)
+		result = renderSuite->RenderVideoFrame(videoRenderID,
+												startTime + (frame * frameDuration),
+												&renderParms,
+												kRenderCacheType_None,
+												&renderResult);
+		
+		if(result == suiteError_NoError)
 		{
-			IMG_PIX *imgY = (IMG_PIX *)(alpha_img->planes[VPX_PLANE_Y] + (alpha_img->stride[VPX_PLANE_Y] * y));
-			IMG_PIX *imgU = (IMG_PIX *)(alpha_img->planes[VPX_PLANE_U] + (alpha_img->stride[VPX_PLANE_U] * (y / sub_y)));
-			IMG_PIX *imgV = (IMG_PIX *)(alpha_img->planes[VPX_PLANE_V] + (alpha_img->stride[VPX_PLANE_V] * (y / sub_y)));
-			
-			const BGRA_PIX *prBGRA = (BGRA_PIX *)(frameBufferP + (rowbytes * (alpha_img->d_h - 1 - y)));
+			prRect bounds;
+			pixSuite->GetBounds(renderResult.outFrame, &bounds);
 			
-			const BGRA_PIX *prA = prBGRA + 3;
+			const int width = bounds.right - bounds.left;
+			const int height = bounds.bottom - bounds.top;
 			
-			if(isARGB)
-			{
-				prA = prBGRA + 0;
-			}
+			vpx_image_t *img = frame_pool.Get(imgfmt, width, height, bit_depth, false);
 			
-			for(int x=0; x < img->d_w; x++)
+			if(img)
 			{
-				*imgY++ = DepthConvert<BGRA_PIX, IMG_PIX>(*prA, img->bit_depth);
+				CopyPixToImg(img, NULL, renderResult.outFrame, pixSuite, pix2Suite, convert_pool, NULL);
 				
-				if( (y % sub_y == 0) && (x % sub_x == 0) )
-				{
-					*imgV++ = DepthConvert<unsigned char, IMG_PIX>(128, img->bit_depth);
-					*imgU++ = DepthConvert<unsigned char, IMG_PIX>(128, img->bit_depth);
-				}
+				if( !planner.Frame(img) )
+					result = exportReturn_InternalError;
+				else if( !planner.Copying() )
+					spill.Put(frame, img, NULL);
 				
-				prA += 4;
+				frame_pool.Release(img);
 			}
+			else
+				result = exportReturn_ErrMemory;
+			
+			pixSuite->Dispose(renderResult.outFrame);
+		}
+		
+		if(result == malNoError)
+		{
+			result = progressSuite->UpdateProgressPercent(exID, (float)(frame + 1) / (float)frames);
+			
+			if(result == suiteError_ExporterSuspended)
+				result = progressSuite->WaitForResume(exID);
 		}
 	}
+	
+	if(result == malNoError)
+		planner.Plan(spans);
+	
+	return result;
 }
 
 
-static void
-CopyPixToImg(vpx_image_t *img, vpx_image_t *alpha_img, const PPixHand &outFrame, PrSDKPPixSuite *pixSuite, PrSDKPPix2Suite *pix2Suite)
+// Mean difference between two high bit depth planes, in 8-bit levels
+static double
+PlaneDifference(const vpx_image_t *a, const vpx_image_t *b, int plane)
 {
-	prRect boundsRect;
-	pixSuite->GetBounds(outFrame, &boundsRect);
+	const unsigned int shift_x = (plane == VPX_PLANE_Y ? 0 : a->x_chroma_shift);
+	const unsigned int shift_y = (plane == VPX_PLANE_Y ? 0 : a->y_chroma_shift);
 	
-	assert(boundsRect.right == img->d_w && boundsRect.bottom == img->d_h);
-
-	PrPixelFormat pixFormat;
-	pixSuite->GetPixelFormat(outFrame, &pixFormat);
-
-	const unsigned int sub_x = img->x_chroma_shift + 1;
-	const unsigned int sub_y = img->y_chroma_shift + 1;
-
-	if(pixFormat == PrPixelFormat_YUV_420_MPEG2_FRAME_PICTURE_PLANAR_8u_601)
+	const unsigned int width = (a->d_w + shift_x) >> shift_x;
+	const unsigned int height = (a->d_h + shift_y) >> shift_y;
+	
+	double total = 0.0;
+	
+	for(unsigned int y=0; y < height; y++)
 	{
-		assert(sub_x == 2 && sub_y == 2);
-		assert(img->bit_depth == 8);
-		assert(alpha_img == NULL);
-		
-		char *Y_PixelAddress, *U_PixelAddress, *V_PixelAddress;
-		csSDK_uint32 Y_RowBytes, U_RowBytes, V_RowBytes;
-		
-		pix2Suite->GetYUV420PlanarBuffers(outFrame, PrPPixBufferAccess_ReadOnly,
-											&Y_PixelAddress, &Y_RowBytes,
-											&U_PixelAddress, &U_RowBytes,
-											&V_PixelAddress, &V_RowBytes);
+		const unsigned short *rowA = (unsigned short *)(a->planes[plane] + (a->stride[plane] * y));
+		const unsigned short *rowB = (unsigned short *)(b->planes[plane] + (b->stride[plane] * y));
 		
-		for(int y = 0; y < img->d_h; y++)
+		for(unsigned int x=0; x < width; x++)
 		{
-			unsigned char *imgY = img->planes[VPX_PLANE_Y] + (img->stride[VPX_PLANE_Y] * y);
-			
-			const unsigned char *prY = (unsigned char *)Y_PixelAddress + (Y_RowBytes * y);
+			const int diff = (int)rowA[x] - (int)rowB[x];
 			
-			memcpy(imgY, prY, img->d_w * sizeof(unsigned char));
+			total += (diff < 0 ? -diff : diff);
 		}
+	}
+	
+	return (total / ((double)width * (double)height)) / (double)(1 << (a->bit_depth - 8));
+}
+
+
+// How many different Y values a high bit depth image has
+static int
+LumaLevels(const vpx_image_t *img)
+{
+	std::vector<bool> seen(1 << img->bit_depth, false);
+	
+	int levels = 0;
+	
+	for(unsigned int y=0; y < img->d_h; y++)
+	{
+		const unsigned short *row = (unsigned short *)(img->planes[VPX_PLANE_Y] + (img->stride[VPX_PLANE_Y] * y));
 		
-		const int chroma_width = (img->d_w / 2) + (img->d_w % 2);
-		const int chroma_height = (img->d_h / 2) + (img->d_h % 2);
-		
-		for(int y = 0; y < chroma_height; y++)
+		for(unsigned int x=0; x < img->d_w; x++)
 		{
-			unsigned char *imgU = img->planes[VPX_PLANE_U] + (img->stride[VPX_PLANE_U] * y);
-			unsigned char *imgV = img->planes[VPX_PLANE_V] + (img->stride[VPX_PLANE_V] * y);
-			
-			const unsigned char *prU = (unsigned char *)U_PixelAddress + (U_RowBytes * y);
-			const unsigned char *prV = (unsigned char *)V_PixelAddress + (V_RowBytes * y);
-			
-			memcpy(imgU, prU, chroma_width * sizeof(unsigned char));
-			memcpy(imgV, prV, chroma_width * sizeof(unsigned char));
-		}
+			if(row[x] < seen.size() && !seen[ row[x] ])
+			{
+				seen[ row[x] ] = true;
+				
+				levels++;
+			}
+		}
 	}
-	else
+	
+	return levels;
+}
+
+
+// PrPixelFormat_VUYA_4444_16u is Premiere's only 16-bit YUV, and it can't
+// always be trusted.  Some hosts render something else when asked for it,
+// some fill it with the wrong levels or with what was really 8-bit.  So we
+// render one frame both ways and only take the YUV if it comes out close to
+// our own conversion of the BGRA.  Otherwise it's BGRA like it always was.
+static bool
+ValidateYUV16(PrTime frameTime, PrSDKSequenceRenderSuite *renderSuite, csSDK_uint32 videoRenderID,
+				const SequenceRender_ParamsRec &renderParms, PrSDKPPixSuite *pixSuite, PrSDKPPix2Suite *pix2Suite,
+				FramePool &frame_pool, WebMWorkerPool &convert_pool, vpx_img_fmt_t imgfmt, int bit_depth)
+{
+	PrPixelFormat yuvFormats[] = { PrPixelFormat_VUYA_4444_16u };
+	PrPixelFormat bgraFormats[] = { PrPixelFormat_BGRA_4444_16u };
+	
+	SequenceRender_ParamsRec yuvParms = renderParms;
+	yuvParms.inRequestedPixelFormatArray = yuvFormats;
+	yuvParms.inRequestedPixelFormatArrayCount = 1;
+	
+	SequenceRender_ParamsRec bgraParms = renderParms;
+	bgraParms.inRequestedPixelFormatArray = bgraFormats;
+	bgraParms.inRequestedPixelFormatArrayCount = 1;
+	
+	SequenceRender_GetFrameReturnRec yuvResult, bgraResult;
+	
+	if(renderSuite->RenderVideoFrame(videoRenderID, frameTime, &yuvParms, kRenderCacheType_None, &yuvResult) != suiteError_NoError)
+	{
+		WebMLog("16-bit YUV: couldn't render it, using BGRA");
+		
+		return false;
+	}
+	
+	if(renderSuite->RenderVideoFrame(videoRenderID, frameTime, &bgraParms, kRenderCacheType_None, &bgraResult) != suiteError_NoError)
 	{
-		char *frameBufferP = NULL;
-		csSDK_int32 rowbytes = 0;
+		pixSuite->Dispose(yuvResult.outFrame);
 		
-		pixSuite->GetPixels(outFrame, PrPPixBufferAccess_ReadOnly, &frameBufferP);
-		pixSuite->GetRowBytes(outFrame, &rowbytes);
+		WebMLog("16-bit YUV: couldn't render BGRA to check it against, using BGRA");
 		
+		return false;
+	}
+	
+	bool valid = false;
+	
+	PrPixelFormat yuvFormat;
+	pixSuite->GetPixelFormat(yuvResult.outFrame, &yuvFormat);
+	
+	prRect yuvBounds, bgraBounds;
+	pixSuite->GetBounds(yuvResult.outFrame, &yuvBounds);
+	pixSuite->GetBounds(bgraResult.outFrame, &bgraBounds);
+	
+	const int width = yuvBounds.right - yuvBounds.left;
+	const int height = yuvBounds.bottom - yuvBounds.top;
+	
+	if(yuvFormat != PrPixelFormat_VUYA_4444_16u)
+	{
+		WebMLog("16-bit YUV: got a different pixel format back, using BGRA");
+	}
+	else if(width != (bgraBounds.right - bgraBounds.left) || height != (bgraBounds.bottom - bgraBounds.top))
+	{
+		WebMLog("16-bit YUV: frame size doesn't match BGRA, using BGRA");
+	}
+	else
+	{
+		vpx_image_t *yuv_img = frame_pool.Get(imgfmt, width, height, bit_depth, false);
+		vpx_image_t *bgra_img = frame_pool.Get(imgfmt, width, height, bit_depth, false);
 		
-		if(pixFormat == PrPixelFormat_UYVY_422_8u_601)
+		if(yuv_img && bgra_img)
 		{
-			assert(sub_x == 2 && sub_y == 1);
-			assert(img->bit_depth == 8);
-			assert(alpha_img == NULL);
+			CopyPixToImg(yuv_img, NULL, yuvResult.outFrame, pixSuite, pix2Suite, convert_pool, NULL);
+			CopyPixToImg(bgra_img, NULL, bgraResult.outFrame, pixSuite, pix2Suite, convert_pool, NULL);
 			
-			for(int y = 0; y < img->d_h; y++)
-			{
-				unsigned char *imgY = img->planes[VPX_PLANE_Y] + (img->stride[VPX_PLANE_Y] * y);
-				unsigned char *imgU = img->planes[VPX_PLANE_U] + (img->stride[VPX_PLANE_U] * y);
-				unsigned char *imgV = img->planes[VPX_PLANE_V] + (img->stride[VPX_PLANE_V] * y);
+			double difference = 0.0;
 			
-				const unsigned char *prUYVY = (unsigned char *)frameBufferP + (rowbytes * y);
-				
-				for(int x=0; x < img->d_w; x++)
-				{
-					if(x % 2 == 0)
-						*imgU++ = *prUYVY++;
-					else
-						*imgV++ = *prUYVY++;
-					
-					*imgY++ = *prUYVY++;;
-				}
-			}
-		}
-		else if(pixFormat == PrPixelFormat_VUYX_4444_8u)
-		{
-			assert(sub_x == 1 && sub_y == 1);
-			assert(img->bit_depth == 8);
-			assert(alpha_img == NULL);
+			for(int p = VPX_PLANE_Y; p <= VPX_PLANE_V; p++)
+				difference = std::max(difference, PlaneDifference(yuv_img, bgra_img, p));
 			
-			CopyVUYAToImg<unsigned char, unsigned char>(img, alpha_img, frameBufferP, rowbytes);
-		}
-		else if(pixFormat == PrPixelFormat_VUYA_4444_16u)
-		{
-			assert(img->bit_depth > 8);
+			// a flat frame doesn't say anything about the levels
+			const int yuv_levels = LumaLevels(yuv_img);
+			const int bgra_levels = LumaLevels(bgra_img);
 			
-			CopyVUYAToImg<unsigned short, unsigned short>(img, alpha_img, frameBufferP, rowbytes);
-		}
-		else if(pixFormat == PrPixelFormat_BGRA_4444_16u)
-		{
-			if(img->bit_depth > 8)
-				CopyBGRAToImg<unsigned short, unsigned short, false>(img, alpha_img, frameBufferP, rowbytes);
-			else
-				CopyBGRAToImg<unsigned short, unsigned char, false>(img, alpha_img, frameBufferP, rowbytes);
-		}
-		else if(pixFormat == PrPixelFormat_BGRA_4444_8u)
-		{
-			if(img->bit_depth > 8)
-				CopyBGRAToImg<unsigned char, unsigned short, false>(img, alpha_img, frameBufferP, rowbytes);
-			else
-				CopyBGRAToImg<unsigned char, unsigned char, false>(img, alpha_img, frameBufferP, rowbytes);
-		}
-		else if(pixFormat == PrPixelFormat_ARGB_4444_8u)
-		{
-			if(img->bit_depth > 8)
-				CopyBGRAToImg<unsigned char, unsigned short, true>(img, alpha_img, frameBufferP, rowbytes);
+			if(difference > 2.0)
+			{
+				WebMLog("16-bit YUV: %.1f levels off from BGRA, using BGRA", difference);
+			}
+			else if(bgra_levels > 256 && yuv_levels <= 256)
+			{
+				WebMLog("16-bit YUV: only %d levels where BGRA has %d, using BGRA", yuv_levels, bgra_levels);
+			}
 			else
-				CopyBGRAToImg<unsigned char, unsigned char, true>(img, alpha_img, frameBufferP, rowbytes);
+				valid = true;
 		}
-		else
-			assert(false);
+		
+		if(yuv_img)
+			frame_pool.Release(yuv_img);
+		
+		if(bgra_img)
+			frame_pool.Release(bgra_img);
 	}
+	
+	pixSuite->Dispose(yuvResult.outFrame);
+	pixSuite->Dispose(bgraResult.outFrame);
+	
+	return valid;
 }
 
 
@@ -1072,6 +1283,97 @@ MakePrivateData(ogg_packet &header, ogg_packet &header_comm, ogg_packet &header_
 }
 
 
+// The controls every encoder in the export gets: color, alpha, and the ladder renditions
+static void
+ConfigureEncoderControls(vpx_codec_ctx_t *encoder, const vpx_codec_enc_cfg_t &config, bool use_vp9,
+							WebM_Video_Method method, const ThreadPlan &thread_plan, const char *customArgs)
+{
+	if(method == WEBM_METHOD_CONSTANT_QUALITY || method == WEBM_METHOD_CONSTRAINED_QUALITY)
+	{
+		const int min_q = config.rc_min_quantizer;
+		const int max_q = config.rc_max_quantizer;
+		
+		// CQ Level should be between min_q and max_q
+		const int cq_level = (min_q + max_q) / 2;
+	
+		vpx_codec_control(encoder, VP8E_SET_CQ_LEVEL, cq_level);
+	}
+	
+	if(use_vp9)
+	{
+		vpx_codec_control(encoder, VP8E_SET_CPUUSED, 2); // much faster if we do this
+		
+		vpx_codec_control(encoder, VP9E_SET_TILE_COLUMNS, thread_plan.tile_columns); // this gives us some multithreading
+		vpx_codec_control(encoder, VP9E_SET_TILE_ROWS, thread_plan.tile_rows);
+		vpx_codec_control(encoder, VP9E_SET_ROW_MT, (thread_plan.row_mt ? 1 : 0));
+		vpx_codec_control(encoder, VP9E_SET_FRAME_PARALLEL_DECODING, 1);
+	}
+	else
+	{
+		vpx_codec_control(encoder, VP8E_SET_TOKEN_PARTITIONS, thread_plan.token_partitions);
+	}
+
+	ConfigureEncoderPost(encoder, customArgs);
+}
+
+
+// Cleans up a pass, even if it throws: the pipeline's threads are stopped
+// before the encoders they're using get destroyed
+class PassEncoders
+{
+  public:
+	PassEncoders(SegmentedEncoder *&pipeline, std::vector<vpx_codec_ctx_t> &encoders, const int &encoders_made,
+					std::vector<vpx_codec_ctx_t> &alpha_encoders, const int &alpha_encoders_made) :
+		_pipeline(pipeline),
+		_encoders(encoders),
+		_encoders_made(encoders_made),
+		_alpha_encoders(alpha_encoders),
+		_alpha_encoders_made(alpha_encoders_made)
+	{}
+	
+	~PassEncoders()
+	{
+		delete _pipeline;
+		
+		_pipeline = NULL;
+		
+		for(int s=0; s < _encoders_made; s++)
+		{
+			vpx_codec_err_t destroy_err = vpx_codec_destroy(&_encoders[s]);
+			assert(destroy_err == VPX_CODEC_OK);
+		}
+		
+		for(int s=0; s < _alpha_encoders_made; s++)
+		{
+			vpx_codec_err_t alpha_destroy_err = vpx_codec_destroy(&_alpha_encoders[s]);
+			assert(alpha_destroy_err == VPX_CODEC_OK);
+		}
+	}
+	
+  private:
+	SegmentedEncoder *&_pipeline;
+	std::vector<vpx_codec_ctx_t> &_encoders;
+	const int &_encoders_made;
+	std::vector<vpx_codec_ctx_t> &_alpha_encoders;
+	const int &_alpha_encoders_made;
+};
+
+
+// The renditions scale the frame before it goes to the movie's pipeline,
+// which gives it back to the pool once it's encoded
+static bool
+SubmitRenditions(std::vector<LadderRendition *> &renditions, const vpx_image_t *img, vpx_codec_pts_t pts, WebMWorkerPool &pool)
+{
+	for(size_t r=0; r < renditions.size(); r++)
+	{
+		if( !renditions[r]->Submit(img, pts, pool) )
+			return false;
+	}
+	
+	return true;
+}
+
+
 static prMALError
 exSDKExport(
 	exportStdParms	*stdParmsP,
@@ -1082,7 +1384,6 @@ exSDKExport(
 	PrSDKExportParamSuite		*paramSuite				= mySettings->exportParamSuite;
 	PrSDKSequenceRenderSuite	*renderSuite			= mySettings->sequenceRenderSuite;
 	PrSDKSequenceAudioSuite		*audioSuite				= mySettings->sequenceAudioSuite;
-	PrSDKMemoryManagerSuite		*memorySuite			= mySettings->memorySuite;
 	PrSDKPPixSuite				*pixSuite				= mySettings->ppixSuite;
 	PrSDKPPix2Suite				*pix2Suite				= mySettings->ppix2Suite;
 
@@ -1149,6 +1450,13 @@ exSDKExport(
 	ncpyUTF16(customArgs, customArgsP.paramString, 255);
 	customArgs[255] = '\0';
 	
+	ExportOptions options;
+	ConfigureExportOptions(options, customArgs);
+	
+	const double export_start = WebMSeconds(); // --finish-in counts from here
+	
+	ExportTiming timing(options.timing, options.timing_trace);
+	
 
 	exParamValues audioCodecP, audioMethodP, audioQualityP, audioBitrateP;
 	paramSuite->GetParamValue(exID, gIdx, WebMAudioCodec, &audioCodecP);
@@ -1161,15 +1469,35 @@ exSDKExport(
 	paramSuite->GetParamValue(exID, gIdx, WebMOpusBitrate, &opusBitrateP);
 	
 	
+	// Premiere's YUV is 601 studio range, for anything else we convert the RGB ourselves.
+	// VP8 only has 601.
+	const vpx_color_space_t color_space = (use_vp9 ? options.color_space : VPX_CS_UNKNOWN);
+	const vpx_color_range_t color_range = (use_vp9 ? options.color_range : VPX_CR_STUDIO_RANGE);
+	
+	const bool premiere_yuv = (WebMColorMatrix(color_space) == WEBM_MATRIX_601 && color_range == VPX_CR_STUDIO_RANGE);
+	
 	const PrPixelFormat yuv_format8 = (use_alpha ? PrPixelFormat_BGRA_4444_16u :
+										!premiere_yuv ? PrPixelFormat_BGRA_4444_8u :
 										chroma == WEBM_444 ? PrPixelFormat_VUYX_4444_8u :
 										chroma == WEBM_422 ? PrPixelFormat_UYVY_422_8u_601 :
 										PrPixelFormat_YUV_420_MPEG2_FRAME_PICTURE_PLANAR_8u_601);
 
-	const PrPixelFormat yuv_format16 = PrPixelFormat_BGRA_4444_16u; // can't trust PrPixelFormat_VUYA_4444_16u, only 16-bit YUV format
+	// can't trust PrPixelFormat_VUYA_4444_16u, only 16-bit YUV format, until ValidateYUV16() says so
+	const PrPixelFormat yuv_format16 = PrPixelFormat_BGRA_4444_16u;
 	
 	const PrPixelFormat yuv_format = (bit_depth > 8 ? yuv_format16 : yuv_format8);
 	
+	// see validate_img() and validate_config() in vp8_cx_iface.c and vp9_cx_iface.c
+	const vpx_img_fmt_t imgfmt8 = chroma == WEBM_444 ? VPX_IMG_FMT_I444 :
+									chroma == WEBM_422 ? VPX_IMG_FMT_I422 :
+									VPX_IMG_FMT_I420;
+									
+	const vpx_img_fmt_t imgfmt16 = chroma == WEBM_444 ? VPX_IMG_FMT_I44416 :
+									chroma == WEBM_422 ? VPX_IMG_FMT_I42216 :
+									VPX_IMG_FMT_I42016;
+									
+	const vpx_img_fmt_t imgfmt = (bit_depth > 8 ? imgfmt16 : imgfmt8);
+	
 	SequenceRender_ParamsRec renderParms;
 	PrPixelFormat pixelFormats[] = { yuv_format,
 									PrPixelFormat_BGRA_4444_16u, // must support BGRA, even if I don't want to
@@ -1188,96 +1516,590 @@ exSDKExport(
 	renderParms.inCompositeOnBlack = (use_alpha ? kPrFalse : kPrTrue);;
 	
 	
+	// the chunk and plan modes change these, so they're ours, not the host's
+	bool export_video = exportInfoP->exportVideo;
+	bool export_audio = exportInfoP->exportAudio;
+	PrTime start_time = exportInfoP->startTime;
+	PrTime end_time = exportInfoP->endTime;
+	
+	
+	// Distributed export
+	// With --manifest and --chunks, we write the job manifest and only export the audio,
+	// which webm_merge will put together with the video chunks.
+	// With --manifest and --chunk, we check our settings against the manifest and encode
+	// only that chunk's frames, video only, into a partial WebM starting at time 0.
+	const bool manifest_plan = (!options.manifest.empty() && options.chunks > 0);
+	const bool manifest_worker = (!options.manifest.empty() && !manifest_plan && options.chunk >= 0);
+	
+	std::vector<unsigned char> video_codec_private;
+	
+	if(manifest_plan || manifest_worker)
+	{
+		if(!export_video)
+			return exportReturn_InternalError;
+		
+		exRatioValue fps;
+		get_framerate(ticksPerSecond, frameRateP.value.timeValue, &fps);
+		
+		// custom args might change the keyframe distance
+		vpx_codec_enc_cfg_t config;
+		vpx_codec_enc_config_default((use_vp9 ? vpx_codec_vp9_cx() : vpx_codec_vp8_cx()), &config, 0);
+		
+		config.kf_max_dist = keyframeMaxDistanceP.value.intValue;
+		
+		unsigned long deadline = VPX_DL_GOOD_QUALITY;
+		
+		ConfigureEncoderPre(config, deadline, customArgs);
+		
+		
+		WebMManifest manifest;
+		InitManifest(manifest);
+		
+		manifest.codec = codecP.value.intValue;
+		manifest.width = renderParms.inWidth;
+		manifest.height = renderParms.inHeight;
+		manifest.pixel_aspect_num = renderParms.inPixelAspectRatioNumerator;
+		manifest.pixel_aspect_den = renderParms.inPixelAspectRatioDenominator;
+		manifest.timebase_num = fps.denominator;
+		manifest.timebase_den = fps.numerator;
+		manifest.frames = (end_time - start_time + frameRateP.value.timeValue - 1) / frameRateP.value.timeValue;
+		manifest.bit_depth = bit_depth;
+		manifest.chroma = chroma;
+		manifest.alpha = use_alpha;
+		manifest.color_space = color_space;
+		manifest.color_range = color_range;
+		manifest.method = method;
+		manifest.quality = videoQualityP.value.intValue;
+		manifest.bitrate = bitrateP.value.intValue;
+		manifest.two_pass = twoPassP.value.intValue;
+		manifest.kf_max_dist = config.kf_max_dist;
+		manifest.args = EncoderArgs(customArgs);
+		
+		video_codec_private = ManifestCodecPrivate(manifest);
+		
+		manifest.codec_private = HexString(video_codec_private);
+		
+		
+		if(manifest_plan)
+		{
+			// webm_merge copies frames with mkvparser, which doesn't give us the BlockAdditions
+			if(use_alpha)
+			{
+				WebMLog("Distributed export can't do alpha yet");
+			
+				return exportReturn_InternalError;
+			}
+		
+			PlanManifestChunks(manifest, options.chunks, options.manifest.c_str());
+			
+			if( !WriteManifest(manifest, options.manifest.c_str()) )
+			{
+				WebMLog("Couldn't write manifest %s", options.manifest.c_str());
+				
+				return exportReturn_InternalError;
+			}
+			
+			WebMLog("Wrote manifest %s: %d frames in %d chunks",
+					options.manifest.c_str(), manifest.frames, (int)manifest.chunks.size());
+			
+			export_video = false;
+			
+			if(!export_audio)
+				return malNoError;
+		}
+		else
+		{
+			WebMManifest job;
+			
+			if( !ReadManifest(job, options.manifest.c_str()) )
+			{
+				WebMLog("Couldn't read manifest %s", options.manifest.c_str());
+				
+				return exportReturn_InternalError;
+			}
+			
+			if( !ManifestSettingsMatch(job, manifest) || options.chunk >= (int)job.chunks.size() )
+			{
+				WebMLog("Export settings don't match manifest %s, chunk %d", options.manifest.c_str(), options.chunk);
+				
+				return exportReturn_InternalError;
+			}
+			
+			const WebMChunk &chunk = job.chunks[options.chunk];
+			
+			start_time += chunk.start * frameRateP.value.timeValue;
+			end_time = std::min<PrTime>(end_time, start_time + (chunk.frames * frameRateP.value.timeValue));
+			
+			export_audio = false;
+		}
+	}
+	
+	
+	// Adaptive bitrate ladder
+	// With --ladder, each frame we render also gets scaled down for the renditions,
+	// each encoded on its own thread into its own file next to the movie.
+	std::vector<LadderRung> ladder;
+	std::vector<std::string> ladder_paths;
+	
+	if(!options.ladder.empty() && export_video)
+	{
+		const std::string movie = OutputPath(mySettings->exportFileSuite, exportInfoP->fileObject);
+		
+		if(manifest_plan || manifest_worker)
+		{
+			WebMLog("Ladder export doesn't go with a distributed export, ignoring the ladder");
+		}
+		else if(use_alpha)
+		{
+			WebMLog("Ladder export can't do alpha yet, ignoring the ladder");
+		}
+		else if(movie.empty())
+		{
+			WebMLog("Ladder export needs the movie's path, ignoring the ladder");
+		}
+		else if( !ParseLadder(ladder, options.ladder) )
+		{
+			WebMLog("Couldn't read ladder \"%s\"", options.ladder.c_str());
+		}
+		
+		for(std::vector<LadderRung>::iterator i = ladder.begin(); i != ladder.end(); )
+		{
+			if(i->width > (unsigned int)renderParms.inWidth || i->height > (unsigned int)renderParms.inHeight)
+			{
+				WebMLog("Ladder rendition %ux%u is bigger than the movie, skipping it", i->width, i->height);
+				
+				i = ladder.erase(i);
+			}
+			else
+			{
+				ladder_paths.push_back( LadderPath(movie, *i) );
+				
+				++i;
+			}
+		}
+		
+		if(!ladder.empty())
+		{
+			// The renditions take the frames in order, so one segment.
+			// And the stats cache would only have the first pass for the movie.
+			if(options.segments > 1)
+				WebMLog("Ladder export encodes the movie in one segment");
+			
+			options.segments = 1;
+			options.stats_cache = false;
+		}
+	}
+	
+	
 	csSDK_uint32 videoRenderID = 0;
 	
-	if(exportInfoP->exportVideo)
+	if(export_video)
 	{
 		result = renderSuite->MakeVideoRenderer(exID, &videoRenderID, frameRateP.value.timeValue);
 	}
 	
 	csSDK_uint32 audioRenderID = 0;
 	
-	if(exportInfoP->exportAudio)
+	if(export_audio)
 	{
 		result = audioSuite->MakeAudioRenderer(exID,
-												exportInfoP->startTime,
+												start_time,
 												audioFormat,
 												kPrAudioSampleType_32BitFloat,
 												sampleRateP.value.floatValue, 
 												&audioRenderID);
 	}
+	
+	PremiereAudioSource audio_source(audioSuite, audioRenderID);
 
 	
-	PrMemoryPtr vbr_buffer = NULL;
-	size_t vbr_buffer_size = 0;
+	const std::string stats_spill_dir = (!options.spill_dir.empty() ? options.spill_dir : WebMTempDirectory());
 	
-	PrMemoryPtr alpha_vbr_buffer = NULL;
-	size_t alpha_vbr_buffer_size = 0;
+	StatsStore vbr_stats(stats_spill_dir, StatsMemoryBudget);
+	StatsStore alpha_vbr_stats(stats_spill_dir, StatsMemoryBudget);
+	
+	// the stats are one segment after another, these are the sizes
+	std::vector<size_t> vbr_segment_sizes;
+	std::vector<size_t> alpha_vbr_segment_sizes;
 
 
+	PremiereFile writer_file(mySettings->exportFileSuite, exportInfoP->fileObject);
 	PrMkvWriter *writer = NULL;
 
 	mkvmuxer::Segment *muxer_segment = NULL;
 	
+	FramePool *frame_pool = NULL;
+	
+	WebMWorkerPool *convert_pool = NULL;
+	
+	SegmentedEncoder *encoder_pipeline = NULL;
+	
+	AudioEncoder *audio_encoder = NULL;
+	
+	StatsCache *stats_cache = NULL;
+	bool stats_cached = false;
+	
+	FrameSpill *frame_spill = NULL;
+	
+	DeadlineGovernor *governor = NULL;
+	
+	std::vector<LadderRendition *> renditions;
+	
+	std::vector<SmartSource *> smart_sources;
+	
 			
 	try{
 	
-	const int passes = ( (exportInfoP->exportVideo && twoPassP.value.intValue) ? 2 : 1);
-	
-	for(int pass = 0; pass < passes && result == malNoError; pass++)
+	if(export_video)
 	{
-		const bool vbr_pass = (passes > 1 && pass == 0);
+		frame_pool = new FramePool(options.huge_pages, color_space, color_range); // lasts through both passes
 		
-
-		if(passes > 1)
+		convert_pool = new WebMWorkerPool(options.convert_threads > 0 ? options.convert_threads : g_num_cpus);
+	}
+	
+	const int passes = ( (export_video && twoPassP.value.intValue) ? 2 : 1);
+	
+	// The segments have to be the same for both passes
+	const int total_frames = (end_time - start_time + frameRateP.value.timeValue - 1) / frameRateP.value.timeValue;
+	
+	// Smart render
+	// The stretches we can copy become segments of their own, in between the encoded ones.
+	std::vector<SmartSpan> smart_spans;
+	std::vector<int> smart_starts;
+	int smart_encoded = 0;
+	int copied_frames = 0;
+	
+	if(export_video && !options.smart_render.empty())
+	{
+		if(manifest_plan || manifest_worker || !ladder.empty())
 		{
-			prUTF16Char utf_str[256];
-		
-			if(vbr_pass)
-				utf16ncpy(utf_str, "Analyzing video", 255);
-			else
-				utf16ncpy(utf_str, "Encoding WebM movie", 255);
-			
-			// This doesn't seem to be doing anything
-			mySettings->exportProgressSuite->SetProgressString(exID, utf_str);
+			WebMLog("Smart render doesn't go with a distributed or ladder export, encoding everything");
 		}
-		
-		
-	
-		exRatioValue fps;
-		get_framerate(ticksPerSecond, frameRateP.value.timeValue, &fps);
-		
-		
-		vpx_codec_err_t codec_err = VPX_CODEC_OK;
-		
-		vpx_codec_ctx_t encoder;
-		vpx_codec_iter_t encoder_iter = NULL;
-		
-		const uint64_t alpha_id = 1;
-		vpx_codec_ctx_t alpha_encoder;
-		vpx_codec_iter_t alpha_encoder_iter = NULL;
-		
-		unsigned long deadline = VPX_DL_GOOD_QUALITY;
-
-												
-		PrTime videoEncoderTime = exportInfoP->startTime;
-		
-		if(exportInfoP->exportVideo)
+		else if(use_alpha || bit_depth > 8 || !premiere_yuv)
 		{
-			vpx_codec_iface_t *iface = use_vp9 ? vpx_codec_vp9_cx() : vpx_codec_vp8_cx();
+			WebMLog("Smart render needs 8-bit YUV without alpha, encoding everything");
+		}
+		else
+		{
+			SmartTarget target;
 			
-			vpx_codec_enc_cfg_t config;
-			vpx_codec_enc_config_default(iface, &config, 0);
+			target.codec_id = (use_vp9 ? mkvmuxer::Tracks::kVp9CodecId : mkvmuxer::Tracks::kVp8CodecId);
+			target.width = renderParms.inWidth;
+			target.height = renderParms.inHeight;
+			target.frame_seconds = (double)frameRateP.value.timeValue / (double)ticksPerSecond;
+			target.fmt = imgfmt;
+			target.bit_depth = bit_depth;
+			target.color_space = color_space;
+			target.color_range = color_range;
 			
-			config.g_w = renderParms.inWidth;
-			config.g_h = renderParms.inHeight;
+			std::string paths = options.smart_render;
 			
-			// (only applies to VP9)
-			// Profile 0 is 4:2:0 only
-			// Profile 1 can do 4:4:4 and 4:2:2
-			// Profile 2 can do 10- and 12-bit, 4:2:0 only
-			// Profile 3 can do 10- and 12-bit, 4:4:4 and 4:2:2
-			config.g_profile = (chroma > WEBM_420 ?
+			while(!paths.empty())
+			{
+				const std::string::size_type semi = paths.find(';');
+				
+				const std::string path = paths.substr(0, semi);
+				
+				paths = (semi != std::string::npos ? paths.substr(semi + 1) : std::string());
+				
+				if(path.empty())
+					continue;
+				
+				SmartSource *source = new SmartSource;
+				
+				if( source->Open(path, target) )
+				{
+					smart_sources.push_back(source);
+				}
+				else
+				{
+					WebMLog("Smart render: %s doesn't match the export settings, skipping it", path.c_str());
+					
+					delete source;
+				}
+			}
+			
+			if(!smart_sources.empty())
+			{
+				// about a second, any less isn't worth the keyframe after it
+				const int min_frames = std::max<int>(12, ticksPerSecond / frameRateP.value.timeValue);
+				
+				// where the keyframe hashes are kept between exports
+				const std::string key_dir = (!WebMCacheDirectory().empty() ? (WebMCacheDirectory() + WebMPathSeparator + "SmartRender") :
+												std::string());
+				
+				// the frames planning rendered, for the encode
+				frame_spill = new FrameSpill((!options.spill_dir.empty() ? options.spill_dir : WebMTempDirectory()),
+												(unsigned long long)options.spill_mb * 1024 * 1024, total_frames);
+				
+				result = PlanSmartRender(smart_spans, smart_sources, key_dir, min_frames, std::max<int>(options.segments, 4),
+											total_frames, start_time, frameRateP.value.timeValue,
+											renderSuite, videoRenderID, renderParms, pixSuite, pix2Suite,
+											*frame_pool, *convert_pool, imgfmt, bit_depth, *frame_spill,
+											mySettings->exportProgressSuite, exID);
+				
+				for(size_t i=0; i < smart_spans.size(); i++)
+				{
+					smart_starts.push_back(smart_spans[i].start);
+					
+					if(smart_spans[i].source >= 0)
+						copied_frames += smart_spans[i].frames;
+					else
+						smart_encoded++;
+				}
+				
+				WebMLog("Smart render: copying %d of %d frames in %d stretches, encoding %d",
+						copied_frames, total_frames, (int)smart_spans.size() - smart_encoded, smart_encoded);
+				
+				// the first pass stats wouldn't be for the whole movie
+				if(copied_frames > 0)
+					options.stats_cache = false;
+			}
+		}
+	}
+	
+	const int segments = (copied_frames > 0 ? (int)smart_spans.size() : std::max<int>(1, std::min<int>(options.segments, total_frames)));
+	
+	const int encoded_segments = (copied_frames > 0 ? smart_encoded : segments);
+	
+	vbr_segment_sizes.resize(segments, 0);
+	alpha_vbr_segment_sizes.resize(segments, 0);
+	
+	// the timing tracks after the export thread: segments, renditions, then audio
+	timing.SetTracks(segments, (int)ladder.size());
+	
+	// the segments and ladder renditions split up the CPUs, then the plan
+	// decides how many of those each encoder can really use at its size
+	ThreadTable thread_table;
+	DefaultThreadTable(thread_table);
+	
+	if(!options.thread_table.empty())
+	{
+		if( !ReadThreadTable(thread_table, options.thread_table) )
+			WebMLog("Couldn't read thread table %s", options.thread_table.c_str());
+	}
+	else
+		ReadThreadTable(thread_table, ThreadTablePath());
+	
+	const int encoder_cores = std::max<int>(1, g_num_cpus / std::max<int>(1, encoded_segments + (int)ladder.size()));
+	
+	const ThreadPlan thread_plan = PlanThreads(thread_table, use_vp9, renderParms.inWidth, renderParms.inHeight, encoder_cores);
+	
+	if(export_video)
+	{
+		WebMLog("Encoder threads: %d, tile columns: %d, tile rows: %d, row-MT: %d, token partitions: %d",
+				thread_plan.threads, (1 << thread_plan.tile_columns), (1 << thread_plan.tile_rows),
+				(thread_plan.row_mt ? 1 : 0), (1 << thread_plan.token_partitions));
+	}
+	
+	std::vector<ThreadPlan> ladder_plans;
+	
+	if(export_video)
+	{
+		for(int r=0; r < (int)ladder.size(); r++)
+		{
+			ladder_plans.push_back( PlanThreads(thread_table, use_vp9, ladder[r].width, ladder[r].height, encoder_cores) );
+			
+			renditions.push_back( new LadderRendition(ladder[r], *frame_pool, timing, segments + 1 + r) );
+			
+			WebMLog("Ladder rendition %ux%u at %u kbps, %d encoder threads: %s",
+					ladder[r].width, ladder[r].height, ladder[r].bitrate, ladder_plans[r].threads, ladder_paths[r].c_str());
+		}
+	}
+	
+	
+	// Premiere's 16-bit YUV skips the RGB conversion, if it passes
+	if(export_video && bit_depth > 8 && !use_alpha && premiere_yuv)
+	{
+		const PrTime middle = start_time + ((PrTime)(total_frames / 2) * frameRateP.value.timeValue);
+		
+		if( ValidateYUV16(middle, renderSuite, videoRenderID, renderParms, pixSuite, pix2Suite,
+							*frame_pool, *convert_pool, imgfmt, bit_depth) )
+		{
+			pixelFormats[0] = PrPixelFormat_VUYA_4444_16u;
+			
+			WebMLog("16-bit YUV: matches BGRA, rendering YUV");
+		}
+	}
+	
+	
+	// the analysis pass gets this much of the progress bar
+	const float firstpass_frac = (use_vp9 ? 0.1f : 0.3f);
+	
+	
+	// Render once
+	// The analysis pass keeps its frames on disk for the second pass, up to the budget.
+	// Smart render already has a spill, for the frames it rendered.
+	if(passes == 2 && options.render_once && frame_spill == NULL)
+	{
+		frame_spill = new FrameSpill((!options.spill_dir.empty() ? options.spill_dir : WebMTempDirectory()),
+										(unsigned long long)options.spill_mb * 1024 * 1024, total_frames);
+	}
+	
+	
+	// Two-pass stats cache
+	// The key is everything that goes into the first pass except the bitrate,
+	// plus a hash of a few frames.  On a hit, every frame gets rendered and
+	// hashed in place of the analysis pass, and only if they're all the frames
+	// the stats were made from do we skip to the second pass.  Otherwise the
+	// entry is stale and we do the analysis after all.  The frames we checked
+	// are spilled either way, so they don't get rendered again.
+	WebMHash stats_key = 0;
+	
+	if(passes == 2 && options.stats_cache && result == malNoError)
+	{
+		const std::string dir = (!options.stats_cache_dir.empty() ? options.stats_cache_dir :
+									!WebMCacheDirectory().empty() ? (WebMCacheDirectory() + WebMPathSeparator + "FirstPass") :
+									std::string());
+		
+		if(!dir.empty())
+		{
+			stats_cache = new StatsCache(dir, (unsigned long long)options.stats_cache_mb * 1024 * 1024, options.stats_cache_days);
+			
+			exRatioValue fps;
+			get_framerate(ticksPerSecond, frameRateP.value.timeValue, &fps);
+			
+			std::stringstream key;
+			
+			key << vpx_codec_version_str() << " " << codecP.value.intValue << " " <<
+				renderParms.inWidth << "x" << renderParms.inHeight << " " <<
+				renderParms.inRenderQuality << " " << renderParms.inFieldType << " " <<
+				fps.numerator << "/" << fps.denominator << " " << total_frames << " " <<
+				bit_depth << " " << chroma << " " << use_alpha << " " <<
+				method << " " << videoQualityP.value.intValue << " " <<
+				keyframeMaxDistanceP.value.intValue << " " << segments << " " <<
+				thread_plan.threads << " " << thread_plan.tile_columns << " " << thread_plan.tile_rows << " " <<
+				thread_plan.row_mt << " " << thread_plan.token_partitions << " " <<
+				EncoderArgs(customArgs);
+			
+			const std::string key_string = key.str();
+			
+			WebMHash probe_hash = 0;
+			
+			result = ProbeFrames(probe_hash, total_frames, 8, start_time, frameRateP.value.timeValue,
+									renderSuite, videoRenderID, renderParms, pixSuite, pix2Suite,
+									*frame_pool, *convert_pool, imgfmt, bit_depth, use_alpha,
+									NULL, NULL, exID, 0.f);
+			
+			stats_key = HashCombine(HashBytes(key_string.c_str(), key_string.size(), 0), probe_hash);
+			
+			StatsCacheEntry entry;
+			
+			bool hit = (result == malNoError && stats_cache->Lookup(stats_key, entry) &&
+						(int)entry.segment_sizes.size() == segments &&
+						(!use_alpha || entry.alpha_stats.size() > 0));
+			
+			if(hit)
+			{
+				// every frame gets rendered to check them, so keep them for the second pass
+				if(frame_spill == NULL)
+				{
+					frame_spill = new FrameSpill((!options.spill_dir.empty() ? options.spill_dir : WebMTempDirectory()),
+													(unsigned long long)options.spill_mb * 1024 * 1024, total_frames);
+				}
+				
+				WebMHash content = 0;
+				
+				result = ProbeFrames(content, total_frames, total_frames, start_time, frameRateP.value.timeValue,
+										renderSuite, videoRenderID, renderParms, pixSuite, pix2Suite,
+										*frame_pool, *convert_pool, imgfmt, bit_depth, use_alpha,
+										frame_spill, mySettings->exportProgressSuite, exID, firstpass_frac);
+				
+				if(result == malNoError && content != entry.content)
+				{
+					stats_cache->Stale(stats_key);
+					
+					WebMLog("Cached first pass stats were for different frames, removed them");
+					
+					hit = false; // the frames we checked are still good for the analysis pass
+				}
+			}
+			
+			if(hit && result == malNoError)
+			{
+				vbr_stats.Reserve(entry.stats.size());
+				
+				if( !vbr_stats.Append(&entry.stats[0], entry.stats.size()) )
+					result = exportReturn_ErrMemory;
+				
+				vbr_segment_sizes = entry.segment_sizes;
+				
+				if(use_alpha && result == malNoError)
+				{
+					alpha_vbr_stats.Reserve(entry.alpha_stats.size());
+					
+					if( !alpha_vbr_stats.Append(&entry.alpha_stats[0], entry.alpha_stats.size()) )
+						result = exportReturn_ErrMemory;
+					
+					alpha_vbr_segment_sizes = entry.alpha_segment_sizes;
+				}
+				
+				stats_cached = (result == malNoError);
+			}
+		}
+	}
+	
+	
+	for(int pass = (stats_cached ? 1 : 0); pass < passes && result == malNoError; pass++)
+	{
+		const bool vbr_pass = (passes > 1 && pass == 0);
+		
+
+		if(passes > 1)
+		{
+			prUTF16Char utf_str[256];
+		
+			if(vbr_pass)
+				utf16ncpy(utf_str, "Analyzing video", 255);
+			else
+				utf16ncpy(utf_str, "Encoding WebM movie", 255);
+			
+			// This doesn't seem to be doing anything
+			mySettings->exportProgressSuite->SetProgressString(exID, utf_str);
+		}
+		
+		
+	
+		exRatioValue fps;
+		get_framerate(ticksPerSecond, frameRateP.value.timeValue, &fps);
+		
+		
+		vpx_codec_err_t codec_err = VPX_CODEC_OK;
+		
+		// a pair of encoders for every segment
+		std::vector<vpx_codec_ctx_t> encoders(segments);
+		int encoders_made = 0;
+		
+		const uint64_t alpha_id = 1;
+		std::vector<vpx_codec_ctx_t> alpha_encoders(segments);
+		int alpha_encoders_made = 0;
+		
+		PassEncoders pass_encoders(encoder_pipeline, encoders, encoders_made, alpha_encoders, alpha_encoders_made);
+		
+		std::vector<int> vbr_segment_packets(segments, 0);
+		
+		// every frame's hash, for the stats cache
+		WebMHash pass_content = 0;
+		
+		unsigned long deadline = VPX_DL_GOOD_QUALITY;
+
+		
+		if(export_video)
+		{
+			vpx_codec_iface_t *iface = use_vp9 ? vpx_codec_vp9_cx() : vpx_codec_vp8_cx();
+			
+			vpx_codec_enc_cfg_t config;
+			vpx_codec_enc_config_default(iface, &config, 0);
+			
+			config.g_w = renderParms.inWidth;
+			config.g_h = renderParms.inHeight;
+			
+			// (only applies to VP9)
+			// Profile 0 is 4:2:0 only
+			// Profile 1 can do 4:4:4 and 4:2:2
+			// Profile 2 can do 10- and 12-bit, 4:2:0 only
+			// Profile 3 can do 10- and 12-bit, 4:4:4 and 4:2:2
+			config.g_profile = (chroma > WEBM_420 ?
 									(bit_depth > 8 ? 3 : 1) :
 									(bit_depth > 8 ? 2 : 0) );
 			
@@ -1322,10 +2144,7 @@ exSDKExport(
 				}
 				else
 				{
-					config.g_pass = VPX_RC_LAST_PASS;
-					
-					config.rc_twopass_stats_in.buf = vbr_buffer;
-					config.rc_twopass_stats_in.sz = vbr_buffer_size;
+					config.g_pass = VPX_RC_LAST_PASS; // stats get set for each segment below
 				}
 			}
 			else
@@ -1335,7 +2154,7 @@ exSDKExport(
 			config.rc_target_bitrate = bitrateP.value.intValue;
 			
 			
-			config.g_threads = g_num_cpus;
+			config.g_threads = thread_plan.threads;
 			
 			config.g_timebase.num = fps.denominator;
 			config.g_timebase.den = fps.numerator;
@@ -1347,6 +2166,20 @@ exSDKExport(
 			
 			assert(config.kf_max_dist >= config.kf_min_dist);
 			
+			// fixed keyframes, so they're at the same frames in every rendition
+			if(!renditions.empty())
+				config.kf_min_dist = config.kf_max_dist;
+			
+			// starts where the encoders start, cpu-used is set in ConfigureEncoderControls()
+			if(options.finish_in > 0 && governor == NULL)
+			{
+				const int cpu_used = (options.cpu_used != WEBM_CPU_USED_DEFAULT ? options.cpu_used :
+										use_vp9 ? 2 : 0); // VP8's default
+			
+				governor = new DeadlineGovernor(export_start + options.finish_in, use_vp9, (passes == 2),
+												deadline, cpu_used, std::max<int>(1, encoded_segments));
+			}
+			
 			
 			vpx_codec_enc_cfg_t alpha_config = config;
 			
@@ -1357,61 +2190,156 @@ exSDKExport(
 				alpha_config.rc_target_bitrate = config.rc_target_bitrate / 3;
 				
 				config.rc_target_bitrate = config.rc_target_bitrate * 2 / 3;
-				
-				if(passes == 2 && !vbr_pass)
-				{
-					config.rc_twopass_stats_in.buf = alpha_vbr_buffer;
-					config.rc_twopass_stats_in.sz = alpha_vbr_buffer_size;
-				}
 			}
 			
 			
 			const vpx_codec_flags_t flags = (config.g_bit_depth == VPX_BITS_8 ? 0 : VPX_CODEC_USE_HIGHBITDEPTH);
 			
-			codec_err = vpx_codec_enc_init(&encoder, iface, &config, flags);
 			
-			if(use_alpha && codec_err == VPX_CODEC_OK)
+			encoder_pipeline = (copied_frames > 0 ? new SegmentedEncoder(total_frames, smart_starts) :
+													new SegmentedEncoder(total_frames, segments));
+			
+			assert(encoder_pipeline->Segments() == segments);
+			
+			size_t vbr_offset = 0;
+			size_t alpha_vbr_offset = 0;
+			
+			// all the first pass stats in one piece, in memory or mapped from the temp file
+			char *vbr_data = NULL;
+			char *alpha_vbr_data = NULL;
+			
+			if(passes == 2 && !vbr_pass)
 			{
-				codec_err = vpx_codec_enc_init(&alpha_encoder, iface, &alpha_config, flags);
+				vbr_data = vbr_stats.Data();
+				
+				if(vbr_data == NULL)
+					codec_err = VPX_CODEC_MEM_ERROR;
+				
+				if(use_alpha)
+				{
+					alpha_vbr_data = alpha_vbr_stats.Data();
+					
+					if(alpha_vbr_data == NULL)
+						codec_err = VPX_CODEC_MEM_ERROR;
+				}
+				
+				if(vbr_stats.Spilled())
+					WebMLog("First pass stats: %.1f MB, read from a temp file", (double)vbr_stats.Size() / (1024.0 * 1024.0));
 			}
 			
-			
-			if(codec_err == VPX_CODEC_OK)
+			for(int s=0; s < segments && codec_err == VPX_CODEC_OK; s++)
 			{
-				if(method == WEBM_METHOD_CONSTANT_QUALITY || method == WEBM_METHOD_CONSTRAINED_QUALITY)
+				// the analysis pass just skips over what gets copied
+				if(copied_frames > 0 && smart_spans[s].source >= 0)
 				{
-					const int min_q = config.rc_min_quantizer;
-					const int max_q = config.rc_max_quantizer;
+					encoder_pipeline->CopySegment(s, (vbr_pass ? NULL :
+														new SmartPacketSource(*smart_sources[smart_spans[s].source], smart_spans[s])));
 					
-					// CQ Level should be between min_q and max_q
-					const int cq_level = (min_q + max_q) / 2;
+					continue;
+				}
+				
+				// copied segments don't get encoders, so these aren't always segment s
+				vpx_codec_ctx_t &encoder = encoders[encoders_made];
+				vpx_codec_ctx_t &alpha_encoder = alpha_encoders[alpha_encoders_made];
 				
-					vpx_codec_control(&encoder, VP8E_SET_CQ_LEVEL, cq_level);
+				if(passes == 2 && !vbr_pass)
+				{
+					// this segment's part of the first pass stats
+					config.rc_twopass_stats_in.buf = vbr_data + vbr_offset;
+					config.rc_twopass_stats_in.sz = vbr_segment_sizes[s];
+					
+					vbr_offset += vbr_segment_sizes[s];
 					
 					if(use_alpha)
-						vpx_codec_control(&alpha_encoder, VP8E_SET_CQ_LEVEL, cq_level);
+					{
+						alpha_config.rc_twopass_stats_in.buf = alpha_vbr_data + alpha_vbr_offset;
+						alpha_config.rc_twopass_stats_in.sz = alpha_vbr_segment_sizes[s];
+						
+						alpha_vbr_offset += alpha_vbr_segment_sizes[s];
+					}
 				}
 				
-				if(use_vp9)
+				codec_err = vpx_codec_enc_init(&encoder, iface, &config, flags);
+				
+				if(codec_err == VPX_CODEC_OK)
+					encoders_made++;
+				
+				if(use_alpha && codec_err == VPX_CODEC_OK)
 				{
-					vpx_codec_control(&encoder, VP8E_SET_CPUUSED, 2); // much faster if we do this
+					codec_err = vpx_codec_enc_init(&alpha_encoder, iface, &alpha_config, flags);
 					
-					vpx_codec_control(&encoder, VP9E_SET_TILE_COLUMNS, mylog2(g_num_cpus)); // this gives us some multithreading
-					vpx_codec_control(&encoder, VP9E_SET_FRAME_PARALLEL_DECODING, 1);
+					if(codec_err == VPX_CODEC_OK)
+						alpha_encoders_made++;
+				}
+				
+				
+				if(codec_err == VPX_CODEC_OK)
+				{
+					ConfigureEncoderControls(&encoder, config, use_vp9, method, thread_plan, customArgs);
 					
 					if(use_alpha)
 					{
-						vpx_codec_control(&alpha_encoder, VP8E_SET_CPUUSED, 2);
+						ConfigureEncoderControls(&alpha_encoder, alpha_config, use_vp9, method, thread_plan, customArgs);
 						
-						vpx_codec_control(&alpha_encoder, VP9E_SET_TILE_COLUMNS, mylog2(g_num_cpus));
-						vpx_codec_control(&alpha_encoder, VP9E_SET_FRAME_PARALLEL_DECODING, 1);
+						// VP8 alt-refs are invisible frames of their own, and an alpha one
+						// can't be muxed unless the color encoder made one at the same time
+						if(!use_vp9)
+							vpx_codec_control(&alpha_encoder, VP8E_SET_ENABLEAUTOALTREF, 0);
 					}
+					
+					
+					encoder_pipeline->SetPipeline(s, new EncoderPipeline(&encoder, (use_alpha ? &alpha_encoder : NULL),
+																			*frame_pool, deadline, options.render_ahead, governor,
+																			timing, s + 1));
 				}
+			}
 			
-				ConfigureEncoderPost(&encoder, customArgs);
+			if(codec_err == VPX_CODEC_OK)
+			{
+				if(governor != NULL)
+					governor->StartPass(total_frames - copied_frames, !vbr_pass);
 				
-				if(use_alpha)
-					ConfigureEncoderPost(&alpha_encoder, customArgs);
+				if( !encoder_pipeline->Start() )
+					codec_err = VPX_CODEC_ERROR;
+			}
+			
+			
+			LadderTrack ladder_track;
+			
+			ladder_track.codec_id = (use_vp9 ? mkvmuxer::Tracks::kVp9CodecId : mkvmuxer::Tracks::kVp8CodecId);
+			ladder_track.frame_rate = (double)fps.numerator / (double)fps.denominator;
+			ladder_track.ticks_per_frame = frameRateP.value.timeValue;
+			ladder_track.ticks_per_second = ticksPerSecond;
+			ladder_track.display_aspect = ((double)renderParms.inWidth * (double)renderParms.inPixelAspectRatioNumerator) /
+											((double)renderParms.inHeight * (double)renderParms.inPixelAspectRatioDenominator);
+			ladder_track.bit_depth = bit_depth;
+			ladder_track.chroma_subsampling_horz = (chroma == WEBM_444 ? 0 : 1);
+			ladder_track.chroma_subsampling_vert = (chroma == WEBM_420 ? 1 : 0);
+			ladder_track.color_space = color_space;
+			ladder_track.color_range = color_range;
+			
+			for(size_t r=0; r < renditions.size() && codec_err == VPX_CODEC_OK; r++)
+			{
+				LadderRendition &rendition = *renditions[r];
+				
+				vpx_codec_enc_cfg_t rendition_config = config;
+				
+				rendition_config.g_threads = ladder_plans[r].threads;
+				
+				codec_err = rendition.InitEncoder(iface, rendition_config, flags);
+				
+				if(codec_err == VPX_CODEC_OK)
+				{
+					ConfigureEncoderControls(rendition.Encoder(), rendition_config, use_vp9, method, ladder_plans[r], customArgs);
+					
+					// the analysis pass doesn't make a file
+					if( !rendition.Start(deadline, options.render_ahead, (vbr_pass ? std::string() : ladder_paths[r]), ladder_track) )
+					{
+						WebMLog("Couldn't start ladder rendition %s", ladder_paths[r].c_str());
+						
+						codec_err = VPX_CODEC_ERROR;
+					}
+				}
 			}
 		}
 		
@@ -1424,28 +2352,17 @@ exSDKExport(
 		vorbis_comment vc;
 		vorbis_dsp_state vd;
 		vorbis_block vb;
-		ogg_packet op;
-		
-		bool packet_waiting = false;
-		op.granulepos = 0;
-		op.packet = NULL;
-		op.bytes = 0;
-		
 		OpusMSEncoder *opus = NULL;
-		float *opus_buffer = NULL;
-		unsigned char *opus_compressed_buffer = NULL;
-		opus_int32 opus_compressed_buffer_size = 0;
 		int opus_pre_skip = 0;
 										
 		int opus_frame_size = 960;
-		float *pr_audio_buffer[6] = {NULL, NULL, NULL, NULL, NULL, NULL};
 		
 		size_t private_size = 0;
 		void *private_data = NULL;
 		
 		csSDK_int32 maxBlip = 100;
 		
-		if(exportInfoP->exportAudio && !vbr_pass)
+		if(export_audio && !vbr_pass)
 		{
 			mySettings->sequenceAudioSuite->GetMaxBlip(audioRenderID, frameRateP.value.timeValue, &maxBlip);
 			
@@ -1549,12 +2466,6 @@ exSDKExport(
 					{
 						opus_frame_size *= 2;
 					}
-					
-					opus_buffer = (float *)malloc(sizeof(float) * audioChannels * opus_frame_size);
-					
-					opus_compressed_buffer_size = sizeof(float) * audioChannels * opus_frame_size * 2; // why not?
-					
-					opus_compressed_buffer = (unsigned char *)malloc(opus_compressed_buffer_size);
 				}
 				else
 					v_err = (err != 0 ? err : -1);
@@ -1615,12 +2526,7 @@ exSDKExport(
 					opus_frame_size = maxBlip;
 				}
 				else
-					exportInfoP->exportAudio = kPrFalse;
-			}
-			
-			for(int i=0; i < audioChannels; i++)
-			{
-				pr_audio_buffer[i] = (float *)malloc(sizeof(float) * opus_frame_size);
+					export_audio = false;
 			}
 		}
 		
@@ -1638,7 +2544,7 @@ exSDKExport(
 			
 			if(!vbr_pass)
 			{
-				writer = new PrMkvWriter(mySettings->exportFileSuite, exportInfoP->fileObject);
+				writer = new PrMkvWriter(writer_file, options.write_buffers, timing);
 				
 				muxer_segment = new mkvmuxer::Segment;
 				
@@ -1669,7 +2575,7 @@ exSDKExport(
 				assert(!muxer_segment->estimate_file_duration());
 				
 		
-				if(exportInfoP->exportVideo)
+				if(export_video)
 				{
 					vid_track = muxer_segment->AddVideoTrack(renderParms.inWidth, renderParms.inHeight, 1);
 					
@@ -1691,6 +2597,14 @@ exSDKExport(
 						video->set_display_height(renderParms.inHeight);
 					}
 					
+					if(!video_codec_private.empty())
+					{
+						bool copied = video->SetCodecPrivate(&video_codec_private[0], video_codec_private.size());
+						
+						if(!copied)
+							result = exportReturn_InternalError;
+					}
+					
 					if(use_alpha)
 					{
 						video->SetAlphaMode(mkvmuxer::VideoTrack::kAlpha);
@@ -1714,17 +2628,22 @@ exSDKExport(
 					color.set_chroma_subsampling_horz(horizontal_subsampling);
 					color.set_chroma_subsampling_vert(vertical_subsampling);
 					
-					// don't want to presume
-					//color.set_matrix_coefficients(mkvmuxer::Colour::kBt709);
-					//color.set_range(mkvmuxer::Colour::kBroadcastRange);
+					// don't want to presume, only the matrix and range the frames were converted with
+					// if the user picked them
 					//color.set_transfer_characteristics(mkvmuxer::Colour::kIturBt709Tc);
 					//color.set_primaries(mkvmuxer::Colour::kIturBt709P);
 					
+					if(WebMMatroskaMatrix(color_space) >= 0)
+						color.set_matrix_coefficients( WebMMatroskaMatrix(color_space) );
+					
+					if(WebMMatroskaRange(color_space, color_range) >= 0)
+						color.set_range( WebMMatroskaRange(color_space, color_range) );
+					
 					video->SetColour(color);
 				}
 				
 				
-				if(exportInfoP->exportAudio)
+				if(export_audio)
 				{
 					if(audioCodecP.value.intValue == WEBM_CODEC_OPUS)
 					{
@@ -1758,13 +2677,11 @@ exSDKExport(
 						free(private_data);
 					}
 
-					if(!exportInfoP->exportVideo)
+					if(!export_video)
 						muxer_segment->CuesTrack(audio_track);
 				}
 			}
 			
-			PrAudioSample currentAudioSample = 0;
-
 			// Here's a question: what do we do when the number of audio samples doesn't match evenly
 			// with the number of frames?  This could especially happen when the user changes the frame
 			// rate to something other than what Premiere is using to specify the out time.  So you could
@@ -1772,17 +2689,40 @@ exSDKExport(
 			// that frame.  What to do?  We could extend the movie duration to the whole frame, but right now
 			// we'll just encode the amount of audio originally requested.  One ramification is that you could
 			// be done encoding all your audio but still have a final frame to encode.
-			const PrAudioSample endAudioSample = (exportInfoP->endTime - exportInfoP->startTime) /
+			const PrAudioSample endAudioSample = (end_time - start_time) /
 													(ticksPerSecond / (PrAudioSample)sampleRateP.value.floatValue);
 													
 			assert(ticksPerSecond % (PrAudioSample)sampleRateP.value.floatValue == 0);
 			
+			
+			// the audio gets pulled and encoded on its own thread from here on
+			if(export_audio && !vbr_pass)
+			{
+				const int audio_timing_track = segments + 1 + (int)ladder.size();
+				
+				if(audioCodecP.value.intValue == WEBM_CODEC_OPUS)
+				{
+					audio_encoder = new AudioEncoder(opus, opus_frame_size, maxBlip,
+														audio_source, audioChannels, (int)sampleRateP.value.floatValue, endAudioSample + opus_pre_skip,
+														AudioQueueDepth, timing, audio_timing_track);
+				}
+				else
+				{
+					audio_encoder = new AudioEncoder(&vd, &vb, opus_frame_size,
+														audio_source, audioChannels, (int)sampleRateP.value.floatValue, endAudioSample,
+														AudioQueueDepth, timing, audio_timing_track);
+				}
+				
+				if( !audio_encoder->Start() )
+					result = exportReturn_InternalError;
+			}
+			
 		
-			PrTime videoTime = exportInfoP->startTime;
+			PrTime videoTime = start_time;
 			
-			while(videoTime <= exportInfoP->endTime && result == malNoError)
+			while(videoTime <= end_time && result == malNoError)
 			{
-				const PrTime fileTime = videoTime - exportInfoP->startTime;
+				const PrTime fileTime = videoTime - start_time;
 				
 				// Time (in nanoseconds) = TimeCode * TimeCodeScale.
 				const uint64_t timeCode = ((fileTime * (S2NS / timeCodeScale)) + (ticksPerSecond / 2)) / ticksPerSecond;
@@ -1795,256 +2735,155 @@ exSDKExport(
 				// but they may not be ready to produce output right away.  So what we do is keep
 				// feeding in the data until the output we want is produced.
 				
-				if(exportInfoP->exportAudio && !vbr_pass)
+				if(export_audio && !vbr_pass)
 				{
-					// Premiere uses Left, Right, Left Rear, Right Rear, Center, LFE
-					// Opus and Vorbis use Left, Center, Right, Left Read, Right Rear, LFE
-					// http://www.xiph.org/vorbis/doc/Vorbis_I_spec.html#x1-800004.3.9
-					static const int stereo_swizzle[] = {0, 1, 0, 1, 0, 1};
-					static const int surround_swizzle[] = {0, 4, 1, 2, 3, 5};
+					assert(audio_encoder != NULL);
 					
-					const int *swizzle = (audioChannels > 2 ? surround_swizzle : stereo_swizzle);
+					const bool last_frame = (videoTime > (end_time - frameRateP.value.timeValue));
 					
+					// the audio thread is usually ahead of us, if not we wait for it, filling the blocks it asks for
+					const uint64_t audio_up_to = (last_frame ? std::numeric_limits<uint64_t>::max() : timeStamp);
 					
-					const bool last_frame = (videoTime > (exportInfoP->endTime - frameRateP.value.timeValue));
-							
-					if(audioCodecP.value.intValue == WEBM_CODEC_OPUS)
+					while(result == malNoError)
 					{
-						assert(opus != NULL);
+						AudioPacket *audio_pkt = audio_encoder->Next(audio_up_to);
+						
+						if(audio_pkt == NULL)
+							break;
 						
-						uint64_t opus_timeStamp = currentAudioSample * S2NS / (uint64_t)sampleRateP.value.floatValue;
+						timing.Begin(TIMING_MUX);
 						
-						while(((opus_timeStamp <= timeStamp) || last_frame) && currentAudioSample < (endAudioSample + opus_pre_skip) && result == malNoError)
+						bool added = false;
+						
+						if(audio_pkt->discard_padding > 0)
 						{
-							const int samples = opus_frame_size;
-							
-							result = audioSuite->GetAudio(audioRenderID, samples, pr_audio_buffer, false);
-							
-							if(result == malNoError)
-							{
-								for(int i=0; i < samples; i++)
-								{
-									for(int c=0; c < audioChannels; c++)
-									{
-										opus_buffer[(i * audioChannels) + c] = pr_audio_buffer[swizzle[c]][i];
-									}
-								}
-								
-								int len = opus_multistream_encode_float(opus, opus_buffer, opus_frame_size,
-																			opus_compressed_buffer, opus_compressed_buffer_size);
-								
-								if(len > 0)
-								{
-									bool added = false;
-									
-									if((currentAudioSample + samples) > (endAudioSample + opus_pre_skip))
-									{
-										const int64_t discardPaddingSamples = (currentAudioSample + samples) - (endAudioSample + opus_pre_skip);
-										const int64_t discardPadding = discardPaddingSamples * S2NS / (int64_t)sampleRateP.value.floatValue;
-										
-										added = muxer_segment->AddFrameWithDiscardPadding(opus_compressed_buffer, len,
-																		discardPadding, audio_track, opus_timeStamp, true);
-									}
-									else
-									{
-										added = muxer_segment->AddFrame(opus_compressed_buffer, len,
-																			audio_track, opus_timeStamp, true);
-									}
-																			
-									if(!added)
-										result = exportReturn_InternalError;
-								}
-								else if(len < 0)
-									result = exportReturn_InternalError;
-								
-								
-								currentAudioSample += samples;
-								
-								opus_timeStamp = currentAudioSample * S2NS / (uint64_t)sampleRateP.value.floatValue;
-							}
+							added = muxer_segment->AddFrameWithDiscardPadding((const uint8_t *)audio_pkt->buf, audio_pkt->sz,
+																		audio_pkt->discard_padding, audio_track, audio_pkt->timestamp, true);
 						}
-					}
-					else
-					{
-						uint64_t op_timeStamp = op.granulepos * S2NS / (uint64_t)sampleRateP.value.floatValue;
-					
-						while(op_timeStamp <= timeStamp && op.granulepos < endAudioSample && result == malNoError)
-						{	
-							// We don't know what samples are in the packet until we get it,
-							// but by then it's too late to decide if we don't want it for this frame.
-							// So we'll hold on to that packet and use it next frame.
-							if(packet_waiting && op.packet != NULL && op.bytes > 0)
-							{
-								bool added = muxer_segment->AddFrame(op.packet, op.bytes,
-																	audio_track, op_timeStamp, true);
-																		
-								if(added)
-									packet_waiting = false;
-								else
-									result = exportReturn_InternalError;
-							}
-							
-							
-							// push out packets
-							while(vorbis_analysis_blockout(&vd, &vb) == 1 && result == malNoError)
-							{
-								vorbis_analysis(&vb, NULL);
-								vorbis_bitrate_addblock(&vb);
-								
-								while(vorbis_bitrate_flushpacket(&vd, &op) && result == malNoError)
-								{
-									assert(!packet_waiting);
-									
-									op_timeStamp = op.granulepos * S2NS / (uint64_t)sampleRateP.value.floatValue;
-									
-									if(op_timeStamp <= timeStamp || last_frame)
-									{
-										bool added = muxer_segment->AddFrame(op.packet, op.bytes,
-																			audio_track, op_timeStamp, true);
-																				
-										if(!added)
-											result = exportReturn_InternalError;
-									}
-									else
-										packet_waiting = true;
-								}
-								
-								if(packet_waiting)
-									break;
-							}
-							
-							
-							if(packet_waiting)
-								break;
-							
-							
-							// make new packets
-							if(op_timeStamp <= timeStamp && op.granulepos < endAudioSample && result == malNoError)
-							{
-								int samples = opus_frame_size; // opus_frame_size is also the size of our buffer in samples
-								
-								assert(samples == maxBlip);
-								
-								assert(currentAudioSample <= endAudioSample); // so samples won't be negative
-								
-								if(samples > (endAudioSample - currentAudioSample))
-									samples = (endAudioSample - currentAudioSample);
-									
-								if(samples > 0)
-								{
-									float **buffer = vorbis_analysis_buffer(&vd, samples);
-									
-									result = audioSuite->GetAudio(audioRenderID, samples, pr_audio_buffer, false);
-									
-									for(int c=0; c < audioChannels; c++)
-									{
-										for(int i=0; i < samples; i++)
-										{
-											buffer[c][i] = pr_audio_buffer[swizzle[c]][i];
-										}
-									}
-								}
-								
-								currentAudioSample += samples;
-								
-								
-								if(result == malNoError)
-								{
-									vorbis_analysis_wrote(&vd, samples);
-									
-									if(currentAudioSample >= endAudioSample)
-										vorbis_analysis_wrote(&vd, NULL); // we have sent everything in
-								}
-							}
+						else
+						{
+							added = muxer_segment->AddFrame((const uint8_t *)audio_pkt->buf, audio_pkt->sz,
+																audio_track, audio_pkt->timestamp, true);
 						}
+						
+						timing.End(TIMING_MUX);
+						
+						delete audio_pkt;
+						
+						if(!added)
+							result = exportReturn_InternalError;
 					}
+					
+					if(result == malNoError && audio_encoder->Error())
+						result = (audio_source.Result() != malNoError ? audio_source.Result() : exportReturn_InternalError);
 				}
 				
 				
-				if(exportInfoP->exportVideo && (videoTime < exportInfoP->endTime)) // there will some audio after the last video frame
+				if(export_video && (videoTime < end_time)) // there will some audio after the last video frame
 				{
+					// The encoders run on their own threads, pulling frames out of queues.
+					// We keep rendering ahead until the queues fill up, muxing packets
+					// as they come back out, until we have the one for this frame.
+					// With segments, the frames we render may be far ahead of this one.
 					bool made_frame = false;
 					
-					const vpx_codec_cx_pkt_t *pkt = NULL;
-					const vpx_codec_cx_pkt_t *alpha_pkt = NULL;
-					
 					while(!made_frame && result == suiteError_NoError)
 					{
-						if(pkt == NULL)
-							pkt = vpx_codec_get_cx_data(&encoder, &encoder_iter);
-							
-						if(use_alpha && alpha_pkt == NULL)
-							alpha_pkt = vpx_codec_get_cx_data(&alpha_encoder, &alpha_encoder_iter);
-					
-						if(pkt != NULL && (!use_alpha || alpha_pkt != NULL))
+						EncodedPacket *pkt = NULL;
+						EncodedPacket *alpha_pkt = NULL;
+						
+						int segment = 0;
+						
+						if( encoder_pipeline->GetPacket(pkt, alpha_pkt, segment) )
 						{
 							if(pkt->kind == VPX_CODEC_STATS_PKT)
 							{
 								assert(vbr_pass);
 							
-								if(vbr_buffer_size == 0)
-									vbr_buffer = memorySuite->NewPtr(pkt->data.twopass_stats.sz);
-								else
-									memorySuite->SetPtrSize(&vbr_buffer, vbr_buffer_size + pkt->data.twopass_stats.sz);
+								// the stats packets are all the same size, one for every frame and a summary for each segment
+								if(vbr_stats.Size() == 0)
+									vbr_stats.Reserve(pkt->sz * (total_frames + segments));
 								
-								memcpy(&vbr_buffer[vbr_buffer_size], pkt->data.twopass_stats.buf, pkt->data.twopass_stats.sz);
+								if( !vbr_stats.Append(pkt->buf, pkt->sz) )
+									result = exportReturn_ErrMemory;
 								
-								vbr_buffer_size += pkt->data.twopass_stats.sz;
+								vbr_segment_sizes[segment] += pkt->sz;
 								
-								made_frame = true;
+								// Each segment's stats end with a summary packet that doesn't go with a frame.
+								// If that was the last VBR packet, we have to wait for the summary packet,
+								// so go through the loop until the encoder is drained
+								const bool summary_packet = (vbr_segment_packets[segment]++ == encoder_pipeline->SegmentFrames(segment));
+								
+								if(encoder_pipeline->FramesLeft() && !summary_packet)
+									made_frame = true;
 								
 								if(use_alpha)
 								{
 									assert(alpha_pkt->kind == VPX_CODEC_STATS_PKT);
 									
-									if(alpha_vbr_buffer_size == 0)
-										alpha_vbr_buffer = memorySuite->NewPtr(alpha_pkt->data.twopass_stats.sz);
-									else
-										memorySuite->SetPtrSize(&alpha_vbr_buffer, alpha_vbr_buffer_size + alpha_pkt->data.twopass_stats.sz);
+									if(alpha_vbr_stats.Size() == 0)
+										alpha_vbr_stats.Reserve(alpha_pkt->sz * (total_frames + segments));
 									
-									memcpy(&alpha_vbr_buffer[alpha_vbr_buffer_size], alpha_pkt->data.twopass_stats.buf, alpha_pkt->data.twopass_stats.sz);
+									if( !alpha_vbr_stats.Append(alpha_pkt->buf, alpha_pkt->sz) )
+										result = exportReturn_ErrMemory;
 									
-									alpha_vbr_buffer_size += alpha_pkt->data.twopass_stats.sz;
+									alpha_vbr_segment_sizes[segment] += alpha_pkt->sz;
 								}
 							}
 							else if(pkt->kind == VPX_CODEC_CX_FRAME_PKT)
 							{
+								// With lag-in-frames the packets come out long after their frames went in,
+								// so the block time comes from the packet.  Invisible frames (VP8 alt-refs)
+								// have the pts of the frame they go in front of, and no duration.
+								const PrTime pktFileTime = pkt->pts * frameRateP.value.timeValue;
+								
+								const uint64_t pktTimeStamp = (((pktFileTime * (S2NS / timeCodeScale)) + (ticksPerSecond / 2)) / ticksPerSecond) * timeCodeScale;
+								
+								const bool invisible = (pkt->flags & VPX_FRAME_IS_INVISIBLE);
+								
 								assert( !vbr_pass );
-								assert( !(pkt->data.frame.flags & VPX_FRAME_IS_INVISIBLE) ); // libwebm not handling these now
-								assert( !(pkt->data.frame.flags & VPX_FRAME_IS_FRAGMENT) );
-								assert( pkt->data.frame.pts == (videoTime - exportInfoP->startTime) * fps.numerator / (ticksPerSecond * fps.denominator) );
-								assert( pkt->data.frame.duration == 1 ); // because of how we did the timescale
+								assert( !(pkt->flags & VPX_FRAME_IS_FRAGMENT) );
+								assert( pkt->pts == (videoTime - start_time) * fps.numerator / (ticksPerSecond * fps.denominator) );
+								assert( pktTimeStamp == timeStamp );
+								assert( pkt->duration == (invisible ? 0 : 1) ); // because of how we did the timescale
 							
-								if(use_alpha)
+								if(use_alpha && !invisible)
 								{
-									assert( !(alpha_pkt->data.frame.flags & VPX_FRAME_IS_INVISIBLE) );
-									assert( !(alpha_pkt->data.frame.flags & VPX_FRAME_IS_FRAGMENT) );
-									assert( alpha_pkt->data.frame.pts == (videoTime - exportInfoP->startTime) * fps.numerator / (ticksPerSecond * fps.denominator) );
-									assert( alpha_pkt->data.frame.duration == 1 );
+									assert( !(alpha_pkt->flags & VPX_FRAME_IS_INVISIBLE) );
+									assert( !(alpha_pkt->flags & VPX_FRAME_IS_FRAGMENT) );
+									assert( alpha_pkt->pts == (videoTime - start_time) * fps.numerator / (ticksPerSecond * fps.denominator) );
+									assert( alpha_pkt->duration == 1 );
 									
 									assert(alpha_pkt->kind == VPX_CODEC_CX_FRAME_PKT);
 									
-									if(pkt->data.frame.flags & VPX_FRAME_IS_KEY)
-										assert(alpha_pkt->data.frame.flags & VPX_FRAME_IS_KEY);
+									if(pkt->flags & VPX_FRAME_IS_KEY)
+										assert(alpha_pkt->flags & VPX_FRAME_IS_KEY);
+									
+									timing.Begin(TIMING_MUX);
+									
+									bool added = muxer_segment->AddFrameWithAdditional((const uint8_t *)pkt->buf, pkt->sz,
+																						(const uint8_t *)alpha_pkt->buf, alpha_pkt->sz, alpha_id,
+																						vid_track, pktTimeStamp,
+																						pkt->flags & VPX_FRAME_IS_KEY);
 									
-									bool added = muxer_segment->AddFrameWithAdditional((const uint8_t *)pkt->data.frame.buf, pkt->data.frame.sz,
-																						(const uint8_t *)alpha_pkt->data.frame.buf, alpha_pkt->data.frame.sz, alpha_id,
-																						vid_track, timeStamp,
-																						pkt->data.frame.flags & VPX_FRAME_IS_KEY);
+									timing.End(TIMING_MUX);
 																		
-									if( !(pkt->data.frame.flags & VPX_FRAME_IS_INVISIBLE) )
-										made_frame = true;
+									made_frame = true;
 									
 									if(!added)
 										result = exportReturn_InternalError;
 								}
 								else
 								{
-									bool added = muxer_segment->AddFrame((const uint8_t *)pkt->data.frame.buf, pkt->data.frame.sz,
-																		vid_track, timeStamp,
-																		pkt->data.frame.flags & VPX_FRAME_IS_KEY);
+									timing.Begin(TIMING_MUX);
+									
+									bool added = muxer_segment->AddFrame((const uint8_t *)pkt->buf, pkt->sz,
+																		vid_track, pktTimeStamp,
+																		pkt->flags & VPX_FRAME_IS_KEY);
+									
+									timing.End(TIMING_MUX);
 																		
-									if( !(pkt->data.frame.flags & VPX_FRAME_IS_INVISIBLE) )
+									if(!invisible)
 										made_frame = true;
 									
 									if(!added)
@@ -2052,35 +2891,34 @@ exSDKExport(
 								}
 							}
 							
-							assert(pkt->kind != VPX_CODEC_FPMB_STATS_PKT); // don't know what to do with this
+							delete pkt;
+							delete alpha_pkt;
 						}
-						
-						if(vbr_pass)
+						else if( encoder_pipeline->Error() )
+						{
+							result = exportReturn_InternalError;
+						}
+						else if( encoder_pipeline->FramesLeft() )
 						{
-							// if that was the last VBR packet, we have to finalize and write a summary packet,
-							// so go through the loop once more
-							if(videoEncoderTime >= exportInfoP->endTime)
+							if( encoder_pipeline->Full() )
 							{
-								made_frame = false;
+								timing.Begin(TIMING_WAIT);
+								
+								encoder_pipeline->WaitForSpace();
 								
-								pkt = NULL;
-								alpha_pkt = NULL;
+								timing.End(TIMING_WAIT);
+								
+								continue;
 							}
 							
-							// the final packet was just written, so break
-							if(videoEncoderTime == LONG_LONG_MAX)
-								break;
-						}
-						
-						
-						if(!made_frame && result == suiteError_NoError)
-						{
+							const PrTime videoEncoderTime = start_time + (encoder_pipeline->NextFrame() * frameRateP.value.timeValue);
+							
 							// this is for the encoder, which does its own math based on config.g_timebase
 							// let's do the math
 							// time = timestamp * timebase :: time = videoTime / ticksPerSecond : timebase = 1 / fps
 							// timestamp = time / timebase
 							// timestamp = (videoTime / ticksPerSecond) * (fps.num / fps.den)
-							const PrTime encoder_fileTime = videoEncoderTime - exportInfoP->startTime;
+							const PrTime encoder_fileTime = videoEncoderTime - start_time;
 							const PrTime encoder_nextFileTime = encoder_fileTime + frameRateP.value.timeValue;
 							
 							const vpx_codec_pts_t encoder_timeStamp = encoder_fileTime * fps.numerator / (ticksPerSecond * fps.denominator);
@@ -2093,6 +2931,8 @@ exSDKExport(
 							const vpx_codec_pts_t encoder_FrameNumber = encoder_fileTime / frameRateP.value.timeValue;
 							const unsigned long encoder_FrameDuration = 1;
 							
+							assert(encoder_FrameNumber == encoder_pipeline->NextFrame());
+							
 							// these asserts will not be true for big time values (int64_t overflow)
 							if(videoEncoderTime < LONG_MAX)
 							{
@@ -2100,148 +2940,185 @@ exSDKExport(
 								assert(encoder_FrameDuration == encoder_duration);
 							}
 							
-				
-							if(videoEncoderTime < exportInfoP->endTime)
+							
+							// With --render-once, the second pass gets the frames the first pass kept.
+							// With smart render, both get the ones planning kept, and so
+							// does the analysis pass after checking cached stats that didn't match.
+							if(frame_spill != NULL && frame_spill->Has(encoder_FrameNumber))
 							{
-								SequenceRender_GetFrameReturnRec renderResult;
+								vpx_image_t *img = frame_pool->Get(imgfmt, renderParms.inWidth, renderParms.inHeight, bit_depth, false);
+								
+								vpx_image_t *alpha_img = NULL;
 								
-								result = renderSuite->RenderVideoFrame(videoRenderID,
-																		videoEncoderTime,
-																		&renderParms,
-																		kRenderCacheType_None,
-																		&renderResult);
+								if(use_alpha)
+									alpha_img = frame_pool->Get(imgfmt, renderParms.inWidth, renderParms.inHeight, bit_depth, true);
 								
-								if(result == suiteError_NoError)
+								if(img && (!use_alpha || alpha_img) && frame_spill->Get(encoder_FrameNumber, img, alpha_img))
 								{
-									prRect bounds;
-									csSDK_uint32 parN, parD;
-									
-									pixSuite->GetBounds(renderResult.outFrame, &bounds);
-									pixSuite->GetPixelAspectRatio(renderResult.outFrame, &parN, &parD);
-									
-									const int width = bounds.right - bounds.left;
-									const int height = bounds.bottom - bounds.top;
-									
-									assert(width == widthP.value.intValue);
-									assert(height == heightP.value.intValue);
-									assert(parN == pixelAspectRatioP.value.ratioValue.numerator);  // Premiere sometimes screws this up
-									assert(parD == pixelAspectRatioP.value.ratioValue.denominator);
-									
-									
-									// see validate_img() and validate_config() in vp8_cx_iface.c and vp9_cx_iface.c
-									const vpx_img_fmt_t imgfmt8 = chroma == WEBM_444 ? VPX_IMG_FMT_I444 :
-																	chroma == WEBM_422 ? VPX_IMG_FMT_I422 :
-																	VPX_IMG_FMT_I420;
-																	
-									const vpx_img_fmt_t imgfmt16 = chroma == WEBM_444 ? VPX_IMG_FMT_I44416 :
-																	chroma == WEBM_422 ? VPX_IMG_FMT_I42216 :
-																	VPX_IMG_FMT_I42016;
-																	
-									const vpx_img_fmt_t imgfmt = (bit_depth > 8 ? imgfmt16 : imgfmt8);
+									if(stats_cache != NULL && vbr_pass)
+										pass_content += HashCombine(ImageHash(img, alpha_img), encoder_FrameNumber);
 									
-											
-									vpx_image_t img_data;
-									vpx_image_t *img = vpx_img_alloc(&img_data, imgfmt, width, height, 32);
-									
-									vpx_image_t alpha_img_data;
-									vpx_image_t *alpha_img = NULL;
-									
-									if(use_alpha)
-										alpha_img = vpx_img_alloc(&alpha_img_data, imgfmt, width, height, 32);
-									
-									
-									if(img && (!use_alpha || alpha_img))
+									if( !SubmitRenditions(renditions, img, encoder_FrameNumber, *convert_pool) )
 									{
-										if(bit_depth > 8)
-										{
-											img->bit_depth = bit_depth;
-											img->bps = img->bps * bit_depth / 16;
-											
-											if(use_alpha)
-											{
-												alpha_img->bit_depth = bit_depth;
-												alpha_img->bps = alpha_img->bps * bit_depth / 16;
-											}
-										}
-									
-										CopyPixToImg(img, alpha_img, renderResult.outFrame, pixSuite, pix2Suite);
-										
-										
-										vpx_codec_err_t encode_err = vpx_codec_encode(&encoder, img, encoder_FrameNumber, encoder_FrameDuration, 0, deadline);
+										frame_pool->Release(img);
 										
-										if(encode_err == VPX_CODEC_OK)
-										{
-											videoEncoderTime += frameRateP.value.timeValue;
-
-											encoder_iter = NULL;
-										}
-										else
-											result = exportReturn_InternalError;
+										if(alpha_img)
+											frame_pool->Release(alpha_img);
 										
-										vpx_img_free(img);
-										
-										
-										if(use_alpha)
-										{
-											vpx_codec_err_t alpha_encode_err = vpx_codec_encode(&alpha_encoder, alpha_img, encoder_FrameNumber, encoder_FrameDuration, 0, deadline);
-											
-											if(alpha_encode_err == VPX_CODEC_OK)
-											{
-												alpha_encoder_iter = NULL;
-											}
-											else
-												result = exportReturn_InternalError;
-											
-											vpx_img_free(alpha_img);
-										}
+										result = exportReturn_InternalError;
 									}
-									else
-										result = exportReturn_ErrMemory;
-									
+									else if( !encoder_pipeline->Submit(img, alpha_img, encoder_FrameDuration) )
+										result = exportReturn_InternalError;
 									
-									pixSuite->Dispose(renderResult.outFrame);
+									continue;
 								}
+								
+								// couldn't read it back, so render it again
+								if(img)
+									frame_pool->Release(img);
+								
+								if(alpha_img)
+									frame_pool->Release(alpha_img);
 							}
-							else
+							
+				
+							SequenceRender_GetFrameReturnRec renderResult;
+							
+							timing.Begin(TIMING_RENDER);
+							
+							result = renderSuite->RenderVideoFrame(videoRenderID,
+																	videoEncoderTime,
+																	&renderParms,
+																	kRenderCacheType_None,
+																	&renderResult);
+							
+							timing.End(TIMING_RENDER);
+							
+							if(result == suiteError_NoError)
 							{
-								// squeeze the last bit out of the encoder
-								vpx_codec_err_t encode_err = vpx_codec_encode(&encoder, NULL, encoder_FrameNumber, encoder_FrameDuration, 0, deadline);
+								prRect bounds;
+								csSDK_uint32 parN, parD;
 								
-								if(encode_err == VPX_CODEC_OK)
-								{
-									videoEncoderTime = LONG_LONG_MAX;
-									
-									encoder_iter = NULL;
-								}
-								else
-									result = exportReturn_InternalError;
+								pixSuite->GetBounds(renderResult.outFrame, &bounds);
+								pixSuite->GetPixelAspectRatio(renderResult.outFrame, &parN, &parD);
+								
+								const int width = bounds.right - bounds.left;
+								const int height = bounds.bottom - bounds.top;
+								
+								assert(width == widthP.value.intValue);
+								assert(height == heightP.value.intValue);
+								assert(parN == pixelAspectRatioP.value.ratioValue.numerator);  // Premiere sometimes screws this up
+								assert(parD == pixelAspectRatioP.value.ratioValue.denominator);
 								
 								
+								// the pipeline will return these to the pool after they've been encoded
+								vpx_image_t *img = NULL;
+								
+								if(!use_alpha)
+									img = WrapPixToImg(renderResult.outFrame, pixSuite, pix2Suite, *frame_pool, imgfmt);
+								
+								const bool wrapped = (img != NULL); // then the pool has the frame now
+								
+								if(!wrapped)
+									img = frame_pool->Get(imgfmt, width, height, bit_depth, false);
+								
+								vpx_image_t *alpha_img = NULL;
+								
 								if(use_alpha)
+									alpha_img = frame_pool->Get(imgfmt, width, height, bit_depth, true);
+								
+								
+								if(img && (!use_alpha || alpha_img))
 								{
-									vpx_codec_err_t alpha_encode_err = vpx_codec_encode(&alpha_encoder, NULL, encoder_FrameNumber, encoder_FrameDuration, 0, deadline);
+									WebMHash frame_hash = 0;
 									
-									if(alpha_encode_err == VPX_CODEC_OK)
+									if(wrapped)
 									{
-										alpha_encoder_iter = NULL;
+										if(stats_cache != NULL && vbr_pass)
+											frame_hash = HashImageRows(img, 0, img->d_h, 0);
 									}
 									else
+									{
+										timing.Begin(TIMING_CONVERT);
+										
+										CopyPixToImg(img, alpha_img, renderResult.outFrame, pixSuite, pix2Suite, *convert_pool,
+														((stats_cache != NULL && vbr_pass) ? &frame_hash : NULL));
+										
+										timing.End(TIMING_CONVERT);
+									}
+									
+									// frames come in segment order, so this has to add up the same in any order
+									pass_content += HashCombine(frame_hash, encoder_FrameNumber);
+									
+									if(frame_spill != NULL && vbr_pass)
+										frame_spill->Put(encoder_FrameNumber, img, alpha_img);
+									
+									
+									if( !SubmitRenditions(renditions, img, encoder_FrameNumber, *convert_pool) )
+									{
+										frame_pool->Release(img);
+										
+										if(alpha_img)
+											frame_pool->Release(alpha_img);
+										
+										result = exportReturn_InternalError;
+									}
+									else if( !encoder_pipeline->Submit(img, alpha_img, encoder_FrameDuration) )
 										result = exportReturn_InternalError;
 								}
+								else
+								{
+									if(img)
+										frame_pool->Release(img);
+									
+									if(alpha_img)
+										frame_pool->Release(alpha_img);
+									
+									result = exportReturn_ErrMemory;
+								}
+								
+								
+								if(!wrapped)
+									pixSuite->Dispose(renderResult.outFrame);
+								
+								DisposeUnwrapped(*frame_pool, pixSuite);
 							}
 						}
+						else if( !encoder_pipeline->Finishing() )
+						{
+							encoder_pipeline->Finish();
+						}
+						else if( encoder_pipeline->Done() )
+						{
+							// the final packet was just written, so break
+							break;
+						}
+						else
+						{
+							timing.Begin(TIMING_WAIT);
+							
+							encoder_pipeline->WaitForPacket();
+							
+							timing.End(TIMING_WAIT);
+						}
+					}
+					
+					// whatever the renditions have ready, they're muxed as they go
+					for(size_t r=0; r < renditions.size() && result == malNoError; r++)
+					{
+						if( !renditions[r]->Mux() )
+							result = exportReturn_InternalError;
 					}
 				}
 				
 				
 				if(result == malNoError)
 				{
-					float progress = (double)(videoTime - exportInfoP->startTime) / (double)(exportInfoP->endTime - exportInfoP->startTime);
+					float progress = (double)(videoTime - start_time) / (double)(end_time - start_time);
 					
+					// with cached stats, checking the frames was the first part
 					if(passes == 2)
 					{
-						const float firstpass_frac = (use_vp9 ? 0.1f : 0.3f);
-					
 						if(pass == 1)
 						{
 							progress = firstpass_frac + (progress * (1.f - firstpass_frac));
@@ -2267,9 +3144,9 @@ exSDKExport(
 			{
 				assert(!vbr_pass);
 				
-				const PrTime endTime = std::min<PrTime>(videoTime, exportInfoP->endTime);
+				const PrTime endTime = std::min<PrTime>(videoTime, end_time);
 				
-				const PrTime fileTimeDuration = endTime - exportInfoP->startTime;
+				const PrTime fileTimeDuration = endTime - start_time;
 					
 				const uint64_t timeCodeDuration = ((fileTimeDuration * (S2NS / timeCodeScale)) + (ticksPerSecond / 2)) / ticksPerSecond;
 				
@@ -2280,13 +3157,27 @@ exSDKExport(
 			}
 			
 			
+			// the renditions finish every pass, the last one closes their files
+			if(result == malNoError && !renditions.empty())
+			{
+				const PrTime endTime = std::min<PrTime>(videoTime, end_time);
+				
+				const PrTime fileTimeDuration = endTime - start_time;
+					
+				const uint64_t timeCodeDuration = ((fileTimeDuration * (S2NS / timeCodeScale)) + (ticksPerSecond / 2)) / ticksPerSecond;
+				
+				for(size_t r=0; r < renditions.size() && result == malNoError; r++)
+				{
+					if( !renditions[r]->Finish(timeCodeDuration) )
+						result = exportReturn_InternalError;
+				}
+			}
+			
+			
 			// audio sanity check
-			if(result == malNoError && exportInfoP->exportAudio && !vbr_pass)
+			if(result == malNoError && export_audio && !vbr_pass)
 			{
-				if(audioCodecP.value.intValue == WEBM_CODEC_OPUS)
-					assert(currentAudioSample >= (endAudioSample + opus_pre_skip));
-				else
-					assert(op.granulepos == endAudioSample);
+				assert(audio_encoder != NULL && audio_encoder->Done());
 			}
 		}
 		else
@@ -2294,33 +3185,85 @@ exSDKExport(
 		
 
 
-		if(exportInfoP->exportVideo)
+		if(export_video)
 		{
-			if(result == malNoError)
-				assert(NULL == vpx_codec_get_cx_data(&encoder, &encoder_iter));
-		
-			vpx_codec_err_t destroy_err = vpx_codec_destroy(&encoder);
-			assert(destroy_err == VPX_CODEC_OK);
-			
-			if(use_alpha)
+			if(encoder_pipeline != NULL)
 			{
-				vpx_codec_err_t alpha_destroy_err = vpx_codec_destroy(&alpha_encoder);
-				assert(alpha_destroy_err == VPX_CODEC_OK);
+				if(result == malNoError)
+				{
+					assert( encoder_pipeline->Done() );
+					
+					encoder_pipeline->Join(); // threads exit after the flush
+					
+					const PipelineStats stats = encoder_pipeline->Stats();
+					
+					WebMLog("%s pass: %d segments, %u frames, export thread waited %u times (%.2f sec), encoder waited %u times (%.2f sec)",
+							(vbr_pass ? "Analysis" : "Encoding"), segments, stats.frames,
+							stats.render_stalls, stats.render_stall_seconds,
+							stats.encoder_stalls, stats.encoder_stall_seconds);
+					
+					if(stats_cache != NULL)
+					{
+						if(vbr_pass)
+						{
+							StatsCacheEntry entry;
+							
+							const char *stats_data = vbr_stats.Data();
+							
+							if(stats_data != NULL)
+								entry.stats.assign(stats_data, stats_data + vbr_stats.Size());
+							
+							entry.segment_sizes = vbr_segment_sizes;
+							
+							if(use_alpha)
+							{
+								const char *alpha_stats_data = alpha_vbr_stats.Data();
+								
+								if(alpha_stats_data != NULL)
+									entry.alpha_stats.assign(alpha_stats_data, alpha_stats_data + alpha_vbr_stats.Size());
+								
+								entry.alpha_segment_sizes = alpha_vbr_segment_sizes;
+							}
+							
+							entry.content = pass_content;
+							
+							if(!entry.stats.empty() && (!use_alpha || !entry.alpha_stats.empty()))
+								stats_cache->Store(stats_key, entry);
+						}
+					}
+				}
+				
+				delete encoder_pipeline;
+				
+				encoder_pipeline = NULL;
+				
+				DisposeUnwrapped(*frame_pool, pixSuite);
 			}
+			
+			// pass_encoders destroys the encoders
 		}
 			
-		if(exportInfoP->exportAudio && !vbr_pass)
+		if(export_audio && !vbr_pass)
 		{
+			// the thread has to be done with the encoder first
+			if(audio_encoder != NULL)
+			{
+				const AudioEncoderStats &stats = audio_encoder->Stats();
+				
+				if(result == malNoError)
+					WebMLog("Audio: %u packets from %u GetAudio calls, export thread waited %u times (%.2f sec), audio thread waited %u times (%.2f sec)",
+							stats.packets, stats.source_calls, stats.mux_stalls, stats.mux_stall_seconds,
+							stats.encoder_stalls, stats.encoder_stall_seconds);
+				
+				delete audio_encoder;
+				
+				audio_encoder = NULL;
+			}
+			
 			if(audioCodecP.value.intValue == WEBM_CODEC_OPUS)
 			{
 				if(opus)
 					opus_multistream_encoder_destroy(opus);
-				
-				if(opus_buffer)
-					free(opus_buffer);
-				
-				if(opus_compressed_buffer)
-					free(opus_compressed_buffer);
 			}
 			else
 			{
@@ -2332,20 +3275,21 @@ exSDKExport(
 				vorbis_comment_clear(&vc);
 				vorbis_info_clear(&vi);
 			}
-			
-			for(int i=0; i < audioChannels; i++)
-			{
-				if(pr_audio_buffer[i] != NULL)
-					free(pr_audio_buffer[i]);
-			}
 		}
 	}
 	
 	
 	if(muxer_segment != NULL)
 	{
+		timing.Begin(TIMING_MUX);
+		
 		bool final = muxer_segment->Finalize();
 		
+		if(final)
+			final = (writer->Flush() == WEBM_WRITER_NO_ERROR);
+		
+		timing.End(TIMING_MUX);
+		
 		if(!final)
 			result = exportReturn_InternalError;
 	}
@@ -2354,22 +3298,90 @@ exSDKExport(
 	}catch(...) { result = exportReturn_InternalError; }
 	
 	
+	delete encoder_pipeline;
+	
+	delete audio_encoder;
+	
+	// after the pipeline, its packet sources read from these
+	for(size_t i=0; i < smart_sources.size(); i++)
+		delete smart_sources[i];
+	
+	// before the frame pool, their pipelines give images back to it
+	for(size_t r=0; r < renditions.size(); r++)
+		delete renditions[r];
+	
+	delete convert_pool;
+	
+	if(stats_cache != NULL)
+	{
+		const StatsCacheReport report = stats_cache->Report();
+		
+		WebMLog("First pass stats cache %s: %u hits, %u misses, %u stale, %u evicted",
+				(stats_cached ? "hit" : "miss"), report.hits, report.misses, report.stale, report.evicted);
+		
+		delete stats_cache;
+	}
+	
+	if(frame_spill != NULL)
+	{
+		const FrameSpillStats stats = frame_spill->Stats();
+		
+		WebMLog("Frame spill: kept %u frames (%.1f MB), %u over budget, %u read back",
+				stats.stored, (double)stats.bytes / (1024.0 * 1024.0), stats.over_budget, stats.read);
+		
+		delete frame_spill;
+	}
+	
+	if(governor != NULL)
+	{
+		governor->Report();
+		
+		delete governor;
+	}
+	
+	if(frame_pool != NULL)
+	{
+		DisposeUnwrapped(*frame_pool, pixSuite);
+		
+		const FramePoolStats stats = frame_pool->Stats();
+		
+		WebMLog("Frame pool: %u hits, %u misses, %u wrapped, %u images (%.1f MB)",
+				stats.hits, stats.misses, stats.wrapped, stats.images, (double)stats.bytes / (1024.0 * 1024.0));
+		
+		delete frame_pool;
+	}
+	
 	delete muxer_segment;
 	
-	delete writer;
+	if(writer != NULL)
+	{
+		WebMLog("Writer: %u calls to Premiere for %.1f MB, export thread waited %.2f sec",
+				writer->Calls(), (double)writer->Bytes() / (1024.0 * 1024.0), writer->Stalled());
+		
+		delete writer;
+	}
 	
 	
-	if(vbr_buffer != NULL)
-		memorySuite->PrDisposePtr(vbr_buffer);
-
-	if(alpha_vbr_buffer != NULL)
-		memorySuite->PrDisposePtr(alpha_vbr_buffer);
+	if( timing.Enabled() )
+	{
+		const std::string movie = OutputPath(mySettings->exportFileSuite, exportInfoP->fileObject);
+		
+		const int frames = (export_video ?
+								(end_time - start_time + frameRateP.value.timeValue - 1) / frameRateP.value.timeValue :
+								0);
+		
+		if( movie.empty() || !timing.WriteReport(movie + ".timing.json", movie, frames) )
+			WebMLog("Couldn't write the timing report");
+		
+		if(options.timing_trace && (movie.empty() || !timing.WriteTrace(movie + ".trace.json")))
+			WebMLog("Couldn't write the timing trace");
+	}
 	
 	
-	if(exportInfoP->exportVideo)
+	if(export_video)
 		renderSuite->ReleaseVideoRenderer(exID, videoRenderID);
 
-	if(exportInfoP->exportAudio)
+	if(export_audio)
 		audioSuite->ReleaseAudioRenderer(exID, audioRenderID);
 	
 
@@ -0,0 +1,635 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_Args.h"
+
+#include "vpx/vp8cx.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include <sstream>
+#include <vector>
+
+using std::string;
+
+
+static bool
+quotedTokenize(const string& str,
+				  std::vector<string>& tokens,
+				  const string& delimiters = " ")
+{
+	// this function will respect quoted strings when tokenizing
+	// the quotes will be included in the returned strings
+	
+	string::size_type i = 0;
+	bool in_quotes = false;
+	
+	// if there are un-quoted delimiters in the beginning, skip them
+	while(i < str.size() && str[i] != '\"' && string::npos != delimiters.find(str[i]) )
+		i++;
+	
+	string::size_type lastPos = i;
+	
+	while(i < str.size())
+	{
+		if(str[i] == '\"' && (i == 0 || str[i-1] != '\\'))
+			in_quotes = !in_quotes;
+		else if(!in_quotes)
+		{
+			if( string::npos != delimiters.find(str[i]) )
+			{
+				tokens.push_back(str.substr(lastPos, i - lastPos));
+				
+				lastPos = i + 1;
+				
+				// if there are more delimiters ahead, push forward
+				while(lastPos < str.size() && (str[lastPos] != '\"' || str[lastPos-1] != '\\') && string::npos != delimiters.find(str[lastPos]) )
+					lastPos++;
+					
+				i = lastPos;
+				continue;
+			}
+		}
+		
+		i++;
+	}
+	
+	if(in_quotes)
+		return false;
+	
+	// we're at the end, was there anything left?
+	if(str.size() - lastPos > 0)
+		tokens.push_back( str.substr(lastPos) );
+	
+	return true;
+}
+
+
+template <typename T>
+static void SetValue(T &v, string s)
+{
+	std::stringstream ss;
+	
+	ss << s;
+	
+	ss >> v;
+}
+
+
+static string
+Unquote(const string &s)
+{
+	// quotedTokenize leaves the quotes on
+	if(s.size() >= 2 && s[0] == '\"' && s[s.size() - 1] == '\"')
+		return s.substr(1, s.size() - 2);
+	else
+		return s;
+}
+
+
+// --color-space and --color-range go to the encoder, and the exporter needs them
+// for picking the RGB to YUV matrix, so both read them here
+static vpx_color_space_t
+ColorSpaceArg(const string &val)
+{
+	return (val == "unknown" ? VPX_CS_UNKNOWN :
+			val == "bt601" ? VPX_CS_BT_601 :
+			val == "bt709" ? VPX_CS_BT_709 :
+			val == "smpte170" ? VPX_CS_SMPTE_170 :
+			val == "smpte240" ? VPX_CS_SMPTE_240 :
+			val == "bt2020" ? VPX_CS_BT_2020 :
+			val == "reserved" ? VPX_CS_RESERVED :
+			val == "sRGB" ? VPX_CS_SRGB :
+			VPX_CS_UNKNOWN);
+}
+
+
+static vpx_color_range_t
+ColorRangeArg(const string &val)
+{
+	return (val == "studio" ? VPX_CR_STUDIO_RANGE :
+			val == "full" ? VPX_CR_FULL_RANGE :
+			VPX_CR_STUDIO_RANGE);
+}
+
+
+// seconds from now until the next time the clock says HH:MM, 0 if it doesn't parse
+static int
+SecondsUntil(const string &clock)
+{
+	int hours = -1, minutes = -1;
+	
+	if(sscanf(Unquote(clock).c_str(), "%d:%d", &hours, &minutes) != 2 ||
+		hours < 0 || hours > 23 || minutes < 0 || minutes > 59)
+	{
+		return 0;
+	}
+	
+	const time_t now = time(NULL);
+	
+	const struct tm *local = localtime(&now);
+	
+	if(local == NULL)
+		return 0;
+	
+	int seconds = ((hours * 60 + minutes) * 60) - ((local->tm_hour * 60 + local->tm_min) * 60 + local->tm_sec);
+	
+	if(seconds <= 0)
+		seconds += 24 * 60 * 60; // tomorrow
+	
+	return seconds;
+}
+
+
+bool
+ConfigureEncoderPre(vpx_codec_enc_cfg_t &config, unsigned long &deadline, const char *txt)
+{
+	std::vector<string> args;
+	
+	if(quotedTokenize(txt, args, " =\t\r\n") && args.size() > 0)
+	{
+		const int num_args = args.size();
+	
+		args.push_back(""); // so there's always an i+1
+		
+		int i = 0;
+		
+		while(i < num_args)
+		{
+			const string &arg = args[i];
+			const string &val = args[i + 1];
+			
+			if(arg == "--best")
+			{	deadline = VPX_DL_BEST_QUALITY;	}
+			
+			else if(arg == "--good")
+			{	deadline = VPX_DL_GOOD_QUALITY;	}
+			
+			else if(arg == "--rt")
+			{	deadline = VPX_DL_REALTIME;	}
+			
+			else if(arg == "-d" || arg == "--deadline")
+			{	SetValue(deadline, val); i++;	}
+
+			else if(arg == "-t" || arg == "--threads")
+			{	SetValue(config.g_threads, val); i++;	}
+			
+			else if(arg == "--lag-in-frames")
+			{	SetValue(config.g_lag_in_frames, val); i++;	}
+			
+			else if(arg == "--drop-frame")
+			{	SetValue(config.rc_dropframe_thresh, val); i++;	}
+			
+			else if(arg == "--resize-allowed")
+			{	SetValue(config.rc_resize_allowed, val); i++;	}
+			
+			else if(arg == "--resize-width")
+			{	SetValue(config.rc_scaled_width, val); i++;	}
+			
+			else if(arg == "--resize-height")
+			{	SetValue(config.rc_scaled_height, val); i++;	}
+			
+			else if(arg == "--resize-up")
+			{	SetValue(config.rc_resize_up_thresh, val); i++;	}
+			
+			else if(arg == "--resize-down")
+			{	SetValue(config.rc_resize_down_thresh, val); i++;	}
+			
+			else if(arg == "--target-bitrate")
+			{	SetValue(config.rc_target_bitrate, val); i++;	}
+			
+			else if(arg == "--min-q")
+			{	SetValue(config.rc_min_quantizer, val); i++;	}
+			
+			else if(arg == "--max-q")
+			{	SetValue(config.rc_max_quantizer, val); i++;	}
+			
+			else if(arg == "--undershoot-pct")
+			{	SetValue(config.rc_undershoot_pct, val); i++;	}
+			
+			else if(arg == "--overshoot-pct")
+			{	SetValue(config.rc_overshoot_pct, val); i++;	}
+
+			else if(arg == "--buf-sz")
+			{	SetValue(config.rc_buf_sz, val); i++;	}
+
+			else if(arg == "--buf-initial-sz")
+			{	SetValue(config.rc_buf_initial_sz, val); i++;	}
+
+			else if(arg == "--buf-optimal-sz")
+			{	SetValue(config.rc_buf_optimal_sz, val); i++;	}
+
+			else if(arg == "--bias-pct")
+			{	SetValue(config.rc_2pass_vbr_bias_pct, val); i++;	}
+
+			else if(arg == "--minsection-pct")
+			{	SetValue(config.rc_2pass_vbr_minsection_pct, val); i++;	}
+
+			else if(arg == "--maxsection-pct")
+			{	SetValue(config.rc_2pass_vbr_maxsection_pct, val); i++;	}
+
+			else if(arg == "--kf-min-dist")
+			{	SetValue(config.kf_min_dist, val); i++;	}
+
+			else if(arg == "--kf-max-dist")
+			{	SetValue(config.kf_max_dist, val); i++;	}
+
+			else if(arg == "--disable-kf")
+			{	config.kf_mode = VPX_KF_DISABLED;	}
+
+			
+			i++;
+		}
+	
+		return true;
+	}
+	else
+		return false;
+}
+
+
+#define ConfigureValue(encoder, ctrl_id, s) \
+	do{							\
+		std::stringstream ss;	\
+		ss << s;				\
+		int v = 0;		\
+		ss >> v;				\
+		if(vpx_codec_control(encoder, ctrl_id, v) != VPX_CODEC_OK) \
+			config_err = VPX_CODEC_ERROR; \
+	}while(0)
+
+bool
+ConfigureEncoderPost(vpx_codec_ctx_t *encoder, const char *txt)
+{
+	std::vector<string> args;
+	
+	vpx_codec_err_t config_err = VPX_CODEC_OK;
+	
+	if(quotedTokenize(txt, args, " =\t\r\n") && args.size() > 0)
+	{
+		const int num_args = args.size();
+
+		args.push_back(""); // so there's always an i+1
+		
+		int i = 0;
+		
+		while(i < num_args)
+		{
+			const string &arg = args[i];
+			const string &val = args[i + 1];
+		
+			if(arg == "--noise-sensitivity")
+			{	ConfigureValue(encoder, VP8E_SET_NOISE_SENSITIVITY, val); i++;	}
+
+			else if(arg == "--sharpness")
+			{	ConfigureValue(encoder, VP8E_SET_SHARPNESS, val); i++;	}
+
+			else if(arg == "--static-thresh")
+			{	ConfigureValue(encoder, VP8E_SET_STATIC_THRESHOLD, val); i++;	}
+
+			else if(arg == "--cpu-used")
+			{	ConfigureValue(encoder, VP8E_SET_CPUUSED, val); i++;	}
+
+			else if(arg == "--token-parts")
+			{	ConfigureValue(encoder, VP8E_SET_TOKEN_PARTITIONS, val); i++;	}
+
+			else if(arg == "--tile-columns")
+			{	ConfigureValue(encoder, VP9E_SET_TILE_COLUMNS, val); i++;	}
+
+			else if(arg == "--tile-rows")
+			{	ConfigureValue(encoder, VP9E_SET_TILE_ROWS, val); i++;	}
+			
+			else if(arg == "--auto-alt-ref")
+			{	ConfigureValue(encoder, VP8E_SET_ENABLEAUTOALTREF, val); i++;	}
+
+			else if(arg == "--arnr-maxframes")
+			{	ConfigureValue(encoder, VP8E_SET_ARNR_MAXFRAMES, val); i++;	}
+
+			else if(arg == "--arnr-strength")
+			{	ConfigureValue(encoder, VP8E_SET_ARNR_STRENGTH, val); i++;	}
+
+			else if(arg == "--arnr-type")
+			{	ConfigureValue(encoder, VP8E_SET_ARNR_TYPE, val); i++;	}
+
+			else if(arg == "--tune")
+			{
+				unsigned int ival = val == "psnr" ? VP8_TUNE_PSNR :
+									val == "ssim" ? VP8_TUNE_SSIM :
+									VP8_TUNE_PSNR;
+			
+				ConfigureValue(encoder, VP8E_SET_TUNING, ival);
+				i++;
+			}
+
+			else if(arg == "--cq-level")
+			{	ConfigureValue(encoder, VP8E_SET_CQ_LEVEL, val); i++;	}
+			
+			else if(arg == "--max-intra-rate")
+			{	ConfigureValue(encoder, VP8E_SET_MAX_INTRA_BITRATE_PCT, val); i++;	}
+
+			else if(arg == "--gf-cbr-boost")
+			{	ConfigureValue(encoder, VP9E_SET_GF_CBR_BOOST_PCT, val); i++;	}
+
+			else if(arg == "--screen-content-mode")
+			{	ConfigureValue(encoder, VP8E_SET_SCREEN_CONTENT_MODE, val);	i++;	}
+			
+			else if(arg == "--lossless")
+			{	ConfigureValue(encoder, VP9E_SET_LOSSLESS, 1);	}
+			
+			else if(arg == "--frame-parallel")
+			{	ConfigureValue(encoder, VP9E_SET_FRAME_PARALLEL_DECODING, val);	i++;	}
+
+			else if(arg == "--aq-mode")
+			{	ConfigureValue(encoder, VP9E_SET_AQ_MODE, val);	i++;	}
+
+			else if(arg == "--frame_boost")
+			{	ConfigureValue(encoder, VP9E_SET_FRAME_PERIODIC_BOOST, val); i++;	}
+
+			else if(arg == "--noise-sensitivity")
+			{	ConfigureValue(encoder, VP9E_SET_NOISE_SENSITIVITY, val); i++;	}
+			
+			else if(arg == "--tune-content")
+			{
+				unsigned int ival = val == "default" ? VP9E_CONTENT_DEFAULT :
+									val == "screen" ? VP9E_CONTENT_SCREEN :
+									VP9E_CONTENT_DEFAULT;
+			
+				ConfigureValue(encoder, VP9E_SET_TUNE_CONTENT, ival);
+				i++;
+			}
+
+			else if(arg == "--color-space")
+			{
+				unsigned int ival = ColorSpaceArg(val);
+			
+				ConfigureValue(encoder, VP9E_SET_COLOR_SPACE, ival);
+				i++;
+			}
+			
+			else if(arg == "--min-gf-interval")
+			{	ConfigureValue(encoder, VP9E_SET_MIN_GF_INTERVAL, val); i++;	}
+			
+			else if(arg == "--max-gf-interval")
+			{	ConfigureValue(encoder, VP9E_SET_MAX_GF_INTERVAL, val); i++;	}
+
+			else if(arg == "--target-level")
+			{	ConfigureValue(encoder, VP9E_SET_TARGET_LEVEL, val); i++;	}
+
+			else if(arg == "--row-mt")
+			{	ConfigureValue(encoder, VP9E_SET_ROW_MT, 1);	}
+
+			else if(arg == "--color-range")
+			{
+				unsigned int ival = ColorRangeArg(val);
+			
+				ConfigureValue(encoder, VP9E_SET_COLOR_RANGE, ival);
+				i++;
+			}
+
+			i++;	
+		}
+		
+		return (config_err == VPX_CODEC_OK);
+	}
+	else
+		return false;
+}
+
+
+bool
+ConfigureExportOptions(ExportOptions &options, const char *txt)
+{
+	options.render_ahead = 4;
+	options.huge_pages = false;
+	options.convert_threads = 0;
+	options.segments = 1;
+	options.manifest.clear();
+	options.chunks = 0;
+	options.chunk = -1;
+	options.stats_cache = true;
+	options.stats_cache_dir.clear();
+	options.stats_cache_mb = 256;
+	options.stats_cache_days = 30;
+	options.render_once = false;
+	options.spill_dir.clear();
+	options.spill_mb = 16384;
+	options.thread_table.clear();
+	options.finish_in = 0;
+	options.timing = false;
+	options.timing_trace = false;
+	options.write_buffers = 3;
+	options.ladder.clear();
+	options.smart_render.clear();
+	options.color_space = VPX_CS_UNKNOWN;
+	options.color_range = VPX_CR_STUDIO_RANGE;
+	options.cpu_used = WEBM_CPU_USED_DEFAULT;
+	
+	std::vector<string> args;
+	
+	if(quotedTokenize(txt, args, " =\t\r\n") && args.size() > 0)
+	{
+		const int num_args = args.size();
+	
+		args.push_back(""); // so there's always an i+1
+		
+		int i = 0;
+		
+		while(i < num_args)
+		{
+			const string &arg = args[i];
+			const string &val = args[i + 1];
+			
+			if(arg == "--render-ahead")
+			{	SetValue(options.render_ahead, val); i++;	}
+			
+			else if(arg == "--huge-pages")
+			{	options.huge_pages = true;	}
+			
+			else if(arg == "--convert-threads")
+			{	SetValue(options.convert_threads, val); i++;	}
+			
+			else if(arg == "--segments")
+			{	SetValue(options.segments, val); i++;	}
+			
+			else if(arg == "--manifest")
+			{	options.manifest = Unquote(val); i++;	}
+			
+			else if(arg == "--chunks")
+			{	SetValue(options.chunks, val); i++;	}
+			
+			else if(arg == "--chunk")
+			{	SetValue(options.chunk, val); i++;	}
+			
+			else if(arg == "--stats-cache")
+			{	options.stats_cache_dir = Unquote(val); i++;	}
+			
+			else if(arg == "--no-stats-cache")
+			{	options.stats_cache = false;	}
+			
+			else if(arg == "--stats-cache-mb")
+			{	SetValue(options.stats_cache_mb, val); i++;	}
+			
+			else if(arg == "--stats-cache-days")
+			{	SetValue(options.stats_cache_days, val); i++;	}
+			
+			else if(arg == "--render-once")
+			{	options.render_once = true;	}
+			
+			else if(arg == "--spill-dir")
+			{	options.spill_dir = Unquote(val); i++;	}
+			
+			else if(arg == "--spill-mb")
+			{	SetValue(options.spill_mb, val); i++;	}
+			
+			else if(arg == "--thread-table")
+			{	options.thread_table = Unquote(val); i++;	}
+			
+			else if(arg == "--finish-in")
+			{	SetValue(options.finish_in, val); options.finish_in *= 60; i++;	}
+			
+			else if(arg == "--finish-by")
+			{	options.finish_in = SecondsUntil(val); i++;	}
+			
+			else if(arg == "--timing")
+			{	options.timing = true;	}
+			
+			else if(arg == "--timing-trace")
+			{	options.timing_trace = true;	}
+			
+			else if(arg == "--write-buffers")
+			{	SetValue(options.write_buffers, val); i++;	}
+			
+			else if(arg == "--ladder")
+			{	options.ladder = Unquote(val); i++;	}
+			
+			else if(arg == "--smart-render")
+			{	options.smart_render = Unquote(val); i++;	}
+			
+			// these go to the encoder too, see EncoderArgs()
+			else if(arg == "--color-space")
+			{	options.color_space = ColorSpaceArg(val); i++;	}
+			
+			else if(arg == "--color-range")
+			{	options.color_range = ColorRangeArg(val); i++;	}
+			
+			else if(arg == "--cpu-used")
+			{	SetValue(options.cpu_used, val); i++;	}
+			
+			i++;
+		}
+		
+		if(options.render_ahead < 1)
+			options.render_ahead = 1;
+		
+		if(options.segments < 1)
+			options.segments = 1;
+		
+		if(options.chunks < 0)
+			options.chunks = 0;
+		
+		if(options.stats_cache_mb < 0)
+			options.stats_cache_mb = 0;
+		
+		if(options.stats_cache_days < 0)
+			options.stats_cache_days = 0;
+		
+		if(options.spill_mb < 0)
+			options.spill_mb = 0;
+		
+		if(options.finish_in < 0)
+			options.finish_in = 0;
+		
+		// one block fills while the others are being written
+		if(options.write_buffers < 0)
+			options.write_buffers = 0;
+		else if(options.write_buffers == 1)
+			options.write_buffers = 2;
+		else if(options.write_buffers > 16)
+			options.write_buffers = 16;
+	
+		return true;
+	}
+	else
+		return false;
+}
+
+
+std::string
+EncoderArgs(const char *txt)
+{
+	string encoder_args;
+	
+	std::vector<string> args;
+	
+	if(quotedTokenize(txt, args, " =\t\r\n") && args.size() > 0)
+	{
+		const int num_args = args.size();
+		
+		int i = 0;
+		
+		while(i < num_args)
+		{
+			const string &arg = args[i];
+			
+			if(arg == "--render-ahead" || arg == "--convert-threads" || arg == "--segments" ||
+				arg == "--manifest" || arg == "--chunks" || arg == "--chunk" ||
+				arg == "--stats-cache" || arg == "--stats-cache-mb" || arg == "--stats-cache-days" ||
+				arg == "--spill-dir" || arg == "--spill-mb" || arg == "--thread-table" ||
+				arg == "--finish-in" || arg == "--finish-by" || arg == "--write-buffers" ||
+				arg == "--ladder" || arg == "--smart-render")
+			{
+				i++; // skip the value too
+			}
+			else if(arg != "--huge-pages" && arg != "--no-stats-cache" && arg != "--render-once" &&
+					arg != "--timing" && arg != "--timing-trace")
+			{
+				if(!encoder_args.empty())
+					encoder_args += " ";
+				
+				encoder_args += arg;
+			}
+			
+			i++;
+		}
+	}
+	
+	return encoder_args;
+}
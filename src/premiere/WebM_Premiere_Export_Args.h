@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_ARGS_H
+#define WEBM_PREMIERE_EXPORT_ARGS_H
+
+#include "vpx/vpx_encoder.h"
+
+#include <string>
+
+
+// The custom args text box.  Nothing in here touches the Premiere SDK,
+// so the tools can read a manifest's args the way the exporter does.
+
+bool ConfigureEncoderPre(vpx_codec_enc_cfg_t &config, unsigned long &deadline, const char *txt);
+
+bool ConfigureEncoderPost(vpx_codec_ctx_t *encoder, const char *txt);
+
+
+// settings for the exporter itself, also passed through the custom args
+typedef struct ExportOptions
+{
+	int		render_ahead;	// frames that can be waiting for the encoder
+	bool	huge_pages;		// back the frame pool with huge pages (Linux only)
+	int		convert_threads;	// for pixel conversion, 0 means one per CPU
+	int		segments;		// split the video into this many independently encoded parts
+	std::string	manifest;	// job manifest for a distributed export
+	int		chunks;			// with a manifest, plan this many chunks (0 means we're not planning)
+	int		chunk;			// with a manifest, encode this chunk (-1 means we're not a worker)
+	bool	stats_cache;	// keep two-pass first pass stats between exports
+	std::string	stats_cache_dir;	// empty for the default folder
+	int		stats_cache_mb;	// evict the oldest entries past this size
+	int		stats_cache_days;	// and any not used in this long
+	bool	render_once;	// two-pass reads back the first pass frames instead of rendering again
+	std::string	spill_dir;	// where they go, empty for the temp folder
+	int		spill_mb;		// disk budget, frames past it get rendered again
+	std::string	thread_table;	// threading calibration table, empty for the default one
+	int		finish_in;		// seconds the export has to be done in, 0 for no deadline
+	bool	timing;			// write a per-stage timing report next to the movie
+	bool	timing_trace;	// and a Chrome trace timeline
+	int		write_buffers;	// blocks for the writer thread, 0 writes on the export thread
+	std::string	ladder;		// "WxH@kbps,..." renditions to encode from the same frames, empty for none
+	std::string	smart_render;	// "a.webm;b.webm" the sequence was cut from, copy what we can of them
+	vpx_color_space_t	color_space;	// --color-space, which also picks the RGB to YUV matrix
+	vpx_color_range_t	color_range;	// --color-range, same
+	int		cpu_used;		// --cpu-used, which the deadline governor starts from, WEBM_CPU_USED_DEFAULT if not given
+} ExportOptions;
+
+#define WEBM_CPU_USED_DEFAULT	(-100) // out of libvpx's range
+
+bool ConfigureExportOptions(ExportOptions &options, const char *txt);
+
+// The custom args without the exporter options that only concern this machine,
+// which is what has to match between the workers of a distributed export.
+std::string EncoderArgs(const char *txt);
+
+
+#endif // WEBM_PREMIERE_EXPORT_ARGS_H
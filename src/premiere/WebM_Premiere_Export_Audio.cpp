@@ -0,0 +1,631 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_Audio.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+	#define WEBM_X86 1
+	
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+	#define WEBM_NEON 1
+	
+	#include <arm_neon.h>
+#endif
+
+
+static const uint64_t S2NS = 1000000000LL;
+
+#define MAX_AUDIO_CHANNELS	8
+
+
+// Planar to interleaved, the planes already in the encoder's channel order.
+// The kernels do stereo and 5.1 four samples at a time and return where
+// they left off for the scalar loop.
+
+#ifdef WEBM_X86
+
+static int
+InterleaveAudio_SSE2(float *out, const float * const *planes, const int channels, const int samples)
+{
+	int i = 0;
+	
+	if(channels == 2)
+	{
+		for(; i <= samples - 4; i += 4)
+		{
+			const __m128 l = _mm_loadu_ps(planes[0] + i);
+			const __m128 r = _mm_loadu_ps(planes[1] + i);
+			
+			_mm_storeu_ps(out + (i * 2), _mm_unpacklo_ps(l, r));
+			_mm_storeu_ps(out + (i * 2) + 4, _mm_unpackhi_ps(l, r));
+		}
+	}
+	else if(channels == 6)
+	{
+		for(; i <= samples - 4; i += 4)
+		{
+			// the first four channels turn into four samples
+			__m128 s0 = _mm_loadu_ps(planes[0] + i);
+			__m128 s1 = _mm_loadu_ps(planes[1] + i);
+			__m128 s2 = _mm_loadu_ps(planes[2] + i);
+			__m128 s3 = _mm_loadu_ps(planes[3] + i);
+			
+			_MM_TRANSPOSE4_PS(s0, s1, s2, s3);
+			
+			// and the last two go in pairs after them
+			const __m128 c4 = _mm_loadu_ps(planes[4] + i);
+			const __m128 c5 = _mm_loadu_ps(planes[5] + i);
+			
+			const __m128 lo = _mm_unpacklo_ps(c4, c5);
+			const __m128 hi = _mm_unpackhi_ps(c4, c5);
+			
+			float *o = out + (i * 6);
+			
+			_mm_storeu_ps(o, s0);
+			_mm_storel_pi((__m64 *)(o + 4), lo);
+			_mm_storeu_ps(o + 6, s1);
+			_mm_storeh_pi((__m64 *)(o + 10), lo);
+			_mm_storeu_ps(o + 12, s2);
+			_mm_storel_pi((__m64 *)(o + 16), hi);
+			_mm_storeu_ps(o + 18, s3);
+			_mm_storeh_pi((__m64 *)(o + 22), hi);
+		}
+	}
+	
+	return i;
+}
+
+#endif // WEBM_X86
+
+
+#ifdef WEBM_NEON
+
+static int
+InterleaveAudio_NEON(float *out, const float * const *planes, const int channels, const int samples)
+{
+	int i = 0;
+	
+	if(channels == 2)
+	{
+		for(; i <= samples - 4; i += 4)
+		{
+			float32x4x2_t lr;
+			
+			lr.val[0] = vld1q_f32(planes[0] + i);
+			lr.val[1] = vld1q_f32(planes[1] + i);
+			
+			vst2q_f32(out + (i * 2), lr);
+		}
+	}
+	else if(channels == 6)
+	{
+		for(; i <= samples - 4; i += 4)
+		{
+			// channel pairs, two samples in each half
+			const float32x4x2_t a = vzipq_f32(vld1q_f32(planes[0] + i), vld1q_f32(planes[1] + i));
+			const float32x4x2_t b = vzipq_f32(vld1q_f32(planes[2] + i), vld1q_f32(planes[3] + i));
+			const float32x4x2_t c = vzipq_f32(vld1q_f32(planes[4] + i), vld1q_f32(planes[5] + i));
+			
+			float *o = out + (i * 6);
+			
+			for(int k=0; k < 2; k++)
+			{
+				vst1_f32(o, vget_low_f32(a.val[k]));
+				vst1_f32(o + 2, vget_low_f32(b.val[k]));
+				vst1_f32(o + 4, vget_low_f32(c.val[k]));
+				vst1_f32(o + 6, vget_high_f32(a.val[k]));
+				vst1_f32(o + 8, vget_high_f32(b.val[k]));
+				vst1_f32(o + 10, vget_high_f32(c.val[k]));
+				
+				o += 12;
+			}
+		}
+	}
+	
+	return i;
+}
+
+#endif // WEBM_NEON
+
+
+static void
+InterleaveAudio(float *out, const float * const *planes, const int channels, const int samples)
+{
+	const WebM_SIMD simd = WebMDetectSIMD();
+	
+	int i = 0;
+	
+#ifdef WEBM_X86
+	if(simd >= WEBM_SIMD_SSE2)
+		i = InterleaveAudio_SSE2(out, planes, channels, samples);
+#endif
+
+#ifdef WEBM_NEON
+	if(simd == WEBM_SIMD_NEON)
+		i = InterleaveAudio_NEON(out, planes, channels, samples);
+#endif
+	
+	for(; i < samples; i++)
+	{
+		for(int c=0; c < channels; c++)
+		{
+			out[(i * channels) + c] = planes[c][i];
+		}
+	}
+	
+	(void)simd;
+}
+
+
+AudioPacket::AudioPacket(const void *data, size_t size, uint64_t timestamp, int64_t discard_padding) :
+	buf(NULL),
+	sz(size),
+	timestamp(timestamp),
+	discard_padding(discard_padding)
+{
+	if(sz > 0)
+	{
+		buf = malloc(sz);
+		
+		if(buf == NULL)
+			throw std::bad_alloc();
+		
+		memcpy(buf, data, sz);
+	}
+}
+
+
+AudioPacket::~AudioPacket()
+{
+	if(buf != NULL)
+		free(buf);
+}
+
+
+#pragma mark-
+
+
+AudioEncoder::AudioEncoder(OpusMSEncoder *opus, int frame_size, int pull_size,
+							AudioSource &source, int channels, int sample_rate, int64_t end_sample,
+							size_t depth, ExportTiming &timing, int track) :
+	_opus(opus),
+	_vd(NULL),
+	_vb(NULL),
+	_frame_size(frame_size),
+	_pull_size(std::max<int>(pull_size, frame_size)),
+	_source(source),
+	_channels(channels),
+	_sample_rate(sample_rate),
+	_end_sample(end_sample),
+	_depth(depth > 0 ? depth : 1),
+	_timing(timing),
+	_track(track),
+	_requested(false),
+	_request_buffers(NULL),
+	_request_samples(0),
+	_request_ok(false),
+	_done(false),
+	_error(false),
+	_abort(false)
+{
+	memset(&_stats, 0, sizeof(_stats));
+	
+	assert(_channels <= MAX_AUDIO_CHANNELS);
+	
+	// a block after what's left of the last one
+	_buffer_size = _pull_size + _frame_size;
+	
+	_interleaved.resize(_channels * _frame_size);
+	
+	_compressed.resize(sizeof(float) * _channels * _frame_size * 2); // why not?
+}
+
+
+AudioEncoder::AudioEncoder(vorbis_dsp_state *vd, vorbis_block *vb, int block_size,
+							AudioSource &source, int channels, int sample_rate, int64_t end_sample,
+							size_t depth, ExportTiming &timing, int track) :
+	_opus(NULL),
+	_vd(vd),
+	_vb(vb),
+	_frame_size(block_size),
+	_pull_size(block_size),
+	_source(source),
+	_channels(channels),
+	_sample_rate(sample_rate),
+	_end_sample(end_sample),
+	_depth(depth > 0 ? depth : 1),
+	_timing(timing),
+	_track(track),
+	_requested(false),
+	_request_buffers(NULL),
+	_request_samples(0),
+	_request_ok(false),
+	_done(false),
+	_error(false),
+	_abort(false)
+{
+	memset(&_stats, 0, sizeof(_stats));
+	
+	assert(_channels <= MAX_AUDIO_CHANNELS);
+	
+	_buffer_size = _pull_size;
+}
+
+
+AudioEncoder::~AudioEncoder()
+{
+	{
+		WebMLock lock(_mutex);
+		
+		_abort = true;
+		
+		_room_cond.Broadcast();
+		_audio_cond.Broadcast();
+	}
+	
+	Join();
+	
+	for(std::deque<AudioPacket *>::iterator i = _packets.begin(); i != _packets.end(); ++i)
+		delete *i;
+}
+
+
+AudioPacket *
+AudioEncoder::Next(uint64_t up_to)
+{
+	WebMLock lock(_mutex);
+	
+	ServeAudio();
+	
+	if(_packets.empty() && !_done && !_error)
+	{
+		const double start = WebMSeconds();
+		
+		_stats.mux_stalls++;
+		
+		do{
+			_packet_cond.Wait(_mutex);
+			
+			ServeAudio();
+		}while(_packets.empty() && !_done && !_error);
+		
+		_stats.mux_stall_seconds += WebMSeconds() - start;
+	}
+	
+	if(_packets.empty() || _packets.front()->timestamp > up_to)
+		return NULL;
+	
+	AudioPacket *pkt = _packets.front();
+	
+	_packets.pop_front();
+	
+	_room_cond.Signal();
+	
+	return pkt;
+}
+
+
+bool
+AudioEncoder::Done()
+{
+	WebMLock lock(_mutex);
+	
+	return (_done && _packets.empty());
+}
+
+
+bool
+AudioEncoder::Error()
+{
+	WebMLock lock(_mutex);
+	
+	return _error;
+}
+
+
+bool
+AudioEncoder::Publish(AudioPacket *pkt)
+{
+	WebMLock lock(_mutex);
+	
+	if(_packets.size() >= _depth && !_abort)
+	{
+		const double start = WebMSeconds();
+		
+		_stats.encoder_stalls++;
+		
+		do{
+			_room_cond.Wait(_mutex);
+		}while(_packets.size() >= _depth && !_abort);
+		
+		_stats.encoder_stall_seconds += WebMSeconds() - start;
+	}
+	
+	if(_abort)
+	{
+		delete pkt;
+		
+		return false;
+	}
+	
+	_packets.push_back(pkt);
+	
+	_stats.packets++;
+	
+	_packet_cond.Signal();
+	
+	return true;
+}
+
+
+bool
+AudioEncoder::ReadAudio(int offset, int samples)
+{
+	assert(offset + samples <= _buffer_size);
+	
+	if(_buffer.empty())
+	{
+		// Premiere uses Left, Right, Left Rear, Right Rear, Center, LFE
+		// Opus and Vorbis use Left, Center, Right, Left Read, Right Rear, LFE
+		// http://www.xiph.org/vorbis/doc/Vorbis_I_spec.html#x1-800004.3.9
+		static const int stereo_swizzle[] = {0, 1, 0, 1, 0, 1};
+		static const int surround_swizzle[] = {0, 4, 1, 2, 3, 5};
+		
+		const int *swizzle = (_channels > 2 ? surround_swizzle : stereo_swizzle);
+		
+		_buffer.resize(_channels * _buffer_size);
+		
+		for(int c=0; c < _channels; c++)
+			_source_planes.push_back(&_buffer[c * _buffer_size]);
+		
+		for(int c=0; c < _channels; c++)
+			_planes.push_back(_source_planes[swizzle[c]]);
+	}
+	
+	float *buffers[MAX_AUDIO_CHANNELS];
+	
+	for(int c=0; c < _channels; c++)
+		buffers[c] = _source_planes[c] + offset;
+	
+	// the export thread fills it
+	WebMLock lock(_mutex);
+	
+	_request_buffers = buffers;
+	_request_samples = samples;
+	_requested = true;
+	
+	_packet_cond.Signal();
+	
+	while(_requested && !_abort)
+		_audio_cond.Wait(_mutex);
+	
+	return (!_requested && _request_ok);
+}
+
+
+void
+AudioEncoder::ServeAudio()
+{
+	if(!_requested)
+		return;
+	
+	_timing.Begin(TIMING_AUDIO_GET);
+	
+	_request_ok = _source.GetAudio(_request_samples, _request_buffers);
+	
+	_timing.End(TIMING_AUDIO_GET);
+	
+	_stats.source_calls++;
+	
+	_requested = false;
+	
+	_audio_cond.Signal();
+}
+
+
+bool
+AudioEncoder::RunOpus()
+{
+	int64_t current_sample = 0;
+	
+	// whole frames from Premiere, so the last one goes past the end
+	int64_t pull_left = ((_end_sample + _frame_size - 1) / _frame_size) * _frame_size;
+	
+	int buffered_start = 0; // where the next frame is in _buffer
+	int buffered = 0;
+	
+	while(current_sample < _end_sample)
+	{
+		const int samples = _frame_size;
+		
+		if(buffered < samples)
+		{
+			if(buffered > 0)
+			{
+				for(int c=0; c < _channels; c++)
+					memmove(_source_planes[c], _source_planes[c] + buffered_start, sizeof(float) * buffered);
+			}
+			
+			buffered_start = 0;
+			
+			const int pull = (int)std::min<int64_t>(_pull_size, pull_left);
+			
+			if( !ReadAudio(buffered, pull) )
+				return false;
+			
+			buffered += pull;
+			pull_left -= pull;
+		}
+		
+		assert(buffered >= samples);
+		
+		const double start = WebMSeconds();
+		
+		const float *planes[MAX_AUDIO_CHANNELS];
+		
+		for(int c=0; c < _channels; c++)
+			planes[c] = _planes[c] + buffered_start;
+		
+		InterleaveAudio(&_interleaved[0], planes, _channels, samples);
+		
+		const int len = opus_multistream_encode_float(_opus, &_interleaved[0], _frame_size,
+														&_compressed[0], _compressed.size());
+		
+		_timing.Add(TIMING_AUDIO_ENCODE, _track, start, WebMSeconds());
+		
+		if(len < 0)
+			return false;
+		
+		if(len > 0)
+		{
+			const uint64_t timestamp = current_sample * S2NS / (uint64_t)_sample_rate;
+			
+			int64_t discard_padding = 0;
+			
+			if((current_sample + samples) > _end_sample)
+			{
+				const int64_t discard_padding_samples = (current_sample + samples) - _end_sample;
+				
+				discard_padding = discard_padding_samples * S2NS / (int64_t)_sample_rate;
+			}
+			
+			if( !Publish(new AudioPacket(&_compressed[0], len, timestamp, discard_padding)) )
+				return false;
+		}
+		
+		buffered_start += samples;
+		buffered -= samples;
+		
+		current_sample += samples;
+	}
+	
+	return true;
+}
+
+
+bool
+AudioEncoder::RunVorbis()
+{
+	int64_t current_sample = 0;
+	
+	while(true)
+	{
+		// push out packets
+		while(vorbis_analysis_blockout(_vd, _vb) == 1)
+		{
+			const double start = WebMSeconds();
+			
+			vorbis_analysis(_vb, NULL);
+			vorbis_bitrate_addblock(_vb);
+			
+			_timing.Add(TIMING_AUDIO_ENCODE, _track, start, WebMSeconds());
+			
+			ogg_packet op;
+			
+			while( vorbis_bitrate_flushpacket(_vd, &op) )
+			{
+				// Vorbis packets are stamped with where they end
+				const uint64_t timestamp = op.granulepos * S2NS / (uint64_t)_sample_rate;
+				
+				if( !Publish(new AudioPacket(op.packet, op.bytes, timestamp, 0)) )
+					return false;
+			}
+		}
+		
+		if(current_sample >= _end_sample)
+			break;
+		
+		
+		// make new packets
+		int samples = _frame_size; // _frame_size is also the size of our buffer in samples
+		
+		if(samples > (_end_sample - current_sample))
+			samples = (_end_sample - current_sample);
+		
+		float **buffer = vorbis_analysis_buffer(_vd, samples);
+		
+		if( !ReadAudio(0, samples) )
+			return false;
+		
+		for(int c=0; c < _channels; c++)
+		{
+			memcpy(buffer[c], _planes[c], sizeof(float) * samples);
+		}
+		
+		vorbis_analysis_wrote(_vd, samples);
+		
+		current_sample += samples;
+		
+		if(current_sample >= _end_sample)
+			vorbis_analysis_wrote(_vd, NULL); // we have sent everything in
+	}
+	
+	return true;
+}
+
+
+void
+AudioEncoder::Run()
+{
+	bool ok = false;
+	
+	try{
+	
+	ok = (_opus != NULL ? RunOpus() : RunVorbis());
+	
+	}catch(...) { ok = false; }
+	
+	WebMLock lock(_mutex);
+	
+	if(ok)
+		_done = true;
+	else if(!_abort)
+		_error = true;
+	
+	_packet_cond.Broadcast();
+}
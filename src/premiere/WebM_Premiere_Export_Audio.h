@@ -0,0 +1,202 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_AUDIO_H
+#define WEBM_PREMIERE_EXPORT_AUDIO_H
+
+#include "WebM_Premiere_Platform.h"
+
+#include "WebM_Premiere_Export_Timing.h"
+
+#include <vorbis/codec.h>
+
+#include "opus_multistream.h"
+
+#include <stdint.h>
+
+#include <deque>
+#include <vector>
+
+
+// Where the audio comes from, planar float in Premiere's channel order
+// (Left, Right, Left Rear, Right Rear, Center, LFE).  Called on the export
+// thread, from AudioEncoder::Next().
+class AudioSource
+{
+  public:
+	virtual ~AudioSource() {}
+	
+	virtual bool GetAudio(int samples, float **buffers) = 0;
+};
+
+
+// The encoder's buffer is only good until the next call, so this is a copy
+class AudioPacket
+{
+  public:
+	AudioPacket(const void *data, size_t size, uint64_t timestamp, int64_t discard_padding);
+	~AudioPacket();
+	
+	void *buf;
+	size_t sz;
+	
+	uint64_t timestamp;			// nanoseconds
+	int64_t discard_padding;	// nanoseconds, 0 for none
+	
+  private:
+	AudioPacket(const AudioPacket &);
+	AudioPacket &operator=(const AudioPacket &);
+};
+
+
+typedef struct AudioEncoderStats
+{
+	unsigned int	packets;
+	unsigned int	source_calls;			// GetAudio, on the export thread
+	
+	unsigned int	mux_stalls;				// export thread waiting for a packet
+	double			mux_stall_seconds;
+	
+	unsigned int	encoder_stalls;			// audio thread waiting for the muxer
+	double			encoder_stall_seconds;
+} AudioEncoderStats;
+
+
+// Encodes the audio with Opus or Vorbis on a thread of its own, so that isn't
+// on the export thread with the video.  The SDK doesn't say the sequence audio
+// suite can be called from any thread but the one Premiere exports on, so the
+// audio still comes out of Premiere there: when the audio thread needs a
+// block it asks for it and waits, and the export thread fills it the next
+// time it comes for packets.  The packets wait in a bounded queue, in order,
+// stamped with their time.
+// The export thread still does all the muxing: for every video frame it takes
+// the packets up to that frame's time, waiting for them if it has to, which
+// keeps the audio interleaved with the video the way it always was.
+// Audio time goes to the timing on its own track.
+//
+// Opus frames can be as small as 120 samples, so rather than go to Premiere
+// for every one, the audio comes in blocks as big as Premiere allows, and the
+// frames are cut out of those and interleaved.  What's left of a block when
+// it runs out gets moved to the front ahead of the next one, so Premiere
+// always fills one piece of memory.
+//
+// The encoder belongs to the caller, set up with its headers already made,
+// and has to outlive this.
+class AudioEncoder : public WebMThread
+{
+  public:
+	// Opus, frame_size samples at a time out of pull_size blocks, end_sample counts the pre-skip
+	AudioEncoder(OpusMSEncoder *opus, int frame_size, int pull_size,
+					AudioSource &source, int channels, int sample_rate, int64_t end_sample,
+					size_t depth, ExportTiming &timing, int track);
+	
+	// Vorbis, Premiere gives us block_size samples at a time
+	AudioEncoder(vorbis_dsp_state *vd, vorbis_block *vb, int block_size,
+					AudioSource &source, int channels, int sample_rate, int64_t end_sample,
+					size_t depth, ExportTiming &timing, int track);
+	
+	virtual ~AudioEncoder();
+	
+	// export thread side
+	AudioPacket * Next(uint64_t up_to); // the next packet if it's at or before up_to, NULL if not or there are no more
+	
+	bool Done();
+	bool Error();
+	
+	const AudioEncoderStats & Stats() const { return _stats; }
+	
+  protected:
+	virtual void Run();
+	
+  private:
+	bool RunOpus();
+	bool RunVorbis();
+	
+	bool ReadAudio(int offset, int samples); // into _buffer at offset, which _planes see swizzled
+	void ServeAudio(); // export thread, with _mutex held
+	bool Publish(AudioPacket *pkt); // false if we're aborting
+	
+	OpusMSEncoder * const _opus;
+	
+	vorbis_dsp_state * const _vd;
+	vorbis_block * const _vb;
+	
+	const int _frame_size;
+	const int _pull_size;
+	
+	AudioSource &_source;
+	const int _channels;
+	const int _sample_rate;
+	const int64_t _end_sample;
+	const size_t _depth;
+	
+	ExportTiming &_timing;
+	const int _track;
+	
+	std::vector<float> _buffer;				// what Premiere gives us, _buffer_size samples a channel
+	int _buffer_size;
+	std::vector<float *> _source_planes;	// in Premiere's channel order
+	std::vector<float *> _planes;			// in the encoder's
+	
+	std::vector<float> _interleaved;			// Opus only
+	std::vector<unsigned char> _compressed;
+	
+	WebMMutex _mutex;
+	WebMCondition _packet_cond;		// signaled when a packet comes out or we're done
+	WebMCondition _room_cond;		// signaled when a packet is taken
+	WebMCondition _audio_cond;		// signaled when the export thread has filled a block
+	
+	std::deque<AudioPacket *> _packets;
+	
+	// the block the audio thread is waiting for
+	bool _requested;
+	float **_request_buffers;
+	int _request_samples;
+	bool _request_ok;
+	
+	bool _done;
+	bool _error;
+	bool _abort;
+	
+	AudioEncoderStats _stats;
+};
+
+
+#endif // WEBM_PREMIERE_EXPORT_AUDIO_H
@@ -0,0 +1,1516 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_Convert.h"
+
+#include "WebM_Premiere_Platform.h"
+#include "WebM_Premiere_Color.h"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+	#define WEBM_X86 1
+	
+	#include <emmintrin.h>
+	
+	// AVX2 kernels get compiled in whenever the compiler can target AVX2 for
+	// individual functions, and are only called if the CPU has it
+	#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+		#define WEBM_AVX2 1
+		#define WEBM_AVX2_TARGET
+	#elif defined(__clang__)
+		#if defined(__has_attribute)
+			#if __has_attribute(target)
+				#define WEBM_AVX2 1
+				#define WEBM_AVX2_TARGET __attribute__((target("avx2")))
+			#endif
+		#endif
+	#elif defined(__GNUC__) && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+		#define WEBM_AVX2 1
+		#define WEBM_AVX2_TARGET __attribute__((target("avx2")))
+	#endif
+	
+	#ifdef WEBM_AVX2
+		#include <immintrin.h>
+	#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+	#define WEBM_NEON 1
+	
+	#include <arm_neon.h>
+#endif
+
+
+// converting from Adobe 16-bit to regular 16-bit
+#define PF_HALF_CHAN16			16384
+
+static inline unsigned short
+Promote(const unsigned short &val)
+{
+	return (val > PF_HALF_CHAN16 ? ( (val - 1) << 1 ) + 1 : val << 1);
+}
+
+
+template <typename BGRA_PIX, typename IMG_PIX>
+static inline IMG_PIX
+DepthConvert(const BGRA_PIX &val, const int &depth);
+
+template<>
+inline unsigned short
+DepthConvert<unsigned short, unsigned short>(const unsigned short &val, const int &depth)
+{
+	return (Promote(val) >> (16 - depth));
+}
+
+template<>
+inline unsigned short
+DepthConvert<unsigned char, unsigned short>(const unsigned char &val, const int &depth)
+{
+	return ((unsigned short)val << (depth - 8)) | (val >> (16 - depth));
+}
+
+template<>
+inline unsigned char
+DepthConvert<unsigned short, unsigned char>(const unsigned short &val, const int &depth)
+{
+	assert(depth == 8);
+	return ( (((long)(val) * 255) + 16384) / 32768);
+}
+
+template<>
+inline unsigned char
+DepthConvert<unsigned char, unsigned char>(const unsigned char &val, const int &depth)
+{
+	assert(depth == 8);
+	return val;
+}
+
+
+// One row of VUYA, starting at pixel x, like BGRARow() below but without the
+// matrix.  Chroma gets averaged with the row below for MPEG-2 siting, the
+// same as the BGRA conversion does it in RGB.
+template <typename VUYA_PIX, typename IMG_PIX>
+static void
+VUYARow(IMG_PIX *imgY, IMG_PIX *imgU, IMG_PIX *imgV, IMG_PIX *imgA, const VUYA_PIX *prVUYA, const VUYA_PIX *prVUYAb,
+			int x, const int width, const unsigned int sub_x, const unsigned int sub_y, const bool chroma_row, const int depth)
+{
+	imgY += x;
+	imgU += x / sub_x;
+	imgV += x / sub_x;
+	
+	if(imgA != NULL)
+		imgA += x;
+	
+	const VUYA_PIX *prV = prVUYA + (x * 4) + 0;
+	const VUYA_PIX *prU = prVUYA + (x * 4) + 1;
+	const VUYA_PIX *prY = prVUYA + (x * 4) + 2;
+	const VUYA_PIX *prA = prVUYA + (x * 4) + 3;
+	
+	const VUYA_PIX *prVb = prVUYAb + (x * 4) + 0;
+	const VUYA_PIX *prUb = prVUYAb + (x * 4) + 1;
+	
+	for(; x < width; x++)
+	{
+		*imgY++ = DepthConvert<VUYA_PIX, IMG_PIX>(*prY, depth);
+		
+		if(imgA != NULL)
+			*imgA++ = DepthConvert<VUYA_PIX, IMG_PIX>(*prA, depth);
+		
+		if( chroma_row && (x % sub_x == 0) )
+		{
+			if(sub_y > 1)
+			{
+				*imgU++ = DepthConvert<VUYA_PIX, IMG_PIX>( ((int)*prU + (int)*prUb + 1) >> 1, depth);
+				*imgV++ = DepthConvert<VUYA_PIX, IMG_PIX>( ((int)*prV + (int)*prVb + 1) >> 1, depth);
+			}
+			else
+			{
+				*imgU++ = DepthConvert<VUYA_PIX, IMG_PIX>(*prU, depth);
+				*imgV++ = DepthConvert<VUYA_PIX, IMG_PIX>(*prV, depth);
+			}
+		}
+		
+		prY += 4;
+		prU += 4;
+		prV += 4;
+		prA += 4;
+		prUb += 4;
+		prVb += 4;
+	}
+}
+
+
+// Full range chroma can come out one past the top, 8-bit 255.5 rounds up to 256.
+// Adobe 16-bit tops out at 32768, so it never does.
+template <typename BGRA_PIX, typename MATRIX>
+static inline int
+ChromaClip(const int &val)
+{
+	return ((MATRIX::FULL_RANGE && sizeof(BGRA_PIX) == 1 && val > 255) ? 255 : val);
+}
+
+
+// One row of BGRA to YUV, starting at pixel x.  The SIMD versions below do
+// as much of the row as they can and leave the rest for this.  imgA gets the
+// alpha channel, or is NULL if we're not doing alpha.  MATRIX is one of the
+// types in WebM_Premiere_Color.h.
+template <typename BGRA_PIX, typename IMG_PIX, bool isARGB, typename MATRIX>
+static void
+BGRARow(IMG_PIX *imgY, IMG_PIX *imgU, IMG_PIX *imgV, IMG_PIX *imgA, const BGRA_PIX *prBGRA, const BGRA_PIX *prBGRAb,
+			int x, const int width, const unsigned int sub_x, const unsigned int sub_y, const bool chroma_row, const int depth)
+{
+	imgY += x;
+	imgU += x / sub_x;
+	imgV += x / sub_x;
+	
+	if(imgA != NULL)
+		imgA += x;
+	
+	// Media Encoder CS5 insists on handing us ARGB in some cases,
+	// even though we didn't list it as an option
+	const int b_chan = (isARGB ? 3 : 0);
+	const int g_chan = (isARGB ? 2 : 1);
+	const int r_chan = (isARGB ? 1 : 2);
+	const int a_chan = (isARGB ? 0 : 3);
+	
+	const BGRA_PIX *prB = prBGRA + (x * 4) + b_chan;
+	const BGRA_PIX *prG = prBGRA + (x * 4) + g_chan;
+	const BGRA_PIX *prR = prBGRA + (x * 4) + r_chan;
+	const BGRA_PIX *prA = prBGRA + (x * 4) + a_chan;
+	
+	// These are the pixels below the current one for MPEG-2 chroma siting
+	const BGRA_PIX *prBb = prBGRAb + (x * 4) + b_chan;
+	const BGRA_PIX *prGb = prBGRAb + (x * 4) + g_chan;
+	const BGRA_PIX *prRb = prBGRAb + (x * 4) + r_chan;
+	
+	
+	// using the conversion found here: http://www.fourcc.org/fccyvrgb.php
+	// and 601 spec here: http://www.itu.int/dms_pubrec/itu-r/rec/bt/R-REC-BT.601-7-201103-I!!PDF-E.pdf
+	// with the other matrices worked out the same way
+	
+	// these are part of the RGBtoYUV math (uses Adobe 16-bit)
+	const int Yadd = (sizeof(BGRA_PIX) > 1 ? MATRIX::YADD16 : MATRIX::YADD8);    // to be divided by 10000
+	const int UVadd = (sizeof(BGRA_PIX) > 1 ? MATRIX::UVADD16 : MATRIX::UVADD8); // includes extra 5000 for rounding
+	
+	for(; x < width; x++)
+	{
+		*imgY++ = DepthConvert<BGRA_PIX, IMG_PIX>( ((MATRIX::YR * (int)*prR) + (MATRIX::YG * (int)*prG) + (MATRIX::YB * (int)*prB) + Yadd) / 10000, depth);
+		
+		if(imgA != NULL)
+			*imgA++ = DepthConvert<BGRA_PIX, IMG_PIX>(*prA, depth);
+		
+		if(sub_y > 1)
+		{
+			if( chroma_row && (x % sub_x == 0) )
+			{
+				*imgV++ = DepthConvert<BGRA_PIX, IMG_PIX>( ChromaClip<BGRA_PIX, MATRIX>(
+									(((MATRIX::VR * (int)*prR) + (MATRIX::VG * (int)*prG) + (MATRIX::VB * (int)*prB) + UVadd) +
+									((MATRIX::VR * (int)*prRb) + (MATRIX::VG * (int)*prGb) + (MATRIX::VB * (int)*prBb) + UVadd)) / 20000), depth);
+				*imgU++ = DepthConvert<BGRA_PIX, IMG_PIX>( ChromaClip<BGRA_PIX, MATRIX>(
+									(((MATRIX::UR * (int)*prR) + (MATRIX::UG * (int)*prG) + (MATRIX::UB * (int)*prB) + UVadd) +
+									((MATRIX::UR * (int)*prRb) + (MATRIX::UG * (int)*prGb) + (MATRIX::UB * (int)*prBb) + UVadd)) / 20000), depth);
+			}
+			
+			prRb += 4;
+			prGb += 4;
+			prBb += 4;
+		}
+		else
+		{
+			if(x % sub_x == 0)
+			{
+				*imgV++ = DepthConvert<BGRA_PIX, IMG_PIX>( ChromaClip<BGRA_PIX, MATRIX>(
+									((MATRIX::VR * (int)*prR) + (MATRIX::VG * (int)*prG) + (MATRIX::VB * (int)*prB) + UVadd) / 10000), depth);
+				*imgU++ = DepthConvert<BGRA_PIX, IMG_PIX>( ChromaClip<BGRA_PIX, MATRIX>(
+									((MATRIX::UR * (int)*prR) + (MATRIX::UG * (int)*prG) + (MATRIX::UB * (int)*prB) + UVadd) / 10000), depth);
+			}
+		}
+		
+		prR += 4;
+		prG += 4;
+		prB += 4;
+		prA += 4;
+	}
+}
+
+
+#pragma mark-
+
+
+// The SIMD kernels have to match the code above exactly.  Everything in there
+// is a non-negative integer divided by 10000, or 20000 when averaging two rows.
+// We do that as a shift by 4 (or 5) and then a divide by 625, which is a
+// multiply by 2^41/625 rounded up.  That's exact for anything under 2^27, and
+// the largest thing we'll see, full range 16-bit U or V averaged over two rows,
+// shifted, is under 2^25.
+static const unsigned int kDiv625Magic = 3518437209u;
+
+// Premiere's 16-bit goes up to 32768, one too many for a signed short, so the
+// x86 kernels subtract 16384 from each channel and put it back in the constant.
+// The U and V coefficients add up to zero, so only Y needs it.
+#define SIMD_YADD16(M)	(M::YADD16 + (PF_HALF_CHAN16 * (M::YR + M::YG + M::YB)))
+
+
+#ifdef WEBM_X86
+
+// Eight pixels as four vectors of two, channels in 16-bit
+static inline void
+LoadPairs_SSE2(const unsigned char *pix, __m128i pairs[4])
+{
+	const __m128i zero = _mm_setzero_si128();
+	
+	const __m128i a = _mm_loadu_si128((const __m128i *)pix);
+	const __m128i b = _mm_loadu_si128((const __m128i *)(pix + 16));
+	
+	pairs[0] = _mm_unpacklo_epi8(a, zero);
+	pairs[1] = _mm_unpackhi_epi8(a, zero);
+	pairs[2] = _mm_unpacklo_epi8(b, zero);
+	pairs[3] = _mm_unpackhi_epi8(b, zero);
+}
+
+static inline void
+LoadPairs_SSE2(const unsigned short *pix, __m128i pairs[4])
+{
+	const __m128i half = _mm_set1_epi16(PF_HALF_CHAN16);
+	
+	for(int i=0; i < 4; i++)
+		pairs[i] = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(pix + (8 * i))), half);
+}
+
+
+static inline __m128i
+Coeffs_SSE2(bool isARGB, short r, short g, short b, short a = 0)
+{
+	return (isARGB ? _mm_setr_epi16(a, r, g, b, a, r, g, b) : _mm_setr_epi16(b, g, r, a, b, g, r, a));
+}
+
+
+// The weighted sums for four pixels, in 32-bit
+static inline __m128i
+Dot4_SSE2(const __m128i &a, const __m128i &b, const __m128i &coeffs)
+{
+	const __m128 ma = _mm_castsi128_ps(_mm_madd_epi16(a, coeffs));
+	const __m128 mb = _mm_castsi128_ps(_mm_madd_epi16(b, coeffs));
+	
+	return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(ma, mb, _MM_SHUFFLE(2, 0, 2, 0))),
+							_mm_castps_si128(_mm_shuffle_ps(ma, mb, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+
+// (n >> shift) / 625, see kDiv625Magic
+template <int shift>
+static inline __m128i
+Div625_SSE2(const __m128i &n)
+{
+	const __m128i magic = _mm_set1_epi32((int)kDiv625Magic);
+	
+	const __m128i m = _mm_srli_epi32(n, shift);
+	
+	const __m128i even = _mm_srli_epi64(_mm_mul_epu32(m, magic), 41);
+	const __m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(m, 32), magic), 41);
+	
+	return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+}
+
+
+// DepthConvert(), staying in 32-bit
+template <typename BGRA_PIX, typename IMG_PIX>
+static inline __m128i
+DepthConvert_SSE2(const __m128i &val, const int depth)
+{
+	if(sizeof(BGRA_PIX) > 1)
+	{
+		if(sizeof(IMG_PIX) > 1)
+		{
+			// Promote() is 2 * val, minus one if over half
+			const __m128i promoted = _mm_add_epi32(_mm_slli_epi32(val, 1), _mm_cmpgt_epi32(val, _mm_set1_epi32(PF_HALF_CHAN16)));
+			
+			return _mm_srl_epi32(promoted, _mm_cvtsi32_si128(16 - depth));
+		}
+		else
+		{
+			const __m128i times255 = _mm_sub_epi32(_mm_slli_epi32(val, 8), val);
+			
+			return _mm_srli_epi32(_mm_add_epi32(times255, _mm_set1_epi32(16384)), 15);
+		}
+	}
+	else
+	{
+		if(sizeof(IMG_PIX) > 1)
+			return _mm_or_si128(_mm_sll_epi32(val, _mm_cvtsi32_si128(depth - 8)), _mm_srl_epi32(val, _mm_cvtsi32_si128(16 - depth)));
+		else
+			return val;
+	}
+}
+
+
+static inline void
+Store4_SSE2(unsigned char *out, const __m128i &val)
+{
+	const int four = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(val, val), _mm_setzero_si128()));
+	
+	memcpy(out, &four, 4);
+}
+
+static inline void
+Store4_SSE2(unsigned short *out, const __m128i &val)
+{
+	_mm_storel_epi64((__m128i *)out, _mm_packs_epi32(val, val));
+}
+
+static inline void
+Store8_SSE2(unsigned char *out, const __m128i &val0, const __m128i &val1)
+{
+	_mm_storel_epi64((__m128i *)out, _mm_packus_epi16(_mm_packs_epi32(val0, val1), _mm_setzero_si128()));
+}
+
+static inline void
+Store8_SSE2(unsigned short *out, const __m128i &val0, const __m128i &val1)
+{
+	_mm_storeu_si128((__m128i *)out, _mm_packs_epi32(val0, val1));
+}
+
+
+// V and U sums for the chroma samples in eight pixels, returns how many vectors of four
+static inline int
+ChromaSums_SSE2(const __m128i pairs[4], const bool subsampled, const __m128i &vCoeffs, const __m128i &uCoeffs, __m128i v[2], __m128i u[2])
+{
+	if(subsampled)
+	{
+		// MPEG-2 siting, so just the even pixels
+		const __m128i even0 = _mm_unpacklo_epi64(pairs[0], pairs[1]);
+		const __m128i even1 = _mm_unpacklo_epi64(pairs[2], pairs[3]);
+		
+		v[0] = Dot4_SSE2(even0, even1, vCoeffs);
+		u[0] = Dot4_SSE2(even0, even1, uCoeffs);
+		
+		return 1;
+	}
+	else
+	{
+		v[0] = Dot4_SSE2(pairs[0], pairs[1], vCoeffs);
+		v[1] = Dot4_SSE2(pairs[2], pairs[3], vCoeffs);
+		u[0] = Dot4_SSE2(pairs[0], pairs[1], uCoeffs);
+		u[1] = Dot4_SSE2(pairs[2], pairs[3], uCoeffs);
+		
+		return 2;
+	}
+}
+
+
+// ChromaClip(), only ever one over
+template <typename BGRA_PIX, typename MATRIX>
+static inline __m128i
+ChromaClip_SSE2(const __m128i &val)
+{
+	if(MATRIX::FULL_RANGE && sizeof(BGRA_PIX) == 1)
+		return _mm_add_epi32(val, _mm_cmpgt_epi32(val, _mm_set1_epi32(255)));
+	else
+		return val;
+}
+
+
+template <typename BGRA_PIX, typename IMG_PIX, bool isARGB, typename MATRIX>
+static int
+BGRARow_SSE2(IMG_PIX *imgY, IMG_PIX *imgU, IMG_PIX *imgV, IMG_PIX *imgA, const BGRA_PIX *prBGRA, const BGRA_PIX *prBGRAb,
+				int x, const int width, const unsigned int sub_x, const unsigned int sub_y, const bool chroma_row, const int depth)
+{
+	const __m128i yCoeffs = Coeffs_SSE2(isARGB, MATRIX::YR, MATRIX::YG, MATRIX::YB);
+	const __m128i vCoeffs = Coeffs_SSE2(isARGB, MATRIX::VR, MATRIX::VG, MATRIX::VB);
+	const __m128i uCoeffs = Coeffs_SSE2(isARGB, MATRIX::UR, MATRIX::UG, MATRIX::UB);
+	const __m128i aCoeffs = Coeffs_SSE2(isARGB, 0, 0, 0, 1);
+	
+	const __m128i Yadd = _mm_set1_epi32(sizeof(BGRA_PIX) > 1 ? SIMD_YADD16(MATRIX) : MATRIX::YADD8);
+	const __m128i Aadd = _mm_set1_epi32(sizeof(BGRA_PIX) > 1 ? PF_HALF_CHAN16 : 0);
+	const __m128i UVadd = _mm_set1_epi32(sizeof(BGRA_PIX) > 1 ? MATRIX::UVADD16 : MATRIX::UVADD8);
+	const __m128i UVadd2 = _mm_add_epi32(UVadd, UVadd);
+	
+	for(; x + 8 <= width; x += 8)
+	{
+		__m128i pairs[4];
+		LoadPairs_SSE2(prBGRA + (x * 4), pairs);
+		
+		const __m128i y0 = Div625_SSE2<4>(_mm_add_epi32(Dot4_SSE2(pairs[0], pairs[1], yCoeffs), Yadd));
+		const __m128i y1 = Div625_SSE2<4>(_mm_add_epi32(Dot4_SSE2(pairs[2], pairs[3], yCoeffs), Yadd));
+		
+		Store8_SSE2(imgY + x, DepthConvert_SSE2<BGRA_PIX, IMG_PIX>(y0, depth), DepthConvert_SSE2<BGRA_PIX, IMG_PIX>(y1, depth));
+		
+		if(imgA != NULL)
+		{
+			// pulling alpha out with a dot product is cheaper than shuffling it out
+			const __m128i a0 = _mm_add_epi32(Dot4_SSE2(pairs[0], pairs[1], aCoeffs), Aadd);
+			const __m128i a1 = _mm_add_epi32(Dot4_SSE2(pairs[2], pairs[3], aCoeffs), Aadd);
+			
+			Store8_SSE2(imgA + x, DepthConvert_SSE2<BGRA_PIX, IMG_PIX>(a0, depth), DepthConvert_SSE2<BGRA_PIX, IMG_PIX>(a1, depth));
+		}
+		
+		if(chroma_row)
+		{
+			__m128i v[2], u[2];
+			
+			const int n = ChromaSums_SSE2(pairs, (sub_x > 1), vCoeffs, uCoeffs, v, u);
+			
+			if(sub_y > 1)
+			{
+				__m128i below[4], vb[2], ub[2];
+				LoadPairs_SSE2(prBGRAb + (x * 4), below);
+				
+				ChromaSums_SSE2(below, (sub_x > 1), vCoeffs, uCoeffs, vb, ub);
+				
+				for(int i=0; i < n; i++)
+				{
+					v[i] = Div625_SSE2<5>(_mm_add_epi32(_mm_add_epi32(v[i], vb[i]), UVadd2));
+					u[i] = Div625_SSE2<5>(_mm_add_epi32(_mm_add_epi32(u[i], ub[i]), UVadd2));
+				}
+			}
+			else
+			{
+				for(int i=0; i < n; i++)
+				{
+					v[i] = Div625_SSE2<4>(_mm_add_epi32(v[i], UVadd));
+					u[i] = Div625_SSE2<4>(_mm_add_epi32(u[i], UVadd));
+				}
+			}
+			
+			for(int i=0; i < n; i++)
+			{
+				v[i] = DepthConvert_SSE2<BGRA_PIX, IMG_PIX>(ChromaClip_SSE2<BGRA_PIX, MATRIX>(v[i]), depth);
+				u[i] = DepthConvert_SSE2<BGRA_PIX, IMG_PIX>(ChromaClip_SSE2<BGRA_PIX, MATRIX>(u[i]), depth);
+			}
+			
+			if(n == 1)
+			{
+				Store4_SSE2(imgV + (x / sub_x), v[0]);
+				Store4_SSE2(imgU + (x / sub_x), u[0]);
+			}
+			else
+			{
+				Store8_SSE2(imgV + x, v[0], v[1]);
+				Store8_SSE2(imgU + x, u[0], u[1]);
+			}
+		}
+	}
+	
+	return x;
+}
+
+
+// Premiere's 16-bit VUYA straight into 10 or 12-bit planes, eight pixels at a
+// time.  There's no matrix, so it's all unpacking and shifting.  Only the
+// 16-bit case gets kernels, 8-bit VUYX is always 4:4:4 and barely any work.
+static inline void
+LoadVUYA_SSE2(const unsigned short *pix, __m128i chan[4])
+{
+	const __m128i p0 = _mm_loadu_si128((const __m128i *)pix + 0);
+	const __m128i p1 = _mm_loadu_si128((const __m128i *)pix + 1);
+	const __m128i p2 = _mm_loadu_si128((const __m128i *)pix + 2);
+	const __m128i p3 = _mm_loadu_si128((const __m128i *)pix + 3);
+	
+	// V0 V2 U0 U2 Y0 Y2 A0 A2, V1 V3 U1 U3 Y1 Y3 A1 A3, ...
+	const __m128i t0 = _mm_unpacklo_epi16(p0, p1);
+	const __m128i t1 = _mm_unpackhi_epi16(p0, p1);
+	const __m128i t2 = _mm_unpacklo_epi16(p2, p3);
+	const __m128i t3 = _mm_unpackhi_epi16(p2, p3);
+	
+	// V0 V1 V2 V3 U0 U1 U2 U3, Y0 Y1 Y2 Y3 A0 A1 A2 A3, ...
+	const __m128i vu0 = _mm_unpacklo_epi16(t0, t1);
+	const __m128i ya0 = _mm_unpackhi_epi16(t0, t1);
+	const __m128i vu1 = _mm_unpacklo_epi16(t2, t3);
+	const __m128i ya1 = _mm_unpackhi_epi16(t2, t3);
+	
+	chan[0] = _mm_unpacklo_epi64(vu0, vu1);
+	chan[1] = _mm_unpackhi_epi64(vu0, vu1);
+	chan[2] = _mm_unpacklo_epi64(ya0, ya1);
+	chan[3] = _mm_unpackhi_epi64(ya0, ya1);
+}
+
+
+// DepthConvert() for 16-bit to 16-bit.  Promote() can make 65536 out of 32768,
+// which wraps to 0 here, but then the minus one takes it to 65535 like it should.
+static inline __m128i
+DepthConvert16_SSE2(const __m128i &val, const __m128i &shift)
+{
+	const __m128i over_half = _mm_min_epi16(_mm_subs_epu16(val, _mm_set1_epi16(PF_HALF_CHAN16)), _mm_set1_epi16(1));
+	
+	return _mm_srl_epi16(_mm_sub_epi16(_mm_slli_epi16(val, 1), over_half), shift);
+}
+
+
+// Every other lane, in the low four.  Premiere's 16-bit tops out at 0x8000,
+// which comes through the sign extension and saturating pack unchanged.
+static inline __m128i
+EvenLanes16_SSE2(const __m128i &val)
+{
+	const __m128i even = _mm_srai_epi32(_mm_slli_epi32(val, 16), 16);
+	
+	return _mm_packs_epi32(even, even);
+}
+
+
+static int
+VUYA16Row_SSE2(unsigned short *imgY, unsigned short *imgU, unsigned short *imgV, unsigned short *imgA,
+				const unsigned short *prVUYA, const unsigned short *prVUYAb,
+				int x, const int width, const unsigned int sub_x, const unsigned int sub_y, const bool chroma_row, const int depth)
+{
+	const __m128i shift = _mm_cvtsi32_si128(16 - depth);
+	
+	for(; x + 8 <= width; x += 8)
+	{
+		__m128i chan[4];
+		LoadVUYA_SSE2(prVUYA + (x * 4), chan);
+		
+		_mm_storeu_si128((__m128i *)(imgY + x), DepthConvert16_SSE2(chan[2], shift));
+		
+		if(imgA != NULL)
+			_mm_storeu_si128((__m128i *)(imgA + x), DepthConvert16_SSE2(chan[3], shift));
+		
+		if(chroma_row)
+		{
+			__m128i v = chan[0];
+			__m128i u = chan[1];
+			
+			if(sub_y > 1)
+			{
+				__m128i below[4];
+				LoadVUYA_SSE2(prVUYAb + (x * 4), below);
+				
+				// (a + b + 1) >> 1, same as VUYARow()
+				v = _mm_avg_epu16(v, below[0]);
+				u = _mm_avg_epu16(u, below[1]);
+			}
+			
+			if(sub_x > 1)
+			{
+				_mm_storel_epi64((__m128i *)(imgV + (x / 2)), DepthConvert16_SSE2(EvenLanes16_SSE2(v), shift));
+				_mm_storel_epi64((__m128i *)(imgU + (x / 2)), DepthConvert16_SSE2(EvenLanes16_SSE2(u), shift));
+			}
+			else
+			{
+				_mm_storeu_si128((__m128i *)(imgV + x), DepthConvert16_SSE2(v, shift));
+				_mm_storeu_si128((__m128i *)(imgU + x), DepthConvert16_SSE2(u, shift));
+			}
+		}
+	}
+	
+	return x;
+}
+
+#endif // WEBM_X86
+
+
+#ifdef WEBM_AVX2
+
+// Same as the SSE2 code, sixteen pixels at a time.  AVX2 mostly works on two
+// 128-bit lanes, so the pixel pairs are arranged such that each lane ends up
+// with four consecutive pixels.
+
+WEBM_AVX2_TARGET
+static inline void
+LoadPairs_AVX2(const unsigned char *pix, __m256i pairs[4])
+{
+	const __m256i zero = _mm256_setzero_si256();
+	
+	const __m256i a = _mm256_loadu_si256((const __m256i *)pix);
+	const __m256i b = _mm256_loadu_si256((const __m256i *)(pix + 32));
+	
+	pairs[0] = _mm256_unpacklo_epi8(a, zero); // pixels 0,1 | 4,5
+	pairs[1] = _mm256_unpackhi_epi8(a, zero); // pixels 2,3 | 6,7
+	pairs[2] = _mm256_unpacklo_epi8(b, zero);
+	pairs[3] = _mm256_unpackhi_epi8(b, zero);
+}
+
+WEBM_AVX2_TARGET
+static inline void
+LoadPairs_AVX2(const unsigned short *pix, __m256i pairs[4])
+{
+	const __m256i half = _mm256_set1_epi16(PF_HALF_CHAN16);
+	
+	for(int i=0; i < 2; i++)
+	{
+		const __m256i a = _mm256_loadu_si256((const __m256i *)(pix + (32 * i))); // pixels 0,1 | 2,3
+		const __m256i b = _mm256_loadu_si256((const __m256i *)(pix + (32 * i) + 16)); // pixels 4,5 | 6,7
+		
+		pairs[(2 * i) + 0] = _mm256_sub_epi16(_mm256_permute2x128_si256(a, b, 0x20), half);
+		pairs[(2 * i) + 1] = _mm256_sub_epi16(_mm256_permute2x128_si256(a, b, 0x31), half);
+	}
+}
+
+
+WEBM_AVX2_TARGET
+static inline __m256i
+Coeffs_AVX2(bool isARGB, short r, short g, short b, short a = 0)
+{
+	return (isARGB ? _mm256_setr_epi16(a, r, g, b, a, r, g, b, a, r, g, b, a, r, g, b) :
+						_mm256_setr_epi16(b, g, r, a, b, g, r, a, b, g, r, a, b, g, r, a));
+}
+
+
+WEBM_AVX2_TARGET
+static inline __m256i
+Dot8_AVX2(const __m256i &a, const __m256i &b, const __m256i &coeffs)
+{
+	const __m256 ma = _mm256_castsi256_ps(_mm256_madd_epi16(a, coeffs));
+	const __m256 mb = _mm256_castsi256_ps(_mm256_madd_epi16(b, coeffs));
+	
+	return _mm256_add_epi32(_mm256_castps_si256(_mm256_shuffle_ps(ma, mb, _MM_SHUFFLE(2, 0, 2, 0))),
+							_mm256_castps_si256(_mm256_shuffle_ps(ma, mb, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+
+template <int shift>
+WEBM_AVX2_TARGET
+static inline __m256i
+Div625_AVX2(const __m256i &n)
+{
+	const __m256i magic = _mm256_set1_epi32((int)kDiv625Magic);
+	
+	const __m256i m = _mm256_srli_epi32(n, shift);
+	
+	const __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(m, magic), 41);
+	const __m256i odd = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(m, 32), magic), 41);
+	
+	return _mm256_or_si256(even, _mm256_slli_epi64(odd, 32));
+}
+
+
+template <typename BGRA_PIX, typename IMG_PIX>
+WEBM_AVX2_TARGET
+static inline __m256i
+DepthConvert_AVX2(const __m256i &val, const int depth)
+{
+	if(sizeof(BGRA_PIX) > 1)
+	{
+		if(sizeof(IMG_PIX) > 1)
+		{
+			const __m256i promoted = _mm256_add_epi32(_mm256_slli_epi32(val, 1), _mm256_cmpgt_epi32(val, _mm256_set1_epi32(PF_HALF_CHAN16)));
+			
+			return _mm256_srl_epi32(promoted, _mm_cvtsi32_si128(16 - depth));
+		}
+		else
+		{
+			const __m256i times255 = _mm256_sub_epi32(_mm256_slli_epi32(val, 8), val);
+			
+			return _mm256_srli_epi32(_mm256_add_epi32(times255, _mm256_set1_epi32(16384)), 15);
+		}
+	}
+	else
+	{
+		if(sizeof(IMG_PIX) > 1)
+			return _mm256_or_si256(_mm256_sll_epi32(val, _mm_cvtsi32_si128(depth - 8)), _mm256_srl_epi32(val, _mm_cvtsi32_si128(16 - depth)));
+		else
+			return val;
+	}
+}
+
+
+WEBM_AVX2_TARGET
+static inline void
+Store8_AVX2(unsigned char *out, const __m256i &val)
+{
+	const __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(val, val), _mm256_setzero_si256());
+	
+	_mm_storel_epi64((__m128i *)out, _mm_unpacklo_epi32(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1)));
+}
+
+WEBM_AVX2_TARGET
+static inline void
+Store8_AVX2(unsigned short *out, const __m256i &val)
+{
+	const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(val, val), _MM_SHUFFLE(3, 1, 2, 0));
+	
+	_mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(packed));
+}
+
+WEBM_AVX2_TARGET
+static inline void
+Store16_AVX2(unsigned char *out, const __m256i &val0, const __m256i &val1)
+{
+	const __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(val0, val1), _MM_SHUFFLE(3, 1, 2, 0));
+	const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), _MM_SHUFFLE(3, 1, 2, 0));
+	
+	_mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(packed));
+}
+
+WEBM_AVX2_TARGET
+static inline void
+Store16_AVX2(unsigned short *out, const __m256i &val0, const __m256i &val1)
+{
+	const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(val0, val1), _MM_SHUFFLE(3, 1, 2, 0));
+	
+	_mm256_storeu_si256((__m256i *)out, packed);
+}
+
+
+WEBM_AVX2_TARGET
+static inline int
+ChromaSums_AVX2(const __m256i pairs[4], const bool subsampled, const __m256i &vCoeffs, const __m256i &uCoeffs, __m256i v[2], __m256i u[2])
+{
+	if(subsampled)
+	{
+		const __m256i even0 = _mm256_unpacklo_epi64(pairs[0], pairs[1]); // pixels 0,2 | 4,6
+		const __m256i even1 = _mm256_unpacklo_epi64(pairs[2], pairs[3]); // pixels 8,10 | 12,14
+		
+		const __m256i a = _mm256_permute2x128_si256(even0, even1, 0x20); // 0,2 | 8,10
+		const __m256i b = _mm256_permute2x128_si256(even0, even1, 0x31); // 4,6 | 12,14
+		
+		v[0] = Dot8_AVX2(a, b, vCoeffs);
+		u[0] = Dot8_AVX2(a, b, uCoeffs);
+		
+		return 1;
+	}
+	else
+	{
+		v[0] = Dot8_AVX2(pairs[0], pairs[1], vCoeffs);
+		v[1] = Dot8_AVX2(pairs[2], pairs[3], vCoeffs);
+		u[0] = Dot8_AVX2(pairs[0], pairs[1], uCoeffs);
+		u[1] = Dot8_AVX2(pairs[2], pairs[3], uCoeffs);
+		
+		return 2;
+	}
+}
+
+
+template <typename BGRA_PIX, typename MATRIX>
+WEBM_AVX2_TARGET
+static inline __m256i
+ChromaClip_AVX2(const __m256i &val)
+{
+	if(MATRIX::FULL_RANGE && sizeof(BGRA_PIX) == 1)
+		return _mm256_min_epi32(val, _mm256_set1_epi32(255));
+	else
+		return val;
+}
+
+
+template <typename BGRA_PIX, typename IMG_PIX, bool isARGB, typename MATRIX>
+WEBM_AVX2_TARGET
+static int
+BGRARow_AVX2(IMG_PIX *imgY, IMG_PIX *imgU, IMG_PIX *imgV, IMG_PIX *imgA, const BGRA_PIX *prBGRA, const BGRA_PIX *prBGRAb,
+				int x, const int width, const unsigned int sub_x, const unsigned int sub_y, const bool chroma_row, const int depth)
+{
+	const __m256i yCoeffs = Coeffs_AVX2(isARGB, MATRIX::YR, MATRIX::YG, MATRIX::YB);
+	const __m256i vCoeffs = Coeffs_AVX2(isARGB, MATRIX::VR, MATRIX::VG, MATRIX::VB);
+	const __m256i uCoeffs = Coeffs_AVX2(isARGB, MATRIX::UR, MATRIX::UG, MATRIX::UB);
+	const __m256i aCoeffs = Coeffs_AVX2(isARGB, 0, 0, 0, 1);
+	
+	const __m256i Yadd = _mm256_set1_epi32(sizeof(BGRA_PIX) > 1 ? SIMD_YADD16(MATRIX) : MATRIX::YADD8);
+	const __m256i Aadd = _mm256_set1_epi32(sizeof(BGRA_PIX) > 1 ? PF_HALF_CHAN16 : 0);
+	const __m256i UVadd = _mm256_set1_epi32(sizeof(BGRA_PIX) > 1 ? MATRIX::UVADD16 : MATRIX::UVADD8);
+	const __m256i UVadd2 = _mm256_add_epi32(UVadd, UVadd);
+	
+	for(; x + 16 <= width; x += 16)
+	{
+		__m256i pairs[4];
+		LoadPairs_AVX2(prBGRA + (x * 4), pairs);
+		
+		const __m256i y0 = Div625_AVX2<4>(_mm256_add_epi32(Dot8_AVX2(pairs[0], pairs[1], yCoeffs), Yadd));
+		const __m256i y1 = Div625_AVX2<4>(_mm256_add_epi32(Dot8_AVX2(pairs[2], pairs[3], yCoeffs), Yadd));
+		
+		Store16_AVX2(imgY + x, DepthConvert_AVX2<BGRA_PIX, IMG_PIX>(y0, depth), DepthConvert_AVX2<BGRA_PIX, IMG_PIX>(y1, depth));
+		
+		if(imgA != NULL)
+		{
+			const __m256i a0 = _mm256_add_epi32(Dot8_AVX2(pairs[0], pairs[1], aCoeffs), Aadd);
+			const __m256i a1 = _mm256_add_epi32(Dot8_AVX2(pairs[2], pairs[3], aCoeffs), Aadd);
+			
+			Store16_AVX2(imgA + x, DepthConvert_AVX2<BGRA_PIX, IMG_PIX>(a0, depth), DepthConvert_AVX2<BGRA_PIX, IMG_PIX>(a1, depth));
+		}
+		
+		if(chroma_row)
+		{
+			__m256i v[2], u[2];
+			
+			const int n = ChromaSums_AVX2(pairs, (sub_x > 1), vCoeffs, uCoeffs, v, u);
+			
+			if(sub_y > 1)
+			{
+				__m256i below[4], vb[2], ub[2];
+				LoadPairs_AVX2(prBGRAb + (x * 4), below);
+				
+				ChromaSums_AVX2(below, (sub_x > 1), vCoeffs, uCoeffs, vb, ub);
+				
+				for(int i=0; i < n; i++)
+				{
+					v[i] = Div625_AVX2<5>(_mm256_add_epi32(_mm256_add_epi32(v[i], vb[i]), UVadd2));
+					u[i] = Div625_AVX2<5>(_mm256_add_epi32(_mm256_add_epi32(u[i], ub[i]), UVadd2));
+				}
+			}
+			else
+			{
+				for(int i=0; i < n; i++)
+				{
+					v[i] = Div625_AVX2<4>(_mm256_add_epi32(v[i], UVadd));
+					u[i] = Div625_AVX2<4>(_mm256_add_epi32(u[i], UVadd));
+				}
+			}
+			
+			for(int i=0; i < n; i++)
+			{
+				v[i] = DepthConvert_AVX2<BGRA_PIX, IMG_PIX>(ChromaClip_AVX2<BGRA_PIX, MATRIX>(v[i]), depth);
+				u[i] = DepthConvert_AVX2<BGRA_PIX, IMG_PIX>(ChromaClip_AVX2<BGRA_PIX, MATRIX>(u[i]), depth);
+			}
+			
+			if(n == 1)
+			{
+				Store8_AVX2(imgV + (x / sub_x), v[0]);
+				Store8_AVX2(imgU + (x / sub_x), u[0]);
+			}
+			else
+			{
+				Store16_AVX2(imgV + x, v[0], v[1]);
+				Store16_AVX2(imgU + x, u[0], u[1]);
+			}
+		}
+	}
+	
+	return x;
+}
+
+#endif // WEBM_AVX2
+
+
+#ifdef WEBM_NEON
+
+// NEON can deinterleave the channels on load and has unsigned widening
+// multiplies, so no offset games here.
+
+static inline void
+LoadChannels_NEON(const unsigned char *pix, uint16x8_t chan[4])
+{
+	const uint8x8x4_t px = vld4_u8(pix);
+	
+	for(int i=0; i < 4; i++)
+		chan[i] = vmovl_u8(px.val[i]);
+}
+
+static inline void
+LoadChannels_NEON(const unsigned short *pix, uint16x8_t chan[4])
+{
+	const uint16x8x4_t px = vld4q_u16(pix);
+	
+	for(int i=0; i < 4; i++)
+		chan[i] = px.val[i];
+}
+
+
+template <typename MATRIX>
+static inline uint32x4_t
+YSum_NEON(const uint16x4_t &r, const uint16x4_t &g, const uint16x4_t &b, const uint32x4_t &add)
+{
+	uint32x4_t sum = vmlal_n_u16(add, r, MATRIX::YR);
+	sum = vmlal_n_u16(sum, g, MATRIX::YG);
+	return vmlal_n_u16(sum, b, MATRIX::YB);
+}
+
+// the negative terms are summed separately, the total is never negative
+template <typename MATRIX>
+static inline uint32x4_t
+VSum_NEON(const uint16x4_t &r, const uint16x4_t &g, const uint16x4_t &b, const uint32x4_t &add)
+{
+	const uint32x4_t pos = vmlal_n_u16(add, r, MATRIX::VR);
+	const uint32x4_t neg = vmlal_n_u16(vmull_n_u16(g, -MATRIX::VG), b, -MATRIX::VB);
+	return vsubq_u32(pos, neg);
+}
+
+template <typename MATRIX>
+static inline uint32x4_t
+USum_NEON(const uint16x4_t &r, const uint16x4_t &g, const uint16x4_t &b, const uint32x4_t &add)
+{
+	const uint32x4_t pos = vmlal_n_u16(add, b, MATRIX::UB);
+	const uint32x4_t neg = vmlal_n_u16(vmull_n_u16(r, -MATRIX::UR), g, -MATRIX::UG);
+	return vsubq_u32(pos, neg);
+}
+
+
+template <int shift>
+static inline uint32x4_t
+Div625_NEON(const uint32x4_t &n)
+{
+	const uint32x2_t magic = vdup_n_u32(kDiv625Magic);
+	
+	const uint32x4_t m = vshrq_n_u32(n, shift);
+	
+	const uint64x2_t lo = vmull_u32(vget_low_u32(m), magic);
+	const uint64x2_t hi = vmull_u32(vget_high_u32(m), magic);
+	
+	return vshrq_n_u32(vcombine_u32(vshrn_n_u64(lo, 32), vshrn_n_u64(hi, 32)), 41 - 32);
+}
+
+
+template <typename BGRA_PIX, typename IMG_PIX>
+static inline uint32x4_t
+DepthConvert_NEON(const uint32x4_t &val, const int depth)
+{
+	if(sizeof(BGRA_PIX) > 1)
+	{
+		if(sizeof(IMG_PIX) > 1)
+		{
+			const uint32x4_t promoted = vaddq_u32(vshlq_n_u32(val, 1), vcgtq_u32(val, vdupq_n_u32(PF_HALF_CHAN16)));
+			
+			return vshlq_u32(promoted, vdupq_n_s32(-(16 - depth)));
+		}
+		else
+			return vshrq_n_u32(vaddq_u32(vmulq_n_u32(val, 255), vdupq_n_u32(16384)), 15);
+	}
+	else
+	{
+		if(sizeof(IMG_PIX) > 1)
+			return vorrq_u32(vshlq_u32(val, vdupq_n_s32(depth - 8)), vshlq_u32(val, vdupq_n_s32(-(16 - depth))));
+		else
+			return val;
+	}
+}
+
+
+static inline void
+Store4_NEON(unsigned char *out, const uint32x4_t &val)
+{
+	const uint16x4_t words = vmovn_u32(val);
+	const uint8x8_t bytes = vmovn_u16(vcombine_u16(words, words));
+	
+	const uint32_t four = vget_lane_u32(vreinterpret_u32_u8(bytes), 0);
+	
+	memcpy(out, &four, 4);
+}
+
+static inline void
+Store4_NEON(unsigned short *out, const uint32x4_t &val)
+{
+	vst1_u16(out, vmovn_u32(val));
+}
+
+static inline void
+Store8_NEON(unsigned char *out, const uint32x4_t &val0, const uint32x4_t &val1)
+{
+	vst1_u8(out, vmovn_u16(vcombine_u16(vmovn_u32(val0), vmovn_u32(val1))));
+}
+
+static inline void
+Store8_NEON(unsigned short *out, const uint32x4_t &val0, const uint32x4_t &val1)
+{
+	vst1q_u16(out, vcombine_u16(vmovn_u32(val0), vmovn_u32(val1)));
+}
+
+
+// V and U sums for the chroma samples in eight pixels, returns how many vectors of four
+template <typename MATRIX>
+static inline int
+ChromaSums_NEON(const uint16x8_t &r, const uint16x8_t &g, const uint16x8_t &b, const bool subsampled,
+					const uint32x4_t &add, uint32x4_t v[2], uint32x4_t u[2])
+{
+	if(subsampled)
+	{
+		// MPEG-2 siting, so just the even pixels
+		const uint16x4_t er = vuzp_u16(vget_low_u16(r), vget_high_u16(r)).val[0];
+		const uint16x4_t eg = vuzp_u16(vget_low_u16(g), vget_high_u16(g)).val[0];
+		const uint16x4_t eb = vuzp_u16(vget_low_u16(b), vget_high_u16(b)).val[0];
+		
+		v[0] = VSum_NEON<MATRIX>(er, eg, eb, add);
+		u[0] = USum_NEON<MATRIX>(er, eg, eb, add);
+		
+		return 1;
+	}
+	else
+	{
+		v[0] = VSum_NEON<MATRIX>(vget_low_u16(r), vget_low_u16(g), vget_low_u16(b), add);
+		v[1] = VSum_NEON<MATRIX>(vget_high_u16(r), vget_high_u16(g), vget_high_u16(b), add);
+		u[0] = USum_NEON<MATRIX>(vget_low_u16(r), vget_low_u16(g), vget_low_u16(b), add);
+		u[1] = USum_NEON<MATRIX>(vget_high_u16(r), vget_high_u16(g), vget_high_u16(b), add);
+		
+		return 2;
+	}
+}
+
+
+// ChromaClip()
+template <typename BGRA_PIX, typename MATRIX>
+static inline uint32x4_t
+ChromaClip_NEON(const uint32x4_t &val)
+{
+	if(MATRIX::FULL_RANGE && sizeof(BGRA_PIX) == 1)
+		return vminq_u32(val, vdupq_n_u32(255));
+	else
+		return val;
+}
+
+
+template <typename BGRA_PIX, typename IMG_PIX, bool isARGB, typename MATRIX>
+static int
+BGRARow_NEON(IMG_PIX *imgY, IMG_PIX *imgU, IMG_PIX *imgV, IMG_PIX *imgA, const BGRA_PIX *prBGRA, const BGRA_PIX *prBGRAb,
+				int x, const int width, const unsigned int sub_x, const unsigned int sub_y, const bool chroma_row, const int depth)
+{
+	const int b_chan = (isARGB ? 3 : 0);
+	const int g_chan = (isARGB ? 2 : 1);
+	const int r_chan = (isARGB ? 1 : 2);
+	const int a_chan = (isARGB ? 0 : 3);
+	
+	const uint32x4_t Yadd = vdupq_n_u32(sizeof(BGRA_PIX) > 1 ? MATRIX::YADD16 : MATRIX::YADD8);
+	const uint32x4_t UVadd = vdupq_n_u32(sizeof(BGRA_PIX) > 1 ? MATRIX::UVADD16 : MATRIX::UVADD8);
+	
+	for(; x + 8 <= width; x += 8)
+	{
+		uint16x8_t chan[4];
+		LoadChannels_NEON(prBGRA + (x * 4), chan);
+		
+		const uint16x8_t &r = chan[r_chan];
+		const uint16x8_t &g = chan[g_chan];
+		const uint16x8_t &b = chan[b_chan];
+		
+		const uint32x4_t y0 = Div625_NEON<4>(YSum_NEON<MATRIX>(vget_low_u16(r), vget_low_u16(g), vget_low_u16(b), Yadd));
+		const uint32x4_t y1 = Div625_NEON<4>(YSum_NEON<MATRIX>(vget_high_u16(r), vget_high_u16(g), vget_high_u16(b), Yadd));
+		
+		Store8_NEON(imgY + x, DepthConvert_NEON<BGRA_PIX, IMG_PIX>(y0, depth), DepthConvert_NEON<BGRA_PIX, IMG_PIX>(y1, depth));
+		
+		if(imgA != NULL)
+		{
+			const uint32x4_t a0 = vmovl_u16(vget_low_u16(chan[a_chan]));
+			const uint32x4_t a1 = vmovl_u16(vget_high_u16(chan[a_chan]));
+			
+			Store8_NEON(imgA + x, DepthConvert_NEON<BGRA_PIX, IMG_PIX>(a0, depth), DepthConvert_NEON<BGRA_PIX, IMG_PIX>(a1, depth));
+		}
+		
+		if(chroma_row)
+		{
+			uint32x4_t v[2], u[2];
+			
+			const int n = ChromaSums_NEON<MATRIX>(r, g, b, (sub_x > 1), UVadd, v, u);
+			
+			if(sub_y > 1)
+			{
+				uint16x8_t below[4];
+				LoadChannels_NEON(prBGRAb + (x * 4), below);
+				
+				uint32x4_t vb[2], ub[2];
+				
+				ChromaSums_NEON<MATRIX>(below[r_chan], below[g_chan], below[b_chan], (sub_x > 1), UVadd, vb, ub);
+				
+				for(int i=0; i < n; i++)
+				{
+					v[i] = Div625_NEON<5>(vaddq_u32(v[i], vb[i]));
+					u[i] = Div625_NEON<5>(vaddq_u32(u[i], ub[i]));
+				}
+			}
+			else
+			{
+				for(int i=0; i < n; i++)
+				{
+					v[i] = Div625_NEON<4>(v[i]);
+					u[i] = Div625_NEON<4>(u[i]);
+				}
+			}
+			
+			for(int i=0; i < n; i++)
+			{
+				v[i] = DepthConvert_NEON<BGRA_PIX, IMG_PIX>(ChromaClip_NEON<BGRA_PIX, MATRIX>(v[i]), depth);
+				u[i] = DepthConvert_NEON<BGRA_PIX, IMG_PIX>(ChromaClip_NEON<BGRA_PIX, MATRIX>(u[i]), depth);
+			}
+			
+			if(n == 1)
+			{
+				Store4_NEON(imgV + (x / sub_x), v[0]);
+				Store4_NEON(imgU + (x / sub_x), u[0]);
+			}
+			else
+			{
+				Store8_NEON(imgV + x, v[0], v[1]);
+				Store8_NEON(imgU + x, u[0], u[1]);
+			}
+		}
+	}
+	
+	return x;
+}
+
+
+// Same as VUYA16Row_SSE2(), but NEON deinterleaves on load
+static inline uint16x8_t
+DepthConvert16_NEON(const uint16x8_t &val, const int16x8_t &shift)
+{
+	// the compare is all ones when over half, so adding it takes one off
+	const uint16x8_t promoted = vaddq_u16(vshlq_n_u16(val, 1), vcgtq_u16(val, vdupq_n_u16(PF_HALF_CHAN16)));
+	
+	return vshlq_u16(promoted, shift);
+}
+
+
+static int
+VUYA16Row_NEON(unsigned short *imgY, unsigned short *imgU, unsigned short *imgV, unsigned short *imgA,
+				const unsigned short *prVUYA, const unsigned short *prVUYAb,
+				int x, const int width, const unsigned int sub_x, const unsigned int sub_y, const bool chroma_row, const int depth)
+{
+	const int16x8_t shift = vdupq_n_s16(depth - 16);
+	
+	for(; x + 8 <= width; x += 8)
+	{
+		const uint16x8x4_t chan = vld4q_u16(prVUYA + (x * 4));
+		
+		vst1q_u16(imgY + x, DepthConvert16_NEON(chan.val[2], shift));
+		
+		if(imgA != NULL)
+			vst1q_u16(imgA + x, DepthConvert16_NEON(chan.val[3], shift));
+		
+		if(chroma_row)
+		{
+			uint16x8_t v = chan.val[0];
+			uint16x8_t u = chan.val[1];
+			
+			if(sub_y > 1)
+			{
+				const uint16x8x4_t below = vld4q_u16(prVUYAb + (x * 4));
+				
+				v = vrhaddq_u16(v, below.val[0]);
+				u = vrhaddq_u16(u, below.val[1]);
+			}
+			
+			if(sub_x > 1)
+			{
+				vst1_u16(imgV + (x / 2), vget_low_u16(DepthConvert16_NEON(vuzpq_u16(v, v).val[0], shift)));
+				vst1_u16(imgU + (x / 2), vget_low_u16(DepthConvert16_NEON(vuzpq_u16(u, u).val[0], shift)));
+			}
+			else
+			{
+				vst1q_u16(imgV + x, DepthConvert16_NEON(v, shift));
+				vst1q_u16(imgU + x, DepthConvert16_NEON(u, shift));
+			}
+		}
+	}
+	
+	return x;
+}
+
+#endif // WEBM_NEON
+
+
+#pragma mark-
+
+
+template <typename BGRA_PIX, typename IMG_PIX, bool isARGB, typename MATRIX>
+static void
+CopyBGRAToImg(vpx_image_t *img, vpx_image_t *alpha_img, const char *frameBufferP, const int rowbytes, const int y_start, const int y_end)
+{
+	const unsigned int sub_x = img->x_chroma_shift + 1;
+	const unsigned int sub_y = img->y_chroma_shift + 1;
+	
+	const WebM_SIMD simd = WebMDetectSIMD();
+	
+	// alpha_img's U and V are already neutral, see FillNeutralChroma()
+	if(alpha_img != NULL)
+	{
+		assert(alpha_img->d_w == img->d_w && alpha_img->d_h == img->d_h);
+		assert(alpha_img->bit_depth == img->bit_depth);
+	}
+
+	for(int y = y_start; y < y_end; y++)
+	{
+		IMG_PIX *imgY = (IMG_PIX *)(img->planes[VPX_PLANE_Y] + (img->stride[VPX_PLANE_Y] * y));
+		IMG_PIX *imgU = (IMG_PIX *)(img->planes[VPX_PLANE_U] + (img->stride[VPX_PLANE_U] * (y / sub_y)));
+		IMG_PIX *imgV = (IMG_PIX *)(img->planes[VPX_PLANE_V] + (img->stride[VPX_PLANE_V] * (y / sub_y)));
+		
+		IMG_PIX *imgA = (alpha_img == NULL ? NULL : (IMG_PIX *)(alpha_img->planes[VPX_PLANE_Y] + (alpha_img->stride[VPX_PLANE_Y] * y)));
+		
+		const BGRA_PIX *prBGRA = (BGRA_PIX *)(frameBufferP + (rowbytes * (img->d_h - 1 - y)));
+		
+		// The row below the current one for MPEG-2 chroma siting,
+		// unless this is the last line and there is no row below
+		const BGRA_PIX *prBGRAb = prBGRA - (rowbytes / sizeof(BGRA_PIX));
+		
+		if(y == ((int)img->d_h - 1) || sub_y != 2)
+			prBGRAb = prBGRA;
+		
+		const bool chroma_row = (y % sub_y == 0);
+		
+		int x = 0;
+		
+	#ifdef WEBM_AVX2
+		if(simd == WEBM_SIMD_AVX2)
+			x = BGRARow_AVX2<BGRA_PIX, IMG_PIX, isARGB, MATRIX>(imgY, imgU, imgV, imgA, prBGRA, prBGRAb, x, img->d_w, sub_x, sub_y, chroma_row, img->bit_depth);
+	#endif
+	
+	#ifdef WEBM_X86
+		if(simd >= WEBM_SIMD_SSE2)
+			x = BGRARow_SSE2<BGRA_PIX, IMG_PIX, isARGB, MATRIX>(imgY, imgU, imgV, imgA, prBGRA, prBGRAb, x, img->d_w, sub_x, sub_y, chroma_row, img->bit_depth);
+	#endif
+	
+	#ifdef WEBM_NEON
+		if(simd == WEBM_SIMD_NEON)
+			x = BGRARow_NEON<BGRA_PIX, IMG_PIX, isARGB, MATRIX>(imgY, imgU, imgV, imgA, prBGRA, prBGRAb, x, img->d_w, sub_x, sub_y, chroma_row, img->bit_depth);
+	#endif
+		
+		BGRARow<BGRA_PIX, IMG_PIX, isARGB, MATRIX>(imgY, imgU, imgV, imgA, prBGRA, prBGRAb, x, img->d_w, sub_x, sub_y, chroma_row, img->bit_depth);
+	}
+}
+
+
+template <typename VUYA_PIX, typename IMG_PIX>
+static inline int
+VUYARow_SIMD(IMG_PIX *imgY, IMG_PIX *imgU, IMG_PIX *imgV, IMG_PIX *imgA, const VUYA_PIX *prVUYA, const VUYA_PIX *prVUYAb,
+				int x, const int width, const unsigned int sub_x, const unsigned int sub_y, const bool chroma_row, const int depth,
+				const WebM_SIMD simd)
+{
+	return x; // only 16-bit has kernels
+}
+
+template<>
+inline int
+VUYARow_SIMD<unsigned short, unsigned short>(unsigned short *imgY, unsigned short *imgU, unsigned short *imgV, unsigned short *imgA,
+				const unsigned short *prVUYA, const unsigned short *prVUYAb,
+				int x, const int width, const unsigned int sub_x, const unsigned int sub_y, const bool chroma_row, const int depth,
+				const WebM_SIMD simd)
+{
+#ifdef WEBM_X86
+	if(simd >= WEBM_SIMD_SSE2)
+		x = VUYA16Row_SSE2(imgY, imgU, imgV, imgA, prVUYA, prVUYAb, x, width, sub_x, sub_y, chroma_row, depth);
+#endif
+
+#ifdef WEBM_NEON
+	if(simd == WEBM_SIMD_NEON)
+		x = VUYA16Row_NEON(imgY, imgU, imgV, imgA, prVUYA, prVUYAb, x, width, sub_x, sub_y, chroma_row, depth);
+#endif
+
+	return x;
+}
+
+
+template <typename VUYA_PIX, typename IMG_PIX>
+static void
+CopyVUYAToImg(vpx_image_t *img, vpx_image_t *alpha_img, const char *frameBufferP, const int rowbytes, const int y_start, const int y_end)
+{
+	const unsigned int sub_x = img->x_chroma_shift + 1;
+	const unsigned int sub_y = img->y_chroma_shift + 1;
+	
+	const WebM_SIMD simd = WebMDetectSIMD();
+	
+	// alpha_img's U and V are already neutral, see FillNeutralChroma()
+	if(alpha_img != NULL)
+	{
+		assert(alpha_img->d_w == img->d_w && alpha_img->d_h == img->d_h);
+		assert(alpha_img->bit_depth == img->bit_depth);
+	}
+	
+	for(int y = y_start; y < y_end; y++)
+	{
+		IMG_PIX *imgY = (IMG_PIX *)(img->planes[VPX_PLANE_Y] + (img->stride[VPX_PLANE_Y] * y));
+		IMG_PIX *imgU = (IMG_PIX *)(img->planes[VPX_PLANE_U] + (img->stride[VPX_PLANE_U] * (y / sub_y)));
+		IMG_PIX *imgV = (IMG_PIX *)(img->planes[VPX_PLANE_V] + (img->stride[VPX_PLANE_V] * (y / sub_y)));
+		
+		IMG_PIX *imgA = (alpha_img == NULL ? NULL : (IMG_PIX *)(alpha_img->planes[VPX_PLANE_Y] + (alpha_img->stride[VPX_PLANE_Y] * y)));
+	
+		const VUYA_PIX *prVUYA = (VUYA_PIX *)(frameBufferP + (rowbytes * (img->d_h - 1 - y)));
+		
+		// the row below, same as CopyBGRAToImg()
+		const VUYA_PIX *prVUYAb = prVUYA - (rowbytes / sizeof(VUYA_PIX));
+		
+		if(y == ((int)img->d_h - 1) || sub_y != 2)
+			prVUYAb = prVUYA;
+		
+		const bool chroma_row = (y % sub_y == 0);
+		
+		const int x = VUYARow_SIMD<VUYA_PIX, IMG_PIX>(imgY, imgU, imgV, imgA, prVUYA, prVUYAb, 0, img->d_w, sub_x, sub_y, chroma_row, img->bit_depth, simd);
+		
+		VUYARow<VUYA_PIX, IMG_PIX>(imgY, imgU, imgV, imgA, prVUYA, prVUYAb, x, img->d_w, sub_x, sub_y, chroma_row, img->bit_depth);
+	}
+}
+
+
+#pragma mark-
+
+
+void
+CopyYUV420ToImg(vpx_image_t *img, const char *Y_PixelAddress, int Y_RowBytes,
+					const char *U_PixelAddress, int U_RowBytes,
+					const char *V_PixelAddress, int V_RowBytes,
+					int y_start, int y_end)
+{
+	assert(y_start % 2 == 0);
+
+	for(int y = y_start; y < y_end; y++)
+	{
+		unsigned char *imgY = img->planes[VPX_PLANE_Y] + (img->stride[VPX_PLANE_Y] * y);
+		
+		const unsigned char *prY = (unsigned char *)Y_PixelAddress + (Y_RowBytes * y);
+		
+		memcpy(imgY, prY, img->d_w * sizeof(unsigned char));
+	}
+	
+	const int chroma_width = (img->d_w / 2) + (img->d_w % 2);
+	const int chroma_start = (y_start / 2);
+	const int chroma_end = (y_end / 2) + (y_end % 2);
+	
+	for(int y = chroma_start; y < chroma_end; y++)
+	{
+		unsigned char *imgU = img->planes[VPX_PLANE_U] + (img->stride[VPX_PLANE_U] * y);
+		unsigned char *imgV = img->planes[VPX_PLANE_V] + (img->stride[VPX_PLANE_V] * y);
+		
+		const unsigned char *prU = (unsigned char *)U_PixelAddress + (U_RowBytes * y);
+		const unsigned char *prV = (unsigned char *)V_PixelAddress + (V_RowBytes * y);
+		
+		memcpy(imgU, prU, chroma_width * sizeof(unsigned char));
+		memcpy(imgV, prV, chroma_width * sizeof(unsigned char));
+	}
+}
+
+
+void
+CopyUYVYToImg(vpx_image_t *img, const char *frameBufferP, int rowbytes, int y_start, int y_end)
+{
+	for(int y = y_start; y < y_end; y++)
+	{
+		unsigned char *imgY = img->planes[VPX_PLANE_Y] + (img->stride[VPX_PLANE_Y] * y);
+		unsigned char *imgU = img->planes[VPX_PLANE_U] + (img->stride[VPX_PLANE_U] * y);
+		unsigned char *imgV = img->planes[VPX_PLANE_V] + (img->stride[VPX_PLANE_V] * y);
+	
+		const unsigned char *prUYVY = (unsigned char *)frameBufferP + (rowbytes * y);
+		
+		for(int x=0; x < (int)img->d_w; x++)
+		{
+			if(x % 2 == 0)
+				*imgU++ = *prUYVY++;
+			else
+				*imgV++ = *prUYVY++;
+			
+			*imgY++ = *prUYVY++;;
+		}
+	}
+}
+
+
+void
+CopyVUYAToImg(vpx_image_t *img, vpx_image_t *alpha_img, const char *frameBufferP, int rowbytes, bool sixteen_bit,
+				int y_start, int y_end)
+{
+	assert(y_start % (img->y_chroma_shift + 1) == 0);
+	
+	if(sixteen_bit)
+		CopyVUYAToImg<unsigned short, unsigned short>(img, alpha_img, frameBufferP, rowbytes, y_start, y_end);
+	else
+		CopyVUYAToImg<unsigned char, unsigned char>(img, alpha_img, frameBufferP, rowbytes, y_start, y_end);
+}
+
+
+template <typename MATRIX>
+static void
+CopyBGRAToImg(vpx_image_t *img, vpx_image_t *alpha_img, const char *frameBufferP, int rowbytes, bool sixteen_bit, bool isARGB,
+				int y_start, int y_end)
+{
+	if(sixteen_bit)
+	{
+		assert(!isARGB); // Premiere only has 8-bit ARGB
+	
+		if(img->bit_depth > 8)
+			CopyBGRAToImg<unsigned short, unsigned short, false, MATRIX>(img, alpha_img, frameBufferP, rowbytes, y_start, y_end);
+		else
+			CopyBGRAToImg<unsigned short, unsigned char, false, MATRIX>(img, alpha_img, frameBufferP, rowbytes, y_start, y_end);
+	}
+	else if(isARGB)
+	{
+		if(img->bit_depth > 8)
+			CopyBGRAToImg<unsigned char, unsigned short, true, MATRIX>(img, alpha_img, frameBufferP, rowbytes, y_start, y_end);
+		else
+			CopyBGRAToImg<unsigned char, unsigned char, true, MATRIX>(img, alpha_img, frameBufferP, rowbytes, y_start, y_end);
+	}
+	else
+	{
+		if(img->bit_depth > 8)
+			CopyBGRAToImg<unsigned char, unsigned short, false, MATRIX>(img, alpha_img, frameBufferP, rowbytes, y_start, y_end);
+		else
+			CopyBGRAToImg<unsigned char, unsigned char, false, MATRIX>(img, alpha_img, frameBufferP, rowbytes, y_start, y_end);
+	}
+}
+
+
+void
+CopyBGRAToImg(vpx_image_t *img, vpx_image_t *alpha_img, const char *frameBufferP, int rowbytes, bool sixteen_bit, bool isARGB,
+				int y_start, int y_end)
+{
+	assert(y_start % (img->y_chroma_shift + 1) == 0);
+	
+	const bool full_range = (img->range == VPX_CR_FULL_RANGE);
+	
+	switch( WebMColorMatrix(img->cs) )
+	{
+		case WEBM_MATRIX_709:
+			if(full_range)
+				CopyBGRAToImg<Color709Full>(img, alpha_img, frameBufferP, rowbytes, sixteen_bit, isARGB, y_start, y_end);
+			else
+				CopyBGRAToImg<Color709Studio>(img, alpha_img, frameBufferP, rowbytes, sixteen_bit, isARGB, y_start, y_end);
+			break;
+		
+		case WEBM_MATRIX_2020:
+			if(full_range)
+				CopyBGRAToImg<Color2020Full>(img, alpha_img, frameBufferP, rowbytes, sixteen_bit, isARGB, y_start, y_end);
+			else
+				CopyBGRAToImg<Color2020Studio>(img, alpha_img, frameBufferP, rowbytes, sixteen_bit, isARGB, y_start, y_end);
+			break;
+		
+		default:
+			if(full_range)
+				CopyBGRAToImg<Color601Full>(img, alpha_img, frameBufferP, rowbytes, sixteen_bit, isARGB, y_start, y_end);
+			else
+				CopyBGRAToImg<Color601Studio>(img, alpha_img, frameBufferP, rowbytes, sixteen_bit, isARGB, y_start, y_end);
+			break;
+	}
+}
+
+
+void
+FillNeutralChroma(vpx_image_t *img)
+{
+	const unsigned int chroma_width = (img->d_w + img->x_chroma_shift) >> img->x_chroma_shift;
+	const unsigned int chroma_height = (img->d_h + img->y_chroma_shift) >> img->y_chroma_shift;
+	
+	for(int p = VPX_PLANE_U; p <= VPX_PLANE_V; p++)
+	{
+		for(unsigned int y=0; y < chroma_height; y++)
+		{
+			if(img->fmt & VPX_IMG_FMT_HIGHBITDEPTH)
+			{
+				unsigned short *row = (unsigned short *)(img->planes[p] + (img->stride[p] * y));
+				
+				const unsigned short val = DepthConvert<unsigned char, unsigned short>(128, img->bit_depth);
+				
+				for(unsigned int x=0; x < chroma_width; x++)
+					*row++ = val;
+			}
+			else
+				memset(img->planes[p] + (img->stride[p] * y), 128, chroma_width);
+		}
+	}
+}
+
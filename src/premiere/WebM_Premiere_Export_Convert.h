@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_CONVERT_H
+#define WEBM_PREMIERE_EXPORT_CONVERT_H
+
+#include "vpx/vpx_image.h"
+
+
+// Converting Premiere's pixel buffers into vpx_image_t planes.
+// Packed buffers are bottom-up, rowbytes apart.  The 8-bit/16-bit
+// flag is for the buffer, the image's bit_depth decides the output.
+// For RGB, the image's cs and range pick the matrix, see WebM_Premiere_Color.h.
+//
+// Each call does image rows y_start up to y_end, so a frame can be split
+// into bands on different threads.  Bands have to start on a chroma row
+// (an even row for 4:2:0).
+
+void CopyYUV420ToImg(vpx_image_t *img, const char *Y_PixelAddress, int Y_RowBytes,
+						const char *U_PixelAddress, int U_RowBytes,
+						const char *V_PixelAddress, int V_RowBytes,
+						int y_start, int y_end);
+
+void CopyUYVYToImg(vpx_image_t *img, const char *frameBufferP, int rowbytes, int y_start, int y_end);
+
+// With alpha, the alpha channel goes into alpha_img's Y plane in the same
+// pass.  Its U and V are left alone, they should have been set once with
+// FillNeutralChroma() when the buffer was allocated.
+//
+// 16-bit VUYA goes straight to 10 or 12-bit planes of any subsampling, the
+// chroma sited like the BGRA conversion would have done it.
+
+void CopyVUYAToImg(vpx_image_t *img, vpx_image_t *alpha_img, const char *frameBufferP, int rowbytes, bool sixteen_bit,
+					int y_start, int y_end);
+
+void CopyBGRAToImg(vpx_image_t *img, vpx_image_t *alpha_img, const char *frameBufferP, int rowbytes, bool sixteen_bit, bool isARGB,
+					int y_start, int y_end);
+
+void FillNeutralChroma(vpx_image_t *img);
+
+
+#endif // WEBM_PREMIERE_EXPORT_CONVERT_H
@@ -0,0 +1,284 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_Governor.h"
+
+#include "vpx/vpx_encoder.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+
+
+static const GovernorRung vp8_ladder[] = {
+	{ VPX_DL_GOOD_QUALITY, 0 },
+	{ VPX_DL_GOOD_QUALITY, 1 },
+	{ VPX_DL_GOOD_QUALITY, 2 },
+	{ VPX_DL_GOOD_QUALITY, 3 },
+	{ VPX_DL_GOOD_QUALITY, 4 },
+	{ VPX_DL_GOOD_QUALITY, 5 },
+	{ VPX_DL_REALTIME, 6 },
+	{ VPX_DL_REALTIME, 8 },
+	{ VPX_DL_REALTIME, 10 },
+	{ VPX_DL_REALTIME, 12 },
+	{ VPX_DL_REALTIME, 16 } };
+
+static const GovernorRung vp9_ladder[] = {
+	{ VPX_DL_GOOD_QUALITY, 0 },
+	{ VPX_DL_GOOD_QUALITY, 1 },
+	{ VPX_DL_GOOD_QUALITY, 2 },
+	{ VPX_DL_GOOD_QUALITY, 3 },
+	{ VPX_DL_GOOD_QUALITY, 4 },
+	{ VPX_DL_GOOD_QUALITY, 5 },
+	{ VPX_DL_REALTIME, 5 },
+	{ VPX_DL_REALTIME, 6 },
+	{ VPX_DL_REALTIME, 7 },
+	{ VPX_DL_REALTIME, 8 } };
+
+
+static const char *
+DeadlineName(unsigned long deadline)
+{
+	return (deadline == VPX_DL_BEST_QUALITY ? "best" :
+			deadline == VPX_DL_GOOD_QUALITY ? "good" :
+			deadline == VPX_DL_REALTIME ? "realtime" :
+			"custom");
+}
+
+
+// A shorter deadline is faster, except 0, which is best quality.
+// Within a deadline, a higher cpu-used is, negative ones being the
+// adaptive versions of the same speed.
+static bool
+Faster(const GovernorRung &a, const GovernorRung &b)
+{
+	const unsigned long a_deadline = (a.deadline == VPX_DL_BEST_QUALITY ? ULONG_MAX : a.deadline);
+	const unsigned long b_deadline = (b.deadline == VPX_DL_BEST_QUALITY ? ULONG_MAX : b.deadline);
+	
+	if(a_deadline != b_deadline)
+		return (a_deadline < b_deadline);
+	else
+		return (abs(a.cpu_used) > abs(b.cpu_used));
+}
+
+
+DeadlineGovernor::DeadlineGovernor(double finish_time, bool vp9, bool two_pass,
+									unsigned long deadline, int cpu_used, int encoders) :
+	_finish_time(finish_time),
+	_encoders(encoders < 1 ? 1 : encoders),
+	_rung(-1),
+	_generation(0),
+	_governed(false),
+	_frames(0),
+	_done(0),
+	_window_start(WebMSeconds()),
+	_window_frames(0),
+	_window_busy(0),
+	_render_bound(false)
+{
+	const GovernorRung *ladder = (vp9 ? vp9_ladder : vp8_ladder);
+	const int rungs = (vp9 ? sizeof(vp9_ladder) : sizeof(vp8_ladder)) / sizeof(GovernorRung);
+	
+	for(int i=0; i < rungs; i++)
+	{
+		// realtime is a one-pass mode
+		if(two_pass && ladder[i].deadline == VPX_DL_REALTIME)
+			continue;
+		
+		if(ladder[i].deadline == deadline && ladder[i].cpu_used == cpu_used)
+			_rung = _ladder.size();
+		
+		_ladder.push_back(ladder[i]);
+	}
+	
+	if(_rung < 0)
+	{
+		// Not on the ladder, which means best quality, a custom deadline, or a
+		// --cpu-used we don't have.  It goes in before the first faster rung,
+		// so best quality is the slowest we'll go.
+		const GovernorRung start = { deadline, cpu_used };
+		
+		_rung = 0;
+		
+		while(_rung < (int)_ladder.size() && !Faster(_ladder[_rung], start))
+			_rung++;
+		
+		_ladder.insert(_ladder.begin() + _rung, start);
+	}
+	
+	_rung_frames.resize(_ladder.size(), 0);
+}
+
+
+void
+DeadlineGovernor::StartPass(int frames, bool governed)
+{
+	WebMLock lock(_mutex);
+	
+	_governed = governed;
+	_frames = frames;
+	_done = 0;
+	
+	_window_start = WebMSeconds();
+	_window_frames = 0;
+	_window_busy = 0;
+	
+	if(governed)
+	{
+		const double time_left = _finish_time - _window_start;
+		
+		WebMLog("Deadline governor: %d frames in %.0f seconds, starting at %s deadline, cpu-used %d",
+				frames, time_left, DeadlineName(_ladder[_rung].deadline), _ladder[_rung].cpu_used);
+	}
+}
+
+
+unsigned int
+DeadlineGovernor::Setting(unsigned long &deadline, int &cpu_used)
+{
+	WebMLock lock(_mutex);
+	
+	deadline = _ladder[_rung].deadline;
+	cpu_used = _ladder[_rung].cpu_used;
+	
+	return _generation;
+}
+
+
+void
+DeadlineGovernor::FrameEncoded(double seconds)
+{
+	WebMLock lock(_mutex);
+	
+	if(!_governed)
+		return;
+	
+	_done++;
+	_rung_frames[_rung]++;
+	
+	_window_frames++;
+	_window_busy += seconds;
+	
+	Adjust(WebMSeconds());
+}
+
+
+void
+DeadlineGovernor::Adjust(double now)
+{
+	// Give each setting a few seconds and a few frames per encoder,
+	// so we're measuring it and not the one before.
+	const double wall = now - _window_start;
+	
+	if(wall < 5.0 || _window_frames < 2 * _encoders || _done >= _frames)
+		return;
+	
+	const double fps = _window_frames / wall;
+	const double time_left = _finish_time - now;
+	const double needed = (time_left > 0 ? (_frames - _done) / time_left : 0);
+	const double busy = _window_busy / (_encoders * wall);
+	
+	int step = 0;
+	
+	if(time_left <= 0 || fps < needed)
+	{
+		const bool render_bound = (busy < 0.75);
+		
+		if(render_bound != _render_bound)
+		{
+			if(render_bound)
+				WebMLog("Deadline governor: behind, but the encoders are only %.0f%% busy, so rendering is the holdup", busy * 100);
+			
+			_render_bound = render_bound;
+		}
+		
+		if(!render_bound)
+			step = ((time_left <= 0 || fps < needed * 0.5) ? 2 : 1);
+	}
+	else if(fps > needed * 1.5)
+	{
+		// well ahead, spend some of it on quality
+		step = -1;
+	}
+	
+	int rung = _rung + step;
+	
+	if(rung < 0)
+		rung = 0;
+	else if(rung >= (int)_ladder.size())
+		rung = _ladder.size() - 1;
+	
+	if(rung != _rung)
+	{
+		WebMLog("Deadline governor: frame %d of %d, %.1f fps with %.1f needed, encoders %.0f%% busy, "
+				"%s deadline cpu-used %d -> %s deadline cpu-used %d",
+				_done, _frames, fps, needed, busy * 100,
+				DeadlineName(_ladder[_rung].deadline), _ladder[_rung].cpu_used,
+				DeadlineName(_ladder[rung].deadline), _ladder[rung].cpu_used);
+		
+		_rung = rung;
+		_generation++;
+	}
+	
+	_window_start = now;
+	_window_frames = 0;
+	_window_busy = 0;
+}
+
+
+void
+DeadlineGovernor::Report()
+{
+	WebMLock lock(_mutex);
+	
+	for(size_t i=0; i < _ladder.size(); i++)
+	{
+		if(_rung_frames[i] > 0)
+		{
+			WebMLog("Deadline governor: %u frames at %s deadline, cpu-used %d",
+					_rung_frames[i], DeadlineName(_ladder[i].deadline), _ladder[i].cpu_used);
+		}
+	}
+	
+	const double early = _finish_time - WebMSeconds();
+	
+	WebMLog("Deadline governor: finished %.0f seconds %s", (early >= 0 ? early : -early),
+			(early >= 0 ? "early" : "late"));
+}
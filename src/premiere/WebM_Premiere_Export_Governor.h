@@ -0,0 +1,108 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_GOVERNOR_H
+#define WEBM_PREMIERE_EXPORT_GOVERNOR_H
+
+#include "WebM_Premiere_Platform.h"
+
+#include <vector>
+
+
+// A speed setting, from slow and good to fast and rough
+typedef struct GovernorRung
+{
+	unsigned long	deadline;	// VPX_DL_*
+	int				cpu_used;
+} GovernorRung;
+
+
+// For exports that have to be done by a certain time.  The encoder threads
+// report every frame they finish, and every few seconds the governor compares
+// how fast frames are going with how fast they have to go to make the finish
+// time, moving cpu-used (and the deadline, for one-pass) up or down a rung.
+// It only speeds up when the encoders are what's holding things up; if they're
+// waiting on Premiere to render, a faster setting would just cost quality.
+// Only the last pass is governed, the first pass of two is fast anyway.
+// Every change is logged, and Report() logs how many frames got each setting.
+class DeadlineGovernor
+{
+  public:
+	// finish_time is on the WebMSeconds() clock, the rest is how the encoders start out
+	DeadlineGovernor(double finish_time, bool vp9, bool two_pass,
+						unsigned long deadline, int cpu_used, int encoders);
+	
+	// export thread, before the pass's encoders start
+	void StartPass(int frames, bool governed);
+	
+	// encoder threads, before each frame, returns a number that changes when the setting does
+	unsigned int Setting(unsigned long &deadline, int &cpu_used);
+	
+	// encoder threads, after each frame, with the time spent in the encoder
+	void FrameEncoded(double seconds);
+	
+	void Report();
+	
+  private:
+	void Adjust(double now); // with the mutex held
+	
+	const double _finish_time;
+	const int _encoders;
+	
+	std::vector<GovernorRung> _ladder;
+	std::vector<unsigned int> _rung_frames;
+	int _rung;
+	unsigned int _generation;
+	
+	bool _governed;
+	int _frames;		// in this pass
+	int _done;
+	
+	double _window_start;
+	int _window_frames;
+	double _window_busy;	// encoder seconds, over all the encoders
+	
+	bool _render_bound;
+	
+	WebMMutex _mutex;
+};
+
+
+#endif // WEBM_PREMIERE_EXPORT_GOVERNOR_H
@@ -0,0 +1,400 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_Ladder.h"
+
+#include "WebM_Premiere_Color.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sstream>
+
+
+static const uint64_t S2NS = 1000000000LL;
+
+// same as the movie, see the comment there
+static const uint64_t timeCodeScale = 1000000LL;
+
+
+bool
+ParseLadder(std::vector<LadderRung> &rungs, const std::string &ladder)
+{
+	rungs.clear();
+	
+	std::string::size_type pos = 0;
+	
+	while(pos < ladder.size())
+	{
+		std::string::size_type comma = ladder.find(',', pos);
+		
+		if(comma == std::string::npos)
+			comma = ladder.size();
+		
+		const std::string entry = ladder.substr(pos, comma - pos);
+		
+		LadderRung rung;
+		char extra = '\0';
+		
+		if(sscanf(entry.c_str(), " %ux%u@%u %c", &rung.width, &rung.height, &rung.bitrate, &extra) != 3 ||
+			rung.width < 16 || rung.height < 16 || rung.bitrate == 0)
+		{
+			rungs.clear();
+			
+			return false;
+		}
+		
+		rungs.push_back(rung);
+		
+		pos = comma + 1;
+	}
+	
+	return !rungs.empty();
+}
+
+
+std::string
+LadderPath(const std::string &movie, const LadderRung &rung)
+{
+	const std::string::size_type slash = movie.find_last_of("/\\");
+	const std::string::size_type dot = movie.find_last_of('.');
+	
+	const std::string base = ((dot != std::string::npos && (slash == std::string::npos || dot > slash)) ?
+								movie.substr(0, dot) : movie);
+	
+	std::stringstream path;
+	
+	path << base << "_" << rung.width << "x" << rung.height << ".webm";
+	
+	return path.str();
+}
+
+
+LadderRendition::LadderRendition(const LadderRung &rung, FramePool &pool, ExportTiming &timing, int track) :
+	_rung(rung),
+	_pool(pool),
+	_timing(timing),
+	_track(track),
+	_encoder_made(false),
+	_pipeline(NULL),
+	_scaler(NULL),
+	_writer(NULL),
+	_segment(NULL),
+	_vid_track(0)
+{
+	memset(&_encoder, 0, sizeof(_encoder));
+	memset(&_track_info, 0, sizeof(_track_info));
+}
+
+
+LadderRendition::~LadderRendition()
+{
+	Close();
+	
+	delete _scaler;
+}
+
+
+void
+LadderRendition::Close()
+{
+	delete _pipeline; // stops the encoder thread first
+	
+	_pipeline = NULL;
+	
+	if(_encoder_made)
+	{
+		vpx_codec_err_t destroy_err = vpx_codec_destroy(&_encoder);
+		assert(destroy_err == VPX_CODEC_OK);
+		
+		_encoder_made = false;
+	}
+	
+	delete _segment;
+	
+	_segment = NULL;
+	
+	if(_writer != NULL)
+	{
+		_writer->Close();
+		
+		delete _writer;
+		
+		_writer = NULL;
+	}
+}
+
+
+vpx_codec_err_t
+LadderRendition::InitEncoder(vpx_codec_iface_t *iface, vpx_codec_enc_cfg_t config, vpx_codec_flags_t flags)
+{
+	assert(_pipeline == NULL && !_encoder_made);
+	
+	config.g_w = _rung.width;
+	config.g_h = _rung.height;
+	
+	config.rc_target_bitrate = _rung.bitrate;
+	
+	if(config.g_pass == VPX_RC_FIRST_PASS)
+	{
+		_stats.clear();
+	}
+	else if(config.g_pass == VPX_RC_LAST_PASS)
+	{
+		if(_stats.empty())
+			return VPX_CODEC_ERROR;
+		
+		config.rc_twopass_stats_in.buf = &_stats[0];
+		config.rc_twopass_stats_in.sz = _stats.size();
+	}
+	
+	const vpx_codec_err_t err = vpx_codec_enc_init(&_encoder, iface, &config, flags);
+	
+	_encoder_made = (err == VPX_CODEC_OK);
+	
+	return err;
+}
+
+
+bool
+LadderRendition::Start(unsigned long deadline, int depth, const std::string &path, const LadderTrack &track)
+{
+	assert(_encoder_made && _pipeline == NULL);
+	
+	_track_info = track;
+	
+	if(!path.empty())
+	{
+		_writer = new mkvmuxer::MkvWriter;
+		
+		if( !_writer->Open(path.c_str()) )
+		{
+			delete _writer;
+			
+			_writer = NULL;
+			
+			return false;
+		}
+		
+		_segment = new mkvmuxer::Segment;
+		
+		_segment->Init(_writer);
+		_segment->set_mode(mkvmuxer::Segment::kFile);
+		
+		mkvmuxer::SegmentInfo* const info = _segment->GetSegmentInfo();
+		
+		info->set_writing_app("fnord WebM for Premiere, built " __DATE__);
+		
+		assert(info->timecode_scale() == timeCodeScale);
+		
+		_vid_track = _segment->AddVideoTrack(_rung.width, _rung.height, 1);
+		
+		mkvmuxer::VideoTrack* const video = static_cast<mkvmuxer::VideoTrack *>(_segment->GetTrackByNumber(_vid_track));
+		
+		if(video == NULL)
+			return false;
+		
+		video->set_frame_rate(track.frame_rate);
+		video->set_codec_id(track.codec_id);
+		
+		// the rung might not have the movie's shape, but it plays at the movie's aspect ratio
+		const uint64_t display_width = ((double)_rung.height * track.display_aspect) + 0.5;
+		
+		if(display_width != _rung.width)
+		{
+			video->set_display_width(display_width);
+			video->set_display_height(_rung.height);
+		}
+		
+		_segment->CuesTrack(_vid_track);
+		
+		mkvmuxer::Colour color;
+		
+		color.set_bits_per_channel(track.bit_depth);
+		color.set_chroma_subsampling_horz(track.chroma_subsampling_horz);
+		color.set_chroma_subsampling_vert(track.chroma_subsampling_vert);
+		
+		if(WebMMatroskaMatrix(track.color_space) >= 0)
+			color.set_matrix_coefficients( WebMMatroskaMatrix(track.color_space) );
+		
+		if(WebMMatroskaRange(track.color_space, track.color_range) >= 0)
+			color.set_range( WebMMatroskaRange(track.color_space, track.color_range) );
+		
+		video->SetColour(color);
+	}
+	
+	// no governor, the renditions keep the deadline they start with
+	_pipeline = new EncoderPipeline(&_encoder, NULL, _pool, deadline, depth, NULL, _timing, _track);
+	
+	return _pipeline->Start();
+}
+
+
+bool
+LadderRendition::Submit(const vpx_image_t *src, vpx_codec_pts_t pts, WebMWorkerPool &pool)
+{
+	assert(_pipeline != NULL);
+	
+	if( _pipeline->Full() )
+	{
+		_timing.Begin(TIMING_WAIT);
+		
+		_pipeline->WaitForRoom();
+		
+		_timing.End(TIMING_WAIT);
+	}
+	
+	// the pipeline gives this back to the pool after it's been encoded
+	vpx_image_t *img = _pool.Get(src->fmt, _rung.width, _rung.height, src->bit_depth, false);
+	
+	if(img == NULL)
+		return false;
+	
+	if(_scaler == NULL || !_scaler->Fits(src, img))
+	{
+		delete _scaler;
+		
+		_scaler = new ImageScaler(src, img);
+	}
+	
+	_timing.Begin(TIMING_CONVERT);
+	
+	ScaleImage(img, src, *_scaler, pool);
+	
+	_timing.End(TIMING_CONVERT);
+	
+	return _pipeline->Submit(img, NULL, pts, 1);
+}
+
+
+bool
+LadderRendition::Mux()
+{
+	assert(_pipeline != NULL);
+	
+	bool ok = !_pipeline->Error();
+	
+	EncodedPacket *pkt = NULL;
+	EncodedPacket *alpha_pkt = NULL;
+	
+	while(ok && _pipeline->GetPacket(pkt, alpha_pkt))
+	{
+		assert(alpha_pkt == NULL);
+		
+		if(pkt->kind == VPX_CODEC_STATS_PKT)
+		{
+			const unsigned char *buf = (const unsigned char *)pkt->buf;
+			
+			_stats.insert(_stats.end(), buf, buf + pkt->sz);
+		}
+		else if(pkt->kind == VPX_CODEC_CX_FRAME_PKT && _segment != NULL)
+		{
+			// same math as the movie, so the blocks line up
+			const long long pktFileTime = pkt->pts * _track_info.ticks_per_frame;
+			
+			const uint64_t pktTimeStamp = (((pktFileTime * (S2NS / timeCodeScale)) + (_track_info.ticks_per_second / 2)) / _track_info.ticks_per_second) * timeCodeScale;
+			
+			_timing.Begin(TIMING_MUX);
+			
+			ok = _segment->AddFrame((const uint8_t *)pkt->buf, pkt->sz,
+									_vid_track, pktTimeStamp,
+									pkt->flags & VPX_FRAME_IS_KEY);
+			
+			_timing.End(TIMING_MUX);
+		}
+		
+		delete pkt;
+	}
+	
+	return ok;
+}
+
+
+bool
+LadderRendition::Finish(uint64_t duration)
+{
+	assert(_pipeline != NULL);
+	
+	_pipeline->Finish();
+	
+	bool ok = true;
+	
+	while(ok)
+	{
+		ok = Mux();
+		
+		if( _pipeline->Done() )
+			break;
+		
+		_timing.Begin(TIMING_WAIT);
+		
+		_pipeline->WaitForPacket();
+		
+		_timing.End(TIMING_WAIT);
+	}
+	
+	if(ok)
+	{
+		_pipeline->Join();
+		
+		const PipelineStats &stats = _pipeline->Stats();
+		
+		WebMLog("Rendition %ux%u@%u: %u frames, export thread waited %u times (%.2f sec), encoder waited %u times (%.2f sec)",
+				_rung.width, _rung.height, _rung.bitrate, stats.frames,
+				stats.render_stalls, stats.render_stall_seconds,
+				stats.encoder_stalls, stats.encoder_stall_seconds);
+	}
+	
+	if(ok && _segment != NULL)
+	{
+		_segment->set_duration(duration);
+		
+		_timing.Begin(TIMING_MUX);
+		
+		ok = _segment->Finalize();
+		
+		_timing.End(TIMING_MUX);
+	}
+	
+	Close();
+	
+	return ok;
+}
@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_LADDER_H
+#define WEBM_PREMIERE_EXPORT_LADDER_H
+
+#include "WebM_Premiere_Export_Pipeline.h"
+#include "WebM_Premiere_Export_Scale.h"
+#include "WebM_Premiere_Export_Timing.h"
+
+#include "vpx/vpx_encoder.h"
+
+#include "mkvmuxer/mkvmuxer.h"
+#include "mkvmuxer/mkvwriter.h"
+
+#include <string>
+#include <vector>
+
+
+// Adaptive bitrate ladder
+// With --ladder "640x360@800,1280x720@2500", every frame the export renders
+// also gets scaled down and encoded for each of these, into a WebM of its own
+// next to the movie.  The renditions use the main encoder settings with their
+// own size and bitrate, and the same fixed keyframe interval, so keyframes
+// line up across all of them and the files can be segmented for DASH.
+
+typedef struct LadderRung
+{
+	unsigned int	width;
+	unsigned int	height;
+	unsigned int	bitrate;	// kbps
+} LadderRung;
+
+bool ParseLadder(std::vector<LadderRung> &rungs, const std::string &ladder);
+
+// movie.webm -> movie_640x360.webm
+std::string LadderPath(const std::string &movie, const LadderRung &rung);
+
+
+// What a rendition's video track copies from the movie's
+typedef struct LadderTrack
+{
+	const char		*codec_id;
+	double			frame_rate;
+	long long		ticks_per_frame;	// Premiere time
+	long long		ticks_per_second;
+	double			display_aspect;		// with the pixel aspect ratio
+	unsigned int	bit_depth;
+	unsigned int	chroma_subsampling_horz;
+	unsigned int	chroma_subsampling_vert;
+	vpx_color_space_t	color_space;
+	vpx_color_range_t	color_range;
+} LadderTrack;
+
+
+// One rendition, with its encoder on an EncoderPipeline of its own so all the
+// renditions encode alongside the movie.  The export thread scales the frames
+// into it and muxes whatever packets are ready.  In a two-pass export, the
+// first pass stats stay here for the second.
+//
+// Each pass: InitEncoder(), set the encoder controls on Encoder(), Start(),
+// then Submit() and Mux() for every frame, and Finish().
+
+class LadderRendition
+{
+  public:
+	LadderRendition(const LadderRung &rung, FramePool &pool, ExportTiming &timing, int track);
+	~LadderRendition();
+	
+	const LadderRung & Rung() const { return _rung; }
+	
+	// the movie's config, the size and bitrate come from the rung
+	vpx_codec_err_t InitEncoder(vpx_codec_iface_t *iface, vpx_codec_enc_cfg_t config, vpx_codec_flags_t flags);
+	vpx_codec_ctx_t * Encoder() { return &_encoder; }
+	
+	bool Start(unsigned long deadline, int depth, const std::string &path, const LadderTrack &track); // no path for the analysis pass
+	
+	bool Submit(const vpx_image_t *src, vpx_codec_pts_t pts, WebMWorkerPool &pool);
+	bool Mux(); // doesn't block
+	bool Finish(uint64_t duration); // flushes the encoder and closes the file, duration in timecode units
+	
+  private:
+	void Close();
+	
+	const LadderRung _rung;
+	FramePool &_pool;
+	ExportTiming &_timing;
+	const int _track;
+	
+	vpx_codec_ctx_t _encoder;
+	bool _encoder_made;
+	
+	EncoderPipeline *_pipeline;
+	ImageScaler *_scaler;
+	
+	LadderTrack _track_info;
+	
+	mkvmuxer::MkvWriter *_writer;
+	mkvmuxer::Segment *_segment;
+	uint64_t _vid_track;
+	
+	std::vector<unsigned char> _stats; // first pass
+	
+	LadderRendition(const LadderRendition &);
+	LadderRendition &operator=(const LadderRendition &);
+};
+
+
+#endif // WEBM_PREMIERE_EXPORT_LADDER_H
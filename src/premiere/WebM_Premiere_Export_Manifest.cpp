@@ -0,0 +1,401 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_Manifest.h"
+
+#include <assert.h>
+#include <math.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+
+static const long long S2NS = 1000000000LL;
+
+// in the same order as the enums in WebM_Premiere_Export_Params.h
+static const char * const codec_names[] = { "vp8", "vp9" };
+static const char * const method_names[] = { "quality", "bitrate", "vbr", "constrained" };
+static const char * const chroma_names[] = { "420", "422", "444" };
+
+#define NAME_COUNT(X)	(sizeof(X) / sizeof(X[0]))
+
+
+static int
+LookupName(const char * const *names, int count, const std::string &name)
+{
+	for(int i=0; i < count; i++)
+	{
+		if(name == names[i])
+			return i;
+	}
+	
+	return -1;
+}
+
+
+void
+InitManifest(WebMManifest &manifest)
+{
+	manifest.codec = 0;
+	manifest.width = 0;
+	manifest.height = 0;
+	manifest.pixel_aspect_num = 1;
+	manifest.pixel_aspect_den = 1;
+	manifest.timebase_num = 1;
+	manifest.timebase_den = 1;
+	manifest.frames = 0;
+	manifest.bit_depth = 8;
+	manifest.chroma = 0;
+	manifest.alpha = false;
+	manifest.color_space = 0;
+	manifest.color_range = 0;
+	manifest.method = 0;
+	manifest.quality = 0;
+	manifest.bitrate = 0;
+	manifest.two_pass = false;
+	manifest.kf_max_dist = 0;
+	manifest.args.clear();
+	manifest.codec_private.clear();
+	manifest.chunks.clear();
+}
+
+
+void
+PlanManifestChunks(WebMManifest &manifest, int chunks, const char *path)
+{
+	manifest.chunks.clear();
+	
+	if(manifest.frames < 1)
+		return;
+	
+	const std::string dir = ManifestDirectory(path);
+	
+	std::string name = std::string(path).substr(dir.size());
+	
+	const std::string::size_type dot = name.find_last_of('.');
+	
+	if(dot != std::string::npos && dot > 0)
+		name = name.substr(0, dot);
+	
+	if(chunks < 1)
+		chunks = 1;
+	
+	int chunk_frames = (manifest.frames + chunks - 1) / chunks;
+	
+	const int kf_dist = manifest.kf_max_dist;
+	
+	if(kf_dist > 0 && kf_dist < chunk_frames)
+		chunk_frames = ((chunk_frames + kf_dist - 1) / kf_dist) * kf_dist;
+	
+	for(int start = 0; start < manifest.frames; start += chunk_frames)
+	{
+		WebMChunk chunk;
+		
+		chunk.start = start;
+		chunk.frames = std::min<int>(chunk_frames, manifest.frames - start);
+		
+		std::stringstream ss;
+		
+		ss << name << "_chunk" << std::setw(3) << std::setfill('0') << manifest.chunks.size() << ".webm";
+		
+		chunk.file = ss.str();
+		
+		manifest.chunks.push_back(chunk);
+	}
+	
+	assert((int)manifest.chunks.size() <= chunks);
+}
+
+
+bool
+WriteManifest(const WebMManifest &manifest, const char *path)
+{
+	std::ofstream f(path);
+	
+	if(!f)
+		return false;
+	
+	f << "webm_manifest 1" << "\n";
+	f << "codec " << codec_names[manifest.codec] << "\n";
+	f << "size " << manifest.width << " " << manifest.height << "\n";
+	f << "pixel_aspect " << manifest.pixel_aspect_num << " " << manifest.pixel_aspect_den << "\n";
+	f << "timebase " << manifest.timebase_num << " " << manifest.timebase_den << "\n";
+	f << "frames " << manifest.frames << "\n";
+	f << "bit_depth " << manifest.bit_depth << "\n";
+	f << "chroma " << chroma_names[manifest.chroma] << "\n";
+	f << "alpha " << (manifest.alpha ? 1 : 0) << "\n";
+	f << "color " << manifest.color_space << " " << manifest.color_range << "\n";
+	f << "method " << method_names[manifest.method] << "\n";
+	f << "quality " << manifest.quality << "\n";
+	f << "bitrate " << manifest.bitrate << "\n";
+	f << "two_pass " << (manifest.two_pass ? 1 : 0) << "\n";
+	f << "kf_max_dist " << manifest.kf_max_dist << "\n";
+	f << "codec_private " << (manifest.codec_private.empty() ? "-" : manifest.codec_private) << "\n";
+	
+	if(!manifest.args.empty())
+		f << "args " << manifest.args << "\n";
+	
+	for(size_t i=0; i < manifest.chunks.size(); i++)
+	{
+		const WebMChunk &chunk = manifest.chunks[i];
+		
+		f << "chunk " << i << " " << chunk.start << " " << chunk.frames << " " << chunk.file << "\n";
+	}
+	
+	f.close();
+	
+	return !f.fail();
+}
+
+
+bool
+ReadManifest(WebMManifest &manifest, const char *path)
+{
+	InitManifest(manifest);
+	
+	std::ifstream f(path);
+	
+	if(!f)
+		return false;
+	
+	std::string line;
+	
+	if(!std::getline(f, line) || line.compare(0, 15, "webm_manifest 1") != 0)
+		return false;
+	
+	bool ok = true;
+	
+	while(ok && std::getline(f, line))
+	{
+		if(!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+	
+		if(line.empty() || line[0] == '#')
+			continue;
+		
+		std::stringstream ss(line);
+		
+		std::string key;
+		
+		ss >> key;
+		
+		if(key == "codec" || key == "chroma" || key == "method")
+		{
+			std::string name;
+			
+			ss >> name;
+			
+			if(key == "codec")
+				manifest.codec = LookupName(codec_names, NAME_COUNT(codec_names), name);
+			else if(key == "chroma")
+				manifest.chroma = LookupName(chroma_names, NAME_COUNT(chroma_names), name);
+			else
+				manifest.method = LookupName(method_names, NAME_COUNT(method_names), name);
+			
+			ok = (manifest.codec >= 0 && manifest.chroma >= 0 && manifest.method >= 0);
+		}
+		else if(key == "size")
+			ss >> manifest.width >> manifest.height;
+		else if(key == "pixel_aspect")
+			ss >> manifest.pixel_aspect_num >> manifest.pixel_aspect_den;
+		else if(key == "timebase")
+			ss >> manifest.timebase_num >> manifest.timebase_den;
+		else if(key == "frames")
+			ss >> manifest.frames;
+		else if(key == "bit_depth")
+			ss >> manifest.bit_depth;
+		else if(key == "alpha")
+			ss >> manifest.alpha;
+		else if(key == "color")
+			ss >> manifest.color_space >> manifest.color_range;
+		else if(key == "quality")
+			ss >> manifest.quality;
+		else if(key == "bitrate")
+			ss >> manifest.bitrate;
+		else if(key == "two_pass")
+			ss >> manifest.two_pass;
+		else if(key == "kf_max_dist")
+			ss >> manifest.kf_max_dist;
+		else if(key == "codec_private")
+		{
+			ss >> manifest.codec_private;
+			
+			if(manifest.codec_private == "-")
+				manifest.codec_private.clear();
+		}
+		else if(key == "args")
+		{
+			std::getline(ss >> std::ws, manifest.args);
+		}
+		else if(key == "chunk")
+		{
+			int index = -1;
+			WebMChunk chunk;
+			
+			ss >> index >> chunk.start >> chunk.frames;
+			
+			std::getline(ss >> std::ws, chunk.file);
+			
+			ok = (index == (int)manifest.chunks.size() && chunk.frames > 0 && !chunk.file.empty());
+			
+			if(ok)
+				manifest.chunks.push_back(chunk);
+		}
+		
+		if(ss.fail())
+			ok = false;
+	}
+	
+	if(ok)
+	{
+		// the chunks have to cover the frames, in order, without gaps
+		int next_frame = 0;
+		
+		for(size_t i=0; i < manifest.chunks.size(); i++)
+		{
+			if(manifest.chunks[i].start != next_frame)
+				ok = false;
+			
+			next_frame += manifest.chunks[i].frames;
+		}
+		
+		if(next_frame != manifest.frames || manifest.timebase_num < 1 || manifest.timebase_den < 1)
+			ok = false;
+	}
+	
+	return ok;
+}
+
+
+bool
+ManifestSettingsMatch(const WebMManifest &a, const WebMManifest &b)
+{
+	return (a.codec == b.codec &&
+			a.width == b.width &&
+			a.height == b.height &&
+			a.pixel_aspect_num == b.pixel_aspect_num &&
+			a.pixel_aspect_den == b.pixel_aspect_den &&
+			a.timebase_num == b.timebase_num &&
+			a.timebase_den == b.timebase_den &&
+			a.frames == b.frames &&
+			a.bit_depth == b.bit_depth &&
+			a.chroma == b.chroma &&
+			a.alpha == b.alpha &&
+			a.color_space == b.color_space &&
+			a.color_range == b.color_range &&
+			a.method == b.method &&
+			a.quality == b.quality &&
+			a.bitrate == b.bitrate &&
+			a.two_pass == b.two_pass &&
+			a.kf_max_dist == b.kf_max_dist &&
+			a.args == b.args &&
+			a.codec_private == b.codec_private);
+}
+
+
+std::vector<unsigned char>
+ManifestCodecPrivate(const WebMManifest &manifest)
+{
+	std::vector<unsigned char> data;
+	
+	if(manifest.codec == 1) // WEBM_CODEC_VP9
+	{
+		// same profile choice as exSDKExport
+		const int profile = (manifest.chroma > 0 ?
+								(manifest.bit_depth > 8 ? 3 : 1) :
+								(manifest.bit_depth > 8 ? 2 : 0) );
+		
+		// 0 is 4:2:0 vertical, 2 is 4:2:2, 3 is 4:4:4
+		const int subsampling = (manifest.chroma == 2 ? 3 : manifest.chroma == 1 ? 2 : 0);
+	
+		// each feature is ID, length, value
+		const unsigned char features[] = { 1, 1, (unsigned char)profile,
+											3, 1, (unsigned char)manifest.bit_depth,
+											4, 1, (unsigned char)subsampling };
+		
+		data.assign(features, features + sizeof(features));
+	}
+	
+	return data;
+}
+
+
+std::string
+HexString(const std::vector<unsigned char> &data)
+{
+	std::stringstream ss;
+	
+	for(size_t i=0; i < data.size(); i++)
+		ss << std::hex << std::setw(2) << std::setfill('0') << (int)data[i];
+	
+	return ss.str();
+}
+
+
+std::string
+ManifestDirectory(const char *path)
+{
+	const std::string p(path);
+	
+	const std::string::size_type slash = p.find_last_of("/\\");
+	
+	return (slash == std::string::npos ? std::string() : p.substr(0, slash + 1));
+}
+
+
+long long
+ManifestFrameTime(const WebMManifest &manifest, long long frame)
+{
+	// split into seconds and the remainder so big frame numbers don't overflow
+	const long long ticks = frame * manifest.timebase_num;
+	const long long den = manifest.timebase_den;
+	
+	return ((ticks / den) * S2NS) + (((ticks % den) * S2NS) + (den / 2)) / den;
+}
+
+
+long long
+ManifestTimeFrame(const WebMManifest &manifest, long long ns)
+{
+	return (long long)floor(((double)ns * (double)manifest.timebase_den) /
+							((double)manifest.timebase_num * (double)S2NS) + 0.5);
+}
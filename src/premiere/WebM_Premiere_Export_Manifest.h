@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_MANIFEST_H
+#define WEBM_PREMIERE_EXPORT_MANIFEST_H
+
+#include <string>
+#include <vector>
+
+
+// A job manifest lets one export be spread over several machines.
+// The planning export writes it, each worker export encodes one chunk
+// into its own partial WebM, and webm_merge (src/tools) puts the partials
+// back together.  Nothing in here touches the Premiere SDK so the tools
+// can share it.
+
+typedef struct WebMChunk
+{
+	int				start;	// first frame, counting from the start of the export
+	int				frames;
+	std::string		file;	// partial WebM, relative to the manifest
+} WebMChunk;
+
+
+// Everything that has to be the same on every worker, or the chunks won't
+// splice together.  The values are the ones exSDKExport uses.
+typedef struct WebMManifest
+{
+	int				codec;			// WebM_Video_Codec
+	int				width;
+	int				height;
+	int				pixel_aspect_num;
+	int				pixel_aspect_den;
+	int				timebase_num;	// seconds per frame, same as g_timebase
+	int				timebase_den;
+	int				frames;			// in the whole export
+	int				bit_depth;
+	int				chroma;			// WebM_Chroma_Sampling
+	bool			alpha;
+	int				color_space;	// vpx_color_space_t, for the RGB conversion and the Colour element
+	int				color_range;	// vpx_color_range_t
+	int				method;			// WebM_Video_Method
+	int				quality;
+	int				bitrate;
+	bool			two_pass;
+	int				kf_max_dist;
+	std::string		args;			// custom args that change the bitstream
+	std::string		codec_private;	// hex, empty if the track has none
+	
+	std::vector<WebMChunk> chunks;
+} WebMManifest;
+
+
+void InitManifest(WebMManifest &manifest);
+
+// Split the frames into (at most) this many chunks.  Each chunk starts with a
+// keyframe, so when we can we make the chunks a multiple of kf_max_dist,
+// keeping the keyframes where a single export would have put them.
+// The chunk files are named after the manifest.
+void PlanManifestChunks(WebMManifest &manifest, int chunks, const char *path);
+
+bool WriteManifest(const WebMManifest &manifest, const char *path);
+
+bool ReadManifest(WebMManifest &manifest, const char *path);
+
+// compares everything but the chunks
+bool ManifestSettingsMatch(const WebMManifest &a, const WebMManifest &b);
+
+// The VP9 CodecPrivate (codec feature metadata): profile, bit depth, and chroma subsampling.
+// VP8 doesn't have one.
+std::vector<unsigned char> ManifestCodecPrivate(const WebMManifest &manifest);
+
+std::string HexString(const std::vector<unsigned char> &data);
+
+// directory part of the path, with the separator, so the chunk files can be found
+std::string ManifestDirectory(const char *path);
+
+// Block timestamps in the partials are rounded to the muxer's timecode scale,
+// so these go back and forth between frame numbers and nanoseconds.
+long long ManifestFrameTime(const WebMManifest &manifest, long long frame);
+
+long long ManifestTimeFrame(const WebMManifest &manifest, long long ns);
+
+
+#endif // WEBM_PREMIERE_EXPORT_MANIFEST_H
@@ -1519,331 +1519,3 @@ exSDKValidateParamChanged (
 
 	return malNoError;
 }
-
-
-static bool
-quotedTokenize(const string& str,
-				  std::vector<string>& tokens,
-				  const string& delimiters = " ")
-{
-	// this function will respect quoted strings when tokenizing
-	// the quotes will be included in the returned strings
-	
-	int i = 0;
-	bool in_quotes = false;
-	
-	// if there are un-quoted delimiters in the beginning, skip them
-	while(i < str.size() && str[i] != '\"' && string::npos != delimiters.find(str[i]) )
-		i++;
-	
-	string::size_type lastPos = i;
-	
-	while(i < str.size())
-	{
-		if(str[i] == '\"' && (i == 0 || str[i-1] != '\\'))
-			in_quotes = !in_quotes;
-		else if(!in_quotes)
-		{
-			if( string::npos != delimiters.find(str[i]) )
-			{
-				tokens.push_back(str.substr(lastPos, i - lastPos));
-				
-				lastPos = i + 1;
-				
-				// if there are more delimiters ahead, push forward
-				while(lastPos < str.size() && (str[lastPos] != '\"' || str[lastPos-1] != '\\') && string::npos != delimiters.find(str[lastPos]) )
-					lastPos++;
-					
-				i = lastPos;
-				continue;
-			}
-		}
-		
-		i++;
-	}
-	
-	if(in_quotes)
-		return false;
-	
-	// we're at the end, was there anything left?
-	if(str.size() - lastPos > 0)
-		tokens.push_back( str.substr(lastPos) );
-	
-	return true;
-}
-
-
-template <typename T>
-static void SetValue(T &v, string s)
-{
-	std::stringstream ss;
-	
-	ss << s;
-	
-	ss >> v;
-}
-
-
-bool
-ConfigureEncoderPre(vpx_codec_enc_cfg_t &config, unsigned long &deadline, const char *txt)
-{
-	std::vector<string> args;
-	
-	if(quotedTokenize(txt, args, " =\t\r\n") && args.size() > 0)
-	{
-		const int num_args = args.size();
-	
-		args.push_back(""); // so there's always an i+1
-		
-		int i = 0;
-		
-		while(i < num_args)
-		{
-			const string &arg = args[i];
-			const string &val = args[i + 1];
-			
-			if(arg == "--best")
-			{	deadline = VPX_DL_BEST_QUALITY;	}
-			
-			else if(arg == "--good")
-			{	deadline = VPX_DL_GOOD_QUALITY;	}
-			
-			else if(arg == "--rt")
-			{	deadline = VPX_DL_REALTIME;	}
-			
-			else if(arg == "-d" || arg == "--deadline")
-			{	SetValue(deadline, val); i++;	}
-
-			else if(arg == "-t" || arg == "--threads")
-			{	SetValue(config.g_threads, val); i++;	}
-			
-			else if(arg == "--lag-in-frames")
-			{	SetValue(config.g_lag_in_frames, val); i++;	}
-			
-			else if(arg == "--drop-frame")
-			{	SetValue(config.rc_dropframe_thresh, val); i++;	}
-			
-			else if(arg == "--resize-allowed")
-			{	SetValue(config.rc_resize_allowed, val); i++;	}
-			
-			else if(arg == "--resize-width")
-			{	SetValue(config.rc_scaled_width, val); i++;	}
-			
-			else if(arg == "--resize-height")
-			{	SetValue(config.rc_scaled_height, val); i++;	}
-			
-			else if(arg == "--resize-up")
-			{	SetValue(config.rc_resize_up_thresh, val); i++;	}
-			
-			else if(arg == "--resize-down")
-			{	SetValue(config.rc_resize_down_thresh, val); i++;	}
-			
-			else if(arg == "--target-bitrate")
-			{	SetValue(config.rc_target_bitrate, val); i++;	}
-			
-			else if(arg == "--min-q")
-			{	SetValue(config.rc_min_quantizer, val); i++;	}
-			
-			else if(arg == "--max-q")
-			{	SetValue(config.rc_max_quantizer, val); i++;	}
-			
-			else if(arg == "--undershoot-pct")
-			{	SetValue(config.rc_undershoot_pct, val); i++;	}
-			
-			else if(arg == "--overshoot-pct")
-			{	SetValue(config.rc_overshoot_pct, val); i++;	}
-
-			else if(arg == "--buf-sz")
-			{	SetValue(config.rc_buf_sz, val); i++;	}
-
-			else if(arg == "--buf-initial-sz")
-			{	SetValue(config.rc_buf_initial_sz, val); i++;	}
-
-			else if(arg == "--buf-optimal-sz")
-			{	SetValue(config.rc_buf_optimal_sz, val); i++;	}
-
-			else if(arg == "--bias-pct")
-			{	SetValue(config.rc_2pass_vbr_bias_pct, val); i++;	}
-
-			else if(arg == "--minsection-pct")
-			{	SetValue(config.rc_2pass_vbr_minsection_pct, val); i++;	}
-
-			else if(arg == "--maxsection-pct")
-			{	SetValue(config.rc_2pass_vbr_maxsection_pct, val); i++;	}
-
-			else if(arg == "--kf-min-dist")
-			{	SetValue(config.kf_min_dist, val); i++;	}
-
-			else if(arg == "--kf-max-dist")
-			{	SetValue(config.kf_max_dist, val); i++;	}
-
-			else if(arg == "--disable-kf")
-			{	config.kf_mode = VPX_KF_DISABLED;	}
-
-			
-			i++;
-		}
-	
-		return true;
-	}
-	else
-		return false;
-}
-
-
-#define ConfigureValue(encoder, ctrl_id, s) \
-	do{							\
-		std::stringstream ss;	\
-		ss << s;				\
-		int v = 0;		\
-		ss >> v;				\
-		config_err = vpx_codec_control(encoder, ctrl_id, v); \
-	}while(0)
-
-bool
-ConfigureEncoderPost(vpx_codec_ctx_t *encoder, const char *txt)
-{
-	std::vector<string> args;
-	
-	vpx_codec_err_t config_err = VPX_CODEC_OK;
-	
-	if(quotedTokenize(txt, args, " =\t\r\n") && args.size() > 0)
-	{
-		const int num_args = args.size();
-
-		args.push_back(""); // so there's always an i+1
-		
-		int i = 0;
-		
-		while(i < num_args)
-		{
-			const string &arg = args[i];
-			const string &val = args[i + 1];
-		
-			if(arg == "--noise-sensitivity")
-			{	ConfigureValue(encoder, VP8E_SET_NOISE_SENSITIVITY, val); i++;	}
-
-			else if(arg == "--sharpness")
-			{	ConfigureValue(encoder, VP8E_SET_SHARPNESS, val); i++;	}
-
-			else if(arg == "--static-thresh")
-			{	ConfigureValue(encoder, VP8E_SET_STATIC_THRESHOLD, val); i++;	}
-
-			else if(arg == "--cpu-used")
-			{	ConfigureValue(encoder, VP8E_SET_CPUUSED, val); i++;	}
-
-			else if(arg == "--token-parts")
-			{	ConfigureValue(encoder, VP8E_SET_TOKEN_PARTITIONS, val); i++;	}
-
-			else if(arg == "--tile-columns")
-			{	ConfigureValue(encoder, VP9E_SET_TILE_COLUMNS, val); i++;	}
-
-			else if(arg == "--tile-rows")
-			{	ConfigureValue(encoder, VP9E_SET_TILE_ROWS, val); i++;	}
-			
-			else if(arg == "--auto-alt-ref")
-			{	ConfigureValue(encoder, VP8E_SET_ENABLEAUTOALTREF, val); i++;	}
-
-			else if(arg == "--arnr-maxframes")
-			{	ConfigureValue(encoder, VP8E_SET_ARNR_MAXFRAMES, val); i++;	}
-
-			else if(arg == "--arnr-strength")
-			{	ConfigureValue(encoder, VP8E_SET_ARNR_STRENGTH, val); i++;	}
-
-			else if(arg == "--arnr-type")
-			{	ConfigureValue(encoder, VP8E_SET_ARNR_TYPE, val); i++;	}
-
-			else if(arg == "--tune")
-			{
-				unsigned int ival = val == "psnr" ? VP8_TUNE_PSNR :
-									val == "ssim" ? VP8_TUNE_SSIM :
-									VP8_TUNE_PSNR;
-			
-				ConfigureValue(encoder, VP8E_SET_TUNING, ival);
-				i++;
-			}
-
-			else if(arg == "--cq-level")
-			{	ConfigureValue(encoder, VP8E_SET_CQ_LEVEL, val); i++;	}
-			
-			else if(arg == "--max-intra-rate")
-			{	ConfigureValue(encoder, VP8E_SET_MAX_INTRA_BITRATE_PCT, val); i++;	}
-
-			else if(arg == "--gf-cbr-boost")
-			{	ConfigureValue(encoder, VP9E_SET_GF_CBR_BOOST_PCT, val); i++;	}
-
-			else if(arg == "--screen-content-mode")
-			{	ConfigureValue(encoder, VP8E_SET_SCREEN_CONTENT_MODE, val);	i++;	}
-			
-			else if(arg == "--lossless")
-			{	ConfigureValue(encoder, VP9E_SET_LOSSLESS, 1);	}
-			
-			else if(arg == "--frame-parallel")
-			{	ConfigureValue(encoder, VP9E_SET_FRAME_PARALLEL_DECODING, val);	i++;	}
-
-			else if(arg == "--aq-mode")
-			{	ConfigureValue(encoder, VP9E_SET_AQ_MODE, val);	i++;	}
-
-			else if(arg == "--frame_boost")
-			{	ConfigureValue(encoder, VP9E_SET_FRAME_PERIODIC_BOOST, val); i++;	}
-
-			else if(arg == "--noise-sensitivity")
-			{	ConfigureValue(encoder, VP9E_SET_NOISE_SENSITIVITY, val); i++;	}
-			
-			else if(arg == "--tune-content")
-			{
-				unsigned int ival = val == "default" ? VP9E_CONTENT_DEFAULT :
-									val == "screen" ? VP9E_CONTENT_SCREEN :
-									VP9E_CONTENT_DEFAULT;
-			
-				ConfigureValue(encoder, VP9E_SET_TUNE_CONTENT, ival);
-				i++;
-			}
-
-			else if(arg == "--color-space")
-			{
-				unsigned int ival = val == "unknown" ? VPX_CS_UNKNOWN :
-									val == "bt601" ? VPX_CS_BT_601 :
-									val == "bt709" ? VPX_CS_BT_709 :
-									val == "smpte170" ? VPX_CS_SMPTE_170 :
-									val == "smpte240" ? VPX_CS_SMPTE_240 :
-									val == "bt2020" ? VPX_CS_BT_2020 :
-									val == "reserved" ? VPX_CS_RESERVED :
-									val == "sRGB" ? VPX_CS_SRGB :
-									VPX_CS_UNKNOWN;
-			
-				ConfigureValue(encoder, VP9E_SET_COLOR_SPACE, ival);
-				i++;
-			}
-			
-			else if(arg == "--min-gf-interval")
-			{	ConfigureValue(encoder, VP9E_SET_MIN_GF_INTERVAL, val); i++;	}
-			
-			else if(arg == "--max-gf-interval")
-			{	ConfigureValue(encoder, VP9E_SET_MAX_GF_INTERVAL, val); i++;	}
-
-			else if(arg == "--target-level")
-			{	ConfigureValue(encoder, VP9E_SET_TARGET_LEVEL, val); i++;	}
-
-			else if(arg == "--row-mt")
-			{	ConfigureValue(encoder, VP9E_SET_ROW_MT, 1);	}
-
-			else if(arg == "--color-range")
-			{
-				unsigned int ival = val == "studio" ? VPX_CR_STUDIO_RANGE :
-									val == "full" ? VPX_CR_FULL_RANGE :
-									VPX_CR_STUDIO_RANGE;
-			
-				ConfigureValue(encoder, VP9E_SET_COLOR_RANGE, ival);
-				i++;
-			}
-
-			i++;	
-		}
-		
-		return true;
-	}
-	else
-		return false;
-}
-
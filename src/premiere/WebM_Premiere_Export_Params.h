@@ -43,8 +43,12 @@
 
 #include "WebM_Premiere_Export.h"
 
+#include "WebM_Premiere_Export_Args.h"
+
 #include "vpx/vpx_encoder.h"
 
+#include <string>
+
 typedef enum {
 	WEBM_CODEC_VP8 = 0,
 	WEBM_CODEC_VP9
@@ -130,9 +134,4 @@ exSDKValidateParamChanged (
 	exParamChangedRec	*validateParamChangedRecP);
 	
 
-bool ConfigureEncoderPre(vpx_codec_enc_cfg_t &config, unsigned long &deadline, const char *txt);
-
-bool ConfigureEncoderPost(vpx_codec_ctx_t *encoder, const char *txt);
-
-
-#endif // WEBM_PREMIERE_EXPORT_PARAMS_H
\ No newline at end of file
+#endif // WEBM_PREMIERE_EXPORT_PARAMS_H
@@ -0,0 +1,1202 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_Pipeline.h"
+
+#include "WebM_Premiere_Export_Convert.h"
+
+#include "vpx/vp8cx.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+
+EncodedPacket::EncodedPacket(const vpx_codec_cx_pkt_t *pkt) :
+	kind(pkt->kind),
+	buf(NULL),
+	sz(0),
+	pts(0),
+	duration(0),
+	flags(0)
+{
+	const void *src = NULL;
+	
+	if(pkt->kind == VPX_CODEC_CX_FRAME_PKT)
+	{
+		src = pkt->data.frame.buf;
+		sz = pkt->data.frame.sz;
+		
+		pts = pkt->data.frame.pts;
+		duration = pkt->data.frame.duration;
+		flags = pkt->data.frame.flags;
+	}
+	else if(pkt->kind == VPX_CODEC_STATS_PKT)
+	{
+		src = pkt->data.twopass_stats.buf;
+		sz = pkt->data.twopass_stats.sz;
+	}
+	
+	if(sz > 0)
+	{
+		buf = malloc(sz);
+		
+		if(buf == NULL)
+			throw std::bad_alloc();
+		
+		memcpy(buf, src, sz);
+	}
+}
+
+
+EncodedPacket::~EncodedPacket()
+{
+	if(buf != NULL)
+		free(buf);
+}
+
+
+#pragma mark-
+
+
+FramePool::FramePool(bool huge_pages, vpx_color_space_t color_space, vpx_color_range_t color_range) :
+	_huge_pages(huge_pages),
+	_color_space(color_space),
+	_color_range(color_range)
+{
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+
+FramePool::~FramePool()
+{
+	for(std::vector<PoolImage *>::iterator i = _images.begin(); i != _images.end(); ++i)
+	{
+		WebMFreeAligned((*i)->buf, (*i)->size, _huge_pages);
+		
+		delete *i;
+	}
+	
+	assert(_unwrapped.empty() && _free_wrappers.size() == _wrappers.size()); // owners should have their planes back
+	
+	for(std::vector<PoolImage *>::iterator i = _wrappers.begin(); i != _wrappers.end(); ++i)
+		delete *i;
+}
+
+
+vpx_image_t *
+FramePool::Get(vpx_img_fmt_t fmt, unsigned int width, unsigned int height, unsigned int bit_depth, bool neutral_chroma)
+{
+	{
+		WebMLock lock(_mutex);
+		
+		for(std::vector<PoolImage *>::iterator i = _free.begin(); i != _free.end(); ++i)
+		{
+			PoolImage *pool_img = *i;
+			
+			if(pool_img->fmt == fmt && pool_img->width == width &&
+				pool_img->height == height && pool_img->bit_depth == bit_depth &&
+				pool_img->neutral_chroma == neutral_chroma)
+			{
+				_free.erase(i);
+				
+				_stats.hits++;
+				
+				return &pool_img->img;
+			}
+		}
+		
+		_stats.misses++;
+	}
+	
+	
+	// Allocate outside the lock so the encoder thread can keep returning images.
+	// Let libvpx lay out the planes the way vpx_img_alloc() would, against a
+	// dummy pointer, so we know how big a buffer to allocate.
+	const int align = 32;
+	
+	static unsigned char probe_data[1];
+	
+	vpx_image_t probe;
+	
+	if(NULL == vpx_img_wrap(&probe, fmt, width, height, align, probe_data))
+		return NULL;
+	
+	const size_t chroma_height = (probe.h + probe.y_chroma_shift) >> probe.y_chroma_shift;
+	
+	const size_t size = ((size_t)probe.stride[VPX_PLANE_Y] * probe.h) +
+						((size_t)probe.stride[VPX_PLANE_U] * chroma_height) +
+						((size_t)probe.stride[VPX_PLANE_V] * chroma_height);
+	
+	PoolImage *pool_img = new PoolImage;
+	
+	pool_img->fmt = fmt;
+	pool_img->width = width;
+	pool_img->height = height;
+	pool_img->bit_depth = bit_depth;
+	pool_img->neutral_chroma = neutral_chroma;
+	pool_img->size = size;
+	pool_img->buf = WebMAllocAligned(size, 64, _huge_pages);
+	pool_img->owner = NULL;
+	
+	if(pool_img->buf == NULL)
+	{
+		delete pool_img;
+		
+		return NULL;
+	}
+	
+	vpx_image_t *img = vpx_img_wrap(&pool_img->img, fmt, width, height, align, (unsigned char *)pool_img->buf);
+	
+	assert(img == &pool_img->img);
+	
+	img->cs = _color_space;
+	img->range = _color_range;
+	
+	if(bit_depth > 8)
+	{
+		// libvpx stores 10 and 12 bit images in 16-bit samples
+		img->bit_depth = bit_depth;
+		img->bps = img->bps * bit_depth / 16;
+	}
+	
+	img->user_priv = pool_img;
+	
+	if(neutral_chroma)
+		FillNeutralChroma(img); // once, rather than with every frame
+	
+	WebMLock lock(_mutex);
+	
+	_images.push_back(pool_img);
+	
+	_stats.images++;
+	_stats.bytes += size;
+	
+	return img;
+}
+
+
+void
+FramePool::Release(vpx_image_t *img)
+{
+	assert(img != NULL);
+
+	PoolImage *pool_img = static_cast<PoolImage *>(img->user_priv);
+	
+	assert(img == &pool_img->img);
+	
+	WebMLock lock(_mutex);
+	
+	if(pool_img->owner != NULL)
+	{
+		_unwrapped.push_back(pool_img->owner);
+		
+		pool_img->owner = NULL;
+		
+		_free_wrappers.push_back(pool_img);
+	}
+	else
+		_free.push_back(pool_img);
+}
+
+
+vpx_image_t *
+FramePool::Wrap(vpx_img_fmt_t fmt, unsigned int width, unsigned int height,
+				unsigned char *planes[3], const int strides[3], void *owner)
+{
+	assert(owner != NULL);
+	assert( !(fmt & VPX_IMG_FMT_HIGHBITDEPTH) );
+	
+	PoolImage *pool_img = NULL;
+	
+	{
+		WebMLock lock(_mutex);
+		
+		if(!_free_wrappers.empty())
+		{
+			pool_img = _free_wrappers.back();
+			
+			_free_wrappers.pop_back();
+		}
+	}
+	
+	if(pool_img == NULL)
+	{
+		pool_img = new PoolImage;
+		
+		WebMLock lock(_mutex);
+		
+		_wrappers.push_back(pool_img);
+	}
+	
+	// vpx_img_wrap() fills in the format details, then the planes get pointed at the real ones
+	vpx_image_t *img = vpx_img_wrap(&pool_img->img, fmt, width, height, 1, planes[VPX_PLANE_Y]);
+	
+	if(img == NULL)
+	{
+		WebMLock lock(_mutex);
+		
+		_free_wrappers.push_back(pool_img);
+		
+		return NULL;
+	}
+	
+	assert(img == &pool_img->img);
+	
+	for(int p = VPX_PLANE_Y; p <= VPX_PLANE_V; p++)
+	{
+		img->planes[p] = planes[p];
+		img->stride[p] = strides[p];
+	}
+	
+	img->cs = _color_space;
+	img->range = _color_range;
+	
+	pool_img->fmt = fmt;
+	pool_img->width = width;
+	pool_img->height = height;
+	pool_img->bit_depth = 8;
+	pool_img->neutral_chroma = false;
+	pool_img->buf = NULL;
+	pool_img->size = 0;
+	pool_img->owner = owner;
+	
+	img->user_priv = pool_img;
+	
+	WebMLock lock(_mutex);
+	
+	_stats.wrapped++;
+	
+	return img;
+}
+
+
+void
+FramePool::Unwrapped(std::vector<void *> &owners)
+{
+	WebMLock lock(_mutex);
+	
+	owners.insert(owners.end(), _unwrapped.begin(), _unwrapped.end());
+	
+	_unwrapped.clear();
+}
+
+
+FramePoolStats
+FramePool::Stats()
+{
+	WebMLock lock(_mutex);
+	
+	return _stats;
+}
+
+
+#pragma mark-
+
+
+EncoderPipeline::EncoderPipeline(vpx_codec_ctx_t *encoder, vpx_codec_ctx_t *alpha_encoder,
+									FramePool &pool, unsigned long deadline, int depth,
+									DeadlineGovernor *governor, ExportTiming &timing, int track) :
+	_encoder(encoder),
+	_alpha_encoder(alpha_encoder),
+	_pool(pool),
+	_deadline(deadline),
+	_depth(depth < 1 ? 1 : depth),
+	_governor(governor),
+	_governor_setting(0),
+	_timing(timing),
+	_track(track),
+	_encode_pool(alpha_encoder != NULL ? 2 : 1),
+	_finishing(false),
+	_flushed(false),
+	_error(false),
+	_abort(false)
+{
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+
+EncoderPipeline::~EncoderPipeline()
+{
+	{
+		WebMLock lock(_mutex);
+		
+		_abort = true;
+		
+		_frame_cond.Broadcast();
+	}
+	
+	Join();
+	
+	while(!_frames.empty())
+	{
+		PipelineFrame &frame = _frames.front();
+		
+		_pool.Release(frame.img);
+		
+		if(frame.alpha_img != NULL)
+			_pool.Release(frame.alpha_img);
+		
+		_frames.pop_front();
+	}
+	
+	for(std::deque<EncodedPacket *>::iterator i = _packets.begin(); i != _packets.end(); ++i)
+		delete *i;
+	
+	for(std::deque<EncodedPacket *>::iterator i = _alpha_packets.begin(); i != _alpha_packets.end(); ++i)
+		delete *i;
+	
+	// an invisible frame at the very end never gets shown, so nothing needs it
+	for(std::deque<EncodedPacket *>::iterator i = _hidden.begin(); i != _hidden.end(); ++i)
+		delete *i;
+	
+	for(std::deque<EncodedPacket *>::iterator i = _alpha_hidden.begin(); i != _alpha_hidden.end(); ++i)
+		delete *i;
+}
+
+
+bool
+EncoderPipeline::Full()
+{
+	WebMLock lock(_mutex);
+	
+	return (_frames.size() >= _depth);
+}
+
+
+bool
+EncoderPipeline::Submit(vpx_image_t *img, vpx_image_t *alpha_img, vpx_codec_pts_t pts, unsigned long duration)
+{
+	assert(img != NULL);
+	assert((alpha_img != NULL) == (_alpha_encoder != NULL));
+	assert(!_finishing);
+
+	WebMLock lock(_mutex);
+	
+	if(_frames.size() >= _depth && !_error)
+	{
+		const double start = WebMSeconds();
+		
+		_stats.render_stalls++;
+		
+		do{
+			_packet_cond.Wait(_mutex);
+		}while(_frames.size() >= _depth && !_error);
+		
+		_stats.render_stall_seconds += WebMSeconds() - start;
+	}
+	
+	if(_error)
+	{
+		_pool.Release(img);
+		
+		if(alpha_img != NULL)
+			_pool.Release(alpha_img);
+		
+		return false;
+	}
+	
+	PipelineFrame frame;
+	
+	frame.img = img;
+	frame.alpha_img = alpha_img;
+	frame.pts = pts;
+	frame.duration = duration;
+	
+	_frames.push_back(frame);
+	
+	_frame_cond.Signal();
+	
+	return true;
+}
+
+
+void
+EncoderPipeline::Finish()
+{
+	WebMLock lock(_mutex);
+	
+	_finishing = true;
+	
+	_frame_cond.Signal();
+}
+
+
+static inline bool
+Invisible(const EncodedPacket *pkt)
+{
+	return (pkt->kind == VPX_CODEC_CX_FRAME_PKT && (pkt->flags & VPX_FRAME_IS_INVISIBLE));
+}
+
+
+bool
+EncoderPipeline::PacketReady() const
+{
+	if(_packets.empty())
+		return false;
+	
+	// invisible frames go out without alpha
+	return (_alpha_encoder == NULL || !_alpha_packets.empty() || Invisible(_packets.front()));
+}
+
+
+bool
+EncoderPipeline::GetPacket(EncodedPacket *&pkt, EncodedPacket *&alpha_pkt)
+{
+	WebMLock lock(_mutex);
+	
+	if( PacketReady() )
+	{
+		pkt = _packets.front();
+		_packets.pop_front();
+		
+		if(_alpha_encoder != NULL && !Invisible(pkt))
+		{
+			alpha_pkt = _alpha_packets.front();
+			_alpha_packets.pop_front();
+		}
+		else
+			alpha_pkt = NULL;
+		
+		return true;
+	}
+	
+	return false;
+}
+
+
+void
+EncoderPipeline::WaitForSpace()
+{
+	WebMLock lock(_mutex);
+	
+	if(!PacketReady() && _frames.size() >= _depth && !_flushed && !_error)
+	{
+		const double start = WebMSeconds();
+		
+		_stats.render_stalls++;
+		
+		do{
+			_packet_cond.Wait(_mutex);
+		}while(!PacketReady() && _frames.size() >= _depth && !_flushed && !_error);
+		
+		_stats.render_stall_seconds += WebMSeconds() - start;
+	}
+}
+
+
+void
+EncoderPipeline::WaitForRoom()
+{
+	WebMLock lock(_mutex);
+	
+	if(_frames.size() >= _depth && !_error)
+	{
+		const double start = WebMSeconds();
+		
+		_stats.render_stalls++;
+		
+		do{
+			_packet_cond.Wait(_mutex);
+		}while(_frames.size() >= _depth && !_error);
+		
+		_stats.render_stall_seconds += WebMSeconds() - start;
+	}
+}
+
+
+void
+EncoderPipeline::WaitForPacket()
+{
+	WebMLock lock(_mutex);
+	
+	if(!PacketReady() && !_flushed && !_error)
+	{
+		const double start = WebMSeconds();
+		
+		_stats.render_stalls++;
+		
+		do{
+			_packet_cond.Wait(_mutex);
+		}while(!PacketReady() && !_flushed && !_error);
+		
+		_stats.render_stall_seconds += WebMSeconds() - start;
+	}
+}
+
+
+bool
+EncoderPipeline::Done()
+{
+	WebMLock lock(_mutex);
+	
+	return (_flushed && !PacketReady());
+}
+
+
+bool
+EncoderPipeline::Error()
+{
+	WebMLock lock(_mutex);
+	
+	return _error;
+}
+
+
+static int
+EncodeFrame(vpx_codec_ctx_t *encoder, vpx_image_t *img, vpx_codec_pts_t pts, unsigned long duration,
+				unsigned long deadline, std::deque<EncodedPacket *> &packets)
+{
+	vpx_codec_err_t encode_err = vpx_codec_encode(encoder, img, pts, duration, 0, deadline);
+	
+	if(encode_err != VPX_CODEC_OK)
+		return -1;
+	
+	int count = 0;
+	
+	vpx_codec_iter_t iter = NULL;
+	
+	const vpx_codec_cx_pkt_t *pkt = NULL;
+	
+	while( (pkt = vpx_codec_get_cx_data(encoder, &iter)) )
+	{
+		assert(pkt->kind != VPX_CODEC_FPMB_STATS_PKT); // don't know what to do with this
+		
+		if(pkt->kind == VPX_CODEC_CX_FRAME_PKT || pkt->kind == VPX_CODEC_STATS_PKT)
+		{
+			packets.push_back(new EncodedPacket(pkt));
+			
+			count++;
+		}
+	}
+	
+	return count;
+}
+
+
+// Index 0 is the color encoder, 1 is alpha.  The two don't know about
+// each other until the muxer puts their frames together.
+class EncodeJob : public WebMJob
+{
+  public:
+	EncodeJob(vpx_codec_ctx_t *encoder, vpx_codec_ctx_t *alpha_encoder,
+				vpx_image_t *img, vpx_image_t *alpha_img,
+				vpx_codec_pts_t pts, unsigned long duration, unsigned long deadline,
+				std::deque<EncodedPacket *> &packets, std::deque<EncodedPacket *> &alpha_packets) :
+		_pts(pts),
+		_duration(duration),
+		_deadline(deadline)
+	{
+		_encoder[0] = encoder;
+		_encoder[1] = alpha_encoder;
+		_img[0] = img;
+		_img[1] = alpha_img;
+		_packets[0] = &packets;
+		_packets[1] = &alpha_packets;
+		got[0] = got[1] = 0;
+	}
+	
+	virtual void Process(int index)
+	{
+		try{
+			got[index] = EncodeFrame(_encoder[index], _img[index], _pts, _duration, _deadline, *_packets[index]);
+		}
+		catch(...) { got[index] = -1; }
+	}
+	
+	int got[2];
+	
+  private:
+	vpx_codec_ctx_t *_encoder[2];
+	vpx_image_t *_img[2];
+	std::deque<EncodedPacket *> *_packets[2];
+	const vpx_codec_pts_t _pts;
+	const unsigned long _duration;
+	const unsigned long _deadline;
+};
+
+
+int
+EncoderPipeline::Encode(vpx_image_t *img, vpx_image_t *alpha_img,
+						vpx_codec_pts_t pts, unsigned long duration,
+						std::deque<EncodedPacket *> &packets, std::deque<EncodedPacket *> &alpha_packets)
+{
+	EncodeJob job(_encoder, _alpha_encoder, img, alpha_img, pts, duration, _deadline, packets, alpha_packets);
+	
+	_encode_pool.Run(job, (_alpha_encoder != NULL ? 2 : 1));
+	
+	if(job.got[0] < 0 || job.got[1] < 0)
+		return -1;
+	
+	return (job.got[0] > job.got[1] ? job.got[0] : job.got[1]);
+}
+
+
+// Invisible frames wait in hidden until a visible one comes along,
+// then go into the queue ahead of it with its pts.
+static void
+QueuePackets(std::deque<EncodedPacket *> &packets, std::deque<EncodedPacket *> &hidden,
+				std::deque<EncodedPacket *> &queue)
+{
+	for(std::deque<EncodedPacket *>::iterator i = packets.begin(); i != packets.end(); ++i)
+	{
+		EncodedPacket *pkt = *i;
+		
+		if( Invisible(pkt) )
+		{
+			hidden.push_back(pkt);
+		}
+		else
+		{
+			if(pkt->kind == VPX_CODEC_CX_FRAME_PKT)
+			{
+				for(std::deque<EncodedPacket *>::iterator h = hidden.begin(); h != hidden.end(); ++h)
+				{
+					(*h)->pts = pkt->pts;
+					
+					queue.push_back(*h);
+				}
+				
+				hidden.clear();
+			}
+			
+			queue.push_back(pkt);
+		}
+	}
+	
+	packets.clear();
+}
+
+
+void
+EncoderPipeline::Publish(std::deque<EncodedPacket *> &packets, std::deque<EncodedPacket *> &alpha_packets)
+{
+	WebMLock lock(_mutex);
+	
+	QueuePackets(packets, _hidden, _packets);
+	
+	// An invisible alpha frame would need an invisible color frame to ride on,
+	// and there's no telling the two encoders will pick the same ones.
+	// exSDKExport turns off VP8 alt-refs for alpha.
+	for(std::deque<EncodedPacket *>::const_iterator i = alpha_packets.begin(); i != alpha_packets.end(); ++i)
+	{
+		if( Invisible(*i) )
+		{
+			WebMLog("Alpha encoder made an invisible frame");
+			
+			_error = true;
+		}
+	}
+	
+	QueuePackets(alpha_packets, _alpha_hidden, _alpha_packets);
+	
+	_packet_cond.Broadcast();
+}
+
+
+// The encoders start out the way exSDKExport set them up,
+// which is the governor's first setting.
+void
+EncoderPipeline::FollowGovernor()
+{
+	int cpu_used = 0;
+	
+	const unsigned int setting = _governor->Setting(_deadline, cpu_used);
+	
+	if(setting != _governor_setting)
+	{
+		vpx_codec_control(_encoder, VP8E_SET_CPUUSED, cpu_used);
+		
+		if(_alpha_encoder != NULL)
+			vpx_codec_control(_alpha_encoder, VP8E_SET_CPUUSED, cpu_used);
+		
+		_governor_setting = setting;
+	}
+}
+
+
+void
+EncoderPipeline::Run()
+{
+	bool ok = true;
+
+	while(ok)
+	{
+		PipelineFrame frame;
+		bool flush = false;
+		
+		{
+			WebMLock lock(_mutex);
+			
+			if(_frames.empty() && !_finishing && !_abort)
+			{
+				const double start = WebMSeconds();
+				
+				_stats.encoder_stalls++;
+				
+				do{
+					_frame_cond.Wait(_mutex);
+				}while(_frames.empty() && !_finishing && !_abort);
+				
+				_stats.encoder_stall_seconds += WebMSeconds() - start;
+			}
+			
+			if(_abort)
+				break;
+			
+			if(_frames.empty())
+			{
+				assert(_finishing);
+				
+				flush = true;
+			}
+			else
+			{
+				frame = _frames.front();
+				_frames.pop_front();
+				
+				_packet_cond.Broadcast(); // there's room in the queue now
+			}
+		}
+		
+		std::deque<EncodedPacket *> packets, alpha_packets;
+		
+		if(flush)
+		{
+			// squeeze the last bit out of the encoder, until it has nothing left to give
+			int got = 0;
+			
+			try{
+			
+			do{
+				const double start = WebMSeconds();
+				
+				got = Encode(NULL, NULL, 0, 1, packets, alpha_packets);
+				
+				_timing.Add(TIMING_ENCODE, _track, start, WebMSeconds());
+				
+				Publish(packets, alpha_packets);
+				
+			}while(got > 0);
+			
+			}catch(...) { got = -1; }
+			
+			Publish(packets, alpha_packets);
+			
+			ok = (got == 0);
+			
+			if(ok)
+			{
+				WebMLock lock(_mutex);
+				
+				_flushed = true;
+				
+				_packet_cond.Broadcast();
+			}
+			
+			break;
+		}
+		else
+		{
+			if(_governor != NULL)
+				FollowGovernor();
+			
+			const double start = WebMSeconds();
+			
+			ok = (Encode(frame.img, frame.alpha_img, frame.pts, frame.duration, packets, alpha_packets) >= 0);
+			
+			const double end = WebMSeconds();
+			
+			_timing.Add(TIMING_ENCODE, _track, start, end);
+			
+			if(_governor != NULL)
+				_governor->FrameEncoded(end - start);
+			
+			_pool.Release(frame.img);
+			
+			if(frame.alpha_img != NULL)
+				_pool.Release(frame.alpha_img);
+			
+			_stats.frames++;
+			
+			Publish(packets, alpha_packets);
+		}
+	}
+	
+	if(!ok)
+	{
+		WebMLock lock(_mutex);
+		
+		_error = true;
+		
+		_packet_cond.Broadcast();
+	}
+}
+
+
+#pragma mark-
+
+
+SegmentedEncoder::SegmentedEncoder(int frames, int segments) :
+	_frames_left(frames > 0 ? frames : 0),
+	_mux(0),
+	_finishing(false)
+{
+	if(segments > frames)
+		segments = frames;
+	
+	if(segments < 1)
+		segments = 1;
+	
+	_segments.resize(segments);
+	
+	// spread the leftover frames over the first few segments
+	int start = 0;
+	
+	for(int i=0; i < segments; i++)
+	{
+		Segment &seg = _segments[i];
+		
+		seg.pipeline = NULL;
+		seg.source = NULL;
+		seg.copied = false;
+		seg.start = start;
+		seg.frames = (_frames_left / segments) + (i < (_frames_left % segments) ? 1 : 0);
+		seg.submitted = 0;
+		
+		start += seg.frames;
+	}
+	
+	assert(start == _frames_left);
+}
+
+
+SegmentedEncoder::SegmentedEncoder(int frames, const std::vector<int> &starts) :
+	_frames_left(frames > 0 ? frames : 0),
+	_mux(0),
+	_finishing(false)
+{
+	assert(!starts.empty() && starts[0] == 0);
+	
+	_segments.resize(starts.size());
+	
+	for(size_t i=0; i < starts.size(); i++)
+	{
+		Segment &seg = _segments[i];
+		
+		seg.pipeline = NULL;
+		seg.source = NULL;
+		seg.copied = false;
+		seg.start = starts[i];
+		seg.frames = (i + 1 < starts.size() ? starts[i + 1] : _frames_left) - starts[i];
+		seg.submitted = 0;
+		
+		assert(seg.frames > 0);
+	}
+}
+
+
+SegmentedEncoder::~SegmentedEncoder()
+{
+	for(std::vector<Segment>::iterator i = _segments.begin(); i != _segments.end(); ++i)
+	{
+		delete i->pipeline;
+		delete i->source;
+	}
+}
+
+
+void
+SegmentedEncoder::SetPipeline(int segment, EncoderPipeline *pipeline)
+{
+	assert(_segments[segment].pipeline == NULL);
+	
+	_segments[segment].pipeline = pipeline;
+}
+
+
+void
+SegmentedEncoder::CopySegment(int segment, PacketSource *source)
+{
+	Segment &seg = _segments[segment];
+	
+	assert(seg.pipeline == NULL && !seg.copied);
+	
+	seg.source = source;
+	seg.copied = true;
+	
+	// nothing to render, so it's never the next segment
+	_frames_left -= (seg.frames - seg.submitted);
+	
+	seg.submitted = seg.frames;
+}
+
+
+bool
+SegmentedEncoder::Start()
+{
+	for(std::vector<Segment>::iterator i = _segments.begin(); i != _segments.end(); ++i)
+	{
+		assert(i->pipeline != NULL || i->copied);
+	
+		if(i->pipeline != NULL && !i->pipeline->Start())
+			return false;
+	}
+	
+	return true;
+}
+
+
+void
+SegmentedEncoder::Join()
+{
+	for(std::vector<Segment>::iterator i = _segments.begin(); i != _segments.end(); ++i)
+	{
+		if(i->pipeline != NULL)
+			i->pipeline->Join();
+	}
+}
+
+
+int
+SegmentedEncoder::NextSegment()
+{
+	// Earliest segment first, so there's always something coming out for the muxer.
+	// When the encoders can't keep up, every queue fills and the frames go around.
+	for(int i = _mux; i < Segments(); i++)
+	{
+		Segment &seg = _segments[i];
+		
+		if(seg.submitted < seg.frames && !seg.pipeline->Full())
+			return i;
+	}
+	
+	return -1;
+}
+
+
+bool
+SegmentedEncoder::Full()
+{
+	return (NextSegment() < 0);
+}
+
+
+vpx_codec_pts_t
+SegmentedEncoder::NextFrame()
+{
+	const int i = NextSegment();
+	
+	assert(i >= 0);
+	
+	return (_segments[i].start + _segments[i].submitted);
+}
+
+
+bool
+SegmentedEncoder::Submit(vpx_image_t *img, vpx_image_t *alpha_img, unsigned long duration)
+{
+	const int i = NextSegment();
+	
+	assert(i >= 0);
+	
+	Segment &seg = _segments[i];
+	
+	const bool submitted = seg.pipeline->Submit(img, alpha_img, seg.start + seg.submitted, duration);
+	
+	if(submitted)
+	{
+		seg.submitted++;
+		
+		_frames_left--;
+		
+		if(seg.submitted == seg.frames)
+			seg.pipeline->Finish(); // flush this one while the others are still going
+	}
+	
+	return submitted;
+}
+
+
+void
+SegmentedEncoder::Finish()
+{
+	_finishing = true;
+	
+	for(std::vector<Segment>::iterator i = _segments.begin(); i != _segments.end(); ++i)
+	{
+		if(i->pipeline != NULL && !i->pipeline->Finishing())
+			i->pipeline->Finish();
+	}
+}
+
+
+bool
+SegmentedEncoder::SegmentDone(Segment &seg)
+{
+	if(seg.copied)
+		return (seg.source == NULL || seg.source->Done() || seg.source->Error());
+	else
+		return seg.pipeline->Done();
+}
+
+
+bool
+SegmentedEncoder::GetPacket(EncodedPacket *&pkt, EncodedPacket *&alpha_pkt, int &segment)
+{
+	while(_mux < Segments())
+	{
+		Segment &seg = _segments[_mux];
+		
+		if(seg.copied)
+		{
+			pkt = (seg.source != NULL ? seg.source->Next() : NULL);
+			alpha_pkt = NULL;
+			
+			if(pkt != NULL)
+			{
+				segment = _mux;
+				
+				return true;
+			}
+			else if(seg.source != NULL && seg.source->Error())
+				return false; // so nothing after it gets muxed in its place
+			else
+				_mux++;
+		}
+		else if( seg.pipeline->GetPacket(pkt, alpha_pkt) )
+		{
+			segment = _mux;
+			
+			return true;
+		}
+		else if( seg.pipeline->Done() )
+			_mux++;
+		else
+			return false;
+	}
+	
+	return false;
+}
+
+
+void
+SegmentedEncoder::WaitForSpace()
+{
+	const int i = NextSegment();
+	
+	if(i >= 0)
+		return;
+	
+	for(int j = _mux; j < Segments(); j++)
+	{
+		Segment &seg = _segments[j];
+		
+		if(seg.submitted < seg.frames)
+		{
+			// we're not taking packets from later segments yet
+			if(j == _mux && !_segments[_mux].copied)
+				seg.pipeline->WaitForSpace();
+			else
+				seg.pipeline->WaitForRoom();
+			
+			return;
+		}
+	}
+}
+
+
+void
+SegmentedEncoder::WaitForPacket()
+{
+	// a copied segment never has to wait
+	if(_mux < Segments() && !_segments[_mux].copied)
+		_segments[_mux].pipeline->WaitForPacket();
+}
+
+
+bool
+SegmentedEncoder::Done()
+{
+	while(_mux < Segments() && SegmentDone(_segments[_mux]))
+		_mux++;
+	
+	return (_mux == Segments());
+}
+
+
+bool
+SegmentedEncoder::Error()
+{
+	for(std::vector<Segment>::iterator i = _segments.begin(); i != _segments.end(); ++i)
+	{
+		if(i->copied ? (i->source != NULL && i->source->Error()) : i->pipeline->Error())
+			return true;
+	}
+	
+	return false;
+}
+
+
+PipelineStats
+SegmentedEncoder::Stats() const
+{
+	PipelineStats total;
+	
+	memset(&total, 0, sizeof(total));
+	
+	for(std::vector<Segment>::const_iterator i = _segments.begin(); i != _segments.end(); ++i)
+	{
+		if(i->pipeline == NULL)
+			continue;
+		
+		const PipelineStats &stats = i->pipeline->Stats();
+		
+		total.frames += stats.frames;
+		total.render_stalls += stats.render_stalls;
+		total.render_stall_seconds += stats.render_stall_seconds;
+		total.encoder_stalls += stats.encoder_stalls;
+		total.encoder_stall_seconds += stats.encoder_stall_seconds;
+	}
+	
+	return total;
+}
@@ -0,0 +1,348 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_PIPELINE_H
+#define WEBM_PREMIERE_EXPORT_PIPELINE_H
+
+#include "WebM_Premiere_Platform.h"
+
+#include "WebM_Premiere_Export_Governor.h"
+#include "WebM_Premiere_Export_Timing.h"
+
+#include "vpx/vpx_encoder.h"
+
+#include <deque>
+#include <vector>
+
+
+// libvpx only keeps its packets around until the next call to vpx_codec_encode,
+// so anything crossing threads has to be copied out.
+class EncodedPacket
+{
+  public:
+	EncodedPacket(const vpx_codec_cx_pkt_t *pkt);
+	~EncodedPacket();
+	
+	vpx_codec_cx_pkt_kind kind;
+	
+	void *buf;
+	size_t sz;
+	
+	vpx_codec_pts_t pts;
+	unsigned long duration;
+	vpx_codec_frame_flags_t flags;
+	
+  private:
+	EncodedPacket(const EncodedPacket &);
+	EncodedPacket &operator=(const EncodedPacket &);
+};
+
+
+typedef struct FramePoolStats
+{
+	unsigned int	hits;		// Get() handed back a recycled image
+	unsigned int	misses;		// Get() had to allocate
+	unsigned int	wrapped;	// Wrap() calls, frames that didn't need a copy
+	unsigned int	images;		// currently allocated, in use or not
+	size_t			bytes;
+} FramePoolStats;
+
+
+// Recycles image buffers over the whole export, so we aren't allocating
+// and page-faulting tens of megabytes per frame.  Images are keyed by
+// format, size and bit depth.  Get() and Release() can be called from
+// different threads.  Every image gets the export's color space and range,
+// which is what the RGB conversion goes by.
+//
+// Images for the alpha channel ask for neutral_chroma.  Their U and V
+// are filled when the buffer is allocated and never touched again,
+// so those are kept apart from the color images.
+//
+// Wrap() makes an image out of planes someone else owns, for frames that are
+// already in the encoder's format.  The owner has to keep them around until
+// the image is released, so releasing it puts the owner on a list, and the
+// thread that owns them takes them back with Unwrapped().
+
+class FramePool
+{
+  public:
+	FramePool(bool huge_pages, vpx_color_space_t color_space, vpx_color_range_t color_range);
+	~FramePool();
+	
+	vpx_image_t * Get(vpx_img_fmt_t fmt, unsigned int width, unsigned int height, unsigned int bit_depth,
+						bool neutral_chroma); // NULL if out of memory
+	void Release(vpx_image_t *img);
+	
+	vpx_image_t * Wrap(vpx_img_fmt_t fmt, unsigned int width, unsigned int height,
+						unsigned char *planes[3], const int strides[3], void *owner); // NULL if it can't
+	void Unwrapped(std::vector<void *> &owners); // appends the owners that are free now
+	
+	FramePoolStats Stats();
+	
+  private:
+	typedef struct PoolImage
+	{
+		vpx_image_t		img;
+		
+		vpx_img_fmt_t	fmt;
+		unsigned int	width;
+		unsigned int	height;
+		unsigned int	bit_depth;
+		bool			neutral_chroma;
+		
+		void			*buf;
+		size_t			size;
+		
+		void			*owner;		// wrapped images only
+	} PoolImage;
+	
+	const bool _huge_pages;
+	const vpx_color_space_t _color_space;
+	const vpx_color_range_t _color_range;
+	
+	WebMMutex _mutex;
+	
+	std::vector<PoolImage *> _images;
+	std::vector<PoolImage *> _free;
+	
+	std::vector<PoolImage *> _wrappers;			// no buffers of their own
+	std::vector<PoolImage *> _free_wrappers;
+	std::vector<void *> _unwrapped;
+	
+	FramePoolStats _stats;
+	
+	FramePool(const FramePool &);
+	FramePool &operator=(const FramePool &);
+};
+
+
+typedef struct PipelineStats
+{
+	unsigned int	frames;
+	
+	unsigned int	render_stalls;			// export thread waiting for the encoder
+	double			render_stall_seconds;
+	
+	unsigned int	encoder_stalls;			// encoder thread waiting for frames
+	double			encoder_stall_seconds;
+} PipelineStats;
+
+
+// Bounded producer/consumer queue between the export thread, which renders and
+// converts frames, and a thread that runs vpx_codec_encode.  Images handed to
+// Submit() belong to the pipeline and go back to the pool after they've been encoded.
+// With alpha, the color and alpha encoders run at the same time on two threads
+// and meet after every frame, and visible frames come back out in pairs.
+// The encoders can hold on to any number of frames (lag-in-frames) and make any
+// number of packets for one.  VP8's alt-refs come out as packets of their own,
+// invisible and stamped with whatever frame the encoder saw last, so they're
+// held until the next visible frame is out, then come out just ahead of it with
+// its pts and no alpha.  (VP9 packs its alt-refs into superframes itself.)
+// With a governor, the deadline and cpu-used can change between frames.
+// Encoding time goes to the timing on its own track.
+class EncoderPipeline : public WebMThread
+{
+  public:
+	EncoderPipeline(vpx_codec_ctx_t *encoder, vpx_codec_ctx_t *alpha_encoder,
+					FramePool &pool, unsigned long deadline, int depth,
+					DeadlineGovernor *governor, ExportTiming &timing, int track);
+	virtual ~EncoderPipeline();
+	
+	// export thread side
+	bool Full();
+	bool Submit(vpx_image_t *img, vpx_image_t *alpha_img, vpx_codec_pts_t pts, unsigned long duration);
+	void Finish(); // no more frames, flush the encoder
+	
+	bool GetPacket(EncodedPacket *&pkt, EncodedPacket *&alpha_pkt); // doesn't block
+	
+	void WaitForSpace(); // until a packet is ready or there's room in the queue
+	void WaitForRoom(); // until there's room in the queue, never mind the packets
+	void WaitForPacket(); // until a packet is ready or we're done
+	
+	bool Finishing() const { return _finishing; }
+	bool Done();
+	bool Error();
+	
+	const PipelineStats & Stats() const { return _stats; }
+	
+  protected:
+	virtual void Run();
+	
+  private:
+	typedef struct PipelineFrame
+	{
+		vpx_image_t			*img;
+		vpx_image_t			*alpha_img;
+		vpx_codec_pts_t		pts;
+		unsigned long		duration;
+	} PipelineFrame;
+	
+	int Encode(vpx_image_t *img, vpx_image_t *alpha_img,
+				vpx_codec_pts_t pts, unsigned long duration,
+				std::deque<EncodedPacket *> &packets, std::deque<EncodedPacket *> &alpha_packets); // returns packet count, -1 for error
+	
+	void Publish(std::deque<EncodedPacket *> &packets, std::deque<EncodedPacket *> &alpha_packets);
+	
+	bool PacketReady() const;
+	
+	void FollowGovernor();
+	
+	vpx_codec_ctx_t * const _encoder;
+	vpx_codec_ctx_t * const _alpha_encoder;
+	FramePool &_pool;
+	unsigned long _deadline;
+	const size_t _depth;
+	
+	DeadlineGovernor * const _governor;
+	unsigned int _governor_setting;
+	
+	ExportTiming &_timing;
+	const int _track;
+	
+	WebMWorkerPool _encode_pool; // one thread, or two with alpha
+	
+	WebMMutex _mutex;
+	WebMCondition _frame_cond;		// signaled when a frame is submitted
+	WebMCondition _packet_cond;		// signaled when a frame is taken or a packet comes out
+	
+	std::deque<PipelineFrame> _frames;
+	std::deque<EncodedPacket *> _packets;
+	std::deque<EncodedPacket *> _alpha_packets;
+	
+	std::deque<EncodedPacket *> _hidden;		// invisible, waiting for a visible frame
+	std::deque<EncodedPacket *> _alpha_hidden;
+	
+	bool _finishing;
+	bool _flushed;
+	bool _error;
+	bool _abort;
+	
+	PipelineStats _stats;
+};
+
+
+// Packets somebody else already compressed, for a segment that gets copied
+// instead of encoded.  Next() hands them over in mux order, visible frames
+// stamped with their frame number like an encoder's would be, and returns
+// NULL when there are no more or one couldn't be read.  Runs on the export thread.
+class PacketSource
+{
+  public:
+	virtual ~PacketSource() {}
+	
+	virtual EncodedPacket * Next() = 0;
+	
+	virtual bool Done() const = 0;
+	virtual bool Error() const = 0;
+};
+
+
+// Splits the frames of a pass into segments, each with its own encoders on
+// its own EncoderPipeline, so encoding can scale past what tiles allow.
+// Every segment starts with a keyframe, because that's how an encoder starts.
+// Frames go to the earliest segment with room in its queue, and packets come
+// back out in order, one segment after the other.  Packets for later segments
+// wait in their pipelines, which is fine because they're compressed.
+// With one segment, this is just an EncoderPipeline.
+//
+// The segments can also start wherever the caller says, and a copied segment
+// takes no frames, its packets come from a PacketSource when its turn comes.
+// A pass that doesn't mux can copy from no source at all.
+class SegmentedEncoder
+{
+  public:
+	SegmentedEncoder(int frames, int segments);
+	SegmentedEncoder(int frames, const std::vector<int> &starts); // the first one is 0
+	~SegmentedEncoder();
+	
+	int Segments() const { return _segments.size(); }
+	int SegmentStart(int segment) const { return _segments[segment].start; }
+	int SegmentFrames(int segment) const { return _segments[segment].frames; }
+	
+	void SetPipeline(int segment, EncoderPipeline *pipeline); // takes ownership
+	void CopySegment(int segment, PacketSource *source); // takes ownership, can be NULL
+	bool Start();
+	void Join();
+	
+	// export thread side, same as EncoderPipeline
+	bool FramesLeft() const { return (_frames_left > 0); }
+	bool Full(); // all the segments that still need frames
+	vpx_codec_pts_t NextFrame(); // the frame to render next, when not Full()
+	bool Submit(vpx_image_t *img, vpx_image_t *alpha_img, unsigned long duration); // for NextFrame()
+	void Finish();
+	
+	bool GetPacket(EncodedPacket *&pkt, EncodedPacket *&alpha_pkt, int &segment);
+	
+	void WaitForSpace();
+	void WaitForPacket();
+	
+	bool Finishing() const { return _finishing; }
+	bool Done();
+	bool Error();
+	
+	PipelineStats Stats() const;
+	
+  private:
+	typedef struct Segment
+	{
+		EncoderPipeline		*pipeline;
+		PacketSource		*source;
+		bool				copied;
+		int					start;
+		int					frames;
+		int					submitted;
+	} Segment;
+	
+	int NextSegment();
+	
+	bool SegmentDone(Segment &seg);
+	
+	std::vector<Segment> _segments;
+	
+	int _frames_left;
+	int _mux; // the segment packets are coming out of
+	bool _finishing;
+	
+	SegmentedEncoder(const SegmentedEncoder &);
+	SegmentedEncoder &operator=(const SegmentedEncoder &);
+};
+
+
+#endif // WEBM_PREMIERE_EXPORT_PIPELINE_H
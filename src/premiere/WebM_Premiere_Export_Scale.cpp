@@ -0,0 +1,554 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_Scale.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+	#define WEBM_X86 1
+	
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+	#define WEBM_NEON 1
+	
+	#include <arm_neon.h>
+#endif
+
+
+// The weights are 14-bit so a weight times a 12-bit pixel fits in a
+// signed 16-bit multiply with a 32-bit sum, which is what SSE2 has.
+#define SCALE_BITS		14
+#define SCALE_ONE		(1 << SCALE_BITS)
+#define SCALE_ROUND		(1 << (SCALE_BITS - 1))
+
+
+void
+ImageScaler::MakeFilter(ScaleFilter &filter, unsigned int src_size, unsigned int dst_size)
+{
+	assert(dst_size > 0 && dst_size <= src_size);
+	
+	const double scale = (double)src_size / (double)dst_size;
+	
+	// widest span of source pixels any output pixel covers
+	int taps = 1;
+	
+	for(unsigned int i=0; i < dst_size; i++)
+	{
+		const int first = floor(i * scale);
+		const int last = std::min<int>(src_size, ceil((i + 1) * scale));
+		
+		taps = std::max<int>(taps, last - first);
+	}
+	
+	taps += (taps & 1); // the SSE2 kernel does pairs
+	
+	filter.taps = taps;
+	filter.start.resize(dst_size);
+	filter.weights.assign(dst_size * taps, 0);
+	
+	for(unsigned int i=0; i < dst_size; i++)
+	{
+		const double left = i * scale;
+		const double right = (i + 1) * scale;
+		
+		const int first = floor(left);
+		const int last = std::min<int>(src_size, ceil(right));
+		
+		short *weights = &filter.weights[i * taps];
+		
+		int total = 0;
+		int biggest = 0;
+		
+		for(int j = first; j < last; j++)
+		{
+			const double covered = std::min<double>(right, j + 1) - std::max<double>(left, j);
+			
+			weights[j - first] = (short)((covered / scale) * SCALE_ONE + 0.5);
+			
+			total += weights[j - first];
+			
+			if(weights[j - first] > weights[biggest])
+				biggest = j - first;
+		}
+		
+		// rounding leftovers go to the biggest tap so a flat area stays flat
+		weights[biggest] += (SCALE_ONE - total);
+		
+		filter.start[i] = first;
+	}
+	
+	// the leftover pixels at the end are only done by the scalar loop
+	const unsigned int groups = dst_size / 4;
+	
+	filter.grouped.resize(groups * taps * 4);
+	
+	for(unsigned int g=0; g < groups; g++)
+	{
+		for(int k=0; k < taps; k++)
+		{
+			for(int i=0; i < 4; i++)
+				filter.grouped[(((g * taps) + k) * 4) + i] = filter.weights[(((g * 4) + i) * taps) + k];
+		}
+	}
+}
+
+
+ImageScaler::ImageScaler(const vpx_image_t *src, const vpx_image_t *dst) :
+	_fmt(src->fmt),
+	_src_w(src->d_w),
+	_src_h(src->d_h),
+	_dst_w(dst->d_w),
+	_dst_h(dst->d_h)
+{
+	assert(src->fmt == dst->fmt && src->bit_depth == dst->bit_depth);
+	
+	MakeFilter(_horizontal[0], src->d_w, dst->d_w);
+	MakeFilter(_vertical[0], src->d_h, dst->d_h);
+	
+	MakeFilter(_horizontal[1], (src->d_w + src->x_chroma_shift) >> src->x_chroma_shift,
+								(dst->d_w + dst->x_chroma_shift) >> dst->x_chroma_shift);
+	
+	MakeFilter(_vertical[1], (src->d_h + src->y_chroma_shift) >> src->y_chroma_shift,
+								(dst->d_h + dst->y_chroma_shift) >> dst->y_chroma_shift);
+}
+
+
+bool
+ImageScaler::Fits(const vpx_image_t *src, const vpx_image_t *dst) const
+{
+	return (src->fmt == _fmt && dst->fmt == _fmt &&
+			src->d_w == _src_w && src->d_h == _src_h &&
+			dst->d_w == _dst_w && dst->d_h == _dst_h);
+}
+
+
+#ifdef WEBM_X86
+
+// two neighboring 16-bit pixels
+static inline int
+LoadPair(const unsigned short *pix)
+{
+	int pair;
+	
+	memcpy(&pair, pix, sizeof(pair));
+	
+	return pair;
+}
+
+static inline void
+Store4_SSE2(unsigned char *out, const __m128i &val)
+{
+	const int four = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(val, val), _mm_setzero_si128()));
+	
+	memcpy(out, &four, 4);
+}
+
+static inline void
+Store4_SSE2(unsigned short *out, const __m128i &val)
+{
+	_mm_storel_epi64((__m128i *)out, _mm_packs_epi32(val, val));
+}
+
+// Four output pixels at a time, each one's next two taps in a multiply-add.
+// The taps are pairs of neighboring source pixels, so they're one load each.
+template <typename PIX>
+static int
+HorizontalRow_SSE2(PIX *out, const unsigned short *in, const int *start, const short *grouped, const int taps, const int width)
+{
+	const __m128i round = _mm_set1_epi32(SCALE_ROUND);
+	
+	int x = 0;
+	
+	for(; x <= width - 4; x += 4)
+	{
+		const unsigned short *pix0 = in + start[x];
+		const unsigned short *pix1 = in + start[x + 1];
+		const unsigned short *pix2 = in + start[x + 2];
+		const unsigned short *pix3 = in + start[x + 3];
+		
+		__m128i sum = round;
+		
+		for(int k=0; k < taps; k += 2)
+		{
+			const __m128i p = _mm_set_epi32(LoadPair(pix3 + k), LoadPair(pix2 + k), LoadPair(pix1 + k), LoadPair(pix0 + k));
+			
+			const __m128i w = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(grouped + (k * 4))),
+													_mm_loadl_epi64((const __m128i *)(grouped + ((k + 1) * 4))));
+			
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(p, w));
+		}
+		
+		Store4_SSE2(out + x, _mm_srai_epi32(sum, SCALE_BITS));
+		
+		grouped += (taps * 4);
+	}
+	
+	return x;
+}
+
+static inline __m128i
+Load8_SSE2(const unsigned char *pix)
+{
+	return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)pix), _mm_setzero_si128());
+}
+
+static inline __m128i
+Load8_SSE2(const unsigned short *pix)
+{
+	return _mm_loadu_si128((const __m128i *)pix);
+}
+
+// Eight pixels at a time, with two source rows in each multiply-add.
+// Returns where it left off for the scalar loop.
+template <typename PIX>
+static int
+VerticalRow_SSE2(unsigned short *out, const PIX * const *rows, const short *weights, const int taps, const int width)
+{
+	const __m128i round = _mm_set1_epi32(SCALE_ROUND);
+	
+	int x = 0;
+	
+	for(; x <= width - 8; x += 8)
+	{
+		__m128i lo = round;
+		__m128i hi = round;
+		
+		for(int k=0; k < taps; k += 2)
+		{
+			const __m128i a = Load8_SSE2(rows[k] + x);
+			const __m128i b = Load8_SSE2(rows[k + 1] + x);
+			
+			const __m128i w = _mm_set1_epi32((int)((unsigned short)weights[k] | ((unsigned int)(unsigned short)weights[k + 1] << 16)));
+			
+			lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+			hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+		}
+		
+		lo = _mm_srai_epi32(lo, SCALE_BITS);
+		hi = _mm_srai_epi32(hi, SCALE_BITS);
+		
+		_mm_storeu_si128((__m128i *)(out + x), _mm_packs_epi32(lo, hi));
+	}
+	
+	return x;
+}
+
+#endif // WEBM_X86
+
+
+#ifdef WEBM_NEON
+
+static inline int16x8_t
+Load8_NEON(const unsigned char *pix)
+{
+	return vreinterpretq_s16_u16(vmovl_u8(vld1_u8(pix)));
+}
+
+static inline int16x8_t
+Load8_NEON(const unsigned short *pix)
+{
+	return vreinterpretq_s16_u16(vld1q_u16(pix));
+}
+
+template <typename PIX>
+static int
+VerticalRow_NEON(unsigned short *out, const PIX * const *rows, const short *weights, const int taps, const int width)
+{
+	int x = 0;
+	
+	for(; x <= width - 8; x += 8)
+	{
+		int32x4_t lo = vdupq_n_s32(SCALE_ROUND);
+		int32x4_t hi = vdupq_n_s32(SCALE_ROUND);
+		
+		for(int k=0; k < taps; k++)
+		{
+			const int16x8_t a = Load8_NEON(rows[k] + x);
+			
+			lo = vmlal_n_s16(lo, vget_low_s16(a), weights[k]);
+			hi = vmlal_n_s16(hi, vget_high_s16(a), weights[k]);
+		}
+		
+		const int16x8_t result = vcombine_s16(vqshrn_n_s32(lo, SCALE_BITS), vqshrn_n_s32(hi, SCALE_BITS));
+		
+		vst1q_u16(out + x, vreinterpretq_u16_s16(result));
+	}
+	
+	return x;
+}
+
+template <typename PIX>
+static inline void
+Store4_NEON(PIX *out, const uint16x4_t &val);
+
+template <>
+inline void
+Store4_NEON<unsigned char>(unsigned char *out, const uint16x4_t &val)
+{
+	const uint8x8_t eight = vmovn_u16(vcombine_u16(val, val));
+	
+	vst1_lane_u32((uint32_t *)out, vreinterpret_u32_u8(eight), 0);
+}
+
+template <>
+inline void
+Store4_NEON<unsigned short>(unsigned short *out, const uint16x4_t &val)
+{
+	vst1_u16(out, val);
+}
+
+// four output pixels at a time, a tap at a time
+template <typename PIX>
+static int
+HorizontalRow_NEON(PIX *out, const unsigned short *in, const int *start, const short *grouped, const int taps, const int width)
+{
+	int x = 0;
+	
+	for(; x <= width - 4; x += 4)
+	{
+		const unsigned short *pix0 = in + start[x];
+		const unsigned short *pix1 = in + start[x + 1];
+		const unsigned short *pix2 = in + start[x + 2];
+		const unsigned short *pix3 = in + start[x + 3];
+		
+		int32x4_t sum = vdupq_n_s32(SCALE_ROUND);
+		
+		for(int k=0; k < taps; k++)
+		{
+			uint16x4_t p = vdup_n_u16(0);
+			
+			p = vld1_lane_u16(pix0 + k, p, 0);
+			p = vld1_lane_u16(pix1 + k, p, 1);
+			p = vld1_lane_u16(pix2 + k, p, 2);
+			p = vld1_lane_u16(pix3 + k, p, 3);
+			
+			sum = vmlal_s16(sum, vreinterpret_s16_u16(p), vld1_s16(grouped + (k * 4)));
+		}
+		
+		Store4_NEON<PIX>(out + x, vqshrun_n_s32(sum, SCALE_BITS));
+		
+		grouped += (taps * 4);
+	}
+	
+	return x;
+}
+
+#endif // WEBM_NEON
+
+
+template <typename PIX>
+static void
+VerticalRow(unsigned short *out, const PIX * const *rows, const short *weights, const int taps, int x, const int width)
+{
+	for(; x < width; x++)
+	{
+		int sum = SCALE_ROUND;
+		
+		for(int k=0; k < taps; k++)
+			sum += rows[k][x] * weights[k];
+		
+		out[x] = (sum >> SCALE_BITS);
+	}
+}
+
+
+template <typename PIX>
+static void
+HorizontalRow(PIX *out, const unsigned short *in, const int *start, const short *weights, const int taps, int x, const int width)
+{
+	weights += (x * taps);
+	
+	for(; x < width; x++)
+	{
+		const unsigned short *pix = in + start[x];
+		
+		int sum = SCALE_ROUND;
+		
+		for(int k=0; k < taps; k++)
+			sum += pix[k] * weights[k];
+		
+		out[x] = (sum >> SCALE_BITS);
+		
+		weights += taps;
+	}
+}
+
+
+template <typename PIX>
+void
+ImageScaler::ScalePlane(vpx_image_t *dst, const vpx_image_t *src, int plane, int y_start, int y_end) const
+{
+	const bool chroma = (plane != VPX_PLANE_Y);
+	
+	const ScaleFilter &horizontal = _horizontal[chroma ? 1 : 0];
+	const ScaleFilter &vertical = _vertical[chroma ? 1 : 0];
+	
+	const int src_width = (chroma ? (src->d_w + src->x_chroma_shift) >> src->x_chroma_shift : src->d_w);
+	const int src_height = (chroma ? (src->d_h + src->y_chroma_shift) >> src->y_chroma_shift : src->d_h);
+	
+	const int dst_width = horizontal.start.size();
+	
+	// Padding taps have no weight, but they still get read.  The row is long
+	// enough for them, and rows past the bottom are the last row again.
+	std::vector<unsigned short> row(src_width + horizontal.taps, 0);
+	
+	std::vector<const PIX *> rows(vertical.taps);
+	
+	const WebM_SIMD simd = WebMDetectSIMD();
+	
+	for(int y = y_start; y < y_end; y++)
+	{
+		for(int k=0; k < vertical.taps; k++)
+		{
+			const int src_y = std::min<int>(vertical.start[y] + k, src_height - 1);
+			
+			rows[k] = (const PIX *)(src->planes[plane] + (src->stride[plane] * src_y));
+		}
+		
+		const short *weights = &vertical.weights[y * vertical.taps];
+		
+		int x = 0;
+		
+	#ifdef WEBM_X86
+		if(simd >= WEBM_SIMD_SSE2)
+			x = VerticalRow_SSE2<PIX>(&row[0], &rows[0], weights, vertical.taps, src_width);
+	#endif
+	
+	#ifdef WEBM_NEON
+		if(simd == WEBM_SIMD_NEON)
+			x = VerticalRow_NEON<PIX>(&row[0], &rows[0], weights, vertical.taps, src_width);
+	#endif
+		
+		VerticalRow<PIX>(&row[0], &rows[0], weights, vertical.taps, x, src_width);
+		
+		PIX *out = (PIX *)(dst->planes[plane] + (dst->stride[plane] * y));
+		
+		const short *grouped = (horizontal.grouped.empty() ? NULL : &horizontal.grouped[0]);
+		
+		x = 0;
+		
+	#ifdef WEBM_X86
+		if(simd >= WEBM_SIMD_SSE2)
+			x = HorizontalRow_SSE2<PIX>(out, &row[0], &horizontal.start[0], grouped, horizontal.taps, dst_width);
+	#endif
+	
+	#ifdef WEBM_NEON
+		if(simd == WEBM_SIMD_NEON)
+			x = HorizontalRow_NEON<PIX>(out, &row[0], &horizontal.start[0], grouped, horizontal.taps, dst_width);
+	#endif
+		
+		HorizontalRow<PIX>(out, &row[0], &horizontal.start[0], &horizontal.weights[0], horizontal.taps, x, dst_width);
+	}
+	
+	(void)simd;
+}
+
+
+void
+ImageScaler::Scale(vpx_image_t *dst, const vpx_image_t *src, int y_start, int y_end) const
+{
+	assert( Fits(src, dst) );
+	assert(y_start % (dst->y_chroma_shift + 1) == 0);
+	
+	const int chroma_start = y_start >> dst->y_chroma_shift;
+	const int chroma_end = (y_end + dst->y_chroma_shift) >> dst->y_chroma_shift;
+	
+	for(int p = VPX_PLANE_Y; p <= VPX_PLANE_V; p++)
+	{
+		const int start = (p == VPX_PLANE_Y ? y_start : chroma_start);
+		const int end = (p == VPX_PLANE_Y ? y_end : chroma_end);
+		
+		if(dst->fmt & VPX_IMG_FMT_HIGHBITDEPTH)
+			ScalePlane<unsigned short>(dst, src, p, start, end);
+		else
+			ScalePlane<unsigned char>(dst, src, p, start, end);
+	}
+}
+
+
+// Horizontal bands of the destination, like CopyPixJob
+class ScaleJob : public WebMJob
+{
+  public:
+	ScaleJob(vpx_image_t *dst, const vpx_image_t *src, const ImageScaler &scaler, int band_height) :
+		_dst(dst),
+		_src(src),
+		_scaler(scaler),
+		_band_height(band_height)
+	{}
+	
+	virtual void Process(int band)
+	{
+		const int y_start = band * _band_height;
+		const int y_end = std::min<int>(y_start + _band_height, _dst->d_h);
+		
+		_scaler.Scale(_dst, _src, y_start, y_end);
+	}
+	
+  private:
+	vpx_image_t *_dst;
+	const vpx_image_t *_src;
+	const ImageScaler &_scaler;
+	const int _band_height;
+};
+
+
+void
+ScaleImage(vpx_image_t *dst, const vpx_image_t *src, const ImageScaler &scaler, WebMWorkerPool &pool)
+{
+	const unsigned int sub_y = dst->y_chroma_shift + 1;
+	
+	const int bands_wanted = pool.Threads() * 2;
+	
+	int band_height = std::max<int>(16, (dst->d_h + bands_wanted - 1) / bands_wanted);
+	
+	band_height = ((band_height + sub_y - 1) / sub_y) * sub_y;
+	
+	const int bands = (dst->d_h + band_height - 1) / band_height;
+	
+	ScaleJob job(dst, src, scaler, band_height);
+	
+	pool.Run(job, bands);
+}
@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_SCALE_H
+#define WEBM_PREMIERE_EXPORT_SCALE_H
+
+#include "WebM_Premiere_Platform.h"
+
+#include "vpx/vpx_image.h"
+
+#include <vector>
+
+
+// Shrinks a vpx_image_t into a smaller one of the same format and bit depth.
+// Each output pixel is the average of the source pixels it covers, with the
+// ones on the edges counted for the part that's covered.  The filters are
+// worked out once for a pair of sizes.  Rows go through a vertical pass into
+// a 16-bit row and then a horizontal pass into the image.  Both passes have
+// SSE2 and NEON kernels.  The horizontal ones do four output pixels at a time,
+// with the weights rearranged so each tap's four come in one load.
+//
+// Scale() does destination rows y_start up to y_end, which have to start on
+// a chroma row, same as the converters.  ScaleImage() splits the frame into
+// bands on a worker pool.
+
+class ImageScaler
+{
+  public:
+	ImageScaler(const vpx_image_t *src, const vpx_image_t *dst);
+	
+	bool Fits(const vpx_image_t *src, const vpx_image_t *dst) const; // the sizes this was made for
+	
+	void Scale(vpx_image_t *dst, const vpx_image_t *src, int y_start, int y_end) const;
+	
+  private:
+	typedef struct ScaleFilter
+	{
+		int					taps;		// per output pixel, always even
+		std::vector<int>	start;		// first source pixel for each output pixel
+		std::vector<short>	weights;	// taps for each output pixel, adding up to 1 << 14
+		std::vector<short>	grouped;	// the same, by four output pixels, then by tap
+	} ScaleFilter;
+	
+	static void MakeFilter(ScaleFilter &filter, unsigned int src_size, unsigned int dst_size);
+	
+	template <typename PIX>
+	void ScalePlane(vpx_image_t *dst, const vpx_image_t *src, int plane, int y_start, int y_end) const;
+	
+	vpx_img_fmt_t _fmt;
+	unsigned int _src_w, _src_h;
+	unsigned int _dst_w, _dst_h;
+	
+	ScaleFilter _horizontal[2]; // luma and chroma
+	ScaleFilter _vertical[2];
+};
+
+
+void ScaleImage(vpx_image_t *dst, const vpx_image_t *src, const ImageScaler &scaler, WebMWorkerPool &pool);
+
+
+#endif // WEBM_PREMIERE_EXPORT_SCALE_H
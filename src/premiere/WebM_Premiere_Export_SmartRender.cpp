@@ -0,0 +1,764 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_SmartRender.h"
+
+#include "WebM_Premiere_Platform.h"
+
+#include "vpx/vp8dx.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include <fstream>
+#include <sstream>
+
+
+extern int g_num_cpus;
+
+
+static const char kKeysExtension[] = ".webmkeys";
+static const char kKeysMagic[8] = { 'W', 'e', 'b', 'M', 'K', 'e', 'y', '1' };
+static const int kKeysDays = 30; // unused ones get deleted after this
+
+
+bool
+SameImage(const vpx_image_t *a, const vpx_image_t *b)
+{
+	if(a->fmt != b->fmt || a->d_w != b->d_w || a->d_h != b->d_h ||
+		a->x_chroma_shift != b->x_chroma_shift || a->y_chroma_shift != b->y_chroma_shift)
+	{
+		return false;
+	}
+	
+	const size_t sample_bytes = (a->fmt & VPX_IMG_FMT_HIGHBITDEPTH) ? 2 : 1;
+	
+	for(int p = VPX_PLANE_Y; p <= VPX_PLANE_V; p++)
+	{
+		const int x_shift = (p == VPX_PLANE_Y ? 0 : a->x_chroma_shift);
+		const int y_shift = (p == VPX_PLANE_Y ? 0 : a->y_chroma_shift);
+		
+		const size_t row_bytes = ((a->d_w + (1 << x_shift) - 1) >> x_shift) * sample_bytes;
+		const unsigned int rows = (a->d_h + (1 << y_shift) - 1) >> y_shift;
+		
+		for(unsigned int y=0; y < rows; y++)
+		{
+			if(memcmp(a->planes[p] + (y * a->stride[p]), b->planes[p] + (y * b->stride[p]), row_bytes) != 0)
+				return false;
+		}
+	}
+	
+	return true;
+}
+
+
+#pragma mark-
+
+
+SmartSource::SmartSource() :
+	_decoder_open(false),
+	_decoded(-1),
+	_img(NULL)
+{
+	memset(&_decoder, 0, sizeof(_decoder));
+}
+
+
+SmartSource::~SmartSource()
+{
+	if(_decoder_open)
+		vpx_codec_destroy(&_decoder);
+	
+	_reader.Close();
+}
+
+
+bool
+SmartSource::Open(const std::string &path, const SmartTarget &target)
+{
+	_path = path;
+	
+	if(_reader.Open(path.c_str()) != 0)
+		return false;
+	
+	long long pos = 0;
+	
+	mkvparser::EBMLHeader ebmlHeader;
+	
+	if(ebmlHeader.Parse(&_reader, pos) < 0)
+		return false;
+	
+	mkvparser::Segment *segment = NULL;
+	
+	if(mkvparser::Segment::CreateInstance(&_reader, pos, segment) != 0 || segment == NULL)
+		return false;
+	
+	bool ok = (segment->Load() >= 0);
+	
+	const mkvparser::VideoTrack *track = NULL;
+	
+	const mkvparser::Tracks* const pTracks = (ok ? segment->GetTracks() : NULL);
+	
+	if(pTracks != NULL)
+	{
+		for(unsigned long t=0; t < pTracks->GetTracksCount() && track == NULL; t++)
+		{
+			const mkvparser::Track* const pTrack = pTracks->GetTrackByIndex(t);
+			
+			if(pTrack != NULL && pTrack->GetType() == mkvparser::Track::kVideo)
+				track = static_cast<const mkvparser::VideoTrack *>(pTrack);
+		}
+	}
+	
+	ok = (track != NULL && track->GetCodecId() != NULL &&
+			strcmp(track->GetCodecId(), target.codec_id) == 0 &&
+			track->GetWidth() == target.width && track->GetHeight() == target.height);
+	
+	const bool vp8 = (ok && strcmp(target.codec_id, "V_VP8") == 0);
+	
+	double frame_seconds = 0.0;
+	
+	if(ok)
+		ok = Index(segment, track, vp8, frame_seconds);
+	
+	delete segment; // we have what we need from it
+	
+	// block times are in milliseconds, but that's averaged over the whole file
+	if(!ok || _frames.empty() || !_frames[0].key ||
+		(_frames.size() > 1 && fabs(frame_seconds - target.frame_seconds) > 0.001))
+	{
+		return false;
+	}
+	
+	
+	vpx_codec_dec_cfg_t config;
+	config.threads = g_num_cpus;
+	config.w = target.width;
+	config.h = target.height;
+	
+	// no frame threading, we want every frame as soon as it's decoded
+	if(vpx_codec_dec_init(&_decoder, (vp8 ? vpx_codec_vp8_dx() : vpx_codec_vp9_dx()), &config, 0) != VPX_CODEC_OK)
+		return false;
+	
+	_decoder_open = true;
+	
+	// the first frame tells us the format
+	const vpx_image_t *img = Decode(0);
+	
+	return (img != NULL && img->fmt == target.fmt && img->bit_depth == target.bit_depth &&
+			img->range == target.color_range &&
+			(target.color_space == VPX_CS_UNKNOWN || img->cs == target.color_space));
+}
+
+
+bool
+SmartSource::Index(mkvparser::Segment *segment, const mkvparser::Track *track, bool vp8, double &frame_seconds)
+{
+	long long first_time = -1, last_time = -1;
+	
+	int invisible = 0; // blocks waiting for a visible one
+	
+	const mkvparser::Cluster *cluster = segment->GetFirst();
+	
+	while(cluster != NULL && !cluster->EOS())
+	{
+		const mkvparser::BlockEntry *entry = NULL;
+		
+		long status = cluster->GetFirst(entry);
+		
+		while(status >= 0 && entry != NULL && !entry->EOS())
+		{
+			const mkvparser::Block *pBlock = entry->GetBlock();
+			
+			if(pBlock->GetTrackNumber() == track->GetNumber())
+			{
+				for(int f=0; f < pBlock->GetFrameCount(); f++)
+				{
+					const mkvparser::Block::Frame &blockFrame = pBlock->GetFrame(f);
+					
+					SourceBlock block;
+					
+					block.pos = blockFrame.pos;
+					block.len = blockFrame.len;
+					block.key = pBlock->IsKey();
+					
+					if(block.len < 1)
+						return false;
+					
+					// VP8 says in the first byte if it's shown.  VP9 packs its
+					// hidden frames into superframes, so every block is shown.
+					bool visible = true;
+					
+					if(vp8)
+					{
+						unsigned char tag = 0;
+						
+						if(_reader.Read(block.pos, 1, &tag) != 0)
+							return false;
+						
+						visible = ((tag >> 4) & 1);
+					}
+					
+					_blocks.push_back(block);
+					
+					if(visible)
+					{
+						SourceFrame frame;
+						
+						frame.first_block = _blocks.size() - 1 - invisible;
+						frame.blocks = invisible + 1;
+						frame.key = (block.key && invisible == 0);
+						
+						_frames.push_back(frame);
+						
+						invisible = 0;
+						
+						const long long time = pBlock->GetTime(cluster);
+						
+						if(first_time < 0)
+							first_time = time;
+						
+						last_time = time;
+					}
+					else
+						invisible++;
+				}
+			}
+			
+			status = cluster->GetNext(entry, entry);
+		}
+		
+		if(status < 0)
+			return false;
+		
+		cluster = segment->GetNext(cluster);
+	}
+	
+	if(_frames.size() > 1)
+		frame_seconds = (double)(last_time - first_time) / (1000000000.0 * (_frames.size() - 1));
+	
+	return true;
+}
+
+
+bool
+SmartSource::ReadBlock(const SourceBlock &block)
+{
+	_data.resize(block.len);
+	
+	return (_reader.Read(block.pos, block.len, &_data[0]) == 0);
+}
+
+
+const vpx_image_t *
+SmartSource::Decode(int frame)
+{
+	if(!_decoder_open || frame < 0 || frame >= (int)_frames.size())
+		return NULL;
+	
+	if(frame == _decoded)
+		return _img;
+	
+	int start = frame;
+	
+	while(start > 0 && !_frames[start].key)
+		start--;
+	
+	if(!_frames[start].key)
+		return NULL;
+	
+	// keep going from where we are if we can
+	const int from = ((_decoded >= start && _decoded < frame) ? _decoded + 1 : start);
+	
+	_decoded = -1;
+	_img = NULL;
+	
+	for(int f = from; f <= frame; f++)
+	{
+		const SourceFrame &source_frame = _frames[f];
+		
+		const vpx_image_t *img = NULL;
+		
+		for(int b=0; b < source_frame.blocks; b++)
+		{
+			if( !ReadBlock(_blocks[source_frame.first_block + b]) )
+				return NULL;
+			
+			if(vpx_codec_decode(&_decoder, &_data[0], _data.size(), NULL, 0) != VPX_CODEC_OK)
+				return NULL;
+			
+			vpx_codec_iter_t iter = NULL;
+			
+			while(const vpx_image_t *out = vpx_codec_get_frame(&_decoder, &iter))
+				img = out;
+		}
+		
+		if(img == NULL)
+			return NULL;
+		
+		_img = img;
+	}
+	
+	_decoded = frame;
+	
+	return _img;
+}
+
+
+bool
+SmartSource::ReadFrame(int frame, vpx_codec_pts_t pts, std::vector<EncodedPacket *> &packets)
+{
+	const SourceFrame &source_frame = _frames[frame];
+	
+	const size_t first_packet = packets.size();
+	
+	for(int b=0; b < source_frame.blocks; b++)
+	{
+		const SourceBlock &block = _blocks[source_frame.first_block + b];
+		
+		if( !ReadBlock(block) )
+		{
+			for(size_t i = first_packet; i < packets.size(); i++)
+				delete packets[i];
+			
+			packets.resize(first_packet);
+			
+			return false;
+		}
+		
+		// stamped the way EncoderPipeline stamps them
+		const bool visible = (b == source_frame.blocks - 1);
+		
+		vpx_codec_cx_pkt_t pkt;
+		memset(&pkt, 0, sizeof(pkt));
+		
+		pkt.kind = VPX_CODEC_CX_FRAME_PKT;
+		pkt.data.frame.buf = &_data[0];
+		pkt.data.frame.sz = _data.size();
+		pkt.data.frame.pts = pts;
+		pkt.data.frame.duration = (visible ? 1 : 0);
+		pkt.data.frame.flags = (visible ? (source_frame.key ? VPX_FRAME_IS_KEY : 0) : VPX_FRAME_IS_INVISIBLE);
+		pkt.data.frame.partition_id = -1;
+		
+		packets.push_back( new EncodedPacket(&pkt) );
+	}
+	
+	return true;
+}
+
+
+static std::string
+KeysPath(const std::string &dir, WebMHash key)
+{
+	std::stringstream ss;
+	
+	ss << dir << WebMPathSeparator << std::hex;
+	ss.width(16);
+	ss.fill('0');
+	ss << key << kKeysExtension;
+	
+	return ss.str();
+}
+
+
+static bool
+ReadKeys(const std::string &path, WebMHash key, std::vector<WebMHash> &hashes)
+{
+	std::ifstream f(path.c_str(), std::ios::in | std::ios::binary);
+	
+	if(!f)
+		return false;
+	
+	char magic[sizeof(kKeysMagic)];
+	WebMHash file_key = 0;
+	unsigned int count = 0;
+	
+	f.read(magic, sizeof(magic));
+	f.read((char *)&file_key, sizeof(file_key));
+	f.read((char *)&count, sizeof(count));
+	
+	if(!f.good() || memcmp(magic, kKeysMagic, sizeof(kKeysMagic)) != 0 || file_key != key || count != hashes.size())
+		return false;
+	
+	if(count > 0)
+		f.read((char *)&hashes[0], count * sizeof(WebMHash));
+	
+	return f.good();
+}
+
+
+static void
+WriteKeys(const std::string &dir, const std::string &path, WebMHash key, const std::vector<WebMHash> &hashes)
+{
+	if( !WebMMakeDirectory(dir) )
+		return;
+	
+	// written off to the side and renamed, same as StatsCache
+	std::stringstream ss;
+	
+	ss << path << "." << std::hex << HashCombine(key, (WebMHash)time(NULL)) << ".tmp";
+	
+	const std::string temp_path = ss.str();
+	
+	std::ofstream f(temp_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	
+	if(!f)
+		return;
+	
+	const unsigned int count = hashes.size();
+	
+	f.write(kKeysMagic, sizeof(kKeysMagic));
+	f.write((const char *)&key, sizeof(key));
+	f.write((const char *)&count, sizeof(count));
+	
+	if(count > 0)
+		f.write((const char *)&hashes[0], count * sizeof(WebMHash));
+	
+	f.close();
+	
+	if(f.fail() || !WebMRenameFile(temp_path, path))
+		WebMDeleteFile(temp_path);
+	
+	// the files they were for are probably gone
+	std::vector<WebMFileInfo> files;
+	
+	if( WebMListDirectory(dir, files) )
+	{
+		const time_t now = time(NULL);
+		
+		for(size_t i=0; i < files.size(); i++)
+		{
+			const std::string &name = files[i].name;
+			
+			const bool ours = (name.size() > strlen(kKeysExtension) &&
+								name.compare(name.size() - strlen(kKeysExtension), strlen(kKeysExtension), kKeysExtension) == 0);
+			
+			if(ours && (now - files[i].modified) > ((time_t)kKeysDays * 24 * 60 * 60))
+				WebMDeleteFile(dir + WebMPathSeparator + name);
+		}
+	}
+}
+
+
+bool
+SmartSource::KeyHashes(const std::string &dir, std::vector<std::pair<int, WebMHash> > &keys)
+{
+	keys.clear();
+	
+	// Keyframes decode on their own, so a keyframe's compressed data says
+	// what its image is.  Reading it back is a lot cheaper than decoding it.
+	std::vector<int> key_frames;
+	
+	WebMHash key = HashBytes(kKeysMagic, sizeof(kKeysMagic), 0);
+	
+	for(int f=0; f < (int)_frames.size(); f++)
+	{
+		if(_frames[f].key)
+		{
+			assert(_frames[f].blocks == 1);
+			
+			if( !ReadBlock(_blocks[_frames[f].first_block]) )
+				return false;
+			
+			key = HashCombine(key, HashBytes(&_data[0], _data.size(), f));
+			
+			key_frames.push_back(f);
+		}
+	}
+	
+	std::vector<WebMHash> hashes(key_frames.size(), 0);
+	
+	const std::string path = (dir.empty() ? std::string() : KeysPath(dir, key));
+	
+	if(!dir.empty() && ReadKeys(path, key, hashes))
+	{
+		WebMTouchFile(path); // so they're kept as long as they're used
+	}
+	else
+	{
+		for(size_t i=0; i < key_frames.size(); i++)
+		{
+			const vpx_image_t *img = Decode(key_frames[i]);
+			
+			if(img == NULL)
+				return false;
+			
+			hashes[i] = HashImageRows(img, 0, img->d_h, 0);
+		}
+		
+		if(!dir.empty())
+			WriteKeys(dir, path, key, hashes);
+	}
+	
+	for(size_t i=0; i < key_frames.size(); i++)
+		keys.push_back( std::make_pair(key_frames[i], hashes[i]) );
+	
+	return true;
+}
+
+
+#pragma mark-
+
+
+SmartPlanner::SmartPlanner(std::vector<SmartSource *> &sources, const std::string &key_dir, int min_frames, int max_encoded) :
+	_sources(sources),
+	_key_dir(key_dir),
+	_min_frames(min_frames > 1 ? min_frames : 1),
+	_max_encoded(max_encoded > 1 ? max_encoded : 1),
+	_indexed(false),
+	_frame(0),
+	_run_source(-1),
+	_run_start(0),
+	_run_source_frame(0)
+{
+
+}
+
+
+bool
+SmartPlanner::Frame(const vpx_image_t *img)
+{
+	if(!_indexed)
+	{
+		for(int s=0; s < (int)_sources.size(); s++)
+		{
+			std::vector<std::pair<int, WebMHash> > keys;
+			
+			if( !_sources[s]->KeyHashes(_key_dir, keys) )
+				return false;
+			
+			for(size_t i=0; i < keys.size(); i++)
+				_keys.insert( std::make_pair(keys[i].second, std::make_pair(s, keys[i].first)) );
+		}
+		
+		_indexed = true;
+	}
+	
+	const int frame = _frame++;
+	
+	if(_run_source >= 0)
+	{
+		SmartSource &source = *_sources[_run_source];
+		
+		const int source_frame = _run_source_frame + (frame - _run_start);
+		
+		if(source_frame < source.Frames())
+		{
+			const vpx_image_t *source_img = source.Decode(source_frame);
+			
+			if(source_img == NULL)
+				return false;
+			
+			if( SameImage(img, source_img) )
+				return true;
+		}
+		
+		EndRun(frame);
+	}
+	
+	// a stretch can start here if this is one of the keyframes
+	const std::pair<KeyMap::const_iterator, KeyMap::const_iterator> keys = _keys.equal_range( HashImageRows(img, 0, img->d_h, 0) );
+	
+	for(KeyMap::const_iterator i = keys.first; i != keys.second; ++i)
+	{
+		const int s = i->second.first;
+		const int k = i->second.second;
+		
+		const vpx_image_t *key_img = _sources[s]->Decode(k);
+		
+		if(key_img == NULL)
+			return false;
+		
+		if( SameImage(img, key_img) )
+		{
+			_run_source = s;
+			_run_start = frame;
+			_run_source_frame = k;
+			
+			break;
+		}
+	}
+	
+	return true;
+}
+
+
+void
+SmartPlanner::EndRun(int end)
+{
+	if(_run_source >= 0 && (end - _run_start) >= _min_frames)
+	{
+		SmartSpan run;
+		
+		run.start = _run_start;
+		run.frames = end - _run_start;
+		run.source = _run_source;
+		run.source_frame = _run_source_frame;
+		
+		_runs.push_back(run);
+	}
+	
+	_run_source = -1;
+}
+
+
+void
+SmartPlanner::Plan(std::vector<SmartSpan> &spans)
+{
+	EndRun(_frame);
+	
+	// Every encoded stretch gets its own encoders, all at once.  Dropping a
+	// copied stretch with encoded ones on both sides makes one out of three.
+	while(!_runs.empty())
+	{
+		int encoded = 0;
+		int drop = -1;
+		int drop_any = -1;
+		
+		for(int i=0; i < (int)_runs.size(); i++)
+		{
+			const int prev_end = (i > 0 ? _runs[i - 1].start + _runs[i - 1].frames : 0);
+			const int next_start = (i + 1 < (int)_runs.size() ? _runs[i + 1].start : _frame);
+			
+			const bool gap_before = (_runs[i].start > prev_end);
+			const bool gap_after = (_runs[i].start + _runs[i].frames < next_start);
+			
+			if(gap_before)
+				encoded++;
+			
+			if(gap_after && i + 1 == (int)_runs.size())
+				encoded++;
+			
+			if(gap_before && gap_after && (drop < 0 || _runs[i].frames < _runs[drop].frames))
+				drop = i;
+			
+			if(drop_any < 0 || _runs[i].frames < _runs[drop_any].frames)
+				drop_any = i;
+		}
+		
+		if(encoded <= _max_encoded)
+			break;
+		
+		_runs.erase(_runs.begin() + (drop >= 0 ? drop : drop_any));
+	}
+	
+	spans.clear();
+	
+	int pos = 0;
+	
+	for(size_t i=0; i <= _runs.size(); i++)
+	{
+		const int next_start = (i < _runs.size() ? _runs[i].start : _frame);
+		
+		if(next_start > pos)
+		{
+			SmartSpan encode;
+			
+			encode.start = pos;
+			encode.frames = next_start - pos;
+			encode.source = -1;
+			encode.source_frame = 0;
+			
+			spans.push_back(encode);
+		}
+		
+		if(i < _runs.size())
+		{
+			spans.push_back(_runs[i]);
+			
+			pos = _runs[i].start + _runs[i].frames;
+		}
+	}
+}
+
+
+#pragma mark-
+
+
+SmartPacketSource::SmartPacketSource(SmartSource &source, const SmartSpan &span) :
+	_source(source),
+	_span(span),
+	_frame(0),
+	_next_packet(0),
+	_error(false)
+{
+	assert(span.source >= 0);
+}
+
+
+SmartPacketSource::~SmartPacketSource()
+{
+	for(size_t i = _next_packet; i < _packets.size(); i++)
+		delete _packets[i];
+}
+
+
+EncodedPacket *
+SmartPacketSource::Next()
+{
+	while(_next_packet == _packets.size())
+	{
+		if(_error || _frame >= _span.frames)
+			return NULL;
+		
+		// the ones we handed over belong to the muxer now
+		_packets.clear();
+		_next_packet = 0;
+		
+		if( !_source.ReadFrame(_span.source_frame + _frame, _span.start + _frame, _packets) )
+		{
+			_error = true;
+			
+			return NULL;
+		}
+		
+		_frame++;
+	}
+	
+	return _packets[_next_packet++];
+}
+
+
+bool
+SmartPacketSource::Done() const
+{
+	return (_frame >= _span.frames && _next_packet == _packets.size());
+}
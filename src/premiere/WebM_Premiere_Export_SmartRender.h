@@ -0,0 +1,233 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_SMARTRENDER_H
+#define WEBM_PREMIERE_EXPORT_SMARTRENDER_H
+
+#include "WebM_Premiere_Export_Pipeline.h"
+#include "WebM_Premiere_Export_StatsCache.h"
+
+#include "vpx/vpx_decoder.h"
+
+#include "mkvparser/mkvparser.h"
+#include "mkvparser/mkvreader.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+// Smart render
+// When the sequence is cuts of WebM files made with the same settings as the
+// export, whole stretches of it can be copied out of those files instead of
+// encoded.  Premiere doesn't tell an exporter what's in the sequence, so the
+// user names the files (--smart-render), and we find out what's what by
+// rendering every frame and comparing it with the files' decoded frames.
+// A stretch can only start on one of the file's keyframes, and has to match
+// frame for frame, so anything with an effect or a title on it gets encoded.
+// Only exact matches count, which in practice means 8-bit 4:2:0, 4:2:2 or
+// 4:4:4 that our importer handed Premiere as YUV.
+//
+// Source frames only get decoded once an export frame has matched one of the
+// keyframes by hash.  The keyframe hashes have to come from decoding them, so
+// they're kept in a cache folder, named for the keyframes' compressed data,
+// and a file only has to be decoded like that the first time.
+
+
+// What the export's frames are, for a file's to be copied into it
+typedef struct SmartTarget
+{
+	const char			*codec_id;	// mkvmuxer::Tracks::kVp8CodecId or kVp9CodecId
+	unsigned int		width;
+	unsigned int		height;
+	double				frame_seconds;
+	vpx_img_fmt_t		fmt;
+	unsigned int		bit_depth;
+	vpx_color_space_t	color_space;	// VPX_CS_UNKNOWN takes any
+	vpx_color_range_t	color_range;
+} SmartTarget;
+
+
+// One of the files the sequence was cut from, its video frames indexed.
+// An invisible block (a VP8 alt-ref) goes with the visible frame after it.
+class SmartSource
+{
+  public:
+	SmartSource();
+	~SmartSource();
+	
+	// false if it can't be read, or can't go in this export
+	bool Open(const std::string &path, const SmartTarget &target);
+	
+	const std::string & Path() const { return _path; }
+	
+	int Frames() const { return _frames.size(); }
+	
+	// Decoding in order is fastest, anything else starts over from a keyframe.
+	// The image is the decoder's, good until the next call.  NULL on an error.
+	const vpx_image_t * Decode(int frame);
+	
+	// the frame's blocks, as packets for export frame pts
+	bool ReadFrame(int frame, vpx_codec_pts_t pts, std::vector<EncodedPacket *> &packets);
+	
+	// HashImageRows() of every keyframe, as frame and hash, from the cache in
+	// dir or by decoding them (and then saving them there).  Empty dir for no cache.
+	bool KeyHashes(const std::string &dir, std::vector<std::pair<int, WebMHash> > &keys);
+	
+  private:
+	typedef struct SourceBlock
+	{
+		long long	pos;
+		long		len;
+		bool		key;
+	} SourceBlock;
+	
+	typedef struct SourceFrame
+	{
+		int			first_block;
+		int			blocks;		// the last one is the visible one
+		bool		key;
+	} SourceFrame;
+	
+	bool Index(mkvparser::Segment *segment, const mkvparser::Track *track, bool vp8, double &frame_seconds);
+	
+	bool ReadBlock(const SourceBlock &block);
+	
+	std::string _path;
+	
+	mkvparser::MkvReader _reader;
+	
+	std::vector<SourceBlock> _blocks;
+	std::vector<SourceFrame> _frames;
+	
+	std::vector<unsigned char> _data;
+	
+	vpx_codec_ctx_t _decoder;
+	bool _decoder_open;
+	
+	int _decoded;		// the frame the decoder is on, -1 for none
+	const vpx_image_t *_img;	// and what it made for that frame
+	
+	SmartSource(const SmartSource &);
+	SmartSource &operator=(const SmartSource &);
+};
+
+
+// A stretch of the export, encoded or copied
+typedef struct SmartSpan
+{
+	int		start;			// export frame
+	int		frames;
+	int		source;			// -1 to encode it
+	int		source_frame;
+} SmartSpan;
+
+
+// Finds the stretches, given every export frame in order.  Frames that start
+// a stretch are looked up among the files' keyframes by hash, then compared.
+// Stretches shorter than min_frames aren't worth the keyframe the encoder
+// has to start over with after them, and to keep the encoders down to
+// max_encoded, the shortest stretches between two encoded ones are dropped.
+// key_dir is for SmartSource::KeyHashes().
+class SmartPlanner
+{
+  public:
+	SmartPlanner(std::vector<SmartSource *> &sources, const std::string &key_dir, int min_frames, int max_encoded);
+	
+	bool Frame(const vpx_image_t *img); // false if a file couldn't be decoded
+	
+	// The last frame is in a stretch long enough to be copied.  The others
+	// will be encoded, unless Plan() has to drop a stretch.
+	bool Copying() const { return (_run_source >= 0 && (_frame - _run_start) >= _min_frames); }
+	
+	void Plan(std::vector<SmartSpan> &spans);
+	
+  private:
+	void EndRun(int end);
+	
+	std::vector<SmartSource *> &_sources;
+	const std::string _key_dir;
+	const int _min_frames;
+	const int _max_encoded;
+	
+	typedef std::multimap<WebMHash, std::pair<int, int> > KeyMap; // to source and frame
+	KeyMap _keys;
+	bool _indexed;
+	
+	int _frame;			// export frames so far
+	
+	std::vector<SmartSpan> _runs;
+	
+	int _run_source;	// -1 when we're not in one
+	int _run_start;
+	int _run_source_frame;
+};
+
+
+// Copies a span's frames out of its file for SegmentedEncoder
+class SmartPacketSource : public PacketSource
+{
+  public:
+	SmartPacketSource(SmartSource &source, const SmartSpan &span);
+	virtual ~SmartPacketSource();
+	
+	virtual EncodedPacket * Next();
+	
+	virtual bool Done() const;
+	virtual bool Error() const { return _error; }
+	
+  private:
+	SmartSource &_source;
+	const SmartSpan _span;
+	
+	int _frame;			// next one to read, in the span
+	
+	std::vector<EncodedPacket *> _packets;	// read but not handed over yet
+	size_t _next_packet;
+	
+	bool _error;
+};
+
+
+// whether two images have the same pixels, visible part only
+bool SameImage(const vpx_image_t *a, const vpx_image_t *b);
+
+
+#endif // WEBM_PREMIERE_EXPORT_SMARTRENDER_H
@@ -0,0 +1,206 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_Spill.h"
+
+#include <assert.h>
+#include <string.h>
+
+
+// bytes in the visible part of the image, plane by plane
+static size_t
+ImageBytes(const vpx_image_t *img)
+{
+	if(img == NULL)
+		return 0;
+	
+	const size_t sample_bytes = (img->fmt & VPX_IMG_FMT_HIGHBITDEPTH) ? 2 : 1;
+	
+	const size_t chroma_w = (img->d_w + (1 << img->x_chroma_shift) - 1) >> img->x_chroma_shift;
+	const size_t chroma_h = (img->d_h + (1 << img->y_chroma_shift) - 1) >> img->y_chroma_shift;
+	
+	return ((img->d_w * img->d_h) + (2 * chroma_w * chroma_h)) * sample_bytes;
+}
+
+
+// packing and unpacking the planes, pack == true goes from image to buffer
+static unsigned char *
+PackImage(vpx_image_t *img, unsigned char *buf, bool pack)
+{
+	if(img == NULL)
+		return buf;
+	
+	const size_t sample_bytes = (img->fmt & VPX_IMG_FMT_HIGHBITDEPTH) ? 2 : 1;
+	
+	for(int p = VPX_PLANE_Y; p <= VPX_PLANE_V; p++)
+	{
+		const int x_shift = (p == VPX_PLANE_Y ? 0 : img->x_chroma_shift);
+		const int y_shift = (p == VPX_PLANE_Y ? 0 : img->y_chroma_shift);
+		
+		const size_t row_bytes = ((img->d_w + (1 << x_shift) - 1) >> x_shift) * sample_bytes;
+		const unsigned int rows = (img->d_h + (1 << y_shift) - 1) >> y_shift;
+		
+		for(unsigned int y=0; y < rows; y++)
+		{
+			unsigned char *row = img->planes[p] + (y * img->stride[p]);
+			
+			if(pack)
+				memcpy(buf, row, row_bytes);
+			else
+				memcpy(row, buf, row_bytes);
+			
+			buf += row_bytes;
+		}
+	}
+	
+	return buf;
+}
+
+
+FrameSpill::FrameSpill(const std::string &dir, unsigned long long budget, int frames) :
+	_dir(dir),
+	_budget(budget),
+	_record_size(0),
+	_slots(frames, -1),
+	_next_slot(0),
+	_full(false)
+{
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+
+FrameSpill::~FrameSpill()
+{
+	_file.Close();
+}
+
+
+bool
+FrameSpill::Put(int frame, const vpx_image_t *img, const vpx_image_t *alpha_img)
+{
+	assert(frame >= 0 && frame < (int)_slots.size());
+	
+	if(frame < 0 || frame >= (int)_slots.size())
+		return false;
+	
+	const size_t record_size = ImageBytes(img) + ImageBytes(alpha_img);
+	
+	if(_record_size == 0)
+	{
+		_record_size = record_size;
+		
+		_buffer.resize(_record_size);
+	}
+	
+	assert(record_size == _record_size);
+	
+	if(!_full && record_size == _record_size &&
+		((unsigned long long)(_next_slot + 1) * _record_size) > _budget)
+	{
+		_full = true;
+	}
+	
+	if(!_full && !_file.IsOpen())
+	{
+		if( !_file.Open(_dir) )
+			_full = true;
+	}
+	
+	if(_full || record_size != _record_size)
+	{
+		_stats.over_budget++;
+		
+		return false;
+	}
+	
+	unsigned char *end = PackImage(const_cast<vpx_image_t *>(img), &_buffer[0], true);
+	
+	end = PackImage(const_cast<vpx_image_t *>(alpha_img), end, true);
+	
+	assert(end == &_buffer[0] + _record_size);
+	
+	const int slot = (_slots[frame] >= 0 ? _slots[frame] : _next_slot);
+	
+	if( !_file.Write((unsigned long long)slot * _record_size, &_buffer[0], _record_size) )
+	{
+		// disk full, probably
+		_full = true;
+		
+		_stats.over_budget++;
+		
+		return false;
+	}
+	
+	if(_slots[frame] < 0)
+	{
+		_slots[frame] = _next_slot++;
+		
+		_stats.stored++;
+		_stats.bytes += _record_size;
+	}
+	
+	return true;
+}
+
+
+bool
+FrameSpill::Has(int frame) const
+{
+	return (frame >= 0 && frame < (int)_slots.size() && _slots[frame] >= 0);
+}
+
+
+bool
+FrameSpill::Get(int frame, vpx_image_t *img, vpx_image_t *alpha_img)
+{
+	if( !Has(frame) || (ImageBytes(img) + ImageBytes(alpha_img)) != _record_size )
+		return false;
+	
+	if( !_file.Read((unsigned long long)_slots[frame] * _record_size, &_buffer[0], _record_size) )
+		return false;
+	
+	unsigned char *end = PackImage(img, &_buffer[0], false);
+	
+	PackImage(alpha_img, end, false);
+	
+	_stats.read++;
+	
+	return true;
+}
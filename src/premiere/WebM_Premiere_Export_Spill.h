@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_SPILL_H
+#define WEBM_PREMIERE_EXPORT_SPILL_H
+
+#include "WebM_Premiere_Platform.h"
+
+#include "vpx/vpx_image.h"
+
+#include <vector>
+
+
+typedef struct FrameSpillStats
+{
+	unsigned int		stored;			// frames written by the first pass
+	unsigned int		over_budget;	// frames that didn't fit, to be rendered again
+	unsigned int		read;			// frames the second pass got back
+	unsigned long long	bytes;
+} FrameSpillStats;
+
+
+// Keeps the converted frames from the analysis pass of a two-pass export
+// (or from smart render's planning) in a temp file, so the encode can read
+// them back instead of having Premiere render them again.  Frames past the
+// disk budget (or any the disk won't take) just aren't kept, and get
+// rendered again like before.  Only the visible part of each plane is
+// written, color then alpha.
+class FrameSpill
+{
+  public:
+	FrameSpill(const std::string &dir, unsigned long long budget, int frames);
+	~FrameSpill();
+	
+	// false if the frame wasn't kept, which is fine
+	bool Put(int frame, const vpx_image_t *img, const vpx_image_t *alpha_img);
+	
+	bool Has(int frame) const;
+	
+	// the images have to be the same format as the ones that went in
+	bool Get(int frame, vpx_image_t *img, vpx_image_t *alpha_img);
+	
+	FrameSpillStats Stats() const { return _stats; }
+	
+  private:
+	WebMTempFile _file;
+	
+	const std::string _dir;
+	const unsigned long long _budget;
+	
+	size_t _record_size;	// set by the first frame
+	
+	std::vector<int> _slots;	// where each frame is in the file, -1 if it isn't
+	int _next_slot;
+	
+	bool _full;
+	
+	std::vector<unsigned char> _buffer;
+	
+	FrameSpillStats _stats;
+};
+
+
+#endif // WEBM_PREMIERE_EXPORT_SPILL_H
@@ -0,0 +1,490 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_StatsCache.h"
+
+#include "WebM_Premiere_Platform.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+
+static const char kEntryExtension[] = ".webmstats";
+static const char kEntryMagic[8] = { 'W', 'e', 'b', 'M', 'S', 't', 'a', '1' };
+static const char kReportName[] = "report.txt";
+
+
+static inline WebMHash
+RotateLeft(WebMHash x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+
+// the MurmurHash3 finalizer
+static inline WebMHash
+Finalize(WebMHash h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	
+	return h;
+}
+
+
+static inline WebMHash
+Round(WebMHash h, WebMHash w)
+{
+	return RotateLeft(h ^ (w * 0x87c37b91114253d5ULL), 31) * 0x4cf5ad432745937fULL;
+}
+
+
+static inline WebMHash
+Load64(const unsigned char *p)
+{
+	WebMHash w;
+	
+	memcpy(&w, p, sizeof(w));
+	
+	return w;
+}
+
+
+WebMHash
+HashBytes(const void *data, size_t len, WebMHash seed)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	
+	// four independent lanes, so the multiplies can overlap
+	WebMHash h0 = seed;
+	WebMHash h1 = seed ^ 0x9e3779b97f4a7c15ULL;
+	WebMHash h2 = seed + 0x6a09e667f3bcc909ULL;
+	WebMHash h3 = seed - 0xbb67ae8584caa73bULL;
+	
+	size_t i = 0;
+	
+	for(; i + 32 <= len; i += 32)
+	{
+		h0 = Round(h0, Load64(p + i));
+		h1 = Round(h1, Load64(p + i + 8));
+		h2 = Round(h2, Load64(p + i + 16));
+		h3 = Round(h3, Load64(p + i + 24));
+	}
+	
+	for(; i + 8 <= len; i += 8)
+		h0 = Round(h0, Load64(p + i));
+	
+	if(i < len)
+	{
+		unsigned char tail[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+		
+		memcpy(tail, p + i, len - i);
+		
+		h1 = Round(h1, Load64(tail));
+	}
+	
+	WebMHash h = RotateLeft(h0, 1) + RotateLeft(h1, 7) + RotateLeft(h2, 12) + RotateLeft(h3, 18);
+	
+	h ^= (WebMHash)len;
+	
+	return Finalize(h);
+}
+
+
+WebMHash
+HashCombine(WebMHash a, WebMHash b)
+{
+	return Finalize(a ^ (b + 0x9e3779b97f4a7c15ULL + (a << 6) + (a >> 2)));
+}
+
+
+WebMHash
+HashImageRows(const vpx_image_t *img, int y_start, int y_end, WebMHash seed)
+{
+	const size_t sample_bytes = (img->fmt & VPX_IMG_FMT_HIGHBITDEPTH) ? 2 : 1;
+	
+	const int x_shift = img->x_chroma_shift;
+	const int y_shift = img->y_chroma_shift;
+	
+	const size_t y_bytes = img->d_w * sample_bytes;
+	const size_t uv_bytes = ((img->d_w + (1 << x_shift) - 1) >> x_shift) * sample_bytes;
+	
+	WebMHash sum = 0;
+	
+	for(int y = y_start; y < y_end; y++)
+	{
+		// seeded with plane and row, so rows can't trade places
+		sum += HashBytes(img->planes[VPX_PLANE_Y] + (y * img->stride[VPX_PLANE_Y]), y_bytes, HashCombine(seed, HashCombine(VPX_PLANE_Y, y)));
+		
+		// chroma rows go with the first luma row they cover
+		if( (y & ((1 << y_shift) - 1)) == 0 )
+		{
+			const int cy = (y >> y_shift);
+			
+			sum += HashBytes(img->planes[VPX_PLANE_U] + (cy * img->stride[VPX_PLANE_U]), uv_bytes, HashCombine(seed, HashCombine(VPX_PLANE_U, cy)));
+			sum += HashBytes(img->planes[VPX_PLANE_V] + (cy * img->stride[VPX_PLANE_V]), uv_bytes, HashCombine(seed, HashCombine(VPX_PLANE_V, cy)));
+		}
+	}
+	
+	return sum;
+}
+
+
+#pragma mark-
+
+
+StatsCache::StatsCache(const std::string &dir, unsigned long long max_bytes, int max_days) :
+	_dir(dir),
+	_max_bytes(max_bytes),
+	_max_days(max_days),
+	_changed(false)
+{
+	memset(&_total, 0, sizeof(_total));
+	
+	WebMMakeDirectory(_dir);
+	
+	ReadReport();
+}
+
+
+StatsCache::~StatsCache()
+{
+	if(_changed)
+		WriteReport();
+}
+
+
+std::string
+StatsCache::EntryName(WebMHash key) const
+{
+	std::stringstream ss;
+	
+	ss << std::hex;
+	ss.width(16);
+	ss.fill('0');
+	ss << key << kEntryExtension;
+	
+	return ss.str();
+}
+
+
+std::string
+StatsCache::EntryPath(WebMHash key) const
+{
+	return _dir + WebMPathSeparator + EntryName(key);
+}
+
+
+static bool
+ReadSizes(std::ifstream &f, std::vector<size_t> &sizes, unsigned int count, size_t &total)
+{
+	total = 0;
+	
+	for(unsigned int i=0; i < count; i++)
+	{
+		unsigned long long size = 0;
+		
+		f.read((char *)&size, sizeof(size));
+		
+		sizes.push_back(size);
+		
+		total += size;
+	}
+	
+	return f.good();
+}
+
+
+static bool
+ReadEntry(const std::string &path, WebMHash key, StatsCacheEntry &entry)
+{
+	std::ifstream f(path.c_str(), std::ios::in | std::ios::binary);
+	
+	if(!f)
+		return false;
+	
+	char magic[sizeof(kEntryMagic)];
+	WebMHash file_key = 0;
+	unsigned int segments = 0;
+	
+	f.read(magic, sizeof(magic));
+	f.read((char *)&file_key, sizeof(file_key));
+	f.read((char *)&entry.content, sizeof(entry.content));
+	f.read((char *)&segments, sizeof(segments));
+	
+	if(!f.good() || memcmp(magic, kEntryMagic, sizeof(kEntryMagic)) != 0 || file_key != key || segments > 65536)
+		return false;
+	
+	size_t stats_size = 0;
+	size_t alpha_stats_size = 0;
+	
+	entry.segment_sizes.clear();
+	entry.alpha_segment_sizes.clear();
+	
+	if( !ReadSizes(f, entry.segment_sizes, segments, stats_size) ||
+		!ReadSizes(f, entry.alpha_segment_sizes, segments, alpha_stats_size) )
+	{
+		return false;
+	}
+	
+	entry.stats.resize(stats_size);
+	entry.alpha_stats.resize(alpha_stats_size);
+	
+	if(stats_size > 0)
+		f.read(&entry.stats[0], stats_size);
+	
+	if(alpha_stats_size > 0)
+		f.read(&entry.alpha_stats[0], alpha_stats_size);
+	
+	return (f.good() && stats_size > 0);
+}
+
+
+bool
+StatsCache::Lookup(WebMHash key, StatsCacheEntry &entry)
+{
+	const std::string path = EntryPath(key);
+	
+	const bool found = ReadEntry(path, key, entry);
+	
+	if(found)
+	{
+		WebMTouchFile(path); // so eviction goes by last use
+		
+		_total.hits++;
+	}
+	else
+		_total.misses++;
+	
+	_changed = true;
+	
+	return found;
+}
+
+
+static void
+WriteSizes(std::ofstream &f, const std::vector<size_t> &sizes, unsigned int count)
+{
+	for(unsigned int i=0; i < count; i++)
+	{
+		const unsigned long long size = (i < sizes.size() ? sizes[i] : 0);
+		
+		f.write((const char *)&size, sizeof(size));
+	}
+}
+
+
+bool
+StatsCache::Store(WebMHash key, const StatsCacheEntry &entry)
+{
+	if(entry.stats.empty())
+		return false;
+	
+	const std::string path = EntryPath(key);
+	
+	// written off to the side and renamed, so another export never sees half a file
+	std::stringstream ss;
+	
+	ss << path << "." << std::hex << HashCombine(key, (WebMHash)time(NULL) ^ (WebMHash)(size_t)this) << ".tmp";
+	
+	const std::string temp_path = ss.str();
+	
+	const unsigned int segments = entry.segment_sizes.size();
+	
+	std::ofstream f(temp_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	
+	if(!f)
+		return false;
+	
+	f.write(kEntryMagic, sizeof(kEntryMagic));
+	f.write((const char *)&key, sizeof(key));
+	f.write((const char *)&entry.content, sizeof(entry.content));
+	f.write((const char *)&segments, sizeof(segments));
+	
+	WriteSizes(f, entry.segment_sizes, segments);
+	WriteSizes(f, entry.alpha_segment_sizes, segments);
+	
+	f.write(&entry.stats[0], entry.stats.size());
+	
+	if(!entry.alpha_stats.empty())
+		f.write(&entry.alpha_stats[0], entry.alpha_stats.size());
+	
+	f.close();
+	
+	const bool written = (!f.fail() && WebMRenameFile(temp_path, path));
+	
+	if(!written)
+		WebMDeleteFile(temp_path);
+	
+	Evict(key);
+	
+	return written;
+}
+
+
+void
+StatsCache::Stale(WebMHash key)
+{
+	WebMDeleteFile( EntryPath(key) );
+	
+	_total.stale++;
+	
+	_changed = true;
+}
+
+
+static bool
+NewerFirst(const WebMFileInfo &a, const WebMFileInfo &b)
+{
+	return (a.modified > b.modified);
+}
+
+
+static bool
+EndsWith(const std::string &s, const char *end)
+{
+	const size_t len = strlen(end);
+	
+	return (s.size() >= len && s.compare(s.size() - len, len, end) == 0);
+}
+
+
+void
+StatsCache::Evict(WebMHash keep)
+{
+	std::vector<WebMFileInfo> files;
+	
+	if( !WebMListDirectory(_dir, files) )
+		return;
+	
+	const time_t now = time(NULL);
+	
+	const time_t max_age = (time_t)_max_days * 24 * 60 * 60;
+	
+	const std::string keep_name = EntryName(keep);
+	
+	unsigned long long total_bytes = 0;
+	
+	std::vector<WebMFileInfo> entries;
+	
+	for(size_t i=0; i < files.size(); i++)
+	{
+		const WebMFileInfo &file = files[i];
+		
+		const time_t age = now - file.modified;
+		
+		if(file.name == keep_name)
+		{
+			total_bytes += file.size;
+		}
+		else if(EndsWith(file.name, kEntryExtension))
+		{
+			if(age > max_age)
+			{
+				if( WebMDeleteFile(_dir + WebMPathSeparator + file.name) )
+					_total.evicted++;
+			}
+			else
+				entries.push_back(file);
+		}
+		else if(EndsWith(file.name, ".tmp") && age > (24 * 60 * 60))
+		{
+			// left over from an export that crashed
+			WebMDeleteFile(_dir + WebMPathSeparator + file.name);
+		}
+	}
+	
+	std::sort(entries.begin(), entries.end(), NewerFirst);
+	
+	for(size_t i=0; i < entries.size(); i++)
+	{
+		total_bytes += entries[i].size;
+		
+		if(total_bytes > _max_bytes)
+		{
+			if( WebMDeleteFile(_dir + WebMPathSeparator + entries[i].name) )
+				_total.evicted++;
+		}
+	}
+	
+	_changed = true;
+}
+
+
+void
+StatsCache::ReadReport()
+{
+	std::ifstream f((_dir + WebMPathSeparator + kReportName).c_str());
+	
+	std::string key;
+	unsigned int value = 0;
+	
+	while(f >> key >> value)
+	{
+		if(key == "hits")
+			_total.hits = value;
+		else if(key == "misses")
+			_total.misses = value;
+		else if(key == "stale")
+			_total.stale = value;
+		else if(key == "evicted")
+			_total.evicted = value;
+	}
+}
+
+
+void
+StatsCache::WriteReport()
+{
+	std::ofstream f((_dir + WebMPathSeparator + kReportName).c_str(), std::ios::out | std::ios::trunc);
+	
+	f << "hits " << _total.hits << "\n";
+	f << "misses " << _total.misses << "\n";
+	f << "stale " << _total.stale << "\n";
+	f << "evicted " << _total.evicted << "\n";
+}
@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_STATSCACHE_H
+#define WEBM_PREMIERE_EXPORT_STATSCACHE_H
+
+#include "vpx/vpx_image.h"
+
+#include <string>
+#include <vector>
+
+
+// 64-bit hashes for the cache keys and for frame contents.  Not cryptographic,
+// just fast and well mixed.
+typedef unsigned long long WebMHash;
+
+WebMHash HashBytes(const void *data, size_t len, WebMHash seed);
+
+WebMHash HashCombine(WebMHash a, WebMHash b);
+
+// Hashes rows y_start to y_end of the image, with the chroma rows that go with them.
+// The result is a sum of per-row hashes, so bands hashed separately can be
+// added up in any order and come out the same as the whole frame.
+// Different seeds keep, say, the alpha image from matching the color image.
+WebMHash HashImageRows(const vpx_image_t *img, int y_start, int y_end, WebMHash seed);
+
+
+// First pass stats, as exSDKExport keeps them: one buffer with the segments
+// one after another, and the size of each.
+typedef struct StatsCacheEntry
+{
+	std::vector<char>	stats;
+	std::vector<size_t>	segment_sizes;
+	std::vector<char>	alpha_stats;
+	std::vector<size_t>	alpha_segment_sizes;
+	WebMHash			content;	// every frame the first pass saw
+} StatsCacheEntry;
+
+
+typedef struct StatsCacheReport
+{
+	unsigned int	hits;
+	unsigned int	misses;
+	unsigned int	stale;		// hit, but the frames turned out to be different
+	unsigned int	evicted;
+} StatsCacheReport;
+
+
+// Keeps first pass stats on disk, so a re-export of the same frames with
+// the same analysis settings can skip straight to the second pass.
+// Entries past the age limit, or the oldest ones past the size limit, get
+// evicted whenever something is stored.  Hit counts are kept on disk too,
+// the report covers all exports that used the folder.
+class StatsCache
+{
+  public:
+	StatsCache(const std::string &dir, unsigned long long max_bytes, int max_days);
+	~StatsCache();
+	
+	bool Lookup(WebMHash key, StatsCacheEntry &entry);
+	
+	bool Store(WebMHash key, const StatsCacheEntry &entry);
+	
+	// the entry was a hit, but the frames didn't match
+	void Stale(WebMHash key);
+	
+	StatsCacheReport Report() const { return _total; }
+	
+  private:
+	std::string EntryName(WebMHash key) const;
+	std::string EntryPath(WebMHash key) const;
+	
+	// the one just stored is kept even if the clock can't tell it's the newest
+	void Evict(WebMHash keep);
+	
+	void ReadReport();
+	void WriteReport();
+	
+	const std::string _dir;
+	const unsigned long long _max_bytes;
+	const int _max_days;
+	
+	StatsCacheReport _total;
+	bool _changed;
+};
+
+
+#endif // WEBM_PREMIERE_EXPORT_STATSCACHE_H
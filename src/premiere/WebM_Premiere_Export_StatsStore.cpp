@@ -0,0 +1,250 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_StatsStore.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+
+// without a Reserve(), and for staging the writes to the file
+static const size_t StatsChunkSize = 1024 * 1024;
+
+
+StatsStore::StatsStore(const std::string &spill_dir, size_t memory_budget) :
+	_dir(spill_dir),
+	_budget(memory_budget),
+	_size(0),
+	_file_size(0)
+{
+
+}
+
+
+StatsStore::~StatsStore()
+{
+	FreeChunks();
+}
+
+
+bool
+StatsStore::AddChunk(size_t size)
+{
+	StatsChunk chunk;
+	
+	chunk.buf = (char *)malloc(size);
+	chunk.size = size;
+	chunk.used = 0;
+	
+	if(chunk.buf == NULL)
+		return false;
+	
+	_chunks.push_back(chunk);
+	
+	return true;
+}
+
+
+void
+StatsStore::FreeChunks()
+{
+	for(std::vector<StatsChunk>::iterator i = _chunks.begin(); i != _chunks.end(); ++i)
+		free(i->buf);
+	
+	_chunks.clear();
+}
+
+
+void
+StatsStore::Reserve(size_t bytes)
+{
+	assert(_size == 0);
+	
+	if(bytes > _budget)
+		Spill(); // if the file doesn't open, we'll just try to keep it all
+	else if(_chunks.empty() && bytes > 0)
+		AddChunk(bytes);
+}
+
+
+bool
+StatsStore::Spill()
+{
+	assert(!_file.IsOpen());
+	
+	if(_dir.empty() || !_file.Open(_dir))
+		return false;
+	
+	_file_size = 0;
+	
+	for(std::vector<StatsChunk>::const_iterator i = _chunks.begin(); i != _chunks.end(); ++i)
+	{
+		if(i->used > 0 && !_file.Write(_file_size, i->buf, i->used))
+		{
+			_file.Close();
+			
+			return false;
+		}
+		
+		_file_size += i->used;
+	}
+	
+	FreeChunks();
+	
+	return AddChunk(StatsChunkSize);
+}
+
+
+bool
+StatsStore::FlushStaging()
+{
+	assert(_file.IsOpen() && _chunks.size() == 1);
+	
+	StatsChunk &staging = _chunks.front();
+	
+	if(staging.used > 0)
+	{
+		if( !_file.Write(_file_size, staging.buf, staging.used) )
+			return false;
+		
+		_file_size += staging.used;
+		
+		staging.used = 0;
+	}
+	
+	return true;
+}
+
+
+bool
+StatsStore::Append(const void *buf, size_t size)
+{
+	_file.Unmap(); // Data() is stale now
+	
+	if(!_file.IsOpen() && _size + size > _budget)
+		Spill();
+	
+	if( _file.IsOpen() )
+	{
+		if(_chunks.empty())
+			return false;
+		
+		if(size > _chunks.front().size - _chunks.front().used)
+		{
+			if( !FlushStaging() )
+				return false;
+			
+			// too big to stage, not that stats packets ever are
+			if(size > _chunks.front().size)
+			{
+				if( !_file.Write(_file_size, buf, size) )
+					return false;
+				
+				_file_size += size;
+				_size += size;
+				
+				return true;
+			}
+		}
+	}
+	else if(_chunks.empty() || size > _chunks.back().size - _chunks.back().used)
+	{
+		if( !AddChunk(std::max<size_t>(StatsChunkSize, size)) )
+			return false;
+	}
+	
+	StatsChunk &chunk = _chunks.back();
+	
+	memcpy(chunk.buf + chunk.used, buf, size);
+	
+	chunk.used += size;
+	_size += size;
+	
+	return true;
+}
+
+
+char *
+StatsStore::Data()
+{
+	if(_size == 0)
+		return NULL;
+	
+	if( _file.IsOpen() )
+	{
+		if( !FlushStaging() )
+			return NULL;
+		
+		assert(_file_size == _size);
+		
+		return (char *)_file.Map(_size);
+	}
+	
+	if(_chunks.size() > 1)
+	{
+		// Reserve() guessed low, or wasn't called, so this is the one time they get copied
+		StatsChunk whole;
+		
+		whole.buf = (char *)malloc(_size);
+		whole.size = _size;
+		whole.used = 0;
+		
+		if(whole.buf == NULL)
+			return NULL;
+		
+		for(std::vector<StatsChunk>::const_iterator i = _chunks.begin(); i != _chunks.end(); ++i)
+		{
+			memcpy(whole.buf + whole.used, i->buf, i->used);
+			
+			whole.used += i->used;
+		}
+		
+		FreeChunks();
+		
+		_chunks.push_back(whole);
+	}
+	
+	assert(_chunks.front().used == _size);
+	
+	return _chunks.front().buf;
+}
@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_STATSSTORE_H
+#define WEBM_PREMIERE_EXPORT_STATSSTORE_H
+
+#include "WebM_Premiere_Platform.h"
+
+#include <string>
+#include <vector>
+
+
+// First pass stats for a two-pass export, appended a packet at a time.
+// Packets go into chunks that never move, so nothing already stored gets
+// copied again.  Every stats packet is the same size, so once the first one is
+// in, Reserve() can size one chunk for the whole pass and Data() is just that
+// chunk.  Past the memory budget, the stats go to a temp file instead
+// (through a staging chunk) and Data() maps the file.  Either way, the second
+// pass reads straight out of Data() through rc_twopass_stats_in.
+class StatsStore
+{
+  public:
+	StatsStore(const std::string &spill_dir, size_t memory_budget);
+	~StatsStore();
+	
+	void Reserve(size_t bytes); // all the bytes expected, before the first Append()
+	
+	bool Append(const void *buf, size_t size);
+	
+	size_t Size() const { return _size; }
+	bool Spilled() const { return _file.IsOpen(); }
+	
+	// Everything so far in one piece, NULL if empty or the file couldn't be mapped.
+	// Good until the next Append().
+	char * Data();
+	
+  private:
+	typedef struct StatsChunk
+	{
+		char	*buf;
+		size_t	size;
+		size_t	used;
+	} StatsChunk;
+	
+	bool AddChunk(size_t size);
+	void FreeChunks();
+	
+	bool Spill();
+	bool FlushStaging();
+	
+	const std::string _dir;
+	const size_t _budget;
+	
+	std::vector<StatsChunk> _chunks; // with a file, just the staging chunk
+	size_t _size;
+	
+	WebMTempFile _file;
+	unsigned long long _file_size;
+	
+	StatsStore(const StatsStore &);
+	StatsStore &operator=(const StatsStore &);
+};
+
+
+#endif // WEBM_PREMIERE_EXPORT_STATSSTORE_H
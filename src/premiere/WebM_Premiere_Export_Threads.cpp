@@ -0,0 +1,256 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_Threads.h"
+
+#include "WebM_Premiere_Platform.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+
+// Conservative starting points, run webm_thread_calibrate to measure the
+// real ones for a machine.
+static const ThreadTableEntry default_table[] = {
+	{ false,	640,	4,	0 },
+	{ false,	1280,	8,	0 },
+	{ false,	1920,	12,	0 },
+	{ false,	4096,	16,	0 },
+	{ true,		640,	4,	0 },
+	{ true,		1280,	8,	0 },
+	{ true,		1920,	16,	0 },
+	{ true,		4096,	32,	1 },
+	{ true,		8192,	64,	1 } };
+
+
+void
+DefaultThreadTable(ThreadTable &table)
+{
+	table.assign(default_table, default_table + (sizeof(default_table) / sizeof(ThreadTableEntry)));
+}
+
+
+bool
+ReadThreadTable(ThreadTable &table, const std::string &path)
+{
+	if(path.empty())
+		return false;
+	
+	std::ifstream f(path.c_str());
+	
+	if(!f)
+		return false;
+	
+	std::string line;
+	
+	if(!std::getline(f, line) || line.compare(0, 14, "webm_threads 1") != 0)
+		return false;
+	
+	ThreadTable new_table;
+	
+	while(std::getline(f, line))
+	{
+		if(!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+	
+		if(line.empty() || line[0] == '#')
+			continue;
+		
+		std::stringstream ss(line);
+		
+		std::string codec;
+		ThreadTableEntry entry;
+		
+		ss >> codec >> entry.max_width >> entry.max_threads >> entry.tile_rows;
+		
+		if(ss.fail() || (codec != "vp8" && codec != "vp9") ||
+			entry.max_width < 1 || entry.max_threads < 1 || entry.tile_rows < 0)
+		{
+			return false;
+		}
+		
+		entry.vp9 = (codec == "vp9");
+		
+		new_table.push_back(entry);
+	}
+	
+	if(new_table.empty())
+		return false;
+	
+	table = new_table;
+	
+	return true;
+}
+
+
+bool
+WriteThreadTable(const ThreadTable &table, const std::string &path)
+{
+	std::ofstream f(path.c_str());
+	
+	if(!f)
+		return false;
+	
+	f << "webm_threads 1" << "\n";
+	f << "# codec max_width max_threads tile_rows" << "\n";
+	
+	for(ThreadTable::const_iterator i = table.begin(); i != table.end(); ++i)
+	{
+		f << (i->vp9 ? "vp9" : "vp8") << " " << i->max_width << " " <<
+			i->max_threads << " " << i->tile_rows << "\n";
+	}
+	
+	return f.good();
+}
+
+
+std::string
+ThreadTablePath()
+{
+	const std::string dir = WebMCacheDirectory();
+	
+	if(dir.empty())
+		return std::string();
+	
+	return dir + WebMPathSeparator + "ThreadTable.txt";
+}
+
+
+int
+MaxTileColumns(int width)
+{
+	// from vp9_get_tile_n_bits: each tile is at least 4 superblocks (256 pixels)
+	const int sb_cols = (width + 63) / 64;
+	
+	int max_log2 = 1;
+	
+	while((sb_cols >> max_log2) >= 4)
+		max_log2++;
+	
+	return std::min<int>(max_log2 - 1, 6);
+}
+
+
+static int
+CeilLog2(int val)
+{
+	int ret = 0;
+	
+	while((1 << ret) < val)
+		ret++;
+	
+	return ret;
+}
+
+
+static int
+FloorLog2(int val)
+{
+	int ret = 0;
+	
+	while((2 << ret) <= val)
+		ret++;
+	
+	return ret;
+}
+
+
+ThreadPlan
+PlanThreads(const ThreadTable &table, bool vp9, int width, int height, int cores)
+{
+	// the narrowest entry the frame fits in, or the widest one if it's bigger than all of them
+	const ThreadTableEntry *fits = NULL;
+	const ThreadTableEntry *widest = NULL;
+	
+	for(ThreadTable::const_iterator i = table.begin(); i != table.end(); ++i)
+	{
+		if(i->vp9 == vp9)
+		{
+			if(i->max_width >= width && (fits == NULL || i->max_width < fits->max_width))
+				fits = &*i;
+			
+			if(widest == NULL || i->max_width > widest->max_width)
+				widest = &*i;
+		}
+	}
+	
+	const ThreadTableEntry *entry = (fits != NULL ? fits : widest);
+	
+	const int table_threads = (entry != NULL ? entry->max_threads : cores);
+	
+	ThreadPlan plan;
+	
+	plan.threads = std::max<int>(1, std::min<int>(std::min<int>(cores, table_threads), 64));
+	plan.tile_columns = 0;
+	plan.tile_rows = 0;
+	plan.row_mt = false;
+	plan.token_partitions = 0;
+	
+	if(vp9)
+	{
+		plan.tile_columns = std::min<int>(CeilLog2(plan.threads), MaxTileColumns(width));
+		
+		// Without row-MT a tile column gets one thread, so any
+		// threads past the tile count would sit idle.
+		plan.row_mt = (plan.threads > (1 << plan.tile_columns));
+		
+		if(plan.row_mt && entry != NULL)
+		{
+			// at least a superblock row in each tile row
+			const int sb_rows = (height + 63) / 64;
+			
+			plan.tile_rows = std::min<int>(std::min<int>(entry->tile_rows, 2), FloorLog2(std::max<int>(1, sb_rows)));
+		}
+	}
+	else
+	{
+		// VP8 threads work on macroblock rows
+		const int mb_rows = (height + 15) / 16;
+		
+		plan.threads = std::min<int>(plan.threads, std::max<int>(1, mb_rows));
+		
+		// separate token partitions let the threads write
+		// the bitstream in parallel too
+		plan.token_partitions = std::min<int>(FloorLog2(plan.threads), 3);
+	}
+	
+	return plan;
+}
@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_THREADS_H
+#define WEBM_PREMIERE_EXPORT_THREADS_H
+
+#include <string>
+#include <vector>
+
+
+// How many threads libvpx can actually use depends on the frame size.
+// VP9 splits the work by tile columns, which have to be at least 256 pixels
+// wide, plus rows within a tile when row-MT is on.  VP8 splits by macroblock
+// rows.  Past some point more threads just get in each other's way, and that
+// point comes from the calibration table.  The table is built in, but
+// webm_thread_calibrate (src/tools) can measure a new one.
+
+typedef struct ThreadTableEntry
+{
+	bool	vp9;
+	int		max_width;		// entry covers frames up to this wide
+	int		max_threads;	// encoding stops getting faster past this
+	int		tile_rows;		// log2, VP9 only
+} ThreadTableEntry;
+
+typedef std::vector<ThreadTableEntry> ThreadTable;
+
+
+typedef struct ThreadPlan
+{
+	int		threads;			// g_threads
+	int		tile_columns;		// log2, VP9 only
+	int		tile_rows;			// log2, VP9 only
+	bool	row_mt;				// VP9 only
+	int		token_partitions;	// log2, VP8 only
+} ThreadPlan;
+
+
+void DefaultThreadTable(ThreadTable &table);
+
+// Text file, one "vp8|vp9 max_width max_threads tile_rows" line per entry,
+// lines starting with # are comments.  Leaves the table alone on failure.
+bool ReadThreadTable(ThreadTable &table, const std::string &path);
+
+bool WriteThreadTable(const ThreadTable &table, const std::string &path);
+
+// ThreadTable.txt in the cache folder, empty if there isn't one
+std::string ThreadTablePath();
+
+// largest log2 tile columns VP9 allows at this width
+int MaxTileColumns(int width);
+
+// cores is what this encoder gets to use, after segments split them up
+ThreadPlan PlanThreads(const ThreadTable &table, bool vp9, int width, int height, int cores);
+
+
+#endif // WEBM_PREMIERE_EXPORT_THREADS_H
@@ -0,0 +1,294 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_Timing.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include <assert.h>
+#include <stdio.h>
+
+
+static const char * const stage_names[TIMING_STAGES] = {
+	"render",
+	"convert",
+	"encode",
+	"wait",
+	"audio_get",
+	"audio_encode",
+	"mux",
+	"write",
+	"write_wait" };
+
+
+ExportTiming::ExportTiming(bool enabled, bool trace) :
+	_enabled(enabled || trace),
+	_trace(trace),
+	_start(WebMSeconds()),
+	_tracks(1),
+	_segment_tracks(0),
+	_rendition_tracks(0)
+{
+	for(int i=0; i < TIMING_STAGES; i++)
+	{
+		_begin[i] = 0;
+		
+		_stages[i].count = 0;
+		_stages[i].seconds = 0;
+		_stages[i].bytes = 0;
+	}
+}
+
+
+void
+ExportTiming::Begin(TimingStage stage)
+{
+	if(_enabled)
+		_begin[stage] = WebMSeconds();
+}
+
+
+void
+ExportTiming::End(TimingStage stage)
+{
+	if(_enabled)
+		Add(stage, 0, _begin[stage], WebMSeconds());
+}
+
+
+void
+ExportTiming::Add(TimingStage stage, int track, double start, double end)
+{
+	if(!_enabled)
+		return;
+	
+	WebMLock lock(_mutex);
+	
+	StageTiming &timing = _stages[stage];
+	
+	timing.samples.push_back(end - start);
+	timing.count++;
+	timing.seconds += end - start;
+	
+	if(_trace)
+	{
+		const TraceEvent event = { start, (float)(end - start), (unsigned char)stage, (unsigned char)std::min<int>(track, 255) };
+		
+		_events.push_back(event);
+		
+		_tracks = std::max<int>(_tracks, event.track + 1);
+	}
+}
+
+
+void
+ExportTiming::Accumulate(TimingStage stage, double seconds, unsigned long long bytes)
+{
+	if(!_enabled)
+		return;
+	
+	WebMLock lock(_mutex);
+	
+	StageTiming &timing = _stages[stage];
+	
+	timing.count++;
+	timing.seconds += seconds;
+	timing.bytes += bytes;
+}
+
+
+void
+ExportTiming::SetTracks(int segments, int renditions)
+{
+	WebMLock lock(_mutex);
+	
+	_segment_tracks = segments;
+	_rendition_tracks = renditions;
+}
+
+
+static std::string
+JsonString(const std::string &s)
+{
+	std::string json = "\"";
+	
+	for(std::string::const_iterator c = s.begin(); c != s.end(); ++c)
+	{
+		if(*c == '\"' || *c == '\\')
+		{
+			json += '\\';
+			json += *c;
+		}
+		else if((unsigned char)*c < 0x20)
+		{
+			char escape[8];
+			sprintf(escape, "\\u%04x", (unsigned char)*c);
+			json += escape;
+		}
+		else
+			json += *c;
+	}
+	
+	return json + "\"";
+}
+
+
+// in milliseconds, from sorted samples
+static double
+Percentile(const std::vector<float> &sorted, double p)
+{
+	assert(!sorted.empty());
+	
+	const size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+	
+	return sorted[i] * 1000.0;
+}
+
+
+bool
+ExportTiming::WriteReport(const std::string &path, const std::string &movie, int frames)
+{
+	if(!_enabled)
+		return false;
+	
+	WebMLock lock(_mutex);
+	
+	std::ofstream f(path.c_str());
+	
+	if(!f)
+		return false;
+	
+	const double seconds = WebMSeconds() - _start;
+	
+	f.setf(std::ios::fixed);
+	f.precision(3);
+	
+	f << "{\n";
+	f << "\t\"movie\": " << JsonString(movie) << ",\n";
+	f << "\t\"seconds\": " << seconds << ",\n";
+	f << "\t\"frames\": " << frames << ",\n";
+	f << "\t\"fps\": " << (seconds > 0 ? frames / seconds : 0) << ",\n";
+	f << "\t\"bytes_written\": " << _stages[TIMING_WRITE].bytes << ",\n";
+	f << "\t\"stages\": {\n";
+	
+	for(int i=0; i < TIMING_STAGES; i++)
+	{
+		const StageTiming &timing = _stages[i];
+		
+		f << "\t\t\"" << stage_names[i] << "\": { ";
+		f << "\"count\": " << timing.count << ", ";
+		f << "\"seconds\": " << timing.seconds;
+		
+		if(!timing.samples.empty())
+		{
+			std::vector<float> sorted = timing.samples;
+			
+			std::sort(sorted.begin(), sorted.end());
+			
+			f << ", \"mean_ms\": " << (timing.seconds * 1000.0 / sorted.size());
+			f << ", \"p50_ms\": " << Percentile(sorted, 0.5);
+			f << ", \"p90_ms\": " << Percentile(sorted, 0.9);
+			f << ", \"p99_ms\": " << Percentile(sorted, 0.99);
+			f << ", \"max_ms\": " << (sorted.back() * 1000.0);
+		}
+		
+		if(timing.bytes > 0)
+			f << ", \"bytes\": " << timing.bytes;
+		
+		f << " }" << (i < TIMING_STAGES - 1 ? "," : "") << "\n";
+	}
+	
+	f << "\t}\n";
+	f << "}\n";
+	
+	return f.good();
+}
+
+
+bool
+ExportTiming::WriteTrace(const std::string &path)
+{
+	if(!_trace)
+		return false;
+	
+	WebMLock lock(_mutex);
+	
+	std::ofstream f(path.c_str());
+	
+	if(!f)
+		return false;
+	
+	f.setf(std::ios::fixed);
+	f.precision(1);
+	
+	f << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	
+	for(int t=0; t < _tracks; t++)
+	{
+		f << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << t << ", \"args\": {\"name\": ";
+		
+		if(t == 0)
+			f << "\"Export\"";
+		else if(_segment_tracks == 0 || t <= _segment_tracks)
+			f << "\"Encoder " << t << "\"";
+		else if(t <= _segment_tracks + _rendition_tracks)
+			f << "\"Rendition " << (t - _segment_tracks) << "\"";
+		else
+			f << "\"Audio\"";
+		
+		f << "}},\n";
+	}
+	
+	for(std::vector<TraceEvent>::const_iterator e = _events.begin(); e != _events.end(); ++e)
+	{
+		// microseconds
+		f << "{\"name\": \"" << stage_names[e->stage] << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << (int)e->track <<
+			", \"ts\": " << ((e->start - _start) * 1000000.0) << ", \"dur\": " << (e->duration * 1000000.0) << "},\n";
+	}
+	
+	// JSON doesn't allow a trailing comma
+	f << "{\"name\": \"export\", \"ph\": \"X\", \"pid\": 1, \"tid\": 0, \"ts\": 0.0, \"dur\": " <<
+		((WebMSeconds() - _start) * 1000000.0) << "}\n";
+	
+	f << "]}\n";
+	
+	return f.good();
+}
@@ -0,0 +1,126 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_TIMING_H
+#define WEBM_PREMIERE_EXPORT_TIMING_H
+
+#include "WebM_Premiere_Platform.h"
+
+#include <string>
+#include <vector>
+
+
+typedef enum {
+	TIMING_RENDER = 0,		// RenderVideoFrame
+	TIMING_CONVERT,			// CopyPixToImg
+	TIMING_ENCODE,			// vpx_codec_encode, on the encoder threads
+	TIMING_WAIT,			// export thread waiting for the encoders
+	TIMING_AUDIO_GET,		// GetAudio
+	TIMING_AUDIO_ENCODE,	// Opus or Vorbis
+	TIMING_MUX,				// mkvmuxer, including the writes it makes
+	TIMING_WRITE,			// PrMkvWriter, totals only
+	TIMING_WRITE_WAIT,		// export thread waiting for the writer thread
+	TIMING_STAGES
+} TimingStage;
+
+
+// Where the time goes in an export.  Each stage keeps every sample so the
+// report can have percentiles, and with tracing every sample is also an event
+// on a Chrome trace timeline (chrome://tracing or ui.perfetto.dev).
+// Writes are too small and too many for that, so they only get totals.
+// When it isn't enabled, everything returns right away.
+class ExportTiming
+{
+  public:
+	ExportTiming(bool enabled, bool trace);
+	
+	bool Enabled() const { return _enabled; }
+	
+	// export thread only
+	void Begin(TimingStage stage);
+	void End(TimingStage stage);
+	
+	// any thread, track 0 is the export thread and 1 and up are the encoder segments, then the ladder renditions, then audio
+	void Add(TimingStage stage, int track, double start, double end);
+	
+	// totals only
+	void Accumulate(TimingStage stage, double seconds, unsigned long long bytes);
+	
+	// how many of the tracks are segments and renditions, to name them in the trace
+	void SetTracks(int segments, int renditions);
+	
+	bool WriteReport(const std::string &path, const std::string &movie, int frames);
+	bool WriteTrace(const std::string &path);
+	
+  private:
+	typedef struct StageTiming
+	{
+		std::vector<float>	samples;	// seconds
+		unsigned int		count;
+		double				seconds;
+		unsigned long long	bytes;
+	} StageTiming;
+	
+	typedef struct TraceEvent
+	{
+		double			start;
+		float			duration;
+		unsigned char	stage;
+		unsigned char	track;
+	} TraceEvent;
+	
+	const bool _enabled;
+	const bool _trace;
+	const double _start;
+	
+	double _begin[TIMING_STAGES];
+	
+	StageTiming _stages[TIMING_STAGES];
+	std::vector<TraceEvent> _events;
+	int _tracks;
+	
+	int _segment_tracks;	// 0 if we weren't told
+	int _rendition_tracks;
+	
+	WebMMutex _mutex;
+};
+
+
+#endif // WEBM_PREMIERE_EXPORT_TIMING_H
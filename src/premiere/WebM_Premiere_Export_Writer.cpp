@@ -0,0 +1,368 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Export_Writer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const uint32_t PrMkvWriterBlock = 4 * 1024 * 1024;
+
+
+PrMkvWriter::PrMkvWriter(WriterFile &file, int buffers, ExportTiming &timing) :
+	_file(file),
+	_timing(timing),
+	_threaded(buffers > 0),
+	_window(NULL),
+	_window_start(0),
+	_window_len(0),
+	_position(0),
+	_file_position(0),
+	_writing(false),
+	_quit(false),
+	_error(WEBM_WRITER_NO_ERROR),
+	_calls(0),
+	_bytes(0),
+	_stalled(0)
+{
+	const int blocks = (buffers > 0 ? buffers : 1);
+	
+	for(int i=0; i < blocks; i++)
+	{
+		char *block = (char *)malloc(PrMkvWriterBlock);
+		
+		if(block == NULL)
+			break;
+		
+		_blocks.push_back(block);
+		_free.push_back(block);
+	}
+	
+	int32_t err = (_blocks.size() == (size_t)blocks ? _file.Open() : WEBM_WRITER_ERR_MEMORY);
+	
+	if(err != WEBM_WRITER_NO_ERROR)
+	{
+		for(std::vector<char *>::iterator i = _blocks.begin(); i != _blocks.end(); ++i)
+			free(*i);
+		
+		throw err;
+	}
+	
+	_window = _free.front();
+	_free.pop_front();
+	
+	if(_threaded && !Start())
+		_threaded = false;
+}
+
+
+PrMkvWriter::~PrMkvWriter()
+{
+	Flush(); // in case the export didn't get as far as Finalize
+	
+	{
+		WebMLock lock(_mutex);
+		
+		_quit = true;
+		
+		_request_cond.Signal();
+	}
+	
+	Join();
+	
+	int32_t err = _file.Close();
+	
+	assert(err == WEBM_WRITER_NO_ERROR);
+	
+	for(std::vector<char *>::iterator i = _blocks.begin(); i != _blocks.end(); ++i)
+		free(*i);
+}
+
+
+int32_t
+PrMkvWriter::Write(const void* buf, uint32_t len)
+{
+	const char *data = (const char *)buf;
+	
+	int32_t err = WEBM_WRITER_NO_ERROR;
+	
+	while(len > 0 && err == WEBM_WRITER_NO_ERROR)
+	{
+		if(_window_len == 0)
+			_window_start = _position;
+		
+		const int64_t window_end = _window_start + _window_len;
+		
+		if(_position + len <= _window_start)
+		{
+			// patching something before the window
+			char *patch = (char *)malloc(len);
+			
+			if(patch == NULL)
+				return WEBM_WRITER_ERR_MEMORY;
+			
+			memcpy(patch, data, len);
+			
+			err = Send(_position, patch, len, false);
+			
+			_position += len;
+			
+			len = 0;
+		}
+		else if(_position >= _window_start && _position <= window_end && _position < _window_start + PrMkvWriterBlock)
+		{
+			const uint32_t room = (_window_start + PrMkvWriterBlock) - _position;
+			const uint32_t copy = (len < room ? len : room);
+			
+			memcpy(&_window[_position - _window_start], data, copy);
+			
+			_position += copy;
+			data += copy;
+			len -= copy;
+			
+			if(_position > window_end)
+				_window_len = _position - _window_start;
+			
+			if(_window_len == PrMkvWriterBlock)
+				err = SendWindow();
+		}
+		else
+		{
+			// somewhere else, so the window moves here
+			err = SendWindow();
+		}
+	}
+	
+	return err;
+}
+
+
+int64_t
+PrMkvWriter::Position() const
+{
+	return _position;
+}
+
+
+int32_t
+PrMkvWriter::Position(int64_t position)
+{
+	// the seek happens when there's something to write
+	if(position < 0)
+		return -1;
+	
+	_position = position;
+	
+	return WEBM_WRITER_NO_ERROR;
+}
+
+
+int32_t
+PrMkvWriter::Send(int64_t position, char *buf, uint32_t len, bool block)
+{
+	if(!_threaded)
+	{
+		int32_t err = WriteFile(position, buf, len);
+		
+		if(block)
+			_free.push_back(buf);
+		else
+			free(buf);
+		
+		return err;
+	}
+	
+	WebMLock lock(_mutex);
+	
+	const WriteRequest request = { position, buf, len, block };
+	
+	_requests.push_back(request);
+	
+	_request_cond.Signal();
+	
+	return _error;
+}
+
+
+int32_t
+PrMkvWriter::SendWindow()
+{
+	if(_window_len == 0)
+		return WEBM_WRITER_NO_ERROR;
+	
+	int32_t err = Send(_window_start, _window, _window_len, true);
+	
+	_window_start += _window_len;
+	_window_len = 0;
+	
+	// the next block, once the writer thread is done with one
+	WebMLock lock(_mutex);
+	
+	if(_free.empty())
+	{
+		const double start = WebMSeconds();
+		
+		do{
+			_written_cond.Wait(_mutex);
+		}while(_free.empty());
+		
+		const double end = WebMSeconds();
+		
+		_stalled += end - start;
+		
+		_timing.Add(TIMING_WRITE_WAIT, 0, start, end);
+	}
+	
+	_window = _free.front();
+	_free.pop_front();
+	
+	return (err != WEBM_WRITER_NO_ERROR ? err : _error);
+}
+
+
+int32_t
+PrMkvWriter::Flush()
+{
+	int32_t err = SendWindow();
+	
+	WebMLock lock(_mutex);
+	
+	if(!_requests.empty() || _writing)
+	{
+		const double start = WebMSeconds();
+		
+		do{
+			_written_cond.Wait(_mutex);
+		}while(!_requests.empty() || _writing);
+		
+		const double end = WebMSeconds();
+		
+		_stalled += end - start;
+		
+		_timing.Add(TIMING_WRITE_WAIT, 0, start, end);
+	}
+	
+	return (err != WEBM_WRITER_NO_ERROR ? err : _error);
+}
+
+
+void
+PrMkvWriter::Run()
+{
+	while(true)
+	{
+		WriteRequest request;
+		
+		{
+			WebMLock lock(_mutex);
+			
+			while(_requests.empty() && !_quit)
+				_request_cond.Wait(_mutex);
+			
+			if(_requests.empty())
+				break;
+			
+			request = _requests.front();
+			_requests.pop_front();
+			
+			_writing = true;
+		}
+		
+		// after an error, the rest just get thrown out
+		const int32_t err = (_error == WEBM_WRITER_NO_ERROR ? WriteFile(request.position, request.buf, request.len) : _error);
+		
+		{
+			WebMLock lock(_mutex);
+			
+			if(request.block)
+				_free.push_back(request.buf);
+			else
+				free(request.buf);
+			
+			if(_error == WEBM_WRITER_NO_ERROR)
+				_error = err;
+			
+			_writing = false;
+			
+			_written_cond.Broadcast();
+		}
+	}
+}
+
+
+int32_t
+PrMkvWriter::WriteFile(int64_t position, const void *buf, uint32_t len)
+{
+	const double start = (_timing.Enabled() ? WebMSeconds() : 0);
+	
+	int32_t err = WEBM_WRITER_NO_ERROR;
+	
+	if(position != _file_position)
+	{
+		err = _file.Seek(position);
+		
+		_calls++;
+	}
+	
+	if(err == WEBM_WRITER_NO_ERROR)
+	{
+		err = _file.Write(buf, len);
+		
+		_calls++;
+		_bytes += len;
+	}
+	
+	// if something went wrong, we don't know where the file is
+	_file_position = (err == WEBM_WRITER_NO_ERROR ? position + len : -1);
+	
+	if(_timing.Enabled())
+		_timing.Accumulate(TIMING_WRITE, WebMSeconds() - start, len);
+	
+	return err;
+}
+
+
+void
+PrMkvWriter::ElementStartNotify(uint64_t element_id, int64_t position)
+{
+	// ummm, should I do something?
+}
@@ -0,0 +1,147 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_EXPORT_WRITER_H
+#define WEBM_PREMIERE_EXPORT_WRITER_H
+
+#include "WebM_Premiere_Platform.h"
+#include "WebM_Premiere_Export_Timing.h"
+
+#include "mkvmuxer/mkvmuxer.h"
+
+#include <deque>
+#include <vector>
+
+
+#define WEBM_WRITER_NO_ERROR	0
+#define WEBM_WRITER_ERR_MEMORY	(-1)
+
+// Where PrMkvWriter's bytes end up: the file Premiere hands the exporter, or a
+// plain file for the tools.  Each call returns WEBM_WRITER_NO_ERROR or its own error.
+class WriterFile
+{
+  public:
+	virtual ~WriterFile() {}
+	
+	virtual int32_t Open() = 0;
+	virtual int32_t Seek(int64_t position) = 0; // from the beginning
+	virtual int32_t Write(const void *buf, uint32_t len) = 0;
+	virtual int32_t Close() = 0;
+};
+
+
+// mkvmuxer writes a few bytes at a time, and asks where it is all the time.
+// So the writes go into a window of the file that only goes to the file when
+// it fills up, and we keep track of the position ourselves.  The window starts
+// at the beginning of the file and moves a whole block at a time, so the writes
+// the file sees are big and lined up.  mkvmuxer seeks back to patch in sizes,
+// which usually lands in the window.  Patches further back (the segment size,
+// seek head and cues at the end) go straight to the file without disturbing it.
+//
+// With buffers, full blocks and patches go to a thread that writes them in the
+// order they were made, so slow storage doesn't hold up the export thread.
+// The export thread only waits when every block is full and waiting to be written.
+// Without buffers the writes happen right here.
+class PrMkvWriter : public mkvmuxer::IMkvWriter, public WebMThread
+{
+  public:
+	PrMkvWriter(WriterFile &file, int buffers, ExportTiming &timing); // throws the error if the file won't open
+	virtual ~PrMkvWriter();
+	
+	virtual int32_t Write(const void* buf, uint32_t len);
+	virtual int64_t Position() const;
+	virtual int32_t Position(int64_t position); // seek
+	virtual bool Seekable() const { return true; }
+	virtual void ElementStartNotify(uint64_t element_id, int64_t position);
+	
+	int32_t Flush(); // everything goes to the file, and we wait for it
+	
+	unsigned int Calls() const { return _calls; } // Write and Seek calls to the file
+	uint64_t Bytes() const { return _bytes; }
+	double Stalled() const { return _stalled; } // seconds the export thread waited
+	
+  protected:
+	virtual void Run();
+	
+  private:
+	typedef struct WriteRequest
+	{
+		int64_t		position;
+		char		*buf;
+		uint32_t	len;
+		bool		block;	// goes back to _free, otherwise it's a patch to free()
+	} WriteRequest;
+	
+	int32_t Send(int64_t position, char *buf, uint32_t len, bool block);
+	int32_t SendWindow();
+	
+	int32_t WriteFile(int64_t position, const void *buf, uint32_t len);
+	
+	WriterFile &_file;
+	ExportTiming &_timing;
+	
+	bool _threaded;
+	
+	std::vector<char *> _blocks;
+	std::deque<char *> _free;
+	
+	char *_window;
+	int64_t _window_start;
+	uint32_t _window_len;
+	
+	int64_t _position;		// where mkvmuxer thinks it is
+	int64_t _file_position;	// where the file is
+	
+	WebMMutex _mutex;
+	WebMCondition _request_cond;	// signaled when something is queued
+	WebMCondition _written_cond;	// signaled when something has been written
+	
+	std::deque<WriteRequest> _requests;
+	bool _writing;
+	bool _quit;
+	int32_t _error; // first one from the writer thread
+	
+	unsigned int _calls;
+	uint64_t _bytes;
+	double _stalled;
+};
+
+
+#endif // WEBM_PREMIERE_EXPORT_WRITER_H
@@ -38,6 +38,7 @@
 
 
 #include "WebM_Premiere_Import.h"
+#include "WebM_Premiere_Color.h"
 
 
 #include "vpx/vpx_decoder.h"
@@ -1832,15 +1833,70 @@ CopyImgToVUYA(const vpx_image_t * const img, char *frameBufferP, csSDK_int32 row
 	}
 }
 
+// MATRIX is one of the structs in WebM_Premiere_Color.h
+template <typename MATRIX>
+static void
+CopyImgToBGRA(const vpx_image_t * const img, char *frameBufferP, csSDK_int32 rowbytes)
+{
+	const unsigned int sub_x = img->x_chroma_shift + 1;
+	const unsigned int sub_y = img->y_chroma_shift + 1;
+	
+	const int subY = (MATRIX::FULL_RANGE ? 0 : ConvertDepth<unsigned short, unsigned short>(16, 8));
+	const int subUV = ConvertDepth<unsigned short, unsigned short>(128, 8);
+	
+	for(int y = 0; y < img->d_h; y++)
+	{
+		const unsigned short *imgY = (unsigned short *)(img->planes[VPX_PLANE_Y] + (img->stride[VPX_PLANE_Y] * y));
+		const unsigned short *imgU = (unsigned short *)(img->planes[VPX_PLANE_U] + (img->stride[VPX_PLANE_U] * (y / sub_y)));
+		const unsigned short *imgV = (unsigned short *)(img->planes[VPX_PLANE_V] + (img->stride[VPX_PLANE_V] * (y / sub_y)));
+		
+		unsigned short *prBGRA = (unsigned short *)(frameBufferP + (rowbytes * (img->d_h - 1 - y)));
+		
+		unsigned short *prB = prBGRA + 0;
+		unsigned short *prG = prBGRA + 1;
+		unsigned short *prR = prBGRA + 2;
+		unsigned short *prA = prBGRA + 3;
+		
+		for(int x=0; x < img->d_w; x++)
+		{
+			const int prY = ConvertDepth<unsigned short, unsigned short>(*imgY++, img->bit_depth);
+			
+			if(x != 0 && (x % sub_x == 0))
+			{
+				imgU++;
+				imgV++;
+			}
+			
+			const int prU = ConvertDepth<unsigned short, unsigned short>(*imgU, img->bit_depth);
+			const int prV = ConvertDepth<unsigned short, unsigned short>(*imgV, img->bit_depth);
+			
+			const int scaledY = MATRIX::YSCALE * (prY - subY);
+			
+			*prB = Clamp16( (scaledY + (MATRIX::BU * (prU - subUV)) + 5000) / 10000 );
+			*prG = Clamp16( (scaledY - (MATRIX::GV * (prV - subUV)) - (MATRIX::GU * (prU - subUV)) + 5000) / 10000 );
+			*prR = Clamp16( (scaledY + (MATRIX::RV * (prV - subUV)) + 5000) / 10000 );
+			*prA = PF_MAX_CHAN16;
+			
+			prB += 4;
+			prG += 4;
+			prR += 4;
+			prA += 4;
+		}
+	}
+}
+
 static void
 CopyImgToPix(const vpx_image_t * const img, PPixHand &ppix, PrSDKPPixSuite *PPixSuite, PrSDKPPix2Suite *PPix2Suite)
 {
 	assert(img->fmt & VPX_IMG_FMT_PLANAR);
 	assert(img->cs != VPX_CS_SRGB);
-	assert(img->range == VPX_CR_STUDIO_RANGE);
 
 	PrPixelFormat pix_format;
 	PPixSuite->GetPixelFormat(ppix, &pix_format);
+	
+	// Premiere's YUV formats are all Rec. 601 studio range,
+	// only the RGB path knows about other matrices
+	assert(pix_format == PrPixelFormat_BGRA_4444_16u || img->range == VPX_CR_STUDIO_RANGE);
 
 	const unsigned int sub_x = img->x_chroma_shift + 1;
 	const unsigned int sub_y = img->y_chroma_shift + 1;
@@ -1999,46 +2055,31 @@ CopyImgToPix(const vpx_image_t * const img, PPixHand &ppix, PrSDKPPixSuite *PPix
 		{
 			// This is only necessary because of a bug with VUYA_4444_16u
 			assert(img->bit_depth > 8);
+			
+			const bool full_range = (img->range == VPX_CR_FULL_RANGE);
 		
-			for(int y = 0; y < img->d_h; y++)
+			switch( WebMColorMatrix(img->cs) )
 			{
-				const unsigned short *imgY = (unsigned short *)(img->planes[VPX_PLANE_Y] + (img->stride[VPX_PLANE_Y] * y));
-				const unsigned short *imgU = (unsigned short *)(img->planes[VPX_PLANE_U] + (img->stride[VPX_PLANE_U] * (y / sub_y)));
-				const unsigned short *imgV = (unsigned short *)(img->planes[VPX_PLANE_V] + (img->stride[VPX_PLANE_V] * (y / sub_y)));
-				
-				unsigned short *prBGRA = (unsigned short *)(frameBufferP + (rowbytes * (img->d_h - 1 - y)));
+				case WEBM_MATRIX_709:
+					if(full_range)
+						CopyImgToBGRA<Color709Full>(img, frameBufferP, rowbytes);
+					else
+						CopyImgToBGRA<Color709Studio>(img, frameBufferP, rowbytes);
+					break;
 				
-				unsigned short *prB = prBGRA + 0;
-				unsigned short *prG = prBGRA + 1;
-				unsigned short *prR = prBGRA + 2;
-				unsigned short *prA = prBGRA + 3;
+				case WEBM_MATRIX_2020:
+					if(full_range)
+						CopyImgToBGRA<Color2020Full>(img, frameBufferP, rowbytes);
+					else
+						CopyImgToBGRA<Color2020Studio>(img, frameBufferP, rowbytes);
+					break;
 				
-				for(int x=0; x < img->d_w; x++)
-				{
-					const int prY = ConvertDepth<unsigned short, unsigned short>(*imgY++, img->bit_depth);
-					
-					if(x != 0 && (x % sub_x == 0))
-					{
-						imgU++;
-						imgV++;
-					}
-					
-					const int prU = ConvertDepth<unsigned short, unsigned short>(*imgU, img->bit_depth);
-					const int prV = ConvertDepth<unsigned short, unsigned short>(*imgV, img->bit_depth);
-					
-					const int subY = ConvertDepth<unsigned short, unsigned short>(16, 8);
-					const int subUV = ConvertDepth<unsigned short, unsigned short>(128, 8);
-					
-					*prB = Clamp16( ((11644 * (prY - subY)) + (20172 * (prU - subUV)) + 5000) / 10000 );
-					*prG = Clamp16( ((11644 * (prY - subY)) - (8130 * (prV - subUV)) - (3918 * (prU - subUV)) + 5000) / 10000 );
-					*prR = Clamp16( ((11644 * (prY - subY)) + (15960 * (prV - subUV)) + 5000) / 10000 );
-					*prA = PF_MAX_CHAN16;
-					
-					prB += 4;
-					prG += 4;
-					prR += 4;
-					prA += 4;
-				}
+				default:
+					if(full_range)
+						CopyImgToBGRA<Color601Full>(img, frameBufferP, rowbytes);
+					else
+						CopyImgToBGRA<Color601Studio>(img, frameBufferP, rowbytes);
+					break;
 			}
 		}
 		else
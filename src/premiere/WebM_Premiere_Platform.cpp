@@ -0,0 +1,1097 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "WebM_Premiere_Platform.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#ifdef PRWIN_ENV
+	#include <malloc.h>
+	#include <sys/utime.h>
+#elif defined(PRMAC_ENV)
+	#include <mach/mach_time.h>
+#else
+	#include <time.h>
+#endif
+
+#ifndef PRWIN_ENV
+	#include <dirent.h>
+	#include <errno.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+	#include <utime.h>
+#endif
+
+#ifndef PRWIN_ENV
+	#include <sys/mman.h>
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+	#define WEBM_X86 1
+	
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#include <immintrin.h>
+	#endif
+#endif
+
+
+#ifdef PRWIN_ENV
+
+WebMMutex::WebMMutex()
+{
+	InitializeCriticalSection(&_mutex);
+}
+
+WebMMutex::~WebMMutex()
+{
+	DeleteCriticalSection(&_mutex);
+}
+
+void
+WebMMutex::Lock()
+{
+	EnterCriticalSection(&_mutex);
+}
+
+void
+WebMMutex::Unlock()
+{
+	LeaveCriticalSection(&_mutex);
+}
+
+
+WebMCondition::WebMCondition()
+{
+	InitializeConditionVariable(&_cond);
+}
+
+WebMCondition::~WebMCondition()
+{
+	// nothing to destroy for a CONDITION_VARIABLE
+}
+
+void
+WebMCondition::Wait(WebMMutex &mutex)
+{
+	SleepConditionVariableCS(&_cond, &mutex._mutex, INFINITE);
+}
+
+void
+WebMCondition::Signal()
+{
+	WakeConditionVariable(&_cond);
+}
+
+void
+WebMCondition::Broadcast()
+{
+	WakeAllConditionVariable(&_cond);
+}
+
+
+WebMThread::WebMThread() :
+	_thread(NULL),
+	_running(false)
+{
+
+}
+
+WebMThread::~WebMThread()
+{
+	assert(!_running);
+}
+
+DWORD WINAPI
+WebMThread::Entry(LPVOID arg)
+{
+	WebMThread *thread = static_cast<WebMThread *>(arg);
+	
+	thread->Run();
+	
+	return 0;
+}
+
+bool
+WebMThread::Start()
+{
+	assert(!_running);
+
+	_thread = CreateThread(NULL, 0, Entry, this, 0, NULL);
+	
+	_running = (_thread != NULL);
+	
+	return _running;
+}
+
+void
+WebMThread::Join()
+{
+	if(_running)
+	{
+		WaitForSingleObject(_thread, INFINITE);
+		CloseHandle(_thread);
+		
+		_thread = NULL;
+		_running = false;
+	}
+}
+
+#else // pthreads
+
+WebMMutex::WebMMutex()
+{
+	pthread_mutex_init(&_mutex, NULL);
+}
+
+WebMMutex::~WebMMutex()
+{
+	pthread_mutex_destroy(&_mutex);
+}
+
+void
+WebMMutex::Lock()
+{
+	pthread_mutex_lock(&_mutex);
+}
+
+void
+WebMMutex::Unlock()
+{
+	pthread_mutex_unlock(&_mutex);
+}
+
+
+WebMCondition::WebMCondition()
+{
+	pthread_cond_init(&_cond, NULL);
+}
+
+WebMCondition::~WebMCondition()
+{
+	pthread_cond_destroy(&_cond);
+}
+
+void
+WebMCondition::Wait(WebMMutex &mutex)
+{
+	pthread_cond_wait(&_cond, &mutex._mutex);
+}
+
+void
+WebMCondition::Signal()
+{
+	pthread_cond_signal(&_cond);
+}
+
+void
+WebMCondition::Broadcast()
+{
+	pthread_cond_broadcast(&_cond);
+}
+
+
+WebMThread::WebMThread() :
+	_running(false)
+{
+
+}
+
+WebMThread::~WebMThread()
+{
+	assert(!_running);
+}
+
+void *
+WebMThread::Entry(void *arg)
+{
+	WebMThread *thread = static_cast<WebMThread *>(arg);
+	
+	thread->Run();
+	
+	return NULL;
+}
+
+bool
+WebMThread::Start()
+{
+	assert(!_running);
+
+	_running = (pthread_create(&_thread, NULL, Entry, this) == 0);
+	
+	return _running;
+}
+
+void
+WebMThread::Join()
+{
+	if(_running)
+	{
+		pthread_join(_thread, NULL);
+		
+		_running = false;
+	}
+}
+
+#endif // PRWIN_ENV
+
+
+WebMWorkerPool::WebMWorkerPool(int threads) :
+	_threads(1),
+	_workers(NULL),
+	_num_workers(0),
+	_job(NULL),
+	_count(0),
+	_next(0),
+	_finished(0),
+	_generation(0),
+	_quit(false)
+{
+	if(threads > 1)
+	{
+		_workers = new Worker *[threads - 1];
+		
+		for(int i=0; i < threads - 1; i++)
+		{
+			Worker *worker = new Worker(*this);
+			
+			if( worker->Start() )
+				_workers[_num_workers++] = worker;
+			else
+				delete worker;
+		}
+	}
+	
+	_threads = _num_workers + 1;
+}
+
+
+WebMWorkerPool::~WebMWorkerPool()
+{
+	{
+		WebMLock lock(_mutex);
+		
+		_quit = true;
+		
+		_work_cond.Broadcast();
+	}
+	
+	for(int i=0; i < _num_workers; i++)
+		delete _workers[i];
+	
+	delete [] _workers;
+}
+
+
+void
+WebMWorkerPool::Run(WebMJob &job, int count)
+{
+	if(_num_workers == 0 || count <= 1)
+	{
+		for(int i=0; i < count; i++)
+			job.Process(i);
+		
+		return;
+	}
+
+	WebMLock lock(_mutex);
+	
+	_job = &job;
+	_count = count;
+	_next = 0;
+	_finished = 0;
+	_generation++;
+	
+	_work_cond.Broadcast();
+	
+	DoWork();
+	
+	while(_finished < _count)
+		_done_cond.Wait(_mutex);
+	
+	_job = NULL;
+}
+
+
+void
+WebMWorkerPool::DoWork()
+{
+	while(_next < _count)
+	{
+		WebMJob *job = _job;
+		
+		const int index = _next++;
+		
+		_mutex.Unlock();
+		
+		job->Process(index);
+		
+		_mutex.Lock();
+		
+		if(++_finished == _count)
+			_done_cond.Signal();
+	}
+}
+
+
+void
+WebMWorkerPool::WorkerLoop()
+{
+	WebMLock lock(_mutex);
+	
+	unsigned int generation = _generation;
+	
+	while(true)
+	{
+		while(generation == _generation && !_quit)
+			_work_cond.Wait(_mutex);
+		
+		if(_quit)
+			break;
+		
+		generation = _generation;
+		
+		DoWork();
+	}
+}
+
+
+double
+WebMSeconds()
+{
+#ifdef PRWIN_ENV
+	static LARGE_INTEGER frequency = {0};
+	
+	if(frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+#elif defined(PRMAC_ENV)
+	static mach_timebase_info_data_t timebase = {0, 0};
+	
+	if(timebase.denom == 0)
+		mach_timebase_info(&timebase);
+	
+	return (double)mach_absolute_time() * (double)timebase.numer / (double)timebase.denom / 1000000000.0;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+#endif
+}
+
+
+void
+WebMLog(const char *fmt, ...)
+{
+	char buf[1024];
+	
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(buf, sizeof(buf) - 1, fmt, args);
+	va_end(args);
+	
+	buf[sizeof(buf) - 1] = '\0';
+
+#ifdef PRWIN_ENV
+	OutputDebugStringA("WebM: ");
+	OutputDebugStringA(buf);
+	OutputDebugStringA("\n");
+#else
+	fprintf(stderr, "WebM: %s\n", buf);
+#endif
+}
+
+
+#ifdef WEBM_X86
+static void
+CPUID(int leaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+	int r[4];
+	__cpuidex(r, leaf, 0);
+	
+	for(int i=0; i < 4; i++)
+		regs[i] = r[i];
+#elif defined(__i386__) && defined(__PIC__)
+	// ebx is the PIC register on 32-bit, so put it back
+	__asm__ __volatile__("xchgl %%ebx, %1\n\t"
+						"cpuid\n\t"
+						"xchgl %%ebx, %1"
+						: "=a"(regs[0]), "=&r"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+						: "a"(leaf), "c"(0));
+#else
+	__asm__ __volatile__("cpuid"
+						: "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+						: "a"(leaf), "c"(0));
+#endif
+}
+
+static unsigned long long
+XGETBV()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0)); // xgetbv, for old assemblers
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif // WEBM_X86
+
+
+static WebM_SIMD
+DetectSIMD()
+{
+#if defined(WEBM_X86)
+	unsigned int regs[4]; // eax, ebx, ecx, edx
+	
+	CPUID(0, regs);
+	
+	const unsigned int max_leaf = regs[0];
+	
+	if(max_leaf < 1)
+		return WEBM_SIMD_NONE;
+	
+	CPUID(1, regs);
+	
+	if( !(regs[3] & (1 << 26)) )
+		return WEBM_SIMD_NONE;
+	
+	// AVX2 needs the OS to be saving the YMM registers too
+	const bool osxsave = (regs[2] & (1 << 27));
+	const bool avx = (regs[2] & (1 << 28));
+	
+	if(max_leaf >= 7 && osxsave && avx && ((XGETBV() & 0x6) == 0x6))
+	{
+		CPUID(7, regs);
+		
+		if(regs[1] & (1 << 5))
+			return WEBM_SIMD_AVX2;
+	}
+	
+	return WEBM_SIMD_SSE2;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+	return WEBM_SIMD_NEON; // if we were compiled for it, we have it
+#else
+	return WEBM_SIMD_NONE;
+#endif
+}
+
+
+WebM_SIMD
+WebMDetectSIMD()
+{
+	// harmless if two threads get here at once, they'll find the same thing
+	static bool detected = false;
+	static WebM_SIMD simd = WEBM_SIMD_NONE;
+	
+	if(!detected)
+	{
+		simd = DetectSIMD();
+		detected = true;
+	}
+	
+	return simd;
+}
+
+
+#ifdef __linux__
+static const size_t kHugePageSize = (2 * 1024 * 1024);
+
+static size_t
+HugePageRound(size_t size)
+{
+	return ((size + kHugePageSize - 1) / kHugePageSize) * kHugePageSize;
+}
+#endif
+
+
+void *
+WebMAllocAligned(size_t size, size_t alignment, bool huge_pages)
+{
+#ifdef __linux__
+	if(huge_pages)
+	{
+		// mmap is page aligned, which covers any alignment we'd ask for
+		void *ptr = mmap(NULL, HugePageRound(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		
+		if(ptr == MAP_FAILED)
+			return NULL;
+		
+	#ifdef MADV_HUGEPAGE
+		madvise(ptr, HugePageRound(size), MADV_HUGEPAGE); // only advice, fine if it fails
+	#endif
+		
+		return ptr;
+	}
+#else
+	(void)huge_pages;
+#endif
+
+#ifdef PRWIN_ENV
+	return _aligned_malloc(size, alignment);
+#else
+	void *ptr = NULL;
+	
+	if(posix_memalign(&ptr, alignment, size) != 0)
+		return NULL;
+	
+	return ptr;
+#endif
+}
+
+
+void
+WebMFreeAligned(void *ptr, size_t size, bool huge_pages)
+{
+	if(ptr == NULL)
+		return;
+
+#ifdef __linux__
+	if(huge_pages)
+	{
+		munmap(ptr, HugePageRound(size));
+		
+		return;
+	}
+#else
+	(void)size;
+	(void)huge_pages;
+#endif
+
+#ifdef PRWIN_ENV
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+
+
+#ifdef PRWIN_ENV
+
+const char WebMPathSeparator = '\\';
+
+
+std::string
+WebMCacheDirectory()
+{
+	const char *local_app_data = getenv("LOCALAPPDATA");
+	
+	if(local_app_data == NULL || *local_app_data == '\0')
+		return std::string();
+	
+	return std::string(local_app_data) + "\\fnord\\WebM";
+}
+
+
+static bool
+MakeOneDirectory(const std::string &path)
+{
+	return (CreateDirectoryA(path.c_str(), NULL) != 0 || GetLastError() == ERROR_ALREADY_EXISTS);
+}
+
+
+bool
+WebMListDirectory(const std::string &path, std::vector<WebMFileInfo> &files)
+{
+	WIN32_FIND_DATAA find_data;
+	
+	HANDLE find = FindFirstFileA((path + "\\*").c_str(), &find_data);
+	
+	if(find == INVALID_HANDLE_VALUE)
+		return false;
+	
+	do{
+		if( !(find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) )
+		{
+			WebMFileInfo info;
+			
+			info.name = find_data.cFileName;
+			info.size = ((unsigned long long)find_data.nFileSizeHigh << 32) | find_data.nFileSizeLow;
+			
+			// FILETIME is 100ns ticks since 1601
+			const unsigned long long ticks = ((unsigned long long)find_data.ftLastWriteTime.dwHighDateTime << 32) |
+												find_data.ftLastWriteTime.dwLowDateTime;
+			
+			info.modified = (time_t)((ticks / 10000000ULL) - 11644473600ULL);
+			
+			files.push_back(info);
+		}
+	}while( FindNextFileA(find, &find_data) );
+	
+	FindClose(find);
+	
+	return true;
+}
+
+
+bool
+WebMDeleteFile(const std::string &path)
+{
+	return (DeleteFileA(path.c_str()) != 0);
+}
+
+
+bool
+WebMRenameFile(const std::string &from, const std::string &to)
+{
+	return (MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0);
+}
+
+
+bool
+WebMTouchFile(const std::string &path)
+{
+	return (_utime(path.c_str(), NULL) == 0);
+}
+
+
+std::string
+WebMTempDirectory()
+{
+	char path[MAX_PATH + 1];
+	
+	const DWORD len = GetTempPathA(MAX_PATH + 1, path);
+	
+	if(len == 0 || len > MAX_PATH)
+		return std::string(".");
+	
+	std::string dir(path, len);
+	
+	if(dir[dir.size() - 1] == '\\')
+		dir.erase(dir.size() - 1);
+	
+	return dir;
+}
+
+
+WebMTempFile::WebMTempFile() :
+	_file(INVALID_HANDLE_VALUE),
+	_mapping(NULL),
+	_map(NULL)
+{
+
+}
+
+
+bool
+WebMTempFile::Open(const std::string &dir)
+{
+	Close();
+	
+	char path[MAX_PATH + 1];
+	
+	if(GetTempFileNameA(dir.c_str(), "wbm", 0, path) == 0)
+		return false;
+	
+	_file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+						FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	
+	if(_file == INVALID_HANDLE_VALUE)
+		DeleteFileA(path);
+	
+	return (_file != INVALID_HANDLE_VALUE);
+}
+
+
+void
+WebMTempFile::Close()
+{
+	Unmap();
+	
+	if(_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(_file);
+		
+		_file = INVALID_HANDLE_VALUE;
+	}
+}
+
+
+bool
+WebMTempFile::IsOpen() const
+{
+	return (_file != INVALID_HANDLE_VALUE);
+}
+
+
+bool
+WebMTempFile::Write(unsigned long long offset, const void *buf, size_t len)
+{
+	OVERLAPPED overlapped;
+	memset(&overlapped, 0, sizeof(overlapped));
+	
+	overlapped.Offset = (DWORD)(offset & 0xffffffff);
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	
+	DWORD written = 0;
+	
+	return (WriteFile(_file, buf, (DWORD)len, &written, &overlapped) != 0 && written == len);
+}
+
+
+bool
+WebMTempFile::Read(unsigned long long offset, void *buf, size_t len)
+{
+	OVERLAPPED overlapped;
+	memset(&overlapped, 0, sizeof(overlapped));
+	
+	overlapped.Offset = (DWORD)(offset & 0xffffffff);
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	
+	DWORD bytes_read = 0;
+	
+	return (ReadFile(_file, buf, (DWORD)len, &bytes_read, &overlapped) != 0 && bytes_read == len);
+}
+
+
+void *
+WebMTempFile::Map(size_t len)
+{
+	Unmap();
+	
+	if(_file == INVALID_HANDLE_VALUE || len == 0)
+		return NULL;
+	
+	const unsigned long long size = len;
+	
+	_mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, (DWORD)(size >> 32), (DWORD)(size & 0xffffffff), NULL);
+	
+	if(_mapping == NULL)
+		return NULL;
+	
+	_map = MapViewOfFile(_mapping, FILE_MAP_COPY, 0, 0, len);
+	
+	if(_map == NULL)
+	{
+		CloseHandle(_mapping);
+		
+		_mapping = NULL;
+	}
+	
+	return _map;
+}
+
+
+void
+WebMTempFile::Unmap()
+{
+	if(_map != NULL)
+	{
+		UnmapViewOfFile(_map);
+		
+		_map = NULL;
+	}
+	
+	if(_mapping != NULL)
+	{
+		CloseHandle(_mapping);
+		
+		_mapping = NULL;
+	}
+}
+
+#else // POSIX
+
+const char WebMPathSeparator = '/';
+
+
+std::string
+WebMCacheDirectory()
+{
+	const char *home = getenv("HOME");
+	
+#ifdef PRMAC_ENV
+	if(home == NULL || *home == '\0')
+		return std::string();
+	
+	return std::string(home) + "/Library/Caches/com.fnordware.WebM";
+#else
+	const char *xdg_cache = getenv("XDG_CACHE_HOME");
+	
+	if(xdg_cache != NULL && *xdg_cache != '\0')
+		return std::string(xdg_cache) + "/fnord-webm";
+	else if(home != NULL && *home != '\0')
+		return std::string(home) + "/.cache/fnord-webm";
+	else
+		return std::string();
+#endif
+}
+
+
+static bool
+MakeOneDirectory(const std::string &path)
+{
+	return (mkdir(path.c_str(), 0755) == 0 || errno == EEXIST);
+}
+
+
+bool
+WebMListDirectory(const std::string &path, std::vector<WebMFileInfo> &files)
+{
+	DIR *dir = opendir(path.c_str());
+	
+	if(dir == NULL)
+		return false;
+	
+	struct dirent *entry;
+	
+	while((entry = readdir(dir)) != NULL)
+	{
+		struct stat st;
+		
+		if(stat((path + "/" + entry->d_name).c_str(), &st) == 0 && S_ISREG(st.st_mode))
+		{
+			WebMFileInfo info;
+			
+			info.name = entry->d_name;
+			info.size = st.st_size;
+			info.modified = st.st_mtime;
+			
+			files.push_back(info);
+		}
+	}
+	
+	closedir(dir);
+	
+	return true;
+}
+
+
+bool
+WebMDeleteFile(const std::string &path)
+{
+	return (unlink(path.c_str()) == 0);
+}
+
+
+bool
+WebMRenameFile(const std::string &from, const std::string &to)
+{
+	return (rename(from.c_str(), to.c_str()) == 0);
+}
+
+
+bool
+WebMTouchFile(const std::string &path)
+{
+	return (utime(path.c_str(), NULL) == 0);
+}
+
+
+std::string
+WebMTempDirectory()
+{
+	const char *tmpdir = getenv("TMPDIR");
+	
+	if(tmpdir != NULL && *tmpdir != '\0')
+	{
+		std::string dir(tmpdir);
+		
+		if(dir.size() > 1 && dir[dir.size() - 1] == '/')
+			dir.erase(dir.size() - 1);
+		
+		return dir;
+	}
+	else
+		return std::string("/tmp");
+}
+
+
+WebMTempFile::WebMTempFile() :
+	_fd(-1),
+	_map_len(0),
+	_map(NULL)
+{
+
+}
+
+
+bool
+WebMTempFile::Open(const std::string &dir)
+{
+	Close();
+	
+	std::string path = dir + "/webm_spill_XXXXXX";
+	
+	std::vector<char> path_buf(path.begin(), path.end());
+	path_buf.push_back('\0');
+	
+	_fd = mkstemp(&path_buf[0]);
+	
+	if(_fd >= 0)
+		unlink(&path_buf[0]); // gone as soon as we close it
+	
+	return (_fd >= 0);
+}
+
+
+void
+WebMTempFile::Close()
+{
+	Unmap();
+	
+	if(_fd >= 0)
+	{
+		close(_fd);
+		
+		_fd = -1;
+	}
+}
+
+
+bool
+WebMTempFile::IsOpen() const
+{
+	return (_fd >= 0);
+}
+
+
+bool
+WebMTempFile::Write(unsigned long long offset, const void *buf, size_t len)
+{
+	const char *p = (const char *)buf;
+	
+	while(len > 0)
+	{
+		const ssize_t written = pwrite(_fd, p, len, (off_t)offset);
+		
+		if(written < 0 && errno == EINTR)
+			continue;
+		else if(written <= 0)
+			return false;
+		
+		p += written;
+		offset += written;
+		len -= written;
+	}
+	
+	return true;
+}
+
+
+bool
+WebMTempFile::Read(unsigned long long offset, void *buf, size_t len)
+{
+	char *p = (char *)buf;
+	
+	while(len > 0)
+	{
+		const ssize_t bytes_read = pread(_fd, p, len, (off_t)offset);
+		
+		if(bytes_read < 0 && errno == EINTR)
+			continue;
+		else if(bytes_read <= 0)
+			return false;
+		
+		p += bytes_read;
+		offset += bytes_read;
+		len -= bytes_read;
+	}
+	
+	return true;
+}
+
+
+void *
+WebMTempFile::Map(size_t len)
+{
+	Unmap();
+	
+	if(_fd < 0 || len == 0)
+		return NULL;
+	
+	void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, _fd, 0);
+	
+	if(map == MAP_FAILED)
+		return NULL;
+	
+	_map = map;
+	_map_len = len;
+	
+	return _map;
+}
+
+
+void
+WebMTempFile::Unmap()
+{
+	if(_map != NULL)
+	{
+		munmap(_map, _map_len);
+		
+		_map = NULL;
+		_map_len = 0;
+	}
+}
+
+#endif // PRWIN_ENV
+
+
+WebMTempFile::~WebMTempFile()
+{
+	Close();
+}
+
+
+bool
+WebMMakeDirectory(const std::string &path)
+{
+	if(path.empty())
+		return false;
+	
+	const std::string::size_type sep = path.find_last_of("/\\");
+	
+	if(sep != std::string::npos && sep > 0 && path[sep - 1] != ':')
+		WebMMakeDirectory(path.substr(0, sep));
+	
+	return MakeOneDirectory(path);
+}
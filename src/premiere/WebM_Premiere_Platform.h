@@ -0,0 +1,305 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM plug-in for Premiere
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_PREMIERE_PLATFORM_H
+#define WEBM_PREMIERE_PLATFORM_H
+
+#ifdef PRWIN_ENV
+	#include <windows.h>
+#else
+	#include <pthread.h>
+#endif
+
+#include <stddef.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+
+// Minimal threading primitives so the exporter can run the encoder
+// alongside Premiere's renderer.  Premiere only hands us Win32 and Mac,
+// but the pthread side works on anything POSIX.
+
+class WebMMutex
+{
+  public:
+	WebMMutex();
+	~WebMMutex();
+	
+	void Lock();
+	void Unlock();
+	
+  private:
+	friend class WebMCondition;
+	
+#ifdef PRWIN_ENV
+	CRITICAL_SECTION _mutex;
+#else
+	pthread_mutex_t _mutex;
+#endif
+
+	WebMMutex(const WebMMutex &);
+	WebMMutex &operator=(const WebMMutex &);
+};
+
+
+class WebMLock
+{
+  public:
+	WebMLock(WebMMutex &mutex) : _mutex(mutex) { _mutex.Lock(); }
+	~WebMLock() { _mutex.Unlock(); }
+	
+  private:
+	WebMMutex &_mutex;
+	
+	WebMLock(const WebMLock &);
+	WebMLock &operator=(const WebMLock &);
+};
+
+
+class WebMCondition
+{
+  public:
+	WebMCondition();
+	~WebMCondition();
+	
+	void Wait(WebMMutex &mutex); // mutex must be locked
+	void Signal();
+	void Broadcast();
+	
+  private:
+#ifdef PRWIN_ENV
+	CONDITION_VARIABLE _cond;
+#else
+	pthread_cond_t _cond;
+#endif
+
+	WebMCondition(const WebMCondition &);
+	WebMCondition &operator=(const WebMCondition &);
+};
+
+
+class WebMThread
+{
+  public:
+	WebMThread();
+	virtual ~WebMThread(); // subclasses must Join() in their own destructor
+	
+	bool Start();
+	void Join();
+	
+	bool Running() const { return _running; }
+	
+  protected:
+	virtual void Run() = 0;
+	
+  private:
+#ifdef PRWIN_ENV
+	static DWORD WINAPI Entry(LPVOID arg);
+	
+	HANDLE _thread;
+#else
+	static void *Entry(void *arg);
+	
+	pthread_t _thread;
+#endif
+
+	bool _running;
+	
+	WebMThread(const WebMThread &);
+	WebMThread &operator=(const WebMThread &);
+};
+
+
+// A piece of work that can be split up by index
+class WebMJob
+{
+  public:
+	virtual ~WebMJob() {}
+	
+	virtual void Process(int index) = 0;
+};
+
+
+// A fixed set of threads for splitting up CPU work.  Run() hands out the
+// indices to the workers and the calling thread, and returns once they're
+// all done.  Only one thread should be calling Run() at a time.
+class WebMWorkerPool
+{
+  public:
+	WebMWorkerPool(int threads); // including the calling thread
+	~WebMWorkerPool();
+	
+	int Threads() const { return _threads; }
+	
+	void Run(WebMJob &job, int count);
+	
+  private:
+	class Worker : public WebMThread
+	{
+	  public:
+		Worker(WebMWorkerPool &pool) : _pool(pool) {}
+		virtual ~Worker() { Join(); }
+		
+	  protected:
+		virtual void Run() { _pool.WorkerLoop(); }
+		
+	  private:
+		WebMWorkerPool &_pool;
+	};
+	
+	friend class Worker;
+	
+	void WorkerLoop();
+	void DoWork(); // mutex must be locked
+	
+	int _threads;
+	
+	Worker **_workers;
+	int _num_workers;
+	
+	WebMMutex _mutex;
+	WebMCondition _work_cond;
+	WebMCondition _done_cond;
+	
+	WebMJob *_job;
+	int _count;
+	int _next;
+	int _finished;
+	unsigned int _generation;
+	bool _quit;
+	
+	WebMWorkerPool(const WebMWorkerPool &);
+	WebMWorkerPool &operator=(const WebMWorkerPool &);
+};
+
+
+// monotonic clock, in seconds
+double WebMSeconds();
+
+// printf-style diagnostics, goes to OutputDebugString on Windows, stderr elsewhere
+void WebMLog(const char *fmt, ...);
+
+// SIMD instruction sets the pixel converters have kernels for
+typedef enum {
+	WEBM_SIMD_NONE = 0,
+	WEBM_SIMD_SSE2,
+	WEBM_SIMD_AVX2,
+	WEBM_SIMD_NEON
+} WebM_SIMD;
+
+// best one this CPU (and OS) can run, checked once
+WebM_SIMD WebMDetectSIMD();
+
+// aligned buffers for image data, with optional huge pages on Linux (ignored elsewhere)
+void *WebMAllocAligned(size_t size, size_t alignment, bool huge_pages);
+void WebMFreeAligned(void *ptr, size_t size, bool huge_pages);
+
+
+// Just enough file system for the caches the exporter keeps between exports.
+// Paths are narrow strings, directories don't have the trailing separator.
+typedef struct WebMFileInfo
+{
+	std::string		name;		// without the directory
+	unsigned long long	size;
+	time_t			modified;
+} WebMFileInfo;
+
+// per-user folder for the exporter's caches, empty if we can't find one
+std::string WebMCacheDirectory();
+
+// makes the parents too
+bool WebMMakeDirectory(const std::string &path);
+
+// regular files only
+bool WebMListDirectory(const std::string &path, std::vector<WebMFileInfo> &files);
+
+bool WebMDeleteFile(const std::string &path);
+
+// replaces whatever's at the destination
+bool WebMRenameFile(const std::string &from, const std::string &to);
+
+// sets the modified time to now
+bool WebMTouchFile(const std::string &path);
+
+extern const char WebMPathSeparator;
+
+// the system's folder for temporary files
+std::string WebMTempDirectory();
+
+
+// A scratch file for big reads and writes at 64-bit offsets.  It's deleted
+// when closed, and the OS cleans it up if we crash (where it can).
+class WebMTempFile
+{
+  public:
+	WebMTempFile();
+	~WebMTempFile();
+	
+	bool Open(const std::string &dir);
+	void Close();
+	
+	bool IsOpen() const;
+	
+	bool Write(unsigned long long offset, const void *buf, size_t len);
+	bool Read(unsigned long long offset, void *buf, size_t len);
+	
+	// The first len bytes in memory, copy-on-write so the file never changes.
+	// Good until Unmap() or Close(), NULL if it can't be done.
+	void * Map(size_t len);
+	void Unmap();
+	
+  private:
+#ifdef PRWIN_ENV
+	HANDLE _file;
+	HANDLE _mapping;
+#else
+	int _fd;
+	size_t _map_len;
+#endif
+	void *_map;
+
+	WebMTempFile(const WebMTempFile &);
+	WebMTempFile &operator=(const WebMTempFile &);
+};
+
+
+#endif // WEBM_PREMIERE_PLATFORM_H
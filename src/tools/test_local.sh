@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# A distributed export with local processes: plan a manifest, encode
+# every chunk in its own process at the same time, merge them, and check
+# the merged movie's frames, timestamps and chunk keyframes.
+# Pass a frame count, chunk count, and codec to change the defaults.
+
+set -e
+
+FRAMES=${1:-300}
+CHUNKS=${2:-4}
+CODEC=${3:-vp9}
+
+OUT=test_out
+MANIFEST=$OUT/test.txt
+
+rm -rf $OUT
+mkdir -p $OUT
+
+./webm_chunk_worker plan $MANIFEST $FRAMES $CHUNKS $CODEC
+
+PIDS=""
+
+for CHUNK in $(awk '$1 == "chunk" { print $2 }' $MANIFEST)
+do
+	./webm_chunk_worker encode $MANIFEST $CHUNK &
+	PIDS="$PIDS $!"
+done
+
+for PID in $PIDS
+do
+	wait $PID
+done
+
+./webm_merge $MANIFEST $OUT/merged.webm
+
+./webm_chunk_worker check $MANIFEST $OUT/merged.webm
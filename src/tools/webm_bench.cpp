@@ -0,0 +1,1670 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM tools for Premiere exports
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+// webm_bench runs the exporter's encode and mux path without Premiere, so it
+// can be benchmarked on a Linux box.  Frames come from a generated clip in
+// one of the pixel formats Premiere hands the exporter and go through the same
+// converters, frame pool, thread plan and encoder pipelines.  Then they're
+// muxed with a generated tone, encoded by the exporter's Opus or Vorbis audio
+// thread, and written through PrMkvWriter.  The first pass spill, ladder
+// renditions and smart render are the exporter's too.  It reports frames per
+// second and the latency from a frame going into the encoders to its packet
+// coming out, and -report writes the exporter's per-stage timing JSON.
+//
+// usage: webm_bench [options]
+//   -codec vp8|vp9                              (vp9)
+//   -size WxH                                   (1920x1080)
+//   -frames n                                   (300)
+//   -fps n                                      (30)
+//   -depth 8|10|12                              (8, VP9 only)
+//   -chroma 420|422|444                         (420, VP9 only)
+//   -alpha
+//   -source bgra|bgra16|vuya|vuya16|uyvy|yuv420 (what exSDKExport would ask Premiere for)
+//   -method quality|bitrate|vbr|constrained     (vbr)
+//   -bitrate kbps                               (5000)
+//   -quality n                                  (50)
+//   -kf n                                       (128, keyframe max distance)
+//   -lag n                                      (libvpx's default, lag-in-frames)
+//   -arf 0|1                                    (libvpx's default, auto-alt-ref)
+//   -passes 1|2                                 (1)
+//   -segments n                                 (1)
+//   -cores n                                    (all of them)
+//   -audio opus|vorbis|none                     (opus)
+//   -channels 2|6                               (2)
+//   -write-buffers n                            (3, 0 writes on the export thread)
+//   -render-once                                (two-pass reads the first pass frames back from a spill)
+//   -ladder WxH@kbps,...                        (renditions next to the movie, one segment, no alpha)
+//   -smart a.webm;b.webm                        (the clip is these files back to back, 8-bit without alpha)
+//   -o movie.webm                               (a temp file that gets deleted)
+//   -report timing.json
+//   -trace trace.json
+//
+// Premiere's render isn't part of it, the frames are made ahead of time and
+// handed over the way RenderVideoFrame would.  With -smart, decoding the files
+// stands in for the render, and whatever matches them gets copied.
+
+
+#include "webm_tools.h"
+
+#include "WebM_Premiere_Color.h"
+#include "WebM_Premiere_Export_Audio.h"
+#include "WebM_Premiere_Export_Convert.h"
+#include "WebM_Premiere_Export_Ladder.h"
+#include "WebM_Premiere_Export_Pipeline.h"
+#include "WebM_Premiere_Export_SmartRender.h"
+#include "WebM_Premiere_Export_Spill.h"
+#include "WebM_Premiere_Export_Threads.h"
+#include "WebM_Premiere_Export_Timing.h"
+#include "WebM_Premiere_Export_Writer.h"
+#include "WebM_Premiere_Platform.h"
+
+#include "vpx/vpx_encoder.h"
+#include "vpx/vp8cx.h"
+
+#include "opus_multistream.h"
+
+#include <vorbis/codec.h>
+#include <vorbis/vorbisenc.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+
+typedef enum {
+	SOURCE_BGRA = 0,	// PrPixelFormat_BGRA_4444_8u
+	SOURCE_BGRA16,		// PrPixelFormat_BGRA_4444_16u
+	SOURCE_VUYA,		// PrPixelFormat_VUYX_4444_8u
+	SOURCE_VUYA16,		// PrPixelFormat_VUYA_4444_16u
+	SOURCE_UYVY,		// PrPixelFormat_UYVY_422_8u_601
+	SOURCE_YUV420,		// PrPixelFormat_YUV_420_MPEG2_FRAME_PICTURE_PLANAR_8u_601
+	SOURCE_DEFAULT
+} SourceFormat;
+
+static const char * const source_names[] = { "bgra", "bgra16", "vuya", "vuya16", "uyvy", "yuv420" };
+
+
+typedef struct BenchSettings
+{
+	WebMManifest	manifest;	// codec, size, depth, chroma, alpha, rate control
+	SourceFormat	source;
+	int				segments;
+	int				cores;
+	int				lag;		// -1 for libvpx's default
+	int				arf;
+	int				audio;		// 0 none, 1 Opus, 2 Vorbis
+	int				channels;
+	int				write_buffers;
+	bool			render_once;
+	std::string		ladder;
+	std::string		smart;
+	std::string		output;
+	std::string		report;
+	std::string		trace;
+} BenchSettings;
+
+
+// Premiere's YUV is 601 studio range, anything else renders BGRA.
+static bool
+PremiereYUV(const WebMManifest &manifest)
+{
+	return (WebMColorMatrix((vpx_color_space_t)manifest.color_space) == WEBM_MATRIX_601 &&
+			manifest.color_range == VPX_CR_STUDIO_RANGE);
+}
+
+
+// The same rules as exSDKExport, and the same limits CopyPixToImg asserts.
+// High bit depth assumes Premiere's 16-bit YUV passed ValidateYUV16().
+static SourceFormat
+DefaultSource(const WebMManifest &manifest)
+{
+	return (manifest.alpha ? SOURCE_BGRA16 :
+			!PremiereYUV(manifest) ? (manifest.bit_depth > 8 ? SOURCE_BGRA16 : SOURCE_BGRA) :
+			manifest.bit_depth > 8 ? SOURCE_VUYA16 :
+			manifest.chroma == 2 ? SOURCE_VUYA :
+			manifest.chroma == 1 ? SOURCE_UYVY :
+			SOURCE_YUV420);
+}
+
+
+static bool
+SourceWorks(SourceFormat source, const WebMManifest &manifest)
+{
+	switch(source)
+	{
+		case SOURCE_YUV420:
+			return (manifest.chroma == 0 && manifest.bit_depth == 8 && !manifest.alpha && PremiereYUV(manifest));
+		
+		case SOURCE_UYVY:
+			return (manifest.chroma == 1 && manifest.bit_depth == 8 && !manifest.alpha && PremiereYUV(manifest));
+		
+		case SOURCE_VUYA:
+			return (manifest.chroma == 2 && manifest.bit_depth == 8 && !manifest.alpha && PremiereYUV(manifest));
+		
+		case SOURCE_VUYA16:
+			return (manifest.bit_depth > 8 && PremiereYUV(manifest));
+		
+		default:
+			return true;
+	}
+}
+
+
+// One rendered frame, laid out the way Premiere would hand it over:
+// packed formats bottom-up, planar 4:2:0 as three top-down planes.
+typedef struct SourceFrame
+{
+	std::vector<unsigned char>	buf;
+	int							rowbytes;
+	
+	size_t						u_offset, v_offset;	// planar only
+	int							uv_rowbytes;
+} SourceFrame;
+
+
+// a gradient with a noisy moving box, so the encoder has some work to do
+static void
+SourcePixel(int x, int y, int frame, int width, int height, int &r, int &g, int &b, int &a)
+{
+	const int box_x = (frame * 8) % width;
+	const int box_y = (frame * 4) % height;
+	const int box_size = height / 4;
+	
+	const bool in_box = (x >= box_x && x < box_x + box_size && y >= box_y && y < box_y + box_size);
+	
+	const unsigned int noise = ((x * 73856093u) ^ (y * 19349663u) ^ (frame * 83492791u)) >> 24;
+	
+	if(in_box)
+	{
+		r = 200 + (noise & 0x1f);
+		g = 220 + (noise & 0x1f);
+		b = 40 + (noise & 0x3f);
+		a = 255;
+	}
+	else
+	{
+		r = (x * 255) / width;
+		g = (y * 255) / height;
+		b = (((x + y + frame) * 2) & 0xff) / 2 + (noise & 0x0f);
+		a = 64 + ((x * 191) / width);
+	}
+}
+
+
+static void
+RGBToYUV(int r, int g, int b, int &y, int &u, int &v)
+{
+	// Rec. 601, video range
+	y = 16 + ((66 * r + 129 * g + 25 * b + 128) >> 8);
+	u = 128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8);
+	v = 128 + ((112 * r - 94 * g - 18 * b + 128) >> 8);
+}
+
+
+// Premiere's 16-bit channels go from 0 to 32768
+static inline unsigned short
+Adobe16(int val)
+{
+	return (val * 32768 + 127) / 255;
+}
+
+
+static void
+MakeSourceFrame(SourceFrame &src, SourceFormat format, int width, int height, int frame)
+{
+	const int pixel_bytes = (format == SOURCE_BGRA16 || format == SOURCE_VUYA16 ? 8 :
+								format == SOURCE_UYVY ? 2 :
+								format == SOURCE_YUV420 ? 1 :
+								4);
+	
+	src.rowbytes = ((width * pixel_bytes) + 15) & ~15;
+	
+	if(format == SOURCE_YUV420)
+	{
+		src.uv_rowbytes = (((width + 1) / 2) + 15) & ~15;
+		
+		src.u_offset = (size_t)src.rowbytes * height;
+		src.v_offset = src.u_offset + (size_t)src.uv_rowbytes * ((height + 1) / 2);
+		
+		src.buf.resize(src.v_offset + (size_t)src.uv_rowbytes * ((height + 1) / 2));
+	}
+	else
+	{
+		src.uv_rowbytes = 0;
+		src.u_offset = src.v_offset = 0;
+		
+		src.buf.resize((size_t)src.rowbytes * height);
+	}
+	
+	for(int y=0; y < height; y++)
+	{
+		// packed buffers are bottom-up
+		unsigned char *row = &src.buf[0] + (size_t)src.rowbytes * (format == SOURCE_YUV420 ? y : (height - 1 - y));
+		
+		for(int x=0; x < width; x++)
+		{
+			int r, g, b, a, Y, U, V;
+			
+			SourcePixel(x, y, frame, width, height, r, g, b, a);
+			
+			RGBToYUV(r, g, b, Y, U, V);
+			
+			switch(format)
+			{
+				case SOURCE_BGRA:
+					row[x * 4 + 0] = b;
+					row[x * 4 + 1] = g;
+					row[x * 4 + 2] = r;
+					row[x * 4 + 3] = a;
+					break;
+				
+				case SOURCE_BGRA16:
+					((unsigned short *)row)[x * 4 + 0] = Adobe16(b);
+					((unsigned short *)row)[x * 4 + 1] = Adobe16(g);
+					((unsigned short *)row)[x * 4 + 2] = Adobe16(r);
+					((unsigned short *)row)[x * 4 + 3] = Adobe16(a);
+					break;
+				
+				case SOURCE_VUYA:
+					row[x * 4 + 0] = V;
+					row[x * 4 + 1] = U;
+					row[x * 4 + 2] = Y;
+					row[x * 4 + 3] = 255;
+					break;
+				
+				case SOURCE_VUYA16:
+					((unsigned short *)row)[x * 4 + 0] = Adobe16(V);
+					((unsigned short *)row)[x * 4 + 1] = Adobe16(U);
+					((unsigned short *)row)[x * 4 + 2] = Adobe16(Y);
+					((unsigned short *)row)[x * 4 + 3] = Adobe16(a);
+					break;
+				
+				case SOURCE_UYVY:
+					row[x * 2 + 0] = ((x & 1) ? V : U);
+					row[x * 2 + 1] = Y;
+					break;
+				
+				case SOURCE_YUV420:
+					row[x] = Y;
+					
+					if(!(x & 1) && !(y & 1))
+					{
+						src.buf[src.u_offset + (size_t)src.uv_rowbytes * (y / 2) + (x / 2)] = U;
+						src.buf[src.v_offset + (size_t)src.uv_rowbytes * (y / 2) + (x / 2)] = V;
+					}
+					break;
+				
+				default:
+					assert(false);
+			}
+		}
+	}
+}
+
+
+// same banding as CopyPixJob in the exporter
+class BenchConvertJob : public WebMJob
+{
+  public:
+	BenchConvertJob(vpx_image_t *img, vpx_image_t *alpha_img, const SourceFrame &src, SourceFormat format, int band_height) :
+		_img(img),
+		_alpha_img(alpha_img),
+		_src(src),
+		_format(format),
+		_band_height(band_height)
+	{}
+	
+	virtual void Process(int band)
+	{
+		const int y_start = band * _band_height;
+		const int y_end = std::min<int>(y_start + _band_height, _img->d_h);
+		
+		const char *buf = (const char *)&_src.buf[0];
+		
+		switch(_format)
+		{
+			case SOURCE_YUV420:
+				CopyYUV420ToImg(_img, buf, _src.rowbytes,
+								buf + _src.u_offset, _src.uv_rowbytes,
+								buf + _src.v_offset, _src.uv_rowbytes,
+								y_start, y_end);
+				break;
+			
+			case SOURCE_UYVY:
+				CopyUYVYToImg(_img, buf, _src.rowbytes, y_start, y_end);
+				break;
+			
+			case SOURCE_VUYA:
+			case SOURCE_VUYA16:
+				CopyVUYAToImg(_img, _alpha_img, buf, _src.rowbytes, (_format == SOURCE_VUYA16), y_start, y_end);
+				break;
+			
+			default:
+				CopyBGRAToImg(_img, _alpha_img, buf, _src.rowbytes, (_format == SOURCE_BGRA16), false, y_start, y_end);
+		}
+	}
+	
+  private:
+	vpx_image_t *_img;
+	vpx_image_t *_alpha_img;
+	const SourceFrame &_src;
+	const SourceFormat _format;
+	const int _band_height;
+};
+
+
+static void
+ConvertFrame(vpx_image_t *img, vpx_image_t *alpha_img, const SourceFrame &src, SourceFormat format, WebMWorkerPool &pool)
+{
+	const int sub_y = img->y_chroma_shift + 1;
+	
+	const int bands_wanted = pool.Threads() * 2;
+	
+	int band_height = std::max<int>(16, (img->d_h + bands_wanted - 1) / bands_wanted);
+	
+	band_height = ((band_height + sub_y - 1) / sub_y) * sub_y;
+	
+	const int bands = (img->d_h + band_height - 1) / band_height;
+	
+	BenchConvertJob job(img, alpha_img, src, format, band_height);
+	
+	pool.Run(job, bands);
+}
+
+
+// smart render is 8-bit only, so this is too
+static void
+CopyDecoded(vpx_image_t *img, const vpx_image_t *decoded)
+{
+	for(int p=0; p < 3; p++)
+	{
+		const unsigned int shift_x = (p == VPX_PLANE_Y ? 0 : img->x_chroma_shift);
+		const unsigned int shift_y = (p == VPX_PLANE_Y ? 0 : img->y_chroma_shift);
+		
+		const unsigned int width = (img->d_w + shift_x) >> shift_x;
+		const unsigned int height = (img->d_h + shift_y) >> shift_y;
+		
+		for(unsigned int y=0; y < height; y++)
+			memcpy(img->planes[p] + (img->stride[p] * y), decoded->planes[p] + (decoded->stride[p] * y), width);
+	}
+}
+
+
+// With -smart, the clip is the files back to back, and decoding them stands
+// in for Premiere rendering a sequence cut from them
+static bool
+DecodeSmartFrame(std::vector<SmartSource *> &sources, int frame, vpx_image_t *img, ExportTiming &timing)
+{
+	size_t s = 0;
+	
+	while(s < sources.size() && frame >= sources[s]->Frames())
+		frame -= sources[s++]->Frames();
+	
+	if(s == sources.size())
+		return false;
+	
+	timing.Begin(TIMING_RENDER);
+	
+	const vpx_image_t *decoded = sources[s]->Decode(frame);
+	
+	if(decoded != NULL)
+		CopyDecoded(img, decoded);
+	
+	timing.End(TIMING_RENDER);
+	
+	return (decoded != NULL);
+}
+
+
+// same as the exporter's default --spill-mb
+static const int spill_mb = 16384;
+
+
+static const int sample_rate = 48000;
+
+// stands in for Premiere's GetMaxBlip()
+static const int audio_blip = 4800;
+
+// same as the exporter's AudioQueueDepth
+static const size_t audio_queue_depth = 64;
+
+
+// stands in for GetAudio, a tone on every channel
+class ToneSource : public AudioSource
+{
+  public:
+	ToneSource(int channels) : _channels(channels), _position(0) {}
+	virtual ~ToneSource() {}
+	
+	virtual bool GetAudio(int samples, float **buffers)
+	{
+		for(int c=0; c < _channels; c++)
+		{
+			const double freq = 220.0 * (c + 2);
+			
+			for(int i=0; i < samples; i++)
+				buffers[c][i] = 0.25f * (float)sin(2.0 * M_PI * freq * (double)(_position + i) / sample_rate);
+		}
+		
+		_position += samples;
+		
+		return true;
+	}
+	
+  private:
+	const int _channels;
+	long long _position;
+};
+
+
+static void
+XiphLace(std::vector<unsigned char> &buf, long len)
+{
+	while(len >= 255)
+	{
+		buf.push_back(255);
+		len -= 255;
+	}
+	
+	buf.push_back(len);
+}
+
+
+// The Opus or Vorbis encoder exSDKExport would set up, with its headers.
+// The encoding itself is the exporter's AudioEncoder.
+class BenchAudioCodec
+{
+  public:
+	BenchAudioCodec(bool opus, int channels);
+	~BenchAudioCodec();
+	
+	bool Ready() const { return _ready; }
+	
+	const std::vector<unsigned char> & CodecPrivate() const { return _private; }
+	uint64_t CodecDelay() const; // nanoseconds
+	
+	AudioEncoder * MakeEncoder(AudioSource &source, long long samples, ExportTiming &timing, int track);
+	
+  private:
+	const bool _opus;
+	const int _channels;
+	
+	bool _ready;
+	
+	std::vector<unsigned char> _private;
+	
+	OpusMSEncoder *_opus_encoder;
+	int _pre_skip;
+	
+	vorbis_info _vi;
+	vorbis_comment _vc;
+	vorbis_dsp_state _vd;
+	vorbis_block _vb;
+};
+
+
+BenchAudioCodec::BenchAudioCodec(bool opus, int channels) :
+	_opus(opus),
+	_channels(channels),
+	_ready(false),
+	_opus_encoder(NULL),
+	_pre_skip(0)
+{
+	if(_opus)
+	{
+		const int mapping_family = (channels > 2 ? 1 : 0);
+		const int streams = (channels > 2 ? 4 : 1);
+		const int coupled_streams = (channels > 2 ? 2 : channels == 2 ? 1 : 0);
+		
+		const unsigned char surround_mapping[6] = {0, 4, 1, 2, 3, 5};
+		const unsigned char stereo_mapping[6] = {0, 1, 0, 1, 0, 1};
+		
+		const unsigned char *mapping = (channels > 2 ? surround_mapping : stereo_mapping);
+		
+		int err = -1;
+		
+		_opus_encoder = opus_multistream_encoder_create(sample_rate, channels, streams, coupled_streams, mapping,
+														OPUS_APPLICATION_AUDIO, &err);
+		
+		if(_opus_encoder != NULL && err == OPUS_OK)
+		{
+			opus_int32 skip = 0;
+			opus_multistream_encoder_ctl(_opus_encoder, OPUS_GET_LOOKAHEAD(&skip));
+			_pre_skip = skip;
+			
+			// http://wiki.xiph.org/MatroskaOpus
+			const char *magic = "OpusHead";
+			
+			_private.assign(magic, magic + 8);
+			_private.push_back(1); // version
+			_private.push_back(channels);
+			_private.push_back(_pre_skip & 0xff);
+			_private.push_back(_pre_skip >> 8);
+			
+			for(int i=0; i < 4; i++)
+				_private.push_back((sample_rate >> (i * 8)) & 0xff);
+			
+			_private.push_back(0); // output gain
+			_private.push_back(0);
+			_private.push_back(mapping_family);
+			
+			if(mapping_family == 1)
+			{
+				_private.push_back(streams);
+				_private.push_back(coupled_streams);
+				_private.insert(_private.end(), mapping, mapping + 6);
+			}
+			
+			_ready = true;
+		}
+	}
+	else
+	{
+		vorbis_info_init(&_vi);
+		
+		if(vorbis_encode_init_vbr(&_vi, channels, sample_rate, 0.5f) == 0)
+		{
+			vorbis_comment_init(&_vc);
+			vorbis_analysis_init(&_vd, &_vi);
+			vorbis_block_init(&_vd, &_vb);
+			
+			ogg_packet header, header_comm, header_code;
+			
+			vorbis_analysis_headerout(&_vd, &_vc, &header, &header_comm, &header_code);
+			
+			_private.push_back(2);
+			XiphLace(_private, header.bytes);
+			XiphLace(_private, header_comm.bytes);
+			_private.insert(_private.end(), header.packet, header.packet + header.bytes);
+			_private.insert(_private.end(), header_comm.packet, header_comm.packet + header_comm.bytes);
+			_private.insert(_private.end(), header_code.packet, header_code.packet + header_code.bytes);
+			
+			_ready = true;
+		}
+		else
+			vorbis_info_clear(&_vi);
+	}
+}
+
+
+BenchAudioCodec::~BenchAudioCodec()
+{
+	if(_opus)
+	{
+		if(_opus_encoder != NULL)
+			opus_multistream_encoder_destroy(_opus_encoder);
+	}
+	else if(_ready)
+	{
+		vorbis_block_clear(&_vb);
+		vorbis_dsp_clear(&_vd);
+		vorbis_comment_clear(&_vc);
+		vorbis_info_clear(&_vi);
+	}
+}
+
+
+uint64_t
+BenchAudioCodec::CodecDelay() const
+{
+	return (uint64_t)_pre_skip * 1000000000LL / sample_rate;
+}
+
+
+AudioEncoder *
+BenchAudioCodec::MakeEncoder(AudioSource &source, long long samples, ExportTiming &timing, int track)
+{
+	assert(_ready);
+	
+	// 20 ms Opus frames, Opus needs pre-skip more samples to get all of them out
+	if(_opus)
+	{
+		return new AudioEncoder(_opus_encoder, 960, audio_blip,
+								source, _channels, sample_rate, samples + _pre_skip,
+								audio_queue_depth, timing, track);
+	}
+	else
+	{
+		return new AudioEncoder(&_vd, &_vb, audio_blip,
+								source, _channels, sample_rate, samples,
+								audio_queue_depth, timing, track);
+	}
+}
+
+
+// the audio packets up to the timestamp, the way exSDKExport muxes them
+static bool
+MuxAudio(mkvmuxer::Segment &segment, uint64_t track, AudioEncoder &encoder, uint64_t up_to, ExportTiming &timing)
+{
+	bool ok = true;
+	
+	while(ok)
+	{
+		AudioPacket *pkt = encoder.Next(up_to);
+		
+		if(pkt == NULL)
+			break;
+		
+		timing.Begin(TIMING_MUX);
+		
+		if(pkt->discard_padding > 0)
+		{
+			ok = segment.AddFrameWithDiscardPadding((const uint8_t *)pkt->buf, pkt->sz,
+													pkt->discard_padding, track, pkt->timestamp, true);
+		}
+		else
+			ok = segment.AddFrame((const uint8_t *)pkt->buf, pkt->sz, track, pkt->timestamp, true);
+		
+		timing.End(TIMING_MUX);
+		
+		delete pkt;
+	}
+	
+	return (ok && !encoder.Error());
+}
+
+
+// PrMkvWriter's way into a plain file
+class StdioFile : public WriterFile
+{
+  public:
+	StdioFile(const std::string &path) : _path(path), _fp(NULL) {}
+	virtual ~StdioFile() { if(_fp) fclose(_fp); }
+	
+	virtual int32_t Open()
+	{
+		_fp = fopen(_path.c_str(), "wb");
+		
+		return (_fp != NULL ? WEBM_WRITER_NO_ERROR : EIO);
+	}
+	
+	virtual int32_t Seek(int64_t position)
+	{
+		return (fseeko(_fp, position, SEEK_SET) == 0 ? WEBM_WRITER_NO_ERROR : EIO);
+	}
+	
+	virtual int32_t Write(const void *buf, uint32_t len)
+	{
+		return (fwrite(buf, 1, len, _fp) == len ? WEBM_WRITER_NO_ERROR : EIO);
+	}
+	
+	virtual int32_t Close()
+	{
+		const int err = fclose(_fp);
+		
+		_fp = NULL;
+		
+		return (err == 0 ? WEBM_WRITER_NO_ERROR : EIO);
+	}
+	
+  private:
+	const std::string _path;
+	FILE *_fp;
+};
+
+
+// same as ConfigureEncoderControls() in the exporter, without custom args
+static void
+ConfigureBenchEncoder(vpx_codec_ctx_t *encoder, const vpx_codec_enc_cfg_t &config, const BenchSettings &settings,
+						const ThreadPlan &plan, bool alpha)
+{
+	const WebMManifest &manifest = settings.manifest;
+	
+	if(manifest.method == 0 || manifest.method == 3)
+		vpx_codec_control(encoder, VP8E_SET_CQ_LEVEL, (config.rc_min_quantizer + config.rc_max_quantizer) / 2);
+	
+	if(manifest.codec == 1)
+	{
+		vpx_codec_control(encoder, VP8E_SET_CPUUSED, 2);
+		vpx_codec_control(encoder, VP9E_SET_TILE_COLUMNS, plan.tile_columns);
+		vpx_codec_control(encoder, VP9E_SET_TILE_ROWS, plan.tile_rows);
+		vpx_codec_control(encoder, VP9E_SET_ROW_MT, (plan.row_mt ? 1 : 0));
+		vpx_codec_control(encoder, VP9E_SET_FRAME_PARALLEL_DECODING, 1);
+	}
+	else
+		vpx_codec_control(encoder, VP8E_SET_TOKEN_PARTITIONS, plan.token_partitions);
+	
+	if(settings.arf >= 0)
+		vpx_codec_control(encoder, VP8E_SET_ENABLEAUTOALTREF, settings.arf);
+	
+	// same as exSDKExport, VP8 alpha can't have invisible frames
+	if(alpha && manifest.codec == 0)
+		vpx_codec_control(encoder, VP8E_SET_ENABLEAUTOALTREF, 0);
+}
+
+
+static double
+Percentile(std::vector<double> sorted, double p)
+{
+	if(sorted.empty())
+		return 0;
+	
+	std::sort(sorted.begin(), sorted.end());
+	
+	return sorted[(size_t)(p * (sorted.size() - 1) + 0.5)];
+}
+
+
+static bool
+Bench(const BenchSettings &settings)
+{
+	WebMManifest manifest = settings.manifest;
+	
+	const bool vp9 = (manifest.codec == 1);
+	const int passes = (manifest.two_pass ? 2 : 1);
+	
+	ExportTiming timing(true, !settings.trace.empty());
+	
+	const vpx_img_fmt_t imgfmt = (vpx_img_fmt_t)((manifest.chroma == 2 ? VPX_IMG_FMT_I444 :
+													manifest.chroma == 1 ? VPX_IMG_FMT_I422 :
+													VPX_IMG_FMT_I420) |
+													(manifest.bit_depth > 8 ? VPX_IMG_FMT_HIGHBITDEPTH : 0));
+	
+	const std::string output = (!settings.output.empty() ? settings.output :
+								WebMTempDirectory() + WebMPathSeparator + "webm_bench.webm");
+	
+	
+	// the files for -smart, which make the clip
+	std::vector<SmartSource *> smart_sources;
+	
+	if(!settings.smart.empty())
+	{
+		SmartTarget target;
+		
+		target.codec_id = (vp9 ? mkvmuxer::Tracks::kVp9CodecId : mkvmuxer::Tracks::kVp8CodecId);
+		target.width = manifest.width;
+		target.height = manifest.height;
+		target.frame_seconds = (double)manifest.timebase_num / (double)manifest.timebase_den;
+		target.fmt = imgfmt;
+		target.bit_depth = manifest.bit_depth;
+		target.color_space = (vpx_color_space_t)manifest.color_space;
+		target.color_range = (vpx_color_range_t)manifest.color_range;
+		
+		manifest.frames = 0;
+		
+		std::string paths = settings.smart;
+		
+		while(!paths.empty())
+		{
+			const std::string::size_type semi = paths.find(';');
+			
+			const std::string path = paths.substr(0, semi);
+			
+			paths = (semi != std::string::npos ? paths.substr(semi + 1) : std::string());
+			
+			if(path.empty())
+				continue;
+			
+			SmartSource *source = new SmartSource;
+			
+			smart_sources.push_back(source);
+			
+			if( !source->Open(path, target) )
+			{
+				fprintf(stderr, "%s doesn't match the bench settings\n", path.c_str());
+				
+				for(size_t i=0; i < smart_sources.size(); i++)
+					delete smart_sources[i];
+				
+				return false;
+			}
+			
+			manifest.frames += source->Frames();
+		}
+	}
+	
+	const int frames = manifest.frames;
+	
+	
+	// a short loop of frames, made ahead of time
+	const int loop = std::min<int>(frames, 8);
+	
+	std::vector<SourceFrame> sources(smart_sources.empty() ? loop : 0);
+	
+	for(size_t i=0; i < sources.size(); i++)
+		MakeSourceFrame(sources[i], settings.source, manifest.width, manifest.height, i);
+	
+	
+	FramePool frame_pool(false, (vpx_color_space_t)manifest.color_space, (vpx_color_range_t)manifest.color_range);
+	
+	WebMWorkerPool convert_pool(settings.cores);
+	
+	FrameSpill *frame_spill = NULL;
+	
+	bool ok = true;
+	
+	const double start = WebMSeconds();
+	
+	
+	// Smart render planning: every frame once, to find what can be copied.
+	// The frames that look like they'll be encoded go in the spill.
+	std::vector<SmartSpan> smart_spans;
+	std::vector<int> smart_starts;
+	int copied_frames = 0;
+	
+	if(!smart_sources.empty())
+	{
+		frame_spill = new FrameSpill(WebMTempDirectory(), (unsigned long long)spill_mb * 1024 * 1024, frames);
+		
+		// about a second, any less isn't worth the keyframe after it
+		const int min_frames = std::max<int>(12, manifest.timebase_den / manifest.timebase_num);
+		
+		// no keyframe hash cache, so every run is like the first export of these files
+		SmartPlanner planner(smart_sources, std::string(), min_frames, std::max<int>(settings.segments, 4));
+		
+		for(int frame=0; frame < frames && ok; frame++)
+		{
+			vpx_image_t *img = frame_pool.Get(imgfmt, manifest.width, manifest.height, manifest.bit_depth, false);
+			
+			ok = (img != NULL && DecodeSmartFrame(smart_sources, frame, img, timing) && planner.Frame(img));
+			
+			if(ok && !planner.Copying())
+				frame_spill->Put(frame, img, NULL);
+			
+			if(img)
+				frame_pool.Release(img);
+		}
+		
+		if(ok)
+			planner.Plan(smart_spans);
+		
+		for(size_t i=0; i < smart_spans.size(); i++)
+		{
+			smart_starts.push_back(smart_spans[i].start);
+			
+			if(smart_spans[i].source >= 0)
+				copied_frames += smart_spans[i].frames;
+		}
+	}
+	
+	const int segments = (copied_frames > 0 ? (int)smart_spans.size() : std::max<int>(1, std::min<int>(settings.segments, frames)));
+	
+	int encoded_segments = segments;
+	
+	for(size_t i=0; i < smart_spans.size() && copied_frames > 0; i++)
+	{
+		if(smart_spans[i].source >= 0)
+			encoded_segments--;
+	}
+	
+	
+	// the ladder renditions, next to the movie
+	std::vector<LadderRung> ladder;
+	
+	if(!settings.ladder.empty())
+		ParseLadder(ladder, settings.ladder);
+	
+	std::vector<LadderRendition *> renditions;
+	
+	for(size_t r=0; r < ladder.size(); r++)
+		renditions.push_back( new LadderRendition(ladder[r], frame_pool, timing, segments + 1 + (int)r) );
+	
+	timing.SetTracks(segments, (int)ladder.size());
+	
+	LadderTrack ladder_track;
+	
+	ladder_track.codec_id = (vp9 ? mkvmuxer::Tracks::kVp9CodecId : mkvmuxer::Tracks::kVp8CodecId);
+	ladder_track.frame_rate = (double)manifest.timebase_den / (double)manifest.timebase_num;
+	ladder_track.ticks_per_frame = manifest.timebase_num;
+	ladder_track.ticks_per_second = manifest.timebase_den;
+	ladder_track.display_aspect = (double)manifest.width / (double)manifest.height;
+	ladder_track.bit_depth = manifest.bit_depth;
+	ladder_track.chroma_subsampling_horz = (manifest.chroma == 2 ? 0 : 1);
+	ladder_track.chroma_subsampling_vert = (manifest.chroma == 0 ? 1 : 0);
+	ladder_track.color_space = (vpx_color_space_t)manifest.color_space;
+	ladder_track.color_range = (vpx_color_range_t)manifest.color_range;
+	
+	
+	// With -render-once, the second pass gets the frames the first pass kept
+	if(passes == 2 && settings.render_once && frame_spill == NULL)
+		frame_spill = new FrameSpill(WebMTempDirectory(), (unsigned long long)spill_mb * 1024 * 1024, frames);
+	
+	
+	// the segments and ladder renditions split up the cores, like the exporter
+	ThreadTable thread_table;
+	DefaultThreadTable(thread_table);
+	ReadThreadTable(thread_table, ThreadTablePath());
+	
+	const int encoder_cores = std::max<int>(1, settings.cores / std::max<int>(1, encoded_segments + (int)ladder.size()));
+	
+	const ThreadPlan plan = PlanThreads(thread_table, vp9, manifest.width, manifest.height, encoder_cores);
+	
+	std::vector<ThreadPlan> ladder_plans;
+	
+	for(size_t r=0; r < ladder.size(); r++)
+		ladder_plans.push_back( PlanThreads(thread_table, vp9, ladder[r].width, ladder[r].height, encoder_cores) );
+	
+	vpx_codec_iface_t *iface = (vp9 ? vpx_codec_vp9_cx() : vpx_codec_vp8_cx());
+	
+	
+	std::vector<std::vector<unsigned char> > stats(segments), alpha_stats(segments);
+	
+	std::vector<double> latencies;
+	
+	StdioFile writer_file(output);
+	PrMkvWriter *writer = NULL;
+	
+	mkvmuxer::Segment muxer_segment;
+	
+	ToneSource tone(settings.channels);
+	BenchAudioCodec *audio_codec = NULL;
+	AudioEncoder *audio_encoder = NULL;
+	uint64_t vid_track = 0, audio_track = 0;
+	
+	for(int pass = 0; pass < passes && ok; pass++)
+	{
+		const bool vbr_pass = (passes > 1 && pass == 0);
+		
+		vpx_codec_enc_cfg_t config;
+		
+		ManifestEncoderConfig(manifest, iface, config, pass);
+		
+		config.g_threads = plan.threads;
+		
+		if(settings.lag >= 0)
+			config.g_lag_in_frames = settings.lag;
+		
+		// fixed keyframes, so they're at the same frames in every rendition
+		if(!renditions.empty())
+			config.kf_min_dist = config.kf_max_dist;
+		
+		vpx_codec_enc_cfg_t alpha_config = config;
+		
+		if(manifest.alpha)
+		{
+			alpha_config.kf_min_dist = alpha_config.kf_max_dist = config.kf_min_dist = config.kf_max_dist;
+			
+			alpha_config.rc_target_bitrate = config.rc_target_bitrate / 3;
+			
+			config.rc_target_bitrate = config.rc_target_bitrate * 2 / 3;
+		}
+		
+		const vpx_codec_flags_t flags = (config.g_bit_depth == VPX_BITS_8 ? 0 : VPX_CODEC_USE_HIGHBITDEPTH);
+		
+		std::vector<vpx_codec_ctx_t> encoders(segments), alpha_encoders(segments);
+		int encoders_made = 0, alpha_encoders_made = 0;
+		
+		SegmentedEncoder *pipeline = (copied_frames > 0 ? new SegmentedEncoder(frames, smart_starts) :
+													new SegmentedEncoder(frames, segments));
+		
+		for(int s=0; s < segments && ok; s++)
+		{
+			// the analysis pass just skips over what gets copied
+			if(copied_frames > 0 && smart_spans[s].source >= 0)
+			{
+				pipeline->CopySegment(s, (vbr_pass ? NULL :
+											new SmartPacketSource(*smart_sources[smart_spans[s].source], smart_spans[s])));
+				
+				continue;
+			}
+			
+			if(passes > 1 && !vbr_pass)
+			{
+				config.rc_twopass_stats_in.buf = (stats[s].empty() ? NULL : &stats[s][0]);
+				config.rc_twopass_stats_in.sz = stats[s].size();
+				
+				alpha_config.rc_twopass_stats_in.buf = (alpha_stats[s].empty() ? NULL : &alpha_stats[s][0]);
+				alpha_config.rc_twopass_stats_in.sz = alpha_stats[s].size();
+			}
+			
+			// copied segments don't get encoders, so these aren't always segment s
+			vpx_codec_ctx_t &encoder = encoders[encoders_made];
+			vpx_codec_ctx_t &alpha_encoder = alpha_encoders[alpha_encoders_made];
+			
+			ok = (vpx_codec_enc_init(&encoder, iface, &config, flags) == VPX_CODEC_OK);
+			
+			if(ok)
+			{
+				encoders_made++;
+				
+				ConfigureBenchEncoder(&encoder, config, settings, plan, false);
+			}
+			
+			if(ok && manifest.alpha)
+			{
+				ok = (vpx_codec_enc_init(&alpha_encoder, iface, &alpha_config, flags) == VPX_CODEC_OK);
+				
+				if(ok)
+				{
+					alpha_encoders_made++;
+					
+					ConfigureBenchEncoder(&alpha_encoder, alpha_config, settings, plan, true);
+				}
+			}
+			
+			if(ok)
+			{
+				pipeline->SetPipeline(s, new EncoderPipeline(&encoder, (manifest.alpha ? &alpha_encoder : NULL),
+															frame_pool, VPX_DL_GOOD_QUALITY, 4, NULL, timing, s + 1));
+			}
+		}
+		
+		for(size_t r=0; r < renditions.size() && ok; r++)
+		{
+			vpx_codec_enc_cfg_t rendition_config = config;
+			
+			rendition_config.g_threads = ladder_plans[r].threads;
+			
+			ok = (renditions[r]->InitEncoder(iface, rendition_config, flags) == VPX_CODEC_OK);
+			
+			if(ok)
+			{
+				ConfigureBenchEncoder(renditions[r]->Encoder(), rendition_config, settings, ladder_plans[r], false);
+				
+				ok = renditions[r]->Start(VPX_DL_GOOD_QUALITY, 4, (vbr_pass ? std::string() : LadderPath(output, ladder[r])), ladder_track);
+			}
+		}
+		
+		if(ok && !vbr_pass)
+		{
+			try
+			{
+				writer = new PrMkvWriter(writer_file, settings.write_buffers, timing);
+			}
+			catch(...) { ok = false; }
+			
+			if(ok)
+			{
+				muxer_segment.Init(writer);
+				muxer_segment.set_mode(mkvmuxer::Segment::kFile);
+				
+				muxer_segment.GetSegmentInfo()->set_writing_app("fnord WebM bench, built " __DATE__);
+				
+				vid_track = AddManifestVideoTrack(muxer_segment, manifest);
+				
+				ok = (vid_track != 0);
+				
+				if(ok && manifest.alpha)
+				{
+					mkvmuxer::VideoTrack *video = static_cast<mkvmuxer::VideoTrack *>(muxer_segment.GetTrackByNumber(vid_track));
+					
+					video->SetAlphaMode(mkvmuxer::VideoTrack::kAlpha);
+					video->set_max_block_additional_id(1);
+				}
+			}
+			
+			if(ok && settings.audio != 0)
+			{
+				audio_codec = new BenchAudioCodec((settings.audio == 1), settings.channels);
+				
+				ok = audio_codec->Ready();
+				
+				if(ok)
+				{
+					audio_track = muxer_segment.AddAudioTrack(sample_rate, settings.channels, 2);
+					
+					mkvmuxer::AudioTrack *track = static_cast<mkvmuxer::AudioTrack *>(muxer_segment.GetTrackByNumber(audio_track));
+					
+					ok = (track != NULL);
+					
+					if(ok)
+					{
+						track->set_codec_id(settings.audio == 1 ? mkvmuxer::Tracks::kOpusCodecId : mkvmuxer::Tracks::kVorbisCodecId);
+						
+						if(settings.audio == 1)
+						{
+							track->set_seek_pre_roll(80000000);
+							track->set_codec_delay(audio_codec->CodecDelay());
+						}
+						
+						ok = track->SetCodecPrivate(&audio_codec->CodecPrivate()[0], audio_codec->CodecPrivate().size());
+					}
+				}
+				
+				if(ok)
+				{
+					const long long samples = (long long)frames * sample_rate * manifest.timebase_num / manifest.timebase_den;
+					
+					audio_encoder = audio_codec->MakeEncoder(tone, samples, timing, segments + 1 + (int)ladder.size());
+					
+					ok = audio_encoder->Start();
+				}
+			}
+		}
+		
+		if(ok)
+			ok = pipeline->Start();
+		
+		
+		std::vector<double> submitted(frames, 0);
+		
+		std::vector<void *> unwrapped;
+		
+		while(ok)
+		{
+			EncodedPacket *pkt = NULL;
+			EncodedPacket *alpha_pkt = NULL;
+			int segment = 0;
+			
+			if( pipeline->GetPacket(pkt, alpha_pkt, segment) )
+			{
+				if(pkt->kind == VPX_CODEC_STATS_PKT)
+				{
+					const unsigned char *buf = (const unsigned char *)pkt->buf;
+					
+					stats[segment].insert(stats[segment].end(), buf, buf + pkt->sz);
+					
+					if(alpha_pkt != NULL)
+					{
+						const unsigned char *alpha_buf = (const unsigned char *)alpha_pkt->buf;
+						
+						alpha_stats[segment].insert(alpha_stats[segment].end(), alpha_buf, alpha_buf + alpha_pkt->sz);
+					}
+				}
+				else if(pkt->kind == VPX_CODEC_CX_FRAME_PKT && pkt->pts < frames)
+				{
+					const bool invisible = (pkt->flags & VPX_FRAME_IS_INVISIBLE);
+					
+					// copied frames were never submitted
+					if(!invisible && submitted[pkt->pts] > 0)
+						latencies.push_back(WebMSeconds() - submitted[pkt->pts]);
+					
+					const uint64_t timestamp = ManifestBlockTime(manifest, pkt->pts);
+					
+					if(audio_encoder != NULL)
+						ok = MuxAudio(muxer_segment, audio_track, *audio_encoder, timestamp, timing);
+					
+					timing.Begin(TIMING_MUX);
+					
+					if(ok && alpha_pkt != NULL && !invisible)
+					{
+						ok = muxer_segment.AddFrameWithAdditional((const uint8_t *)pkt->buf, pkt->sz,
+																	(const uint8_t *)alpha_pkt->buf, alpha_pkt->sz, 1,
+																	vid_track, timestamp, (pkt->flags & VPX_FRAME_IS_KEY));
+					}
+					else if(ok)
+					{
+						ok = muxer_segment.AddFrame((const uint8_t *)pkt->buf, pkt->sz,
+													vid_track, timestamp, (pkt->flags & VPX_FRAME_IS_KEY));
+					}
+					
+					timing.End(TIMING_MUX);
+				}
+				
+				delete pkt;
+				delete alpha_pkt;
+			}
+			else if( pipeline->Error() )
+			{
+				ok = false;
+			}
+			else if( pipeline->FramesLeft() )
+			{
+				if( pipeline->Full() )
+				{
+					timing.Begin(TIMING_WAIT);
+					
+					pipeline->WaitForSpace();
+					
+					timing.End(TIMING_WAIT);
+					
+					continue;
+				}
+				
+				const int frame = pipeline->NextFrame();
+				
+				vpx_image_t *img = NULL;
+				vpx_image_t *alpha_img = NULL;
+				
+				bool have_frame = false;
+				
+				// the frames the spill kept don't get made again
+				if(frame_spill != NULL && frame_spill->Has(frame))
+				{
+					img = frame_pool.Get(imgfmt, manifest.width, manifest.height, manifest.bit_depth, false);
+					
+					if(manifest.alpha)
+						alpha_img = frame_pool.Get(imgfmt, manifest.width, manifest.height, manifest.bit_depth, true);
+					
+					have_frame = (img != NULL && (!manifest.alpha || alpha_img != NULL) && frame_spill->Get(frame, img, alpha_img));
+				}
+				
+				if(!have_frame && !smart_sources.empty())
+				{
+					if(img == NULL)
+						img = frame_pool.Get(imgfmt, manifest.width, manifest.height, manifest.bit_depth, false);
+					
+					have_frame = (img != NULL && DecodeSmartFrame(smart_sources, frame, img, timing));
+				}
+				else if(!have_frame)
+				{
+					SourceFrame &src = sources[frame % loop];
+					
+					// planar 4:2:0 goes to the encoder without a copy, same as the exporter
+					if(img == NULL && settings.source == SOURCE_YUV420 && imgfmt == VPX_IMG_FMT_I420 && !manifest.alpha)
+					{
+						unsigned char *planes[3] = { &src.buf[0], &src.buf[src.u_offset], &src.buf[src.v_offset] };
+						const int strides[3] = { src.rowbytes, src.uv_rowbytes, src.uv_rowbytes };
+						
+						img = frame_pool.Wrap(imgfmt, manifest.width, manifest.height, planes, strides, &src);
+						
+						have_frame = (img != NULL);
+					}
+					
+					if(!have_frame)
+					{
+						if(img == NULL)
+							img = frame_pool.Get(imgfmt, manifest.width, manifest.height, manifest.bit_depth, false);
+						
+						if(manifest.alpha && alpha_img == NULL)
+							alpha_img = frame_pool.Get(imgfmt, manifest.width, manifest.height, manifest.bit_depth, true);
+						
+						if(img != NULL && (!manifest.alpha || alpha_img != NULL))
+						{
+							timing.Begin(TIMING_CONVERT);
+							
+							ConvertFrame(img, alpha_img, src, settings.source, convert_pool);
+							
+							timing.End(TIMING_CONVERT);
+							
+							have_frame = true;
+						}
+					}
+					
+					if(have_frame && frame_spill != NULL && vbr_pass)
+						frame_spill->Put(frame, img, alpha_img);
+				}
+				
+				for(size_t r=0; r < renditions.size() && have_frame; r++)
+					have_frame = renditions[r]->Submit(img, frame, convert_pool);
+				
+				if(!have_frame)
+				{
+					if(img)
+						frame_pool.Release(img);
+					
+					if(alpha_img)
+						frame_pool.Release(alpha_img);
+					
+					ok = false;
+					
+					break;
+				}
+				
+				submitted[frame] = WebMSeconds();
+				
+				ok = pipeline->Submit(img, alpha_img, 1);
+				
+				// the renditions mux whatever they have ready as they go
+				for(size_t r=0; r < renditions.size() && ok; r++)
+					ok = renditions[r]->Mux();
+				
+				// the sources last the whole run, so there's nothing to give back
+				frame_pool.Unwrapped(unwrapped);
+				unwrapped.clear();
+			}
+			else if( !pipeline->Finishing() )
+			{
+				pipeline->Finish();
+			}
+			else if( pipeline->Done() )
+			{
+				break;
+			}
+			else
+			{
+				timing.Begin(TIMING_WAIT);
+				
+				pipeline->WaitForPacket();
+				
+				timing.End(TIMING_WAIT);
+			}
+		}
+		
+		pipeline->Join();
+		
+		// before the encoders it was using
+		delete pipeline;
+		
+		// the renditions finish every pass, the last one closes their files
+		for(size_t r=0; r < renditions.size() && ok; r++)
+			ok = renditions[r]->Finish(ManifestBlockTime(manifest, frames) / 1000000LL);
+		
+		if(ok && !vbr_pass)
+		{
+			if(audio_encoder != NULL)
+				ok = MuxAudio(muxer_segment, audio_track, *audio_encoder, std::numeric_limits<uint64_t>::max(), timing);
+			
+			muxer_segment.set_duration(ManifestBlockTime(manifest, frames) / 1000000LL);
+			
+			timing.Begin(TIMING_MUX);
+			
+			if(ok)
+				ok = muxer_segment.Finalize();
+			
+			timing.End(TIMING_MUX);
+			
+			if(ok)
+				ok = (writer->Flush() == WEBM_WRITER_NO_ERROR);
+		}
+		
+		for(int s=0; s < encoders_made; s++)
+			vpx_codec_destroy(&encoders[s]);
+		
+		for(int s=0; s < alpha_encoders_made; s++)
+			vpx_codec_destroy(&alpha_encoders[s]);
+	}
+	
+	std::vector<void *> unwrapped;
+	frame_pool.Unwrapped(unwrapped);
+	
+	const double seconds = WebMSeconds() - start;
+	
+	
+	if(ok)
+	{
+		static const char * const chroma_names[] = { "4:2:0", "4:2:2", "4:4:4" };
+		static const char * const audio_names[] = { "no audio", "Opus", "Vorbis" };
+		
+		printf("%s %dx%d %d-bit %s%s from %s, %d pass, %d segment, %s\n",
+				(vp9 ? "VP9" : "VP8"), manifest.width, manifest.height, manifest.bit_depth,
+				chroma_names[manifest.chroma], (manifest.alpha ? " with alpha" : ""),
+				(!smart_sources.empty() ? "smart render files" : source_names[settings.source]),
+				passes, segments, audio_names[settings.audio]);
+		
+		printf("threads %d, tile columns %d, tile rows %d, row-MT %d, token partitions %d\n",
+				plan.threads, (1 << plan.tile_columns), (1 << plan.tile_rows), (plan.row_mt ? 1 : 0),
+				(1 << plan.token_partitions));
+		
+		printf("%d frames in %.2f s: %.2f fps\n", frames, seconds, frames / seconds);
+		
+		printf("latency ms: p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+				Percentile(latencies, 0.5) * 1000, Percentile(latencies, 0.9) * 1000,
+				Percentile(latencies, 0.99) * 1000, Percentile(latencies, 1.0) * 1000);
+		
+		if(!smart_sources.empty())
+			printf("smart render: %d of %d frames copied, %d encoded segments\n", copied_frames, frames, encoded_segments);
+		
+		for(size_t r=0; r < ladder.size(); r++)
+			printf("ladder: %ux%u at %u kbps\n", ladder[r].width, ladder[r].height, ladder[r].bitrate);
+		
+		if(frame_spill != NULL)
+		{
+			const FrameSpillStats stats = frame_spill->Stats();
+			
+			printf("spill: %u frames stored, %u read back, %u over budget\n", stats.stored, stats.read, stats.over_budget);
+		}
+		
+		if(audio_encoder != NULL)
+		{
+			const AudioEncoderStats &stats = audio_encoder->Stats();
+			
+			printf("audio: %u packets, muxer waited %u times (%.2f s)\n", stats.packets, stats.mux_stalls, stats.mux_stall_seconds);
+		}
+		
+		printf("writer: %u calls for %.1f MB, waited %.2f s\n",
+				writer->Calls(), (double)writer->Bytes() / (1024.0 * 1024.0), writer->Stalled());
+		
+		if(!settings.report.empty() && !timing.WriteReport(settings.report, output, frames))
+			fprintf(stderr, "Couldn't write %s\n", settings.report.c_str());
+		
+		if(!settings.trace.empty() && !timing.WriteTrace(settings.trace))
+			fprintf(stderr, "Couldn't write %s\n", settings.trace.c_str());
+	}
+	else
+		fprintf(stderr, "Benchmark failed\n");
+	
+	delete audio_encoder;
+	delete audio_codec;
+	
+	delete writer;
+	
+	delete frame_spill;
+	
+	for(size_t r=0; r < renditions.size(); r++)
+		delete renditions[r];
+	
+	for(size_t i=0; i < smart_sources.size(); i++)
+		delete smart_sources[i];
+	
+	if(settings.output.empty())
+	{
+		WebMDeleteFile(output);
+		
+		for(size_t r=0; r < ladder.size(); r++)
+			WebMDeleteFile( LadderPath(output, ladder[r]) );
+	}
+	
+	return ok;
+}
+
+
+static int
+LookupArg(const char *arg, const char * const names[], int count)
+{
+	for(int i=0; i < count; i++)
+	{
+		if(strcmp(arg, names[i]) == 0)
+			return i;
+	}
+	
+	return -1;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	static const char * const codec_args[] = { "vp8", "vp9" };
+	static const char * const chroma_args[] = { "420", "422", "444" };
+	static const char * const method_args[] = { "quality", "bitrate", "vbr", "constrained" };
+	static const char * const audio_args[] = { "none", "opus", "vorbis" };
+	
+	BenchSettings settings;
+	
+	WebMManifest &manifest = settings.manifest;
+	
+	InitManifest(manifest);
+	
+	manifest.codec = 1;
+	manifest.width = 1920;
+	manifest.height = 1080;
+	manifest.timebase_num = 1;
+	manifest.timebase_den = 30;
+	manifest.frames = 300;
+	manifest.method = 2;
+	manifest.quality = 50;
+	manifest.bitrate = 5000;
+	manifest.kf_max_dist = 128;
+	
+	settings.source = SOURCE_DEFAULT;
+	settings.segments = 1;
+	settings.cores = sysconf(_SC_NPROCESSORS_ONLN);
+	settings.lag = -1;
+	settings.arf = -1;
+	settings.audio = 1;
+	settings.channels = 2;
+	settings.write_buffers = 3;
+	settings.render_once = false;
+	
+	bool ok = true;
+	
+	for(int i = 1; i < argc && ok; i++)
+	{
+		const char *arg = argv[i];
+		const char *val = (i + 1 < argc ? argv[i + 1] : NULL);
+		
+		if(strcmp(arg, "-alpha") == 0)
+		{
+			manifest.alpha = true;
+			
+			continue;
+		}
+		else if(strcmp(arg, "-render-once") == 0)
+		{
+			settings.render_once = true;
+			
+			continue;
+		}
+		
+		if(val == NULL)
+		{
+			ok = false;
+			
+			break;
+		}
+		
+		i++;
+		
+		if(strcmp(arg, "-codec") == 0)
+			ok = ((manifest.codec = LookupArg(val, codec_args, 2)) >= 0);
+		else if(strcmp(arg, "-size") == 0)
+			ok = (sscanf(val, "%dx%d", &manifest.width, &manifest.height) == 2 && manifest.width > 0 && manifest.height > 0);
+		else if(strcmp(arg, "-frames") == 0)
+			ok = ((manifest.frames = atoi(val)) > 0);
+		else if(strcmp(arg, "-fps") == 0)
+			ok = ((manifest.timebase_den = atoi(val)) > 0);
+		else if(strcmp(arg, "-depth") == 0)
+			ok = ((manifest.bit_depth = atoi(val)) == 8 || manifest.bit_depth == 10 || manifest.bit_depth == 12);
+		else if(strcmp(arg, "-chroma") == 0)
+			ok = ((manifest.chroma = LookupArg(val, chroma_args, 3)) >= 0);
+		else if(strcmp(arg, "-source") == 0)
+			ok = ((settings.source = (SourceFormat)LookupArg(val, source_names, 6)) >= 0);
+		else if(strcmp(arg, "-method") == 0)
+			ok = ((manifest.method = LookupArg(val, method_args, 4)) >= 0);
+		else if(strcmp(arg, "-bitrate") == 0)
+			ok = ((manifest.bitrate = atoi(val)) > 0);
+		else if(strcmp(arg, "-quality") == 0)
+			manifest.quality = atoi(val);
+		else if(strcmp(arg, "-kf") == 0)
+			ok = ((manifest.kf_max_dist = atoi(val)) > 0);
+		else if(strcmp(arg, "-lag") == 0)
+			ok = ((settings.lag = atoi(val)) >= 0);
+		else if(strcmp(arg, "-arf") == 0)
+			ok = ((settings.arf = atoi(val)) == 0 || settings.arf == 1);
+		else if(strcmp(arg, "-passes") == 0)
+			manifest.two_pass = (atoi(val) == 2);
+		else if(strcmp(arg, "-segments") == 0)
+			ok = ((settings.segments = atoi(val)) > 0);
+		else if(strcmp(arg, "-cores") == 0)
+			ok = ((settings.cores = atoi(val)) > 0);
+		else if(strcmp(arg, "-audio") == 0)
+			ok = ((settings.audio = LookupArg(val, audio_args, 3)) >= 0);
+		else if(strcmp(arg, "-channels") == 0)
+			ok = ((settings.channels = atoi(val)) == 2 || settings.channels == 6);
+		else if(strcmp(arg, "-write-buffers") == 0)
+			ok = ((settings.write_buffers = atoi(val)) >= 0);
+		else if(strcmp(arg, "-ladder") == 0)
+			settings.ladder = val;
+		else if(strcmp(arg, "-smart") == 0)
+			settings.smart = val;
+		else if(strcmp(arg, "-o") == 0)
+			settings.output = val;
+		else if(strcmp(arg, "-report") == 0)
+			settings.report = val;
+		else if(strcmp(arg, "-trace") == 0)
+			settings.trace = val;
+		else
+			ok = false;
+	}
+	
+	if(manifest.codec == 0 && (manifest.bit_depth != 8 || manifest.chroma != 0))
+	{
+		fprintf(stderr, "VP8 is 8-bit 4:2:0 only\n");
+		
+		return 1;
+	}
+	
+	if(ok && settings.source == SOURCE_DEFAULT)
+		settings.source = DefaultSource(manifest);
+	
+	if(ok && settings.smart.empty() && !SourceWorks(settings.source, manifest))
+	{
+		fprintf(stderr, "The exporter doesn't take %s for these settings\n", source_names[settings.source]);
+		
+		return 1;
+	}
+	
+	if(ok && !settings.ladder.empty())
+	{
+		std::vector<LadderRung> ladder;
+		
+		if(manifest.alpha || !settings.smart.empty() || !ParseLadder(ladder, settings.ladder))
+		{
+			fprintf(stderr, "The ladder goes without alpha or smart render, as WxH@kbps,...\n");
+			
+			return 1;
+		}
+		
+		for(size_t r=0; r < ladder.size(); r++)
+		{
+			if(ladder[r].width > (unsigned int)manifest.width || ladder[r].height > (unsigned int)manifest.height)
+			{
+				fprintf(stderr, "Ladder rendition %ux%u is bigger than the movie\n", ladder[r].width, ladder[r].height);
+				
+				return 1;
+			}
+		}
+		
+		// the renditions take the frames in order, same as the exporter
+		settings.segments = 1;
+	}
+	
+	if(ok && !settings.smart.empty() && (manifest.alpha || manifest.bit_depth > 8))
+	{
+		fprintf(stderr, "Smart render needs 8-bit without alpha\n");
+		
+		return 1;
+	}
+	
+	if(!ok)
+	{
+		fprintf(stderr, "usage: %s [-codec vp8|vp9] [-size WxH] [-frames n] [-fps n] [-depth 8|10|12]\n"
+						"       [-chroma 420|422|444] [-alpha] [-source bgra|bgra16|vuya|vuya16|uyvy|yuv420]\n"
+						"       [-method quality|bitrate|vbr|constrained] [-bitrate kbps] [-quality n] [-kf n]\n"
+						"       [-lag n] [-arf 0|1] [-passes 1|2] [-segments n] [-cores n] [-audio opus|vorbis|none] [-channels 2|6]\n"
+						"       [-write-buffers n] [-render-once] [-ladder WxH@kbps,...] [-smart a.webm;b.webm]\n"
+						"       [-o movie.webm] [-report timing.json] [-trace trace.json]\n", argv[0]);
+		
+		return 1;
+	}
+	
+	manifest.codec_private = HexString(ManifestCodecPrivate(manifest));
+	
+	return (Bench(settings) ? 0 : 1);
+}
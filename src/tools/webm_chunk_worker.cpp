@@ -0,0 +1,444 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM tools for distributed Premiere exports
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+// webm_chunk_worker stands in for Premiere, so a distributed export can be
+// tested with local processes on a Linux box.  It plans a manifest the way
+// the exporter does, and encodes chunks of a synthetic (but deterministic)
+// clip into partial WebMs the way a worker export would.
+//
+// usage: webm_chunk_worker plan manifest.txt frames chunks [vp8|vp9]
+//        webm_chunk_worker encode manifest.txt chunk
+//        webm_chunk_worker check manifest.txt merged.webm
+//
+// check makes sure webm_merge put every frame of the manifest in the merged
+// movie, in order, with a keyframe where each chunk starts.
+//
+// The encoder config follows exSDKExport, custom args included, and every
+// process runs a single encoder thread unless the args say otherwise.
+
+
+#include "webm_tools.h"
+
+#include "WebM_Premiere_Export_Args.h"
+
+#include "mkvmuxer/mkvwriter.h"
+
+#include "vpx/vpx_encoder.h"
+#include "vpx/vp8cx.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static int
+Plan(const char *manifest_path, int frames, int chunks, const char *codec)
+{
+	WebMManifest manifest;
+	InitManifest(manifest);
+	
+	manifest.codec = (codec != NULL && strcmp(codec, "vp8") == 0 ? 0 : 1);
+	manifest.width = 640;
+	manifest.height = 360;
+	manifest.timebase_num = 1001;
+	manifest.timebase_den = 30000;
+	manifest.frames = frames;
+	manifest.method = 0;
+	manifest.quality = 50;
+	manifest.bitrate = 1000;
+	manifest.kf_max_dist = 60;
+	manifest.codec_private = HexString(ManifestCodecPrivate(manifest));
+	
+	PlanManifestChunks(manifest, chunks, manifest_path);
+	
+	if( !WriteManifest(manifest, manifest_path) )
+	{
+		fprintf(stderr, "Couldn't write %s\n", manifest_path);
+		
+		return 1;
+	}
+	
+	printf("Planned %d frames in %d chunks\n", manifest.frames, (int)manifest.chunks.size());
+	
+	return 0;
+}
+
+
+static int
+Encode(const char *manifest_path, int chunk_num)
+{
+	WebMManifest manifest;
+	
+	if( !ReadManifest(manifest, manifest_path) )
+	{
+		fprintf(stderr, "Couldn't read manifest %s\n", manifest_path);
+		
+		return 1;
+	}
+	
+	if(chunk_num < 0 || chunk_num >= (int)manifest.chunks.size() || manifest.alpha)
+	{
+		fprintf(stderr, "Can't encode chunk %d\n", chunk_num);
+		
+		return 1;
+	}
+	
+	const WebMChunk &chunk = manifest.chunks[chunk_num];
+	
+	const std::string path = ManifestDirectory(manifest_path) + chunk.file;
+	
+	
+	vpx_codec_iface_t *iface = (manifest.codec == 1 ? vpx_codec_vp9_cx() : vpx_codec_vp8_cx());
+	
+	const vpx_img_fmt_t fmt = (vpx_img_fmt_t)((manifest.chroma == 2 ? VPX_IMG_FMT_I444 :
+												manifest.chroma == 1 ? VPX_IMG_FMT_I422 :
+												VPX_IMG_FMT_I420) |
+												(manifest.bit_depth > 8 ? VPX_IMG_FMT_HIGHBITDEPTH : 0));
+	
+	vpx_image_t *img = vpx_img_alloc(NULL, fmt, manifest.width, manifest.height, 32);
+	
+	if(img == NULL)
+		return 1;
+	
+	img->bit_depth = manifest.bit_depth;
+	
+	
+	mkvmuxer::MkvWriter writer;
+	mkvmuxer::Segment muxer_segment;
+	
+	uint64_t vid_track = 0;
+	
+	std::vector<unsigned char> stats;
+	
+	bool ok = true;
+	
+	const int passes = (manifest.two_pass ? 2 : 1);
+	
+	for(int pass = 0; pass < passes && ok; pass++)
+	{
+		const bool vbr_pass = (passes > 1 && pass == 0);
+		
+		vpx_codec_enc_cfg_t config;
+		
+		ManifestEncoderConfig(manifest, iface, config, pass);
+		
+		unsigned long deadline = VPX_DL_GOOD_QUALITY;
+		
+		if(!manifest.args.empty())
+			ConfigureEncoderPre(config, deadline, manifest.args.c_str());
+		
+		if(passes > 1 && !vbr_pass)
+		{
+			config.rc_twopass_stats_in.buf = (stats.empty() ? NULL : &stats[0]);
+			config.rc_twopass_stats_in.sz = stats.size();
+		}
+		
+		const vpx_codec_flags_t flags = (config.g_bit_depth == VPX_BITS_8 ? 0 : VPX_CODEC_USE_HIGHBITDEPTH);
+		
+		vpx_codec_ctx_t encoder;
+		
+		if(vpx_codec_enc_init(&encoder, iface, &config, flags) != VPX_CODEC_OK)
+		{
+			fprintf(stderr, "Couldn't make the encoder\n");
+			
+			ok = false;
+			
+			break;
+		}
+		
+		if(manifest.method == 0 || manifest.method == 3)
+			vpx_codec_control(&encoder, VP8E_SET_CQ_LEVEL, (config.rc_min_quantizer + config.rc_max_quantizer) / 2);
+		
+		if(manifest.codec == 1)
+		{
+			vpx_codec_control(&encoder, VP8E_SET_CPUUSED, 2);
+			vpx_codec_control(&encoder, VP9E_SET_TILE_COLUMNS, 0);
+			vpx_codec_control(&encoder, VP9E_SET_FRAME_PARALLEL_DECODING, 1);
+		}
+		
+		if(!manifest.args.empty())
+			ConfigureEncoderPost(&encoder, manifest.args.c_str());
+		
+		if(!vbr_pass)
+		{
+			ok = writer.Open(path.c_str());
+			
+			if(ok)
+			{
+				muxer_segment.Init(&writer);
+				muxer_segment.set_mode(mkvmuxer::Segment::kFile);
+				
+				muxer_segment.GetSegmentInfo()->set_writing_app("fnord WebM chunk worker, built " __DATE__);
+				
+				vid_track = AddManifestVideoTrack(muxer_segment, manifest);
+				
+				ok = (vid_track != 0);
+			}
+		}
+		
+		
+		int frame = 0;
+		bool flushed = false;
+		
+		// VP8 alt-refs, waiting to go in front of the next visible frame
+		std::vector<std::vector<unsigned char> > hidden;
+		
+		while(ok && !flushed)
+		{
+			vpx_codec_err_t err = VPX_CODEC_OK;
+			
+			const bool flushing = (frame == chunk.frames);
+			
+			if(!flushing)
+			{
+				// frames are numbered from the start of the export, timestamps from the start of the chunk
+				MakeTestFrame(img, chunk.start + frame);
+				
+				err = vpx_codec_encode(&encoder, img, frame, 1, 0, deadline);
+				
+				frame++;
+			}
+			else
+				err = vpx_codec_encode(&encoder, NULL, frame, 1, 0, deadline);
+			
+			if(err != VPX_CODEC_OK)
+			{
+				ok = false;
+				
+				break;
+			}
+			
+			bool got_packet = false;
+			
+			vpx_codec_iter_t iter = NULL;
+			
+			const vpx_codec_cx_pkt_t *pkt;
+			
+			while(ok && (pkt = vpx_codec_get_cx_data(&encoder, &iter)))
+			{
+				got_packet = true;
+				
+				if(pkt->kind == VPX_CODEC_STATS_PKT)
+				{
+					const unsigned char *buf = (const unsigned char *)pkt->data.twopass_stats.buf;
+					
+					stats.insert(stats.end(), buf, buf + pkt->data.twopass_stats.sz);
+				}
+				else if(pkt->kind == VPX_CODEC_CX_FRAME_PKT)
+				{
+					const unsigned char *buf = (const unsigned char *)pkt->data.frame.buf;
+					
+					if(pkt->data.frame.flags & VPX_FRAME_IS_INVISIBLE)
+					{
+						// its pts is just past the last frame the encoder was given
+						hidden.push_back(std::vector<unsigned char>(buf, buf + pkt->data.frame.sz));
+					}
+					else
+					{
+						const uint64_t timestamp = ManifestBlockTime(manifest, pkt->data.frame.pts);
+						
+						for(std::vector<std::vector<unsigned char> >::const_iterator i = hidden.begin(); i != hidden.end() && ok; ++i)
+							ok = muxer_segment.AddFrame(&(*i)[0], i->size(), vid_track, timestamp, false);
+						
+						hidden.clear();
+						
+						if(ok)
+						{
+							ok = muxer_segment.AddFrame(buf, pkt->data.frame.sz, vid_track, timestamp,
+														pkt->data.frame.flags & VPX_FRAME_IS_KEY);
+						}
+					}
+				}
+			}
+			
+			if(flushing && !got_packet)
+				flushed = true;
+		}
+		
+		vpx_codec_destroy(&encoder);
+	}
+	
+	if(ok)
+	{
+		muxer_segment.set_duration(ManifestBlockTime(manifest, chunk.frames) / 1000000LL);
+		
+		ok = muxer_segment.Finalize();
+	}
+	
+	writer.Close();
+	
+	vpx_img_free(img);
+	
+	
+	if(ok)
+	{
+		printf("Chunk %d: frames %d to %d in %s\n", chunk_num, chunk.start, chunk.start + chunk.frames - 1, path.c_str());
+		
+		return 0;
+	}
+	else
+	{
+		fprintf(stderr, "Chunk %d failed\n", chunk_num);
+		
+		return 1;
+	}
+}
+
+
+static int
+Check(const char *manifest_path, const char *movie_path)
+{
+	WebMManifest manifest;
+	
+	if( !ReadManifest(manifest, manifest_path) )
+	{
+		fprintf(stderr, "Couldn't read manifest %s\n", manifest_path);
+		
+		return 1;
+	}
+	
+	TrackReader reader;
+	
+	if( !reader.Open(movie_path, mkvparser::Track::kVideo) )
+	{
+		fprintf(stderr, "Couldn't read video from %s\n", movie_path);
+		
+		return 1;
+	}
+	
+	std::vector<bool> chunk_start(manifest.frames, false);
+	
+	for(size_t c=0; c < manifest.chunks.size(); c++)
+	{
+		if(manifest.chunks[c].start < manifest.frames)
+			chunk_start[manifest.chunks[c].start] = true;
+	}
+	
+	std::vector<unsigned char> data;
+	
+	int frames = 0;
+	long long last_time = -1;
+	
+	long long time = 0;
+	bool key = false;
+	long long discard_padding = 0;
+	
+	bool ok = true;
+	
+	while(ok && reader.Next(data, time, key, discard_padding))
+	{
+		// VP8 alt-refs go in at the time of the frame that follows, see webm_merge
+		const bool invisible = (manifest.codec == 0 && !data.empty() && !(data[0] & 0x10));
+		
+		if(time < last_time || (!invisible && time == last_time))
+		{
+			fprintf(stderr, "Timestamps go backwards at %lld ns\n", time);
+			
+			ok = false;
+		}
+		else if(!invisible)
+		{
+			const long long frame = ManifestTimeFrame(manifest, time);
+			
+			if(frame != frames || frames >= manifest.frames)
+			{
+				fprintf(stderr, "Expected frame %d, found frame %lld\n", frames, frame);
+				
+				ok = false;
+			}
+			else if(chunk_start[frames] && !key)
+			{
+				fprintf(stderr, "No keyframe where the chunk at frame %d starts\n", frames);
+				
+				ok = false;
+			}
+			
+			frames++;
+		}
+		
+		last_time = time;
+	}
+	
+	if(ok && (reader.Error() || frames != manifest.frames))
+	{
+		fprintf(stderr, "Expected %d frames, found %d\n", manifest.frames, frames);
+		
+		ok = false;
+	}
+	
+	if(ok)
+	{
+		printf("Checked %d frames in %d chunks\n", frames, (int)manifest.chunks.size());
+		
+		return 0;
+	}
+	else
+	{
+		fprintf(stderr, "%s failed the check\n", movie_path);
+		
+		return 1;
+	}
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	if(argc >= 5 && strcmp(argv[1], "plan") == 0)
+	{
+		return Plan(argv[2], atoi(argv[3]), atoi(argv[4]), (argc > 5 ? argv[5] : NULL));
+	}
+	else if(argc == 4 && strcmp(argv[1], "encode") == 0)
+	{
+		return Encode(argv[2], atoi(argv[3]));
+	}
+	else if(argc == 4 && strcmp(argv[1], "check") == 0)
+	{
+		return Check(argv[2], argv[3]);
+	}
+	else
+	{
+		fprintf(stderr, "usage: %s plan manifest.txt frames chunks [vp8|vp9]\n", argv[0]);
+		fprintf(stderr, "       %s encode manifest.txt chunk\n", argv[0]);
+		fprintf(stderr, "       %s check manifest.txt merged.webm\n", argv[0]);
+		
+		return 1;
+	}
+}
@@ -0,0 +1,313 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM tools for distributed Premiere exports
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+// webm_merge puts the partial WebMs from a distributed export back together.
+// The frames are copied, not re-encoded.  Each chunk's frames get their
+// timestamps moved to where the chunk sits in the export, the audio (exported
+// separately by the planning export) gets interleaved back in, and mkvmuxer
+// writes fresh Clusters, Cues and SeekHead.
+//
+// usage: webm_merge manifest.txt output.webm [audio.webm]
+
+
+#include "webm_tools.h"
+
+#include "mkvmuxer/mkvwriter.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+static bool
+AddFrame(mkvmuxer::Segment &segment, const std::vector<unsigned char> &data, uint64_t track,
+			uint64_t timestamp, bool key, long long discard_padding)
+{
+	static const uint8_t empty = 0;
+	
+	const uint8_t *buf = (data.empty() ? &empty : &data[0]);
+	
+	if(discard_padding != 0)
+		return segment.AddFrameWithDiscardPadding(buf, data.size(), discard_padding, track, timestamp, key);
+	else
+		return segment.AddFrame(buf, data.size(), track, timestamp, key);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	if(argc < 3 || argc > 4)
+	{
+		fprintf(stderr, "usage: %s manifest.txt output.webm [audio.webm]\n", argv[0]);
+		
+		return 1;
+	}
+	
+	const char *manifest_path = argv[1];
+	const char *output_path = argv[2];
+	const char *audio_path = (argc > 3 ? argv[3] : NULL);
+	
+	
+	WebMManifest manifest;
+	
+	if( !ReadManifest(manifest, manifest_path) )
+	{
+		fprintf(stderr, "Couldn't read manifest %s\n", manifest_path);
+		
+		return 1;
+	}
+	
+	if(manifest.alpha)
+	{
+		fprintf(stderr, "Can't merge alpha, mkvparser doesn't give us the BlockAdditions\n");
+		
+		return 1;
+	}
+	
+	const std::string dir = ManifestDirectory(manifest_path);
+	
+	std::vector<unsigned char> codec_private;
+	
+	if( !ParseHex(manifest.codec_private, codec_private) )
+	{
+		fprintf(stderr, "Bad codec_private in manifest\n");
+		
+		return 1;
+	}
+	
+	
+	mkvmuxer::MkvWriter writer;
+	
+	if( !writer.Open(output_path) )
+	{
+		fprintf(stderr, "Couldn't open %s\n", output_path);
+		
+		return 1;
+	}
+	
+	mkvmuxer::Segment muxer_segment;
+	
+	muxer_segment.Init(&writer);
+	muxer_segment.set_mode(mkvmuxer::Segment::kFile);
+	
+	muxer_segment.GetSegmentInfo()->set_writing_app("fnord WebM merge, built " __DATE__);
+	
+	const uint64_t vid_track = AddManifestVideoTrack(muxer_segment, manifest);
+	
+	bool ok = (vid_track != 0);
+	
+	
+	TrackReader audio_reader;
+	
+	uint64_t audio_track = 0;
+	
+	if(ok && audio_path != NULL)
+	{
+		if( audio_reader.Open(audio_path, mkvparser::Track::kAudio) )
+		{
+			const mkvparser::AudioTrack* const pAudioTrack = static_cast<const mkvparser::AudioTrack *>(audio_reader.GetTrack());
+			
+			audio_track = muxer_segment.AddAudioTrack(pAudioTrack->GetSamplingRate(), pAudioTrack->GetChannels(), 2);
+			
+			mkvmuxer::AudioTrack* const audio = static_cast<mkvmuxer::AudioTrack *>(muxer_segment.GetTrackByNumber(audio_track));
+			
+			if(audio != NULL)
+			{
+				audio->set_codec_id(pAudioTrack->GetCodecId());
+				
+				if(pAudioTrack->GetBitDepth() > 0)
+					audio->set_bit_depth(pAudioTrack->GetBitDepth());
+				
+				audio->set_seek_pre_roll(pAudioTrack->GetSeekPreRoll());
+				audio->set_codec_delay(pAudioTrack->GetCodecDelay());
+				
+				size_t private_size = 0;
+				const unsigned char *private_data = pAudioTrack->GetCodecPrivate(private_size);
+				
+				if(private_data != NULL && private_size > 0)
+					ok = audio->SetCodecPrivate(private_data, private_size);
+			}
+			else
+				ok = false;
+		}
+		else
+		{
+			fprintf(stderr, "Couldn't read audio from %s\n", audio_path);
+		
+			ok = false;
+		}
+	}
+	
+	
+	// Audio is read one frame ahead, so it can go in before the video frame it precedes,
+	// the same way the exporter interleaves them.
+	std::vector<unsigned char> audio_data;
+	long long audio_time = 0;
+	bool audio_key = true;
+	long long audio_padding = 0;
+	
+	bool audio_waiting = (ok && audio_track != 0 && audio_reader.Next(audio_data, audio_time, audio_key, audio_padding));
+	
+	
+	std::vector<unsigned char> data;
+	
+	for(size_t c=0; c < manifest.chunks.size() && ok; c++)
+	{
+		const WebMChunk &chunk = manifest.chunks[c];
+		
+		const std::string path = dir + chunk.file;
+		
+		TrackReader part;
+		
+		if( !part.Open(path, mkvparser::Track::kVideo) )
+		{
+			fprintf(stderr, "Couldn't read video from %s\n", path.c_str());
+			
+			ok = false;
+			
+			break;
+		}
+		
+		const mkvparser::VideoTrack* const pVideoTrack = static_cast<const mkvparser::VideoTrack *>(part.GetTrack());
+		
+		size_t private_size = 0;
+		const unsigned char *private_data = pVideoTrack->GetCodecPrivate(private_size);
+		
+		const bool private_match = (private_size == codec_private.size() &&
+									(private_size == 0 || memcmp(private_data, &codec_private[0], private_size) == 0));
+		
+		const char *codec_id = (manifest.codec == 1 ? mkvmuxer::Tracks::kVp9CodecId : mkvmuxer::Tracks::kVp8CodecId);
+		
+		if(strcmp(pVideoTrack->GetCodecId(), codec_id) != 0 ||
+			pVideoTrack->GetWidth() != manifest.width ||
+			pVideoTrack->GetHeight() != manifest.height ||
+			!private_match)
+		{
+			fprintf(stderr, "%s wasn't encoded with the manifest's settings\n", path.c_str());
+			
+			ok = false;
+			
+			break;
+		}
+		
+		
+		int frames = 0;
+		
+		long long time = 0;
+		bool key = false;
+		long long discard_padding = 0;
+		
+		while(ok && part.Next(data, time, key, discard_padding))
+		{
+			// partials start at time 0
+			const long long local_frame = ManifestTimeFrame(manifest, time);
+			
+			// VP8 alt-refs are invisible frames in their own blocks, at the time of the
+			// frame that follows (the show_frame bit is in the first byte of the frame tag)
+			const bool invisible = (manifest.codec == 0 && !data.empty() && !(data[0] & 0x10));
+			
+			if(local_frame != frames || frames >= chunk.frames || (frames == 0 && !key))
+			{
+				fprintf(stderr, "%s: unexpected frame at %lld ns\n", path.c_str(), time);
+				
+				ok = false;
+				
+				break;
+			}
+			
+			const uint64_t timestamp = ManifestBlockTime(manifest, chunk.start + local_frame);
+			
+			while(ok && audio_waiting && audio_time <= (long long)timestamp)
+			{
+				ok = AddFrame(muxer_segment, audio_data, audio_track, audio_time, audio_key, audio_padding);
+				
+				audio_waiting = audio_reader.Next(audio_data, audio_time, audio_key, audio_padding);
+			}
+			
+			if(ok)
+				ok = AddFrame(muxer_segment, data, vid_track, timestamp, key, 0);
+			
+			if(!invisible)
+				frames++;
+		}
+		
+		if(ok && (part.Error() || frames != chunk.frames))
+		{
+			fprintf(stderr, "%s: expected %d frames, found %d\n", path.c_str(), chunk.frames, frames);
+			
+			ok = false;
+		}
+	}
+	
+	while(ok && audio_waiting)
+	{
+		ok = AddFrame(muxer_segment, audio_data, audio_track, audio_time, audio_key, audio_padding);
+		
+		audio_waiting = audio_reader.Next(audio_data, audio_time, audio_key, audio_padding);
+	}
+	
+	if(audio_reader.Error())
+		ok = false;
+	
+	
+	if(ok)
+	{
+		muxer_segment.set_duration(ManifestBlockTime(manifest, manifest.frames) / 1000000LL);
+	
+		ok = muxer_segment.Finalize();
+	}
+	
+	writer.Close();
+	
+	
+	if(ok)
+	{
+		printf("Merged %d chunks, %d frames%s into %s\n", (int)manifest.chunks.size(), manifest.frames,
+				(audio_track != 0 ? " with audio" : ""), output_path);
+		
+		return 0;
+	}
+	else
+	{
+		fprintf(stderr, "Merge failed\n");
+		
+		return 1;
+	}
+}
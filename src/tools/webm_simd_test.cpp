@@ -0,0 +1,446 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM tools for Premiere exports
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+// webm_simd_test runs the exporter's SIMD pixel kernels against the scalar
+// code they replace and fails if a single output value differs.  It links the
+// converters and the scaler without WebM_Premiere_Platform.cpp and answers
+// WebMDetectSIMD() itself, so each export path can be forced in turn, scalar
+// first.  Kernels this machine can't run are skipped and listed.
+//
+// Widths go from 1 up past two AVX2 vectors, so every kernel hands a
+// leftover to the scalar loop.  Buffers are all 0, all at the maximum,
+// random, and random picks of the two, converted to 8, 10 and 12 bits.
+// Image rows get guard bytes after them, which have to come back untouched.
+// The scaler gets 8, 10 and 12-bit images shrunk to sizes that leave
+// leftovers in both passes, with all kinds of tap counts.
+//
+// usage: webm_simd_test
+
+#include "WebM_Premiere_Export_Convert.h"
+#include "WebM_Premiere_Export_Scale.h"
+#include "WebM_Premiere_Platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+
+static WebM_SIMD g_simd = WEBM_SIMD_NONE;
+
+WebM_SIMD
+WebMDetectSIMD()
+{
+	return g_simd;
+}
+
+
+// ScaleImage() needs this to link, the test calls ImageScaler::Scale() itself
+void
+WebMWorkerPool::Run(WebMJob &job, int count)
+{
+	for(int i=0; i < count; i++)
+		job.Process(i);
+}
+
+
+static std::vector<WebM_SIMD>
+AvailableSIMD()
+{
+	std::vector<WebM_SIMD> levels;
+	
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_cpu_init();
+	
+	if(__builtin_cpu_supports("sse2"))
+		levels.push_back(WEBM_SIMD_SSE2);
+	else
+		printf("skipping SSE2, this CPU doesn't have it\n");
+	
+	if(__builtin_cpu_supports("avx2"))
+		levels.push_back(WEBM_SIMD_AVX2);
+	else
+		printf("skipping AVX2, this CPU doesn't have it\n");
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	levels.push_back(WEBM_SIMD_NEON);
+#else
+	printf("no SIMD kernels for this CPU\n");
+#endif
+
+	return levels;
+}
+
+
+static const char *
+SIMDName(WebM_SIMD simd)
+{
+	return (simd == WEBM_SIMD_SSE2 ? "SSE2" :
+			simd == WEBM_SIMD_AVX2 ? "AVX2" :
+			simd == WEBM_SIMD_NEON ? "NEON" :
+			"scalar");
+}
+
+
+static const int kGuard = 32;
+static const unsigned char kGuardVal = 0xa5;
+
+class TestImage
+{
+  public:
+	TestImage(int width, int height, int sub_x, int sub_y, int depth, vpx_color_space_t cs, vpx_color_range_t range);
+	
+	vpx_image_t *img() { return &_img; }
+	
+	bool operator == (const TestImage &other) const;
+	
+	void Fill(int max_val); // random, visible part only
+	
+  private:
+	vpx_image_t _img;
+	std::vector<unsigned char> _planes[3];
+};
+
+
+TestImage::TestImage(int width, int height, int sub_x, int sub_y, int depth, vpx_color_space_t cs, vpx_color_range_t range)
+{
+	memset(&_img, 0, sizeof(_img));
+	
+	_img.fmt = (sub_y ? VPX_IMG_FMT_I420 : sub_x ? VPX_IMG_FMT_I422 : VPX_IMG_FMT_I444);
+	
+	if(depth > 8)
+		_img.fmt = (vpx_img_fmt_t)(_img.fmt | VPX_IMG_FMT_HIGHBITDEPTH);
+	_img.d_w = width;
+	_img.d_h = height;
+	_img.x_chroma_shift = sub_x;
+	_img.y_chroma_shift = sub_y;
+	_img.bit_depth = depth;
+	_img.cs = cs;
+	_img.range = range;
+	
+	const int bytes = (depth > 8 ? 2 : 1);
+	
+	for(int p = VPX_PLANE_Y; p <= VPX_PLANE_V; p++)
+	{
+		const int plane_width = (p == VPX_PLANE_Y ? width : (width + sub_x) >> sub_x);
+		const int plane_height = (p == VPX_PLANE_Y ? height : (height + sub_y) >> sub_y);
+		
+		_img.stride[p] = (plane_width * bytes) + kGuard;
+		
+		_planes[p].assign(_img.stride[p] * plane_height, kGuardVal);
+		
+		_img.planes[p] = &_planes[p][0];
+	}
+}
+
+
+bool
+TestImage::operator == (const TestImage &other) const
+{
+	for(int p = VPX_PLANE_Y; p <= VPX_PLANE_V; p++)
+	{
+		if(_planes[p] != other._planes[p])
+			return false;
+	}
+	
+	return true;
+}
+
+
+void
+TestImage::Fill(int max_val)
+{
+	for(int p = VPX_PLANE_Y; p <= VPX_PLANE_V; p++)
+	{
+		const int plane_width = (p == VPX_PLANE_Y ? _img.d_w : (_img.d_w + _img.x_chroma_shift) >> _img.x_chroma_shift);
+		const int plane_height = (p == VPX_PLANE_Y ? _img.d_h : (_img.d_h + _img.y_chroma_shift) >> _img.y_chroma_shift);
+		
+		for(int y=0; y < plane_height; y++)
+		{
+			unsigned char *row = _img.planes[p] + (_img.stride[p] * y);
+			
+			for(int x=0; x < plane_width; x++)
+			{
+				const int r = rand() % 8;
+				
+				const int val = (r == 0 ? 0 : r == 1 ? max_val : (rand() % (max_val + 1)));
+				
+				if(_img.bit_depth > 8)
+					((unsigned short *)row)[x] = val;
+				else
+					row[x] = val;
+			}
+		}
+	}
+}
+
+
+typedef enum {
+	FILL_ZERO = 0,
+	FILL_MAX,
+	FILL_RANDOM,
+	FILL_EXTREMES,
+	FILL_COUNT
+} Fill;
+
+static const char *kFillNames[FILL_COUNT] = { "zero", "max", "random", "extremes" };
+
+
+// Premiere's 16-bit white is 32768
+static void
+FillBuffer(std::vector<unsigned char> &buf, bool sixteen_bit, Fill fill)
+{
+	const int max_val = (sixteen_bit ? 32768 : 255);
+	
+	const size_t count = (sixteen_bit ? buf.size() / 2 : buf.size());
+	
+	for(size_t i=0; i < count; i++)
+	{
+		const int val = (fill == FILL_ZERO ? 0 :
+							fill == FILL_MAX ? max_val :
+							fill == FILL_RANDOM ? (rand() % (max_val + 1)) :
+							((rand() & 1) ? max_val : 0));
+	
+		if(sixteen_bit)
+			((unsigned short *)&buf[0])[i] = val;
+		else
+			buf[i] = val;
+	}
+}
+
+
+typedef enum {
+	SOURCE_BGRA = 0,
+	SOURCE_ARGB,
+	SOURCE_VUYA,
+	SOURCE_COUNT
+} Source;
+
+static const char *kSourceNames[SOURCE_COUNT] = { "BGRA", "ARGB", "VUYA" };
+
+
+static void
+Convert(Source source, TestImage &img, TestImage &alpha_img, const std::vector<unsigned char> &buf, int rowbytes, bool sixteen_bit)
+{
+	const char *frameBufferP = (const char *)&buf[0];
+	
+	const int height = img.img()->d_h;
+
+	if(source == SOURCE_VUYA)
+		CopyVUYAToImg(img.img(), alpha_img.img(), frameBufferP, rowbytes, sixteen_bit, 0, height);
+	else
+		CopyBGRAToImg(img.img(), alpha_img.img(), frameBufferP, rowbytes, sixteen_bit, (source == SOURCE_ARGB), 0, height);
+}
+
+
+static void
+TestConverters(const std::vector<WebM_SIMD> &levels, int &tests, int &failures)
+{
+	// odd ones, and either side of the 4, 8 and 16 pixel vectors
+	const int widths[] = { 1, 2, 3, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 47, 63, 65 };
+	const int num_widths = sizeof(widths) / sizeof(widths[0]);
+	
+	const int height = 5; // odd, so 4:2:0 has a last row without one below it
+	
+	const vpx_color_space_t spaces[] = { VPX_CS_BT_601, VPX_CS_BT_709, VPX_CS_BT_2020 };
+	const int num_spaces = sizeof(spaces) / sizeof(spaces[0]);
+	
+	for(int source = SOURCE_BGRA; source < SOURCE_COUNT; source++)
+	{
+		for(int sixteen = 0; sixteen <= 1; sixteen++)
+		{
+			const bool sixteen_bit = (sixteen != 0);
+			
+			if(source == SOURCE_ARGB && sixteen_bit)
+				continue; // Premiere only has 8-bit ARGB
+			
+			for(int depth = 8; depth <= 12; depth += 2)
+			{
+				// VUYA only gets converted to the same depth, or 16-bit to high bit depth
+				if(source == SOURCE_VUYA && (sixteen_bit != (depth > 8)))
+					continue;
+			
+				for(int s=0; s < num_spaces; s++)
+				{
+					for(int full = 0; full <= 1; full++)
+					{
+						// VUYA doesn't go through a matrix
+						if(source == SOURCE_VUYA && (s > 0 || full))
+							continue;
+						
+						const vpx_color_range_t range = (full ? VPX_CR_FULL_RANGE : VPX_CR_STUDIO_RANGE);
+						
+						for(int sub = 0; sub < 3; sub++)
+						{
+							const int sub_x = (sub < 2 ? 1 : 0);
+							const int sub_y = (sub == 0 ? 1 : 0); // 4:2:0, 4:2:2, 4:4:4
+							
+							for(int w=0; w < num_widths; w++)
+							{
+								const int width = widths[w];
+								
+								const int rowbytes = (width * 4 * (sixteen_bit ? 2 : 1)) + 16;
+								
+								std::vector<unsigned char> buf(rowbytes * height);
+								
+								for(int fill = FILL_ZERO; fill < FILL_COUNT; fill++)
+								{
+									FillBuffer(buf, sixteen_bit, (Fill)fill);
+									
+									TestImage scalar(width, height, sub_x, sub_y, depth, spaces[s], range);
+									TestImage scalar_alpha(width, height, sub_x, sub_y, depth, spaces[s], range);
+									
+									g_simd = WEBM_SIMD_NONE;
+									
+									Convert((Source)source, scalar, scalar_alpha, buf, rowbytes, sixteen_bit);
+									
+									for(size_t l=0; l < levels.size(); l++)
+									{
+										TestImage simd(width, height, sub_x, sub_y, depth, spaces[s], range);
+										TestImage simd_alpha(width, height, sub_x, sub_y, depth, spaces[s], range);
+										
+										g_simd = levels[l];
+										
+										Convert((Source)source, simd, simd_alpha, buf, rowbytes, sixteen_bit);
+										
+										tests++;
+										
+										if( !(simd == scalar) || !(simd_alpha == scalar_alpha) )
+										{
+											printf("FAIL %s %s %s to %d-bit, cs %d %s, %s, width %d, %s\n",
+													SIMDName(levels[l]), kSourceNames[source], (sixteen_bit ? "16-bit" : "8-bit"), depth,
+													(int)spaces[s], (full ? "full" : "studio"),
+													(sub == 0 ? "4:2:0" : sub == 1 ? "4:2:2" : "4:4:4"),
+													width, kFillNames[fill]);
+											
+											failures++;
+										}
+									}
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	
+}
+
+
+static void
+TestScaler(const std::vector<WebM_SIMD> &levels, int &tests, int &failures)
+{
+	// down to sizes that aren't a multiple of 4 or 8, and by up to 9x
+	const int sizes[][4] = { { 1920, 1080, 1280, 720 },
+							{ 1920, 1080, 640, 360 },
+							{ 1919, 1081, 853, 481 },
+							{ 3840, 2160, 426, 240 },
+							{ 100, 50, 99, 49 },
+							{ 64, 64, 64, 64 },
+							{ 37, 23, 5, 3 },
+							{ 9, 9, 1, 1 } };
+	const int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+	
+	for(int depth = 8; depth <= 12; depth += 2)
+	{
+		for(int sub = 0; sub < 3; sub++)
+		{
+			const int sub_x = (sub < 2 ? 1 : 0);
+			const int sub_y = (sub == 0 ? 1 : 0);
+			
+			for(int s=0; s < num_sizes; s++)
+			{
+				TestImage src(sizes[s][0], sizes[s][1], sub_x, sub_y, depth, VPX_CS_UNKNOWN, VPX_CR_STUDIO_RANGE);
+				
+				src.Fill((1 << depth) - 1);
+				
+				TestImage scalar(sizes[s][2], sizes[s][3], sub_x, sub_y, depth, VPX_CS_UNKNOWN, VPX_CR_STUDIO_RANGE);
+				
+				const ImageScaler scaler(src.img(), scalar.img());
+				
+				g_simd = WEBM_SIMD_NONE;
+				
+				scaler.Scale(scalar.img(), src.img(), 0, sizes[s][3]);
+				
+				for(size_t l=0; l < levels.size(); l++)
+				{
+					TestImage simd(sizes[s][2], sizes[s][3], sub_x, sub_y, depth, VPX_CS_UNKNOWN, VPX_CR_STUDIO_RANGE);
+					
+					g_simd = levels[l];
+					
+					scaler.Scale(simd.img(), src.img(), 0, sizes[s][3]);
+					
+					tests++;
+					
+					if( !(simd == scalar) )
+					{
+						printf("FAIL %s scaling %d-bit %s, %dx%d to %dx%d\n",
+								SIMDName(levels[l]), depth, (sub == 0 ? "4:2:0" : sub == 1 ? "4:2:2" : "4:4:4"),
+								sizes[s][0], sizes[s][1], sizes[s][2], sizes[s][3]);
+						
+						failures++;
+					}
+				}
+			}
+		}
+	}
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	const std::vector<WebM_SIMD> levels = AvailableSIMD();
+	
+	srand(1);
+	
+	int tests = 0;
+	int failures = 0;
+	
+	TestConverters(levels, tests, failures);
+	TestScaler(levels, tests, failures);
+	
+	g_simd = WEBM_SIMD_NONE;
+	
+	printf("%d of %d conversions and scales matched the scalar code\n", tests - failures, tests);
+	
+	return (failures > 0 ? 1 : 0);
+}
@@ -0,0 +1,278 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM tools for Premiere exports
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+// webm_thread_calibrate measures how encoding speed scales with threads on
+// this machine, and writes the table the exporter's threading planner uses.
+// For each codec and frame size it doubles the threads until the next
+// doubling gains less than 10%, then (for VP9) checks whether tile rows help.
+//
+// usage: webm_thread_calibrate [-o table.txt] [-frames n] [-cores n]
+//
+// The table goes to the exporter's cache folder unless -o says otherwise,
+// so running this on the machine that does the exports is all it takes.
+// To use it on another machine, copy it there and point --thread-table at it.
+// The encoder config follows exSDKExport: good quality deadline, VBR,
+// cpu-used 2 for VP9.
+
+
+#include "webm_tools.h"
+
+#include "WebM_Premiere_Export_Threads.h"
+#include "WebM_Premiere_Platform.h"
+
+#include "vpx/vpx_encoder.h"
+#include "vpx/vp8cx.h"
+
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+
+typedef struct CalibrationSize
+{
+	int		width;
+	int		height;
+} CalibrationSize;
+
+static const CalibrationSize sizes[] = { { 640, 360 }, { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+
+
+// frames per second with the plan, 0 if the encoder didn't work
+static double
+EncodeSpeed(bool vp9, int width, int height, const ThreadPlan &plan, int frames)
+{
+	vpx_codec_iface_t *iface = (vp9 ? vpx_codec_vp9_cx() : vpx_codec_vp8_cx());
+	
+	vpx_codec_enc_cfg_t config;
+	
+	vpx_codec_enc_config_default(iface, &config, 0);
+	
+	config.g_w = width;
+	config.g_h = height;
+	config.g_threads = plan.threads;
+	config.g_timebase.num = 1;
+	config.g_timebase.den = 30;
+	config.rc_end_usage = VPX_VBR;
+	config.rc_target_bitrate = (width * height) / 200; // about 10 Mbps at 1080p
+	
+	vpx_codec_ctx_t encoder;
+	
+	if(vpx_codec_enc_init(&encoder, iface, &config, 0) != VPX_CODEC_OK)
+		return 0;
+	
+	if(vp9)
+	{
+		vpx_codec_control(&encoder, VP8E_SET_CPUUSED, 2);
+		vpx_codec_control(&encoder, VP9E_SET_TILE_COLUMNS, plan.tile_columns);
+		vpx_codec_control(&encoder, VP9E_SET_TILE_ROWS, plan.tile_rows);
+		vpx_codec_control(&encoder, VP9E_SET_ROW_MT, (plan.row_mt ? 1 : 0));
+		vpx_codec_control(&encoder, VP9E_SET_FRAME_PARALLEL_DECODING, 1);
+	}
+	else
+		vpx_codec_control(&encoder, VP8E_SET_TOKEN_PARTITIONS, plan.token_partitions);
+	
+	vpx_image_t *img = vpx_img_alloc(NULL, VPX_IMG_FMT_I420, width, height, 32);
+	
+	if(img == NULL)
+	{
+		vpx_codec_destroy(&encoder);
+		
+		return 0;
+	}
+	
+	bool ok = true;
+	
+	const double start = WebMSeconds();
+	
+	for(int frame = 0; frame <= frames && ok; frame++)
+	{
+		if(frame < frames)
+			MakeTestFrame(img, frame);
+		
+		// flush with the last one, so the frames in the lag count
+		ok = (vpx_codec_encode(&encoder, (frame < frames ? img : NULL), frame, 1, 0, VPX_DL_GOOD_QUALITY) == VPX_CODEC_OK);
+		
+		vpx_codec_iter_t iter = NULL;
+		
+		while(ok && vpx_codec_get_cx_data(&encoder, &iter) != NULL) {}
+	}
+	
+	const double seconds = WebMSeconds() - start;
+	
+	vpx_img_free(img);
+	
+	vpx_codec_destroy(&encoder);
+	
+	return (ok && seconds > 0 ? frames / seconds : 0);
+}
+
+
+static ThreadPlan
+PlanFor(bool vp9, const CalibrationSize &size, int threads, int tile_rows)
+{
+	// a table that lets the planner use exactly this many threads
+	ThreadTableEntry entry;
+	
+	entry.vp9 = vp9;
+	entry.max_width = size.width;
+	entry.max_threads = threads;
+	entry.tile_rows = tile_rows;
+	
+	const ThreadTable table(1, entry);
+	
+	return PlanThreads(table, vp9, size.width, size.height, threads);
+}
+
+
+static ThreadTableEntry
+Calibrate(bool vp9, const CalibrationSize &size, int cores, int frames)
+{
+	ThreadTableEntry entry;
+	
+	entry.vp9 = vp9;
+	entry.max_width = size.width;
+	entry.max_threads = 1;
+	entry.tile_rows = 0;
+	
+	double best_fps = EncodeSpeed(vp9, size.width, size.height, PlanFor(vp9, size, 1, 0), frames);
+	
+	printf("%s %dx%d: 1 thread %.1f fps\n", (vp9 ? "vp9" : "vp8"), size.width, size.height, best_fps);
+	
+	// doubling, but making sure the last try is all the cores
+	for(int threads = std::min<int>(2, cores); threads > entry.max_threads; threads = std::min<int>(threads * 2, cores))
+	{
+		const ThreadPlan plan = PlanFor(vp9, size, threads, 0);
+		
+		if(plan.threads <= entry.max_threads)
+			break; // the planner won't go any higher at this size
+		
+		const double fps = EncodeSpeed(vp9, size.width, size.height, plan, frames);
+		
+		printf("%s %dx%d: %d threads %.1f fps\n", (vp9 ? "vp9" : "vp8"), size.width, size.height, plan.threads, fps);
+		
+		if(fps < best_fps * 1.1)
+			break;
+		
+		entry.max_threads = plan.threads;
+		best_fps = fps;
+	}
+	
+	if(vp9)
+	{
+		const ThreadPlan plan = PlanFor(vp9, size, entry.max_threads, 1);
+		
+		if(plan.tile_rows > 0)
+		{
+			const double fps = EncodeSpeed(vp9, size.width, size.height, plan, frames);
+			
+			printf("%s %dx%d: %d threads, 2 tile rows %.1f fps\n", "vp9", size.width, size.height, plan.threads, fps);
+			
+			if(fps > best_fps * 1.05)
+				entry.tile_rows = 1;
+		}
+	}
+	
+	return entry;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	std::string path = ThreadTablePath();
+	int frames = 60;
+	int cores = sysconf(_SC_NPROCESSORS_ONLN);
+	
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			path = argv[++i];
+		else if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-cores") == 0 && i + 1 < argc)
+			cores = atoi(argv[++i]);
+		else
+		{
+			fprintf(stderr, "usage: %s [-o table.txt] [-frames n] [-cores n]\n", argv[0]);
+			
+			return 1;
+		}
+	}
+	
+	if(path.empty())
+	{
+		fprintf(stderr, "No cache folder, use -o to say where the table goes\n");
+		
+		return 1;
+	}
+	
+	if(frames < 1 || cores < 1)
+		return 1;
+	
+	ThreadTable table;
+	
+	for(int codec = 0; codec < 2; codec++)
+	{
+		for(size_t s = 0; s < sizeof(sizes) / sizeof(CalibrationSize); s++)
+		{
+			table.push_back( Calibrate(codec == 1, sizes[s], cores, frames) );
+		}
+	}
+	
+	const std::string::size_type sep = path.find_last_of(WebMPathSeparator);
+	
+	if(sep != std::string::npos)
+		WebMMakeDirectory(path.substr(0, sep));
+	
+	if( !WriteThreadTable(table, path) )
+	{
+		fprintf(stderr, "Couldn't write %s\n", path.c_str());
+		
+		return 1;
+	}
+	
+	printf("Wrote %s\n", path.c_str());
+	
+	return 0;
+}
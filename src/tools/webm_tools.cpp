@@ -0,0 +1,338 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM tools for distributed Premiere exports
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#include "webm_tools.h"
+
+#include "WebM_Premiere_Color.h"
+
+#include <stdlib.h>
+
+
+uint64_t
+AddManifestVideoTrack(mkvmuxer::Segment &segment, const WebMManifest &manifest)
+{
+	const uint64_t vid_track = segment.AddVideoTrack(manifest.width, manifest.height, 1);
+	
+	if(vid_track == 0)
+		return 0;
+	
+	mkvmuxer::VideoTrack* const video = static_cast<mkvmuxer::VideoTrack *>(segment.GetTrackByNumber(vid_track));
+	
+	video->set_frame_rate((double)manifest.timebase_den / (double)manifest.timebase_num);
+	
+	video->set_codec_id(manifest.codec == 1 ? mkvmuxer::Tracks::kVp9CodecId :
+							mkvmuxer::Tracks::kVp8CodecId);
+	
+	if(manifest.pixel_aspect_num != manifest.pixel_aspect_den)
+	{
+		const uint64_t display_width = ((double)manifest.width *
+										(double)manifest.pixel_aspect_num /
+										(double)manifest.pixel_aspect_den)
+										+ 0.5;
+	
+		video->set_display_width(display_width);
+		video->set_display_height(manifest.height);
+	}
+	
+	std::vector<unsigned char> codec_private;
+	
+	if(ParseHex(manifest.codec_private, codec_private) && !codec_private.empty())
+	{
+		if( !video->SetCodecPrivate(&codec_private[0], codec_private.size()) )
+			return 0;
+	}
+	
+	segment.CuesTrack(vid_track);
+	
+	mkvmuxer::Colour color;
+	
+	color.set_bits_per_channel(manifest.bit_depth);
+	
+	color.set_chroma_subsampling_horz(manifest.chroma == 2 ? 0 : 1);
+	color.set_chroma_subsampling_vert(manifest.chroma == 0 ? 1 : 0);
+	
+	const vpx_color_space_t color_space = (vpx_color_space_t)manifest.color_space;
+	const vpx_color_range_t color_range = (vpx_color_range_t)manifest.color_range;
+	
+	if(WebMMatroskaMatrix(color_space) >= 0)
+		color.set_matrix_coefficients( WebMMatroskaMatrix(color_space) );
+	
+	if(WebMMatroskaRange(color_space, color_range) >= 0)
+		color.set_range( WebMMatroskaRange(color_space, color_range) );
+	
+	video->SetColour(color);
+	
+	return vid_track;
+}
+
+
+uint64_t
+ManifestBlockTime(const WebMManifest &manifest, long long frame)
+{
+	const uint64_t timeCodeScale = 1000000LL;
+	
+	return ((ManifestFrameTime(manifest, frame) + (timeCodeScale / 2)) / timeCodeScale) * timeCodeScale;
+}
+
+
+bool
+ParseHex(const std::string &hex, std::vector<unsigned char> &data)
+{
+	data.clear();
+	
+	if(hex.size() % 2 != 0)
+		return false;
+	
+	for(size_t i=0; i < hex.size(); i += 2)
+	{
+		const std::string byte = hex.substr(i, 2);
+		
+		char *end = NULL;
+		
+		const long val = strtol(byte.c_str(), &end, 16);
+		
+		if(end != byte.c_str() + 2)
+			return false;
+		
+		data.push_back(val);
+	}
+	
+	return true;
+}
+
+
+void
+ManifestEncoderConfig(const WebMManifest &manifest, vpx_codec_iface_t *iface, vpx_codec_enc_cfg_t &config, int pass)
+{
+	vpx_codec_enc_config_default(iface, &config, 0);
+	
+	config.g_w = manifest.width;
+	config.g_h = manifest.height;
+	
+	config.g_profile = (manifest.chroma > 0 ?
+							(manifest.bit_depth > 8 ? 3 : 1) :
+							(manifest.bit_depth > 8 ? 2 : 0) );
+	
+	config.g_bit_depth = (manifest.bit_depth == 12 ? VPX_BITS_12 :
+							manifest.bit_depth == 10 ? VPX_BITS_10 :
+							VPX_BITS_8);
+	
+	config.g_input_bit_depth = config.g_bit_depth;
+	
+	if(manifest.method == 0 || manifest.method == 3) // quality, constrained
+	{
+		config.rc_end_usage = (manifest.method == 0 ? VPX_Q : VPX_CQ);
+		
+		const int min_q = config.rc_min_quantizer + 1;
+		const int max_q = config.rc_max_quantizer;
+		
+		config.rc_max_quantizer = min_q + ((((float)(100 - manifest.quality) / 100.f) * (max_q - min_q)) + 0.5f);
+	}
+	else
+		config.rc_end_usage = (manifest.method == 2 ? VPX_VBR : VPX_CBR);
+	
+	config.g_pass = (!manifest.two_pass ? VPX_RC_ONE_PASS :
+						pass == 0 ? VPX_RC_FIRST_PASS :
+						VPX_RC_LAST_PASS);
+	
+	config.rc_target_bitrate = manifest.bitrate;
+	
+	config.g_threads = 1;
+	
+	config.g_timebase.num = manifest.timebase_num;
+	config.g_timebase.den = manifest.timebase_den;
+	
+	config.kf_max_dist = manifest.kf_max_dist;
+}
+
+
+// a gradient with a box moving across it, any frame can be made on its own
+void
+MakeTestFrame(vpx_image_t *img, int frame)
+{
+	const bool high = (img->fmt & VPX_IMG_FMT_HIGHBITDEPTH);
+	const int shift = (high ? img->bit_depth - 8 : 0);
+	
+	const int box_x = (frame * 4) % img->d_w;
+	const int box_y = (frame * 2) % img->d_h;
+	const int box_size = img->d_h / 4;
+	
+	for(int p=0; p < 3; p++)
+	{
+		const int w = (p == 0 ? img->d_w : (img->d_w + img->x_chroma_shift) >> img->x_chroma_shift);
+		const int h = (p == 0 ? img->d_h : (img->d_h + img->y_chroma_shift) >> img->y_chroma_shift);
+		
+		const int sx = (p == 0 ? 0 : img->x_chroma_shift);
+		const int sy = (p == 0 ? 0 : img->y_chroma_shift);
+		
+		for(int y=0; y < h; y++)
+		{
+			unsigned char *row = img->planes[p] + (y * img->stride[p]);
+			
+			for(int x=0; x < w; x++)
+			{
+				const int full_x = (x << sx);
+				const int full_y = (y << sy);
+				
+				const bool in_box = (full_x >= box_x && full_x < box_x + box_size &&
+										full_y >= box_y && full_y < box_y + box_size);
+				
+				const int val = (p == 0 ? (in_box ? 235 : 16 + ((full_x + full_y + frame) % 200)) :
+									p == 1 ? (in_box ? 90 : 128 + (full_x * 32 / img->d_w)) :
+									(in_box ? 240 : 128 - (full_y * 32 / img->d_h)));
+				
+				if(high)
+					((unsigned short *)row)[x] = (val << shift);
+				else
+					row[x] = val;
+			}
+		}
+	}
+}
+
+
+TrackReader::TrackReader() :
+	_segment(NULL),
+	_track(NULL),
+	_cluster(NULL),
+	_entry(NULL),
+	_error(false)
+{
+
+}
+
+
+TrackReader::~TrackReader()
+{
+	delete _segment;
+}
+
+
+bool
+TrackReader::Open(const std::string &path, mkvparser::Track::Type type)
+{
+	if(_reader.Open(path.c_str()) != 0)
+		return false;
+	
+	long long pos = 0;
+	
+	mkvparser::EBMLHeader ebmlHeader;
+	
+	if(ebmlHeader.Parse(&_reader, pos) < 0)
+		return false;
+	
+	if(mkvparser::Segment::CreateInstance(&_reader, pos, _segment) != 0 || _segment == NULL)
+		return false;
+	
+	if(_segment->Load() < 0)
+		return false;
+	
+	const mkvparser::Tracks* const pTracks = _segment->GetTracks();
+	
+	if(pTracks == NULL)
+		return false;
+	
+	for(unsigned long t=0; t < pTracks->GetTracksCount() && _track == NULL; t++)
+	{
+		const mkvparser::Track* const pTrack = pTracks->GetTrackByIndex(t);
+		
+		if(pTrack != NULL && pTrack->GetType() == type)
+			_track = pTrack;
+	}
+	
+	_cluster = _segment->GetFirst();
+	
+	return (_track != NULL);
+}
+
+
+bool
+TrackReader::Next(std::vector<unsigned char> &data, long long &time, bool &key, long long &discard_padding)
+{
+	while(_cluster != NULL && !_cluster->EOS() && !_error)
+	{
+		const long status = (_entry == NULL ? _cluster->GetFirst(_entry) : _cluster->GetNext(_entry, _entry));
+		
+		if(status < 0)
+		{
+			_error = true;
+		}
+		else if(_entry == NULL || _entry->EOS())
+		{
+			_cluster = _segment->GetNext(_cluster);
+			
+			_entry = NULL;
+		}
+		else
+		{
+			const mkvparser::Block *pBlock = _entry->GetBlock();
+			
+			if(pBlock->GetTrackNumber() == _track->GetNumber())
+			{
+				// the exporter never laces
+				if(pBlock->GetFrameCount() != 1)
+				{
+					_error = true;
+					
+					return false;
+				}
+			
+				const mkvparser::Block::Frame &blockFrame = pBlock->GetFrame(0);
+				
+				data.resize(blockFrame.len);
+				
+				if(blockFrame.len > 0 && blockFrame.Read(&_reader, &data[0]) != 0)
+				{
+					_error = true;
+					
+					return false;
+				}
+				
+				time = pBlock->GetTime(_cluster);
+				key = pBlock->IsKey();
+				discard_padding = pBlock->GetDiscardPadding();
+				
+				return true;
+			}
+		}
+	}
+	
+	return false;
+}
@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// WebM tools for distributed Premiere exports
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+
+
+#ifndef WEBM_TOOLS_H
+#define WEBM_TOOLS_H
+
+#include "WebM_Premiere_Export_Manifest.h"
+
+#include "mkvmuxer/mkvmuxer.h"
+#include "mkvparser/mkvparser.h"
+#include "mkvparser/mkvreader.h"
+
+#include "vpx/vpx_encoder.h"
+
+
+// The video track the way exSDKExport sets it up, so the merged file
+// looks like one that came straight out of Premiere.
+uint64_t AddManifestVideoTrack(mkvmuxer::Segment &segment, const WebMManifest &manifest);
+
+// The encoder config exSDKExport would make for these settings, without
+// custom args, and with one thread (callers with a thread plan set g_threads).
+// Pass 0 is the first pass of two-pass.
+void ManifestEncoderConfig(const WebMManifest &manifest, vpx_codec_iface_t *iface, vpx_codec_enc_cfg_t &config, int pass);
+
+// exSDKExport rounds block times to the timecode scale (milliseconds)
+uint64_t ManifestBlockTime(const WebMManifest &manifest, long long frame);
+
+bool ParseHex(const std::string &hex, std::vector<unsigned char> &data);
+
+// a synthetic clip where any frame can be made on its own
+void MakeTestFrame(vpx_image_t *img, int frame);
+
+
+// Reads the frames of the first track of a type out of a WebM, in order
+class TrackReader
+{
+  public:
+	TrackReader();
+	~TrackReader();
+	
+	bool Open(const std::string &path, mkvparser::Track::Type type);
+	
+	const mkvparser::Track *GetTrack() const { return _track; }
+	
+	// false at the end of the track, or on an error
+	bool Next(std::vector<unsigned char> &data, long long &time, bool &key, long long &discard_padding);
+	
+	bool Error() const { return _error; }
+	
+  private:
+	mkvparser::MkvReader _reader;
+	mkvparser::Segment *_segment;
+	const mkvparser::Track *_track;
+	
+	const mkvparser::Cluster *_cluster;
+	const mkvparser::BlockEntry *_entry;
+	
+	bool _error;
+};
+
+
+#endif // WEBM_TOOLS_H